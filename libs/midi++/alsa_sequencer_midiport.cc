@@ -47,6 +47,8 @@ ALSA_SequencerMidiPort::ALSA_SequencerMidiPort (PortRequest &req)
 	, seq (0)
 	, decoder (0) 
 	, encoder (0) 
+	, queue_id (-1)
+	, queue_base (0)
 {
 	TR_FN();
 	int err;
@@ -67,8 +69,14 @@ ALSA_SequencerMidiPort::~ALSA_SequencerMidiPort ()
 		snd_midi_event_free (decoder);
 	if (encoder)
 		snd_midi_event_free (encoder);
-	if (seq)
+	if (seq) {
+		if (queue_id >= 0) {
+			snd_seq_stop_queue (seq, queue_id, 0);
+			snd_seq_drain_output (seq);
+			snd_seq_free_queue (seq, queue_id);
+		}
 		snd_seq_close (seq);
+	}
 }
 
 int ALSA_SequencerMidiPort::selectable () const
@@ -119,28 +127,119 @@ int ALSA_SequencerMidiPort::write (byte *msg, size_t msglen)
 	return totwritten;
 }
 
+timestamp_t ALSA_SequencerMidiPort::event_time (const snd_seq_event_t *ev)
+{
+	/* incoming events are stamped in real time against our queue,
+	   which was started at queue_base host time */
+	if (queue_id >= 0 && ev->queue == queue_id && snd_seq_ev_is_real (ev)) {
+		return queue_base + (timestamp_t) ev->time.time.tv_sec + (timestamp_t) (ev->time.time.tv_nsec * 1e-9);
+	}
+	return get_current_host_time();
+}
+
+bool ALSA_SequencerMidiPort::deliver_event (const snd_seq_event_t *ev, timestamp_t when)
+{
+	/* map the typed sequencer event directly to status/data bytes.
+	   returns false for anything the sink doesn't take, which then
+	   goes through the decoder and parser as before */
+	byte status;
+	byte d1 = 0;
+	byte d2 = 0;
+	
+	switch (ev->type) {
+	case SND_SEQ_EVENT_NOTEON:
+		status = MIDI::on | (ev->data.note.channel & 0x0F);
+		d1 = ev->data.note.note & 0x7F;
+		d2 = ev->data.note.velocity & 0x7F;
+		break;
+	case SND_SEQ_EVENT_NOTEOFF:
+		status = MIDI::off | (ev->data.note.channel & 0x0F);
+		d1 = ev->data.note.note & 0x7F;
+		d2 = ev->data.note.velocity & 0x7F;
+		break;
+	case SND_SEQ_EVENT_KEYPRESS:
+		status = MIDI::polypress | (ev->data.note.channel & 0x0F);
+		d1 = ev->data.note.note & 0x7F;
+		d2 = ev->data.note.velocity & 0x7F;
+		break;
+	case SND_SEQ_EVENT_CONTROLLER:
+		status = MIDI::controller | (ev->data.control.channel & 0x0F);
+		d1 = ev->data.control.param & 0x7F;
+		d2 = ev->data.control.value & 0x7F;
+		break;
+	case SND_SEQ_EVENT_PGMCHANGE:
+		status = MIDI::program | (ev->data.control.channel & 0x0F);
+		d1 = ev->data.control.value & 0x7F;
+		break;
+	case SND_SEQ_EVENT_CHANPRESS:
+		status = MIDI::chanpress | (ev->data.control.channel & 0x0F);
+		d1 = ev->data.control.value & 0x7F;
+		break;
+	case SND_SEQ_EVENT_PITCHBEND: {
+		int bend = ev->data.control.value + 8192;
+		status = MIDI::pitchbend | (ev->data.control.channel & 0x0F);
+		d1 = bend & 0x7F;
+		d2 = (bend >> 7) & 0x7F;
+		break;
+	}
+	case SND_SEQ_EVENT_CLOCK:
+		status = MIDI::timing;
+		break;
+	case SND_SEQ_EVENT_START:
+		status = MIDI::start;
+		break;
+	case SND_SEQ_EVENT_CONTINUE:
+		status = MIDI::contineu;
+		break;
+	case SND_SEQ_EVENT_STOP:
+		status = MIDI::stop;
+		break;
+	default:
+		return false;
+	}
+
+	_event_sink (_event_sink_arg, status, d1, d2, when);
+	return true;
+}
+
 int ALSA_SequencerMidiPort::read (byte *buf, size_t max)
 {
 	TR_FN();
 	int err;
+	int total = 0;
 	snd_seq_event_t *ev;
-	if (0 <= (err = snd_seq_event_input (seq, &ev))) {
-		TR_VAL(err);
-		err = snd_midi_event_decode (decoder, buf, max, ev);
-	}
 
-	if (err > 0) {
-		bytes_read += err;
+	/* drain everything that is pending, not just one event per wakeup */
+	
+	do {
+		if ((err = snd_seq_event_input (seq, &ev)) < 0) {
+			break;
+		}
+		TR_VAL(err);
 
-		if (input_parser) {
-			input_parser->raw_preparse (*input_parser, buf, err, get_current_host_time());
-			for (int i = 0; i < err; i++) {
-				input_parser->scanner (buf[i]);
-			}	
-			input_parser->raw_postparse (*input_parser, buf, err);
+		timestamp_t when = event_time (ev);
+		
+		if (_event_sink && deliver_event (ev, when)) {
+			// three bytes is close enough for the stats
+			bytes_read += 3;
+			total += 3;
+			continue;
+		}
+		
+		if ((err = snd_midi_event_decode (decoder, buf, max, ev)) > 0) {
+			bytes_read += err;
+			total += err;
+			parse_input (buf, err, when);
 		}
+		
+	} while (snd_seq_event_input_pending (seq, 1) > 0);
+
+	if (total > 0) {
+		// never ask the caller to come back for more, we've drained it
+		return ((size_t) total >= max) ? (int) max - 1 : total;
 	}
-	return -ENOENT == err ? 0 : err;
+	
+	return (-ENOENT == err || -EAGAIN == err) ? 0 : err;
 }
 
 int ALSA_SequencerMidiPort::CreatePorts (PortRequest &req)
@@ -161,9 +260,56 @@ int ALSA_SequencerMidiPort::CreatePorts (PortRequest &req)
 			snd_seq_ev_set_source (&SEv, port_id);
 			snd_seq_ev_set_subs (&SEv);
 			snd_seq_ev_set_direct (&SEv);
-		} else 
+
+			if (caps & SND_SEQ_PORT_CAP_WRITE) {
+				// not fatal, we just fall back to host time stamps
+				CreateQueue ();
+			}
+		} else {
 			snd_seq_close (seq);
+			seq = 0;
+		}
+	}
+	return err;
+}
+
+int ALSA_SequencerMidiPort::CreateQueue ()
+{
+	/* have the sequencer stamp incoming events in real time against
+	   our own queue, so we keep the arrival time instead of the time
+	   we got around to reading them */
+	int err;
+	snd_seq_port_info_t *pinfo;
+
+	if ((err = snd_seq_alloc_queue (seq)) < 0) {
+		return err;
+	}
+	queue_id = err;
+
+	snd_seq_port_info_alloca (&pinfo);
+	
+	if ((err = snd_seq_get_port_info (seq, port_id, pinfo)) < 0) {
+		goto fail;
 	}
+	snd_seq_port_info_set_timestamping (pinfo, 1);
+	snd_seq_port_info_set_timestamp_real (pinfo, 1);
+	snd_seq_port_info_set_timestamp_queue (pinfo, queue_id);
+	
+	if ((err = snd_seq_set_port_info (seq, port_id, pinfo)) < 0) {
+		goto fail;
+	}
+
+	if ((err = snd_seq_start_queue (seq, queue_id, 0)) < 0 ||
+	    (err = snd_seq_drain_output (seq)) < 0) {
+		goto fail;
+	}
+	queue_base = get_current_host_time();
+	
+	return 0;
+
+  fail:
+	snd_seq_free_queue (seq, queue_id);
+	queue_id = -1;
 	return err;
 }
 
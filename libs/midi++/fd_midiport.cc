@@ -168,15 +168,7 @@ FD_MidiPort::read (byte* buf, size_t max)
 
 		// cerr << " read " << nread << endl;
 
-		if (input_parser) {
-			input_parser->raw_preparse 
-				(*input_parser, buf, nread, get_current_host_time());
-			for (int i = 0; i < nread; i++) {
-				input_parser->scanner (buf[i]);
-			}	
-			input_parser->raw_postparse 
-				(*input_parser, buf, nread);
-		}
+		parse_input (buf, nread, get_current_host_time());
 	}
 	
 	return nread;
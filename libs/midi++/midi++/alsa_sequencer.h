@@ -44,6 +44,8 @@ class ALSA_SequencerMidiPort : public Port
 
 	virtual timestamp_t get_current_host_time();
 
+	virtual bool supports_event_sink () const { return true; }
+
   protected:
 	/* Direct I/O */
 	
@@ -55,7 +57,12 @@ class ALSA_SequencerMidiPort : public Port
 	snd_midi_event_t *decoder, *encoder;
 	int port_id;
 	snd_seq_event_t SEv;
+	int queue_id;
+	timestamp_t queue_base;
 	int CreatePorts(PortRequest &req);
+	int CreateQueue();
+	timestamp_t event_time (const snd_seq_event_t *ev);
+	bool deliver_event (const snd_seq_event_t *ev, timestamp_t when);
 
 };
 
@@ -91,6 +91,16 @@ class Parser : public sigc::trackable {
 
 	void scanner (byte c);
 
+	/* lean mode: with a sink installed, feed() consumes a whole
+	   buffer and hands complete channel and realtime messages to
+	   the sink, none of the signals above are emitted. sysex and
+	   undefined messages are dropped.
+	*/
+
+	void set_event_sink (EventSink sink, void * arg);
+	bool lean () const { return _event_sink != 0; }
+	void feed (byte *buf, size_t len, timestamp_t timestamp);
+
 	size_t *message_counts() { return message_counter; }
 	const char *midi_event_type_name (MIDI::eventType);
 	void trace (bool onoff, std::ostream *o, const std::string &prefix = "");
@@ -171,6 +181,13 @@ class Parser : public sigc::trackable {
 
 	void handle_preparse(Parser &, byte *, size_t, timestamp_t);
 	timestamp_t _timestamp;
+
+	EventSink _event_sink;
+	void *    _event_sink_arg;
+	byte      _lean_status;
+	byte      _lean_data[2];
+	int       _lean_need;
+	int       _lean_have;
 };
 
 }; /* namespace MIDI */
@@ -118,6 +118,17 @@ class Port : public sigc::trackable {
 	
 	virtual timestamp_t get_current_host_time() { return 0; }
 
+	/* typed event delivery. complete channel and realtime messages
+	   go to the sink instead of through the input parser signals.
+	   ports that receive events already split into status and data
+	   (eg. the ALSA sequencer) hand them over directly, the others
+	   feed their read buffers through the parser's lean mode.
+	   the sink is called from whatever thread calls read().
+	*/
+
+	virtual bool supports_event_sink () const { return input_parser != 0; }
+	void set_event_sink (EventSink sink, void * arg);
+
 	const char *device () const { return _devname.c_str(); }
 	const char *name () const   { return _tagname.c_str(); }
 	Type   type () const        { return _type; }
@@ -139,6 +150,10 @@ class Port : public sigc::trackable {
 	Parser *input_parser;
 	Parser *output_parser;
 	size_t slowdown;
+	EventSink _event_sink;
+
+	void parse_input (byte *buf, size_t len, timestamp_t timestamp);
+	void * _event_sink_arg;
 
   private:
 	static size_t nports;
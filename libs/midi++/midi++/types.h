@@ -12,6 +12,10 @@ namespace MIDI {
 
 	typedef double timestamp_t;
 
+	/* single callback for complete channel and realtime messages,
+	   used instead of the Parser signals when installed */
+	typedef void (*EventSink) (void * arg, byte status, byte d1, byte d2, timestamp_t timestamp);
+
 	enum eventType {
 	    none = 0x0,
 	    raw = 0xF4, /* undefined in MIDI spec */
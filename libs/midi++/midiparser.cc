@@ -119,6 +119,12 @@ Parser::Parser (Port &p)
 	_mmc_forward = false;
 	reset_mtc_state ();
 
+	_event_sink = 0;
+	_event_sink_arg = 0;
+	_lean_status = 0;
+	_lean_need = 0;
+	_lean_have = 0;
+
 	raw_preparse.connect(mem_fun(*this, &Parser::handle_preparse));
 
 	/* this hack deals with the possibility of our first MIDI
@@ -330,6 +336,87 @@ Parser::trace (bool onoff, ostream *o, const string &prefix)
 	}
 }
 
+/* number of data bytes following each status byte 0x80-0xFF.
+   -1 marks sysex, eox and undefined messages, whose data is dropped
+   in lean mode. realtime bytes never get looked up.
+*/
+
+static const signed char lean_data_bytes[128] = {
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, /* note off */
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, /* note on */
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, /* poly pressure */
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, /* controller */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* program */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* channel pressure */
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, /* pitchbend */
+	-1, 1, 2, 1, -1, -1, 0, -1, 0, 0, 0, 0, 0, 0, 0, 0 /* system */
+};
+
+void
+Parser::set_event_sink (EventSink sink, void * arg)
+{
+	_event_sink_arg = arg;
+	_lean_status = 0;
+	_lean_have = 0;
+	_event_sink = sink;
+}
+
+void
+Parser::feed (byte *buf, size_t len, timestamp_t timestamp)
+{
+	byte *end = buf + len;
+	
+	_timestamp = timestamp;
+
+	for (; buf < end; ++buf) {
+		byte c = *buf;
+
+		if (c < 0x80) {
+			/* data byte, for the current (or running) status */
+			if (_lean_status == 0) {
+				continue;
+			}
+			_lean_data[_lean_have++] = c;
+
+			if (_lean_have < _lean_need) {
+				continue;
+			}
+
+			message_counter[_lean_status]++;
+			_event_sink (_event_sink_arg, _lean_status, _lean_data[0], _lean_need > 1 ? _lean_data[1] : 0, timestamp);
+			_lean_have = 0;
+
+			if (_lean_status >= 0xF0) {
+				/* no running status for system common */
+				_lean_status = 0;
+			}
+		}
+		else if (c >= 0xF8) {
+			/* realtime, may be interleaved anywhere and
+			   leaves running status alone */
+			message_counter[c]++;
+			_event_sink (_event_sink_arg, c, 0, 0, timestamp);
+		}
+		else {
+			int need = lean_data_bytes[c & 0x7F];
+			
+			_lean_have = 0;
+			
+			if (need > 0) {
+				_lean_status = c;
+				_lean_need = need;
+			}
+			else {
+				if (need == 0) {
+					message_counter[c]++;
+					_event_sink (_event_sink_arg, c, 0, 0, timestamp);
+				}
+				_lean_status = 0;
+			}
+		}
+	}
+}
+
 void
 Parser::scanner (unsigned char inbyte)
 {
@@ -43,6 +43,8 @@ Port::Port (PortRequest &req)
 	input_parser = 0;
 	output_parser = 0;
 	slowdown = 0;
+	_event_sink = 0;
+	_event_sink_arg = 0;
 
 	_devname = req.devname;
 	_tagname = req.tagname;
@@ -83,6 +85,36 @@ Port::~Port ()
 	}
 }
 
+void
+Port::set_event_sink (EventSink sink, void * arg)
+{
+	_event_sink_arg = arg;
+	_event_sink = sink;
+
+	if (input_parser) {
+		input_parser->set_event_sink (sink, arg);
+	}
+}
+
+void
+Port::parse_input (byte *buf, size_t len, timestamp_t timestamp)
+{
+	if (!input_parser) {
+		return;
+	}
+
+	if (input_parser->lean()) {
+		input_parser->feed (buf, len, timestamp);
+		return;
+	}
+	
+	input_parser->raw_preparse (*input_parser, buf, len, timestamp);
+	for (size_t i = 0; i < len; i++) {
+		input_parser->scanner (buf[i]);
+	}	
+	input_parser->raw_postparse (*input_parser, buf, len);
+}
+
 int
 Port::clock ()
 	
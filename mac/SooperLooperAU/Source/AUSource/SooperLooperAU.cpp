@@ -1059,7 +1059,7 @@ void SooperLooperAU::loop_added(int index, bool huh)
 	loops_changed();
 }
 
-void SooperLooperAU::loop_removed()
+void SooperLooperAU::loop_removed(int index)
 {
 	loops_changed();
 }
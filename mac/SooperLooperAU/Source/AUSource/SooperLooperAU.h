@@ -188,7 +188,7 @@ protected:
 	void parameter_changed(int ctrl_id, int instance);
 	void loops_changed();
 	void loop_added(int, bool);
-	void loop_removed();
+	void loop_removed(int index);
 	
 	// SL stuff
 	SooperLooper::Engine *     _engine;
@@ -0,0 +1,592 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <algorithm>
+#include <unistd.h>
+
+#include <pbd/xml++.h>
+
+#include "automation.hpp"
+#include "command_map.hpp"
+#include "utils.hpp"
+
+using namespace SooperLooper;
+using namespace std;
+
+// values closer than this are the same when thinning
+static const float ThinEpsilon = 1e-5f;
+
+static inline nframes_t
+travel (nframes_t from, nframes_t p, nframes_t length, bool forward)
+{
+	// loop frames from 'from' to p going the way the loop plays
+	if (forward) {
+		return p >= from ? p - from : p + length - from;
+	}
+	return p <= from ? from - p : from + length - p;
+}
+
+// first point at or after pos, like lower_bound
+static inline unsigned int
+lower_point (const Automation::Point * points, unsigned int count, nframes_t pos)
+{
+	unsigned int lo = 0, hi = count;
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		if (points[mid].pos < pos) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+// first point after pos, like upper_bound
+static inline unsigned int
+upper_point (const Automation::Point * points, unsigned int count, nframes_t pos)
+{
+	unsigned int lo = 0, hi = count;
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		if (points[mid].pos <= pos) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+
+Automation::Automation ()
+	: _lane_count(0), _mode(Off), _seq(0)
+{
+}
+
+bool
+Automation::is_automatable (Event::control_t ctrl)
+{
+	switch (ctrl) {
+	case Event::DryLevel:
+	case Event::WetLevel:
+	case Event::Feedback:
+	case Event::Rate:
+	case Event::InputGain:
+	case Event::PanChannel1:
+	case Event::PanChannel2:
+	case Event::PanChannel3:
+	case Event::PanChannel4:
+	case Event::PitchShift:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void
+Automation::set_mode (Mode mode)
+{
+	if (mode == _mode) {
+		return;
+	}
+
+	if (_mode == Record) {
+		// anything still being touched is done
+		begin_write ();
+		for (int n=0; n < _lane_count; ++n) {
+			if (_lanes[n].touch_left) {
+				end_touch (_lanes[n]);
+			}
+		}
+		end_write ();
+	}
+
+	_mode = mode;
+}
+
+Automation::Lane *
+Automation::find_lane (Event::control_t ctrl)
+{
+	for (int n=0; n < _lane_count; ++n) {
+		if (_lanes[n].control == ctrl) {
+			return &_lanes[n];
+		}
+	}
+	return 0;
+}
+
+bool
+Automation::record (Event::control_t ctrl, float value, nframes_t pos, nframes_t length)
+{
+	if (_mode != Record || length == 0 || !is_automatable (ctrl)) {
+		return false;
+	}
+
+	Lane * lane = find_lane (ctrl);
+
+	begin_write ();
+
+	if (!lane) {
+		if (_lane_count >= MaxLanes) {
+			end_write ();
+			return false;
+		}
+		lane = &_lanes[_lane_count++];
+		lane->control = ctrl;
+		lane->count = 0;
+		lane->undo_count = 0;
+		lane->have_undo = true; // undo empties it again
+		lane->have_redo = false;
+		lane->touch_left = 0;
+	}
+
+	if (!lane->touch_left) {
+		memcpy (lane->undo_points, lane->points, lane->count * sizeof(Point));
+		lane->undo_count = lane->count;
+		lane->have_undo = true;
+
+		// a new pass, like new audio, ends what could be redone
+		for (int n=0; n < _lane_count; ++n) {
+			_lanes[n].have_redo = false;
+		}
+	}
+
+	lane->touch_left = length;
+	insert_point (*lane, pos, value);
+
+	end_write ();
+
+	return true;
+}
+
+void
+Automation::insert_point (Lane & lane, nframes_t pos, float value)
+{
+	unsigned int idx = lower_point (lane.points, lane.count, pos);
+
+	// a burst of changes (a fader ride) moves the nearby point along
+	if (idx < lane.count && lane.points[idx].pos - pos < (nframes_t) ThinFrames) {
+		lane.points[idx].pos = pos;
+		lane.points[idx].value = value;
+		lane.points[idx].fresh = true;
+		return;
+	}
+	if (idx > 0 && pos - lane.points[idx-1].pos < (nframes_t) ThinFrames) {
+		lane.points[idx-1].pos = pos;
+		lane.points[idx-1].value = value;
+		lane.points[idx-1].fresh = true;
+		return;
+	}
+
+	if (lane.count >= (unsigned int) MaxPoints) {
+		return;
+	}
+
+	memmove (&lane.points[idx+1], &lane.points[idx], (lane.count - idx) * sizeof(Point));
+	lane.points[idx].pos = pos;
+	lane.points[idx].value = value;
+	lane.points[idx].fresh = true;
+	++lane.count;
+}
+
+void
+Automation::erase_passed (Lane & lane, nframes_t from, nframes_t span, nframes_t length, bool forward)
+{
+	unsigned int out = 0;
+
+	for (unsigned int n=0; n < lane.count; ++n) {
+		if (!lane.points[n].fresh) {
+			nframes_t d = travel (from, lane.points[n].pos, length, forward);
+			if (d > 0 && d <= span) {
+				continue;
+			}
+		}
+		lane.points[out++] = lane.points[n];
+	}
+
+	lane.count = out;
+}
+
+void
+Automation::end_touch (Lane & lane)
+{
+	// drop every breakpoint that doesn't change the value in effect
+	lane.touch_left = 0;
+
+	for (unsigned int n=0; n < lane.count; ++n) {
+		lane.points[n].fresh = false;
+	}
+
+	if (lane.count < 2) {
+		return;
+	}
+
+	float prev = lane.points[lane.count-1].value;
+	unsigned int out = 0;
+
+	for (unsigned int n=0; n < lane.count; ++n) {
+		if (fabsf (lane.points[n].value - prev) < ThinEpsilon) {
+			continue;
+		}
+		prev = lane.points[n].value;
+		lane.points[out++] = lane.points[n];
+	}
+
+	if (out == 0) {
+		// the same value all the way round
+		out = 1;
+	}
+	lane.count = out;
+}
+
+nframes_t
+Automation::distance_to_next (nframes_t pos, nframes_t length, bool forward) const
+{
+	nframes_t best = 0;
+
+	for (int n=0; n < _lane_count; ++n) {
+		const Lane & lane = _lanes[n];
+
+		if (lane.touch_left || lane.count == 0) {
+			continue;
+		}
+
+		nframes_t d;
+		if (forward) {
+			unsigned int idx = upper_point (lane.points, lane.count, pos);
+			d = (idx < lane.count) ? lane.points[idx].pos - pos : lane.points[0].pos + length - pos;
+		}
+		else {
+			unsigned int idx = lower_point (lane.points, lane.count, pos);
+			d = (idx > 0) ? pos - lane.points[idx-1].pos : pos + length - lane.points[lane.count-1].pos;
+		}
+
+		if (d > 0 && (best == 0 || d < best)) {
+			best = d;
+		}
+	}
+
+	return best;
+}
+
+bool
+Automation::last_passed (const Lane & lane, nframes_t from, nframes_t to, bool forward, float & value) const
+{
+	// passed is (from, to] in the direction of play
+	if (lane.count == 0 || from == to) {
+		return false;
+	}
+
+	if (forward) {
+		unsigned int idx = upper_point (lane.points, lane.count, to);
+		if (to > from) {
+			if (idx > 0 && lane.points[idx-1].pos > from) {
+				value = lane.points[idx-1].value;
+				return true;
+			}
+		}
+		else {
+			// wrapped, [0, to] was passed last
+			if (idx > 0) {
+				value = lane.points[idx-1].value;
+				return true;
+			}
+			if (lane.points[lane.count-1].pos > from) {
+				value = lane.points[lane.count-1].value;
+				return true;
+			}
+		}
+	}
+	else {
+		unsigned int idx = lower_point (lane.points, lane.count, to);
+		if (to < from) {
+			if (idx < lane.count && lane.points[idx].pos < from) {
+				value = lane.points[idx].value;
+				return true;
+			}
+		}
+		else {
+			// wrapped, [to, end) was passed last
+			if (idx < lane.count) {
+				value = lane.points[idx].value;
+				return true;
+			}
+			if (lane.points[0].pos < from) {
+				value = lane.points[0].value;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+int
+Automation::advance (nframes_t from, nframes_t to, nframes_t length, bool forward,
+		     Event::control_t * ctrls, float * values)
+{
+	int filled = 0;
+
+	if (from == to || length == 0 || _lane_count == 0) {
+		return 0;
+	}
+
+	nframes_t span = travel (from, to, length, forward);
+	bool changing = false;
+
+	for (int n=0; n < _lane_count; ++n) {
+		Lane & lane = _lanes[n];
+
+		if (lane.touch_left) {
+			if (!changing) {
+				begin_write ();
+				changing = true;
+			}
+
+			nframes_t todo = min (span, lane.touch_left);
+
+			erase_passed (lane, from, todo, length, forward);
+			lane.touch_left -= todo;
+
+			if (!lane.touch_left) {
+				end_touch (lane);
+			}
+			continue;
+		}
+
+		float value;
+		if (_mode != Off && last_passed (lane, from, to, forward, value)) {
+			ctrls[filled] = lane.control;
+			values[filled] = value;
+			++filled;
+		}
+	}
+
+	if (changing) {
+		end_write ();
+	}
+
+	return filled;
+}
+
+void
+Automation::swap_undo (Lane & lane)
+{
+	unsigned int count = max (lane.count, lane.undo_count);
+
+	for (unsigned int n=0; n < count; ++n) {
+		Point tmp = lane.points[n];
+		lane.points[n] = lane.undo_points[n];
+		lane.undo_points[n] = tmp;
+		// an interrupted touch is kept as it stood
+		lane.undo_points[n].fresh = false;
+	}
+	swap (lane.count, lane.undo_count);
+	lane.touch_left = 0;
+}
+
+void
+Automation::undo ()
+{
+	begin_write ();
+
+	// a lane that was new in that pass is left empty, redo refills it
+	for (int n=0; n < _lane_count; ++n) {
+		Lane & lane = _lanes[n];
+
+		if (lane.have_undo) {
+			swap_undo (lane);
+			lane.have_undo = false;
+			lane.have_redo = true;
+		}
+	}
+
+	end_write ();
+}
+
+void
+Automation::redo ()
+{
+	begin_write ();
+
+	for (int n=0; n < _lane_count; ++n) {
+		Lane & lane = _lanes[n];
+
+		if (lane.have_redo) {
+			swap_undo (lane);
+			lane.have_redo = false;
+			lane.have_undo = true;
+		}
+	}
+
+	end_write ();
+}
+
+void
+Automation::clear ()
+{
+	begin_write ();
+	_lane_count = 0;
+	end_write ();
+}
+
+XMLNode &
+Automation::get_state () const
+{
+	CommandMap & cmap = CommandMap::instance();
+	LocaleGuard lg ("POSIX");
+
+	XMLNode *node = new XMLNode ("Automation");
+	char buf[64];
+
+	snprintf(buf, sizeof(buf), "%d", (int) _mode);
+	node->add_property ("mode", buf);
+
+	// a consistent copy, the rt thread may be recording while we read
+	vector<Event::control_t> ctrls;
+	vector<vector<Point> > lanes;
+	bool consistent = false;
+
+	for (int tries = 0; tries < 100 && !consistent; ++tries) {
+		unsigned int before = _seq;
+		__sync_synchronize();
+
+		if (before & 1) {
+			usleep (1000);
+			continue;
+		}
+
+		// a torn read may see any count, keep within the arrays
+		int count = min (max (_lane_count, 0), (int) MaxLanes);
+		ctrls.resize (count);
+		lanes.resize (count);
+
+		for (int n=0; n < count; ++n) {
+			ctrls[n] = _lanes[n].control;
+			lanes[n].assign (_lanes[n].points, _lanes[n].points + min (_lanes[n].count, (unsigned int) MaxPoints));
+		}
+
+		__sync_synchronize();
+		consistent = (_seq == before);
+	}
+
+	if (!consistent) {
+		// better none than a torn copy
+		cerr << "sooperlooper: automation kept changing, its lanes are not saved" << endl;
+		ctrls.clear();
+		lanes.clear();
+	}
+
+	for (size_t n=0; n < lanes.size(); ++n) {
+		if (lanes[n].empty()) {
+			// emptied by an undo
+			continue;
+		}
+
+		XMLNode * lane_node = new XMLNode ("Lane");
+		lane_node->add_property ("control", cmap.to_control_str (ctrls[n]));
+
+		// pos:value pairs
+		string points;
+		for (size_t p=0; p < lanes[n].size(); ++p) {
+			snprintf(buf, sizeof(buf), "%s%lu:%.10g", p > 0 ? " " : "",
+				 (unsigned long) lanes[n][p].pos, lanes[n][p].value);
+			points += buf;
+		}
+		lane_node->add_property ("points", points);
+
+		node->add_child_nocopy (*lane_node);
+	}
+
+	return *node;
+}
+
+int
+Automation::set_state (const XMLNode & node)
+{
+	LocaleGuard lg ("POSIX");
+	const XMLProperty* prop;
+	CommandMap & cmap = CommandMap::instance();
+
+	if (node.name() != "Automation") {
+		cerr << "incorrect XML node passed to Automation: " << node.name() << endl;
+		return -1;
+	}
+
+	_lane_count = 0;
+
+	if ((prop = node.property ("mode")) != 0) {
+		int mode = 0;
+		sscanf (prop->value().c_str(), "%d", &mode);
+		// never comes back up recording
+		_mode = (mode == Off) ? Off : Play;
+	}
+
+	XMLNodeList lane_kids = node.children ("Lane");
+
+	for (XMLNodeConstIterator niter = lane_kids.begin(); niter != lane_kids.end() && _lane_count < MaxLanes; ++niter)
+	{
+		Event::control_t ctrl = Event::Unknown;
+
+		if ((prop = (*niter)->property ("control")) != 0) {
+			ctrl = cmap.to_control_t (prop->value());
+		}
+		if (!is_automatable (ctrl) || find_lane (ctrl) || (prop = (*niter)->property ("points")) == 0) {
+			continue;
+		}
+
+		Lane & lane = _lanes[_lane_count];
+		lane.control = ctrl;
+		lane.count = 0;
+		lane.undo_count = 0;
+		lane.have_undo = false;
+		lane.have_redo = false;
+		lane.touch_left = 0;
+
+		const char * str = prop->value().c_str();
+		unsigned long pos;
+		float value;
+		int used;
+
+		while (lane.count < (unsigned int) MaxPoints && sscanf (str, " %lu:%g%n", &pos, &value, &used) == 2) {
+			str += used;
+			// keep them sorted whatever the file says
+			if (lane.count == 0 || (nframes_t) pos > lane.points[lane.count-1].pos) {
+				lane.points[lane.count].pos = (nframes_t) pos;
+				lane.points[lane.count].value = value;
+				lane.points[lane.count].fresh = false;
+				++lane.count;
+			}
+		}
+
+		if (lane.count > 0) {
+			++_lane_count;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,132 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+#ifndef __sooperlooper_automation__
+#define __sooperlooper_automation__
+
+#include <vector>
+
+#include "audio_driver.hpp"
+#include "event.hpp"
+
+class XMLNode;
+
+/*
+ * Control automation of one loop, kept against the loop position.  Each
+ * lane is a sorted list of breakpoints for one control, a value holds
+ * until the next breakpoint.  In record mode a hand made change starts
+ * a touch: the lane stops playing, changes are written at the current
+ * position and the old breakpoints the loop passes over are dropped,
+ * until a whole loop length went by without another change.  The lane
+ * is then thinned and plays again.  Everything but the state i/o is rt
+ * thread only, the storage is fixed so nothing allocates.  The main
+ * thread reads through a sequence count bumped around every change.
+ */
+
+namespace SooperLooper {
+
+class Automation
+{
+  public:
+	enum Mode {
+		Off = 0,
+		Play,
+		Record
+	};
+
+	enum {
+		// one for every control is_automatable() takes
+		MaxLanes = 10,
+		MaxPoints = 1024,
+		// changes closer than this to a breakpoint move it instead of adding one
+		ThinFrames = 64
+	};
+
+	struct Point {
+		nframes_t pos;
+		float     value;
+		bool      fresh; // written in the current touch
+	};
+
+	Automation ();
+
+	static bool is_automatable (Event::control_t ctrl);
+
+	Mode get_mode () const { return _mode; }
+	void set_mode (Mode mode);
+
+	// true if there is anything to play or record
+	bool is_active () const { return _mode != Off && _lane_count > 0; }
+
+	// a change that did not come from us, at loop position pos.
+	// false if it isn't recorded
+	bool record (Event::control_t ctrl, float value, nframes_t pos, nframes_t length);
+
+	// loop frames from pos to the next breakpoint of a playing lane, 0 for none
+	nframes_t distance_to_next (nframes_t pos, nframes_t length, bool forward) const;
+
+	// the loop moved from one position to the other.  touched lanes
+	// erase what was passed over, for the playing ones the last value
+	// passed is returned.  returns how many were filled in
+	int advance (nframes_t from, nframes_t to, nframes_t length, bool forward,
+		     Event::control_t * ctrls, float * values);
+
+	// one level only, the audio undo history is not mirrored.  undo puts
+	// every lane back as it was before its last touch, redo brings that
+	// touch back until a new one starts.  clear can't be redone
+	void undo ();
+	void redo ();
+	void clear ();
+
+	XMLNode & get_state () const;
+	// only before the loop is running
+	int set_state (const XMLNode & node);
+
+  private:
+	struct Lane {
+		Event::control_t control;
+		unsigned int     count;
+		unsigned int     undo_count;
+		bool             have_undo;
+		bool             have_redo;   // undo_points hold what undo took away
+		nframes_t        touch_left; // loop frames until the touch ends, 0 when playing
+		Point            points[MaxPoints];
+		Point            undo_points[MaxPoints];
+	};
+
+	Lane * find_lane (Event::control_t ctrl);
+	void swap_undo (Lane & lane);
+	void insert_point (Lane & lane, nframes_t pos, float value);
+	void erase_passed (Lane & lane, nframes_t from, nframes_t span, nframes_t length, bool forward);
+	void end_touch (Lane & lane);
+	bool last_passed (const Lane & lane, nframes_t from, nframes_t to, bool forward, float & value) const;
+
+	// odd while the rt thread is changing the lanes
+	void begin_write () { _seq = _seq + 1; __sync_synchronize(); }
+	void end_write () { __sync_synchronize(); _seq = _seq + 1; }
+
+	Lane           _lanes[MaxLanes];
+	int            _lane_count;
+	Mode           _mode;
+	volatile unsigned int _seq;
+};
+
+};
+
+#endif
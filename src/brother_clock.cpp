@@ -0,0 +1,372 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+#include <iostream>
+#include <cmath>
+#include <sys/time.h>
+
+#include "brother_clock.hpp"
+
+using namespace SooperLooper;
+using namespace std;
+
+// how often the clock goes out to followers, and the followers re-register
+#define CLOCK_SEND_INTERVAL   0.02
+#define REGISTER_INTERVAL     1.0
+#define PING_INTERVAL         0.2
+// followers that haven't re-registered in this long are dropped
+#define FOLLOWER_TIMEOUT      5.0
+// the leader is considered gone when its last clock is this old
+#define CLOCK_STALE           0.5
+
+// phase errors larger than this (in beats) are jumped instead of pulled in
+#define MAX_PHASE_ERROR       0.25
+// pll loop filter, time constant 0.5 s with damping 0.7
+#define PLL_GAIN_P            2.8
+#define PLL_GAIN_I            4.0
+#define MAX_RATE_ADJUST       0.05
+// how fast the clock offset estimate may creep upward
+#define OFFSET_CREEP          0.002
+// how fast the best round trip may creep upward
+#define RTT_CREEP             0.05
+
+
+static inline double
+host_time_now ()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double) tv.tv_sec + (tv.tv_usec * 1e-6);
+}
+
+
+void
+BrotherClock::SeqClock::write (const ClockState & st)
+{
+	// odd sequence while writing
+	seq = seq + 1;
+	__sync_synchronize();
+	state = st;
+	__sync_synchronize();
+	seq = seq + 1;
+}
+
+bool
+BrotherClock::SeqClock::read (ClockState & st) const
+{
+	// bounded, the rt thread must not spin on a preempted writer
+	for (int tries = 0; tries < 3; ++tries) {
+		unsigned int before = seq;
+		__sync_synchronize();
+		if (before == 0 || (before & 1)) {
+			continue;
+		}
+		st = state;
+		__sync_synchronize();
+		if (seq == before) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+BrotherClock::BrotherClock ()
+	: _last_sent(0.0), _leader_addr(0), _last_register(0.0), _last_ping(0.0), _leader_gen(0),
+	  _offset_gen(0), _clock_offset(0.0), _have_offset(false), _best_rtt(0.0), _have_rtt(false),
+	  _beats(0.0), _period_beats(0.0), _integral(0.0), _locked(false), _phase_error(0.0)
+{
+}
+
+BrotherClock::~BrotherClock ()
+{
+	for (FollowerMap::iterator iter = _followers.begin(); iter != _followers.end(); ++iter) {
+		lo_address_free (iter->second.first);
+	}
+	_followers.clear();
+
+	if (_leader_addr) {
+		lo_address_free (_leader_addr);
+		_leader_addr = 0;
+	}
+}
+
+void
+BrotherClock::publish (double hosttime, double beats, double tempo)
+{
+	ClockState st;
+	st.hosttime = hosttime;
+	st.beats = beats;
+	st.tempo = tempo;
+
+	_published.write (st);
+}
+
+void
+BrotherClock::add_follower (const std::string & url)
+{
+	double now = host_time_now();
+	FollowerMap::iterator iter = _followers.find (url);
+
+	if (iter != _followers.end()) {
+		iter->second.second = now;
+		return;
+	}
+
+	lo_address addr = lo_address_new_from_url (url.c_str());
+	if (!addr) {
+		cerr << "BrotherClock: bad follower url: " << url << endl;
+		return;
+	}
+
+	_followers[url] = make_pair (addr, now);
+#ifdef DEBUG
+	cerr << "BrotherClock: added follower " << url << endl;
+#endif
+}
+
+void
+BrotherClock::remove_follower (const std::string & url)
+{
+	FollowerMap::iterator iter = _followers.find (url);
+
+	if (iter != _followers.end()) {
+		lo_address_free (iter->second.first);
+		_followers.erase (iter);
+	}
+}
+
+void
+BrotherClock::answer_ping (const std::string & url, double sent)
+{
+	lo_address addr = lo_address_new_from_url (url.c_str());
+	if (!addr) {
+		return;
+	}
+
+	lo_send (addr, "/sl/brother_pong", "dd", sent, host_time_now());
+	lo_address_free (addr);
+}
+
+void
+BrotherClock::set_leader (const std::string & url, const std::string & our_url)
+{
+	if (_leader_addr) {
+		// let the old one know right away
+		lo_send (_leader_addr, "/brother_unregister", "s", _our_url.c_str());
+		lo_address_free (_leader_addr);
+		_leader_addr = 0;
+	}
+
+	_leader_url = url;
+	_our_url = our_url;
+	_last_register = 0.0;
+	_last_ping = 0.0;
+	// the osc thread re-estimates the clock offset for the new leader
+	__sync_add_and_fetch (&_leader_gen, 1);
+
+	if (!url.empty()) {
+		if (!(_leader_addr = lo_address_new_from_url (url.c_str()))) {
+			cerr << "BrotherClock: bad leader url: " << url << endl;
+			_leader_url = "";
+		}
+	}
+}
+
+void
+BrotherClock::check_leader_gen ()
+{
+	unsigned int gen = _leader_gen;
+	if (gen != _offset_gen) {
+		_offset_gen = gen;
+		_have_offset = false;
+		_have_rtt = false;
+	}
+}
+
+void
+BrotherClock::receive (const ClockState & state)
+{
+	double arrival = host_time_now();
+
+	check_leader_gen();
+
+	if (!_have_rtt) {
+		// no round trip yet, maybe an older leader.  the smallest
+		// (arrival - sent) seen is the best we have, but it includes
+		// the one way latency, so we lag the leader by that much.
+		// letting it creep back up slowly follows drift.
+		double offset = arrival - state.hosttime;
+
+		if (!_have_offset || offset < _clock_offset) {
+			_clock_offset = offset;
+			_have_offset = true;
+		}
+		else {
+			_clock_offset += (offset - _clock_offset) * OFFSET_CREEP;
+		}
+	}
+
+	ClockState local = state;
+	local.hosttime += _clock_offset;
+
+	_received.write (local);
+}
+
+void
+BrotherClock::receive_pong (double sent, double leader_time)
+{
+	double rtt = host_time_now() - sent;
+
+	if (rtt < 0.0) {
+		return;
+	}
+
+	check_leader_gen();
+
+	// the leader answered about halfway through the round trip.  the
+	// shortest one is the least skewed by queueing, letting it creep
+	// back up slowly keeps following drift between the clocks.
+	if (!_have_rtt || rtt <= _best_rtt) {
+		_best_rtt = rtt;
+		_clock_offset = sent + rtt * 0.5 - leader_time;
+		_have_offset = true;
+		_have_rtt = true;
+	}
+	else {
+		_best_rtt += (rtt - _best_rtt) * RTT_CREEP;
+	}
+}
+
+int
+BrotherClock::run (float * syncbuf, nframes_t offset, nframes_t nframes, double now,
+		  double srate, double pulse_beats, double & tempo)
+{
+	ClockState st;
+	int hit_at = -1;
+
+	if (_received.read (st) && st.tempo > 0.0 && (now - st.hosttime) < CLOCK_STALE) {
+		// where the leader is now
+		double target = st.beats + (now - st.hosttime) * st.tempo / 60.0;
+		double err = target - _beats;
+
+		tempo = st.tempo;
+
+		if (!_locked || fabs(err) > MAX_PHASE_ERROR) {
+			// too far off to pull in smoothly
+			_beats = target;
+			_integral = 0.0;
+			err = 0.0;
+			_locked = true;
+		}
+		_phase_error = err;
+	}
+	else {
+		// lost the leader, free run at the current tempo
+		_locked = false;
+		_phase_error = 0.0;
+	}
+
+	_period_beats = _beats;
+
+	if (tempo <= 0.0 || srate <= 0.0 || pulse_beats <= 0.0) {
+		// no real sync here
+		for (nframes_t n = offset; n < nframes; ++n) {
+			syncbuf[n] = 1.0f;
+		}
+		return -1;
+	}
+
+	double ratio = 1.0;
+
+	if (_locked) {
+		// PI loop filter on the phase error in seconds
+		double err_secs = _phase_error * 60.0 / tempo;
+		_integral += err_secs * (nframes - offset) / srate;
+		ratio += PLL_GAIN_P * err_secs + PLL_GAIN_I * _integral;
+		ratio = max (1.0 - MAX_RATE_ADJUST, min (1.0 + MAX_RATE_ADJUST, ratio));
+	}
+
+	double inc = ratio * tempo / (60.0 * srate);
+	double beats = _beats;
+
+	for (nframes_t n = offset; n < nframes; ++n) {
+		double next = beats + inc;
+
+		if (floor (next / pulse_beats) != floor (beats / pulse_beats)) {
+			syncbuf[n] = 2.0f;
+		}
+		else {
+			syncbuf[n] = 0.0f;
+		}
+
+		if (hit_at < 0 && floor (next) != floor (beats)) {
+			hit_at = (int) n;
+		}
+		beats = next;
+	}
+
+	_beats = beats;
+
+	return hit_at;
+}
+
+void
+BrotherClock::service (double now)
+{
+	// leader, send our latest clock
+	if (!_followers.empty() && (now - _last_sent) >= CLOCK_SEND_INTERVAL) {
+		ClockState st;
+		bool have = _published.read (st) && st.tempo > 0.0;
+
+		for (FollowerMap::iterator iter = _followers.begin(); iter != _followers.end(); )
+		{
+			if ((now - iter->second.second) > FOLLOWER_TIMEOUT) {
+#ifdef DEBUG
+				cerr << "BrotherClock: follower timed out " << iter->first << endl;
+#endif
+				lo_address_free (iter->second.first);
+				_followers.erase (iter++);
+				continue;
+			}
+
+			if (have) {
+				lo_send (iter->second.first, "/sl/brother_clock", "ddd", st.hosttime, st.beats, st.tempo);
+			}
+			++iter;
+		}
+
+		_last_sent = now;
+	}
+
+	// follower, keep our registration alive
+	if (_leader_addr && (now - _last_register) >= REGISTER_INTERVAL) {
+		if (lo_send (_leader_addr, "/brother_register", "s", _our_url.c_str()) < 0) {
+#ifdef DEBUG
+			cerr << "BrotherClock: couldn't register with " << _leader_url << endl;
+#endif
+		}
+		_last_register = now;
+	}
+
+	if (_leader_addr && (now - _last_ping) >= PING_INTERVAL) {
+		lo_send (_leader_addr, "/brother_ping", "sd", _our_url.c_str(), host_time_now());
+		_last_ping = now;
+	}
+}
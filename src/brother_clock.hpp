@@ -0,0 +1,148 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+#ifndef __sooperlooper_brother_clock__
+#define __sooperlooper_brother_clock__
+
+#include <string>
+#include <map>
+
+#include <lo/lo.h>
+
+#include "audio_driver.hpp"
+
+/*
+ * Clock exchange between SooperLooper engines (the BrotherSync source).
+ * Every engine publishes its beat position against host time once per
+ * period.  The main thread sends the latest one to each follower that
+ * has registered, as /sl/brother_clock over any liblo transport.  A
+ * follower tracks the leader's beat position with a phase locked loop
+ * and generates its sync pulses from it.  The difference between the
+ * two host clocks is measured with a ping round trip, so the one way
+ * network latency doesn't end up in it.
+ */
+
+namespace SooperLooper {
+
+class BrotherClock
+{
+  public:
+	struct ClockState {
+		ClockState() : hosttime(0.0), beats(0.0), tempo(0.0) {}
+
+		double hosttime; // seconds, gettimeofday() time base
+		double beats;    // quarter notes since an arbitrary origin
+		double tempo;    // bpm
+	};
+
+	BrotherClock ();
+	~BrotherClock ();
+
+	// leader side
+
+	// rt thread, once per period
+	void publish (double hosttime, double beats, double tempo);
+
+	// main thread, adds or refreshes a follower url
+	void add_follower (const std::string & url);
+	void remove_follower (const std::string & url);
+	size_t follower_count () const { return _followers.size(); }
+
+	// osc thread, on each /brother_ping, answers right away with our host time
+	void answer_ping (const std::string & url, double sent);
+
+	// follower side
+
+	// main thread, empty url stops following
+	void set_leader (const std::string & url, const std::string & our_url);
+	const std::string & get_leader () const { return _leader_url; }
+
+	// osc thread, on each /sl/brother_clock
+	void receive (const ClockState & state);
+
+	// osc thread, on each /sl/brother_pong.  sent is our host time from
+	// the ping, leader_time the leader's when it answered.
+	void receive_pong (double sent, double leader_time);
+
+	// rt thread, fills syncbuf with pulses every pulse_beats and
+	// returns the offset of a quarter note in this period or -1.
+	// tempo is set to the leader's tempo.
+	int run (float * syncbuf, nframes_t offset, nframes_t nframes, double now,
+		 double srate, double pulse_beats, double & tempo);
+
+	// rt thread, our beat position at the start of the last run() period
+	double get_period_beats () const { return _period_beats; }
+
+	bool   is_locked () const { return _locked; }
+	double get_phase_error () const { return _phase_error; }
+
+	// main thread, called regularly from the engine mainloop.
+	// sends our clock to followers and keeps up our registration with the leader.
+	void service (double now);
+
+  private:
+
+	// single writer, single reader, the reader retries if the writer got in the way
+	struct SeqClock {
+		SeqClock() : seq(0) {}
+		volatile unsigned int seq;
+		ClockState state;
+
+		void write (const ClockState & st);
+		bool read (ClockState & st) const;
+	};
+
+	SeqClock _published;  // written by rt
+	SeqClock _received;   // written by the osc thread, in our host time
+
+	// leader
+	typedef std::map<std::string, std::pair<lo_address, double> > FollowerMap;
+	FollowerMap _followers;
+	double      _last_sent;
+
+	// follower
+	std::string _leader_url;
+	std::string _our_url;
+	lo_address  _leader_addr;
+	double      _last_register;
+	double      _last_ping;
+	// bumped by the main thread on each leader change, the osc thread
+	// starts a new offset estimate when it sees a new one
+	volatile unsigned int _leader_gen;
+
+	// offset estimate, osc thread only
+	void check_leader_gen ();
+	unsigned int _offset_gen;
+	double      _clock_offset;
+	bool        _have_offset;
+	// from the round trip, preferred over the one way estimate
+	double      _best_rtt;
+	bool        _have_rtt;
+
+	// pll state, rt only
+	double _beats;
+	double _period_beats;
+	double _integral;
+	bool   _locked;
+	double _phase_error;
+};
+
+}
+
+#endif
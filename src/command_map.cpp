@@ -126,6 +126,8 @@ CommandMap::CommandMap()
 	add_input_control("pitch_shift", Event::PitchShift, UnitSemitones, -12.0f, 12.0f, 0.0f); 
 	add_input_control("tempo_stretch", Event::TempoStretch, UnitBoolean);
 	add_input_control("round_integer_tempo", Event::RoundIntegerTempo, UnitBoolean);
+	add_input_control("group", Event::LoopGroup, UnitIndexed, -1.0f, 31.0f, -1.0f);
+	add_input_control("automation", Event::AutomationMode, UnitIndexed, 0.0f, 2.0f, 0.0f);
 	add_input_control("jack_timebase_master", Event::JackTimebaseMaster, UnitBoolean);
 
 	_str_ctrl_map.insert (_input_controls.begin(), _input_controls.end());
@@ -146,6 +148,8 @@ CommandMap::CommandMap()
 	add_output_control("in_peak_meter", Event::InPeakMeter, UnitGeneric, 0.0f, 4.0f);
 	add_output_control("out_peak_meter", Event::OutPeakMeter, UnitGeneric, 0.0f, 4.0f);
 	add_output_control("is_soloed", Event::IsSoloed, UnitBoolean);
+	// auto updates send the position model instead, see doc_osc.html
+	add_output_control("playhead", Event::PlayheadModel, UnitSeconds, 0.0f, 1e6);
 
 	_str_ctrl_map.insert (_output_controls.begin(), _output_controls.end());
 
@@ -172,6 +176,9 @@ CommandMap::CommandMap()
 	add_global_control("use_midi_start", Event::UseMidiStart, UnitBoolean, 0.0f, 1.0f, 1.0f);
 	add_global_control("use_midi_stop", Event::UseMidiStop, UnitBoolean, 0.0f, 1.0f, 1.0f);
 	add_global_control("send_midi_start_on_trigger", Event::SendMidiStartOnTrigger, UnitBoolean, 0.0f, 1.0f, 1.0f);
+	add_global_control("timetag_offset", Event::TimetagOffset, UnitSeconds, 0.0f, 1.0f, 0.01f);
+	add_global_control("timetag_late_count", Event::TimetagLateCount, UnitInteger, 0.0f, 1e9);
+	add_global_control("timetag_frame_offset", Event::TimetagFrameOffset, UnitGeneric, 0.0f, 1e6);
 	_str_ctrl_map.insert (_global_controls.begin(), _global_controls.end());
 
 	// reverse it
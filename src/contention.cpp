@@ -0,0 +1,93 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+#include "contention.hpp"
+
+using namespace SooperLooper;
+using namespace std;
+
+volatile unsigned long Contention::_counts[Contention::CounterCount];
+unsigned long Contention::_bases[Contention::CounterCount];
+
+// these are also the /get parameter names
+static const char * counter_names[Contention::CounterCount] = {
+	"loop_lock_misses",
+	"midi_lock_drops",
+	"wakeup_lock_misses",
+	"event_drops",
+	"midi_event_drops",
+	"timed_event_drops",
+	"sync_event_drops",
+	"update_drops",
+	"nonrt_drops",
+	"loop_manage_drops",
+	"event_queue_high",
+	"midi_event_queue_high",
+	"timed_event_queue_high",
+	"update_queue_high",
+	"nonrt_queue_high",
+	"worker_rejects",
+	"osc_drops",
+	"period_event_drops",
+	"command_overwrites"
+};
+
+void
+Contention::set_total (Counter c, unsigned long total)
+{
+	// the source keeps counting across a reset
+	if (total < _bases[c]) {
+		_bases[c] = 0;
+	}
+	_counts[c] = total - _bases[c];
+}
+
+void
+Contention::reset ()
+{
+	for (int n=0; n < CounterCount; ++n) {
+		// swapped for zero in one step, an rt count can land at any time
+		unsigned long curr;
+		do {
+			curr = _counts[n];
+		} while (!__sync_bool_compare_and_swap (&_counts[n], curr, 0UL));
+
+		_bases[n] += curr;
+	}
+}
+
+const char *
+Contention::name (Counter c)
+{
+	if (c < 0 || c >= CounterCount) {
+		return "";
+	}
+	return counter_names[c];
+}
+
+int
+Contention::find (const string & name)
+{
+	for (int n=0; n < CounterCount; ++n) {
+		if (name == counter_names[n]) {
+			return n;
+		}
+	}
+	return -1;
+}
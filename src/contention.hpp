@@ -0,0 +1,93 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+#ifndef __sooperlooper_contention__
+#define __sooperlooper_contention__
+
+#include <string>
+
+/*
+ * Counters for the places that give up instead of waiting: trylocks
+ * that failed and events dropped because a ringbuffer was full, plus
+ * the high water marks of the event queues.  Counting is a single
+ * atomic add so it is safe from any thread, including the rt one.
+ * The engine polls the worker and OSC sender totals into the rest and
+ * logs whatever changed from the main loop.
+ */
+
+namespace SooperLooper {
+
+class Contention
+{
+  public:
+	enum Counter {
+		LoopLockMisses = 0,   // Looper::run found the loop locked, ran bypassed
+		MidiLockDrops,        // midi dropped on a busy bindings lock
+		WakeupLockMisses,     // main loop not signalled, it wakes on its timer instead
+		EventDrops,
+		MidiEventDrops,
+		TimedEventDrops,
+		SyncEventDrops,
+		UpdateDrops,          // rt thread to main loop updates
+		NonRTDrops,
+		LoopManageDrops,
+		EventQueueHigh,
+		MidiEventQueueHigh,
+		TimedEventQueueHigh,
+		UpdateQueueHigh,
+		NonRTQueueHigh,
+		WorkerRejects,        // polled from the worker
+		OscDrops,             // polled from the OSC sender
+		PeriodEventDrops,     // a loop's per period event list was full
+		CommandOverwrites,    // a loop's pending commands were full, the last one was replaced
+		CounterCount
+	};
+
+	static void count (Counter c) { __sync_fetch_and_add (&_counts[c], 1UL); }
+
+	// for the high water marks
+	static void note_level (Counter c, unsigned long level) {
+		unsigned long curr;
+		while (level > (curr = _counts[c])) {
+			if (__sync_bool_compare_and_swap (&_counts[c], curr, level)) {
+				break;
+			}
+		}
+	}
+
+	// for the polled ones, total is what the source counted since it started
+	static void set_total (Counter c, unsigned long total);
+
+	static unsigned long get (Counter c) { return _counts[c]; }
+
+	// zeros every counter, main thread
+	static void reset ();
+
+	static const char * name (Counter c);
+	// -1 if there is no counter by that name
+	static int find (const std::string & name);
+
+  private:
+	static volatile unsigned long _counts[CounterCount];
+	static unsigned long _bases[CounterCount];
+};
+
+};
+
+#endif
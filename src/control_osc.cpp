@@ -17,13 +17,19 @@
 **  
 */
 
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include <iostream>
 #include <cstdio>
 #include <cstdlib>
 #include <cerrno>
+#include <cmath>
 #include <algorithm>
 
 #include <sys/poll.h>
+#include <sys/time.h>
 #include <unistd.h>
 #include <fcntl.h>
 
@@ -33,6 +39,10 @@
 #include "ringbuffer.hpp"
 #include "midi_bind.hpp"
 #include "command_map.hpp"
+#include "utils.hpp"
+#include "trace.hpp"
+#include "brother_clock.hpp"
+#include "plugin.hpp"
 #include "version.h"
 
 #include <lo/lo.h>
@@ -44,6 +54,16 @@ using namespace std;
 
 //#define DEBUG 1
 
+// keeps each audio transfer message under the liblo message size limit
+#define AUDIO_CHUNK_BYTES 16384
+
+// how long get replies wait for more to the same client, and the most per bundle
+#define GET_BATCH_WINDOW_MS 2
+#define GET_BATCH_MAX 32
+
+// timetags further ahead than this many seconds are held only this long
+#define TIMETAG_HORIZON 60.0
+
 static void error_callback(int num, const char *m, const char *path)
 {
 #ifdef DEBUG
@@ -62,8 +82,16 @@ ControlOSC::ControlOSC(Engine * eng, unsigned int port)
 	_shutdown = false;
 	_osc_server = 0;
 	_osc_unix_server = 0;
+	_osc_tcp_server = 0;
 	_osc_thread = 0;
 	_max_instance = 0;
+	_get_batch_start = 0.0;
+	_get_next_id = 0;
+	pthread_mutex_init (&_get_answer_lock, NULL);
+	_sender = new OscSender();
+	_config_old_count = 0;
+	_config_dirty = false;
+	_config_version = 1;
 	
 	for (int j=0; j < 20; ++j) {
 		snprintf(tmpstr, sizeof(tmpstr), "%d", _port);
@@ -78,6 +106,20 @@ ControlOSC::ControlOSC(Engine * eng, unsigned int port)
 		continue;
 	}
 
+#ifdef LO_TCP
+	// a stream server on the same port number, for things like audio
+	// transfer where udp is not a good fit
+	if (_osc_server) {
+		snprintf(tmpstr, sizeof(tmpstr), "%d", _port);
+		_osc_tcp_server = lo_server_new_with_proto (tmpstr, LO_TCP, error_callback);
+#ifdef DEBUG
+		if (!_osc_tcp_server) {
+			cerr << "can't get osc tcp at port: " << _port << endl;
+		}
+#endif
+	}
+#endif
+
 	/*** APPEARS sluggish for now
 	     
 	// attempt to create unix socket server too
@@ -128,21 +170,34 @@ ControlOSC::~ControlOSC()
 
 	// stop server thread
 	terminate_osc_thread();
+
+	delete _sender;
+	pthread_mutex_destroy (&_get_answer_lock);
+
+	for (size_t n=0; n < _update_rows.size(); ++n) {
+		delete _update_rows[n];
+	}
 }
 
 void
 ControlOSC::register_callbacks()
 {
-	lo_server srvs[2];
+	lo_server srvs[3];
 	lo_server serv;
 
 	srvs[0] = _osc_server;
 	srvs[1] = _osc_unix_server;
+	srvs[2] = _osc_tcp_server;
 	
-	for (size_t i=0; i < 2; ++i) {
+	for (size_t i=0; i < 3; ++i) {
 		if (!srvs[i]) continue;
 		serv = srvs[i];
 
+#ifdef HAVE_LO_SERVER_ENABLE_QUEUE
+		// dispatch bundles as soon as they arrive, the engine schedules
+		// anything timetagged against the audio clock itself
+		lo_server_enable_queue (serv, 0, 1);
+#endif
 
 		/* add method that will match the path /quit with no args */
 		lo_server_add_method(serv, "/quit", "", ControlOSC::_quit_handler, this);
@@ -161,6 +216,9 @@ ControlOSC::register_callbacks()
 		// save session:  s:filename  s:returl  s:retpath (i:write_audio)
 		lo_server_add_method(serv, "/save_session", "sss", ControlOSC::_save_session_handler, this);
 		lo_server_add_method(serv, "/save_session", "sssi", ControlOSC::_save_session_handler, this);
+
+		// save trace timeline (when built with tracing):  s:filename  s:returl  s:retpath
+		lo_server_add_method(serv, "/save_trace", "sss", ControlOSC::_save_trace_handler, this);
 		
 		// add loop del handler:  i:index 
 		lo_server_add_method(serv, "/loop_del", "i", ControlOSC::_loop_del_handler, this);
@@ -169,6 +227,10 @@ ControlOSC::register_callbacks()
 		lo_server_add_method(serv, "/register", "ss", ControlOSC::_register_config_handler, this);
 		lo_server_add_method(serv, "/unregister", "ss", ControlOSC::_unregister_config_handler, this);
 
+		// loop add/remove deltas instead of pingacks:  s:returl s:retpath
+		lo_server_add_method(serv, "/register_config_delta", "ss", ControlOSC::_register_config_handler, this);
+		lo_server_add_method(serv, "/unregister_config_delta", "ss", ControlOSC::_unregister_config_handler, this);
+
 		lo_server_add_method(serv, "/set", "sf", ControlOSC::_global_set_handler, this);
 		lo_server_add_method(serv, "/get", "sss", ControlOSC::_global_get_handler, this);
 
@@ -182,6 +244,32 @@ ControlOSC::register_callbacks()
 		// certain RT global ctrls
 		lo_server_add_method(serv, "/sl/-2/set", "sf", ControlOSC::_set_handler, new CommandInfo(this, -2, Event::type_global_control_change));
 
+		// loop groups:  s:name  s:returl  s:retpath
+		lo_server_add_method(serv, "/add_group", "sss", ControlOSC::_add_group_handler, this);
+		// s:name  (s:returl  s:retpath)
+		lo_server_add_method(serv, "/remove_group", "s", ControlOSC::_remove_group_handler, this);
+		lo_server_add_method(serv, "/remove_group", "sss", ControlOSC::_remove_group_handler, this);
+		// s:returl  s:retpath
+		lo_server_add_method(serv, "/get_groups", "ss", ControlOSC::_get_groups_handler, this);
+
+		// modulators of every loop:  s:returl  s:retpath
+		lo_server_add_method(serv, "/get_modulators", "ss", ControlOSC::_get_modulators_handler, this);
+
+		// queue depth and lag of every client we send to:  s:returl  s:retpath
+		lo_server_add_method(serv, "/get_osc_stats", "ss", ControlOSC::_get_osc_stats_handler, this);
+
+		// mixes loops into one:  s:loops  i:target  i:clear_sources  (s:returl  s:retpath)
+		lo_server_add_method(serv, "/bounce", "sii", ControlOSC::_bounce_handler, this);
+		lo_server_add_method(serv, "/bounce", "siiss", ControlOSC::_bounce_handler, this);
+
+		// group commands apply to all loops in the group at once:  s:group  s:cmd
+		lo_server_add_method(serv, "/group/down", "ss", ControlOSC::_group_updown_handler, new CommandInfo(this, -4, Event::type_cmd_down));
+		lo_server_add_method(serv, "/group/up", "ss", ControlOSC::_group_updown_handler, new CommandInfo(this, -4, Event::type_cmd_up));
+		lo_server_add_method(serv, "/group/hit", "ss", ControlOSC::_group_updown_handler, new CommandInfo(this, -4, Event::type_cmd_hit));
+		lo_server_add_method(serv, "/group/upforce", "ss", ControlOSC::_group_updown_handler, new CommandInfo(this, -4, Event::type_cmd_upforce));
+		// s:group  s:ctrl  f:value   ("gain" is the group output gain)
+		lo_server_add_method(serv, "/group/set", "ssf", ControlOSC::_group_set_handler, this);
+
 		// get all midi bindings:  s:returl s:retpath
 		lo_server_add_method(serv, "/get_all_midi_bindings", "ss", ControlOSC::_midi_binding_handler,
 				     new MidiBindCommand(this, MidiBindCommand::GetAllBinding));
@@ -227,7 +315,17 @@ ControlOSC::register_callbacks()
 		lo_server_add_method(serv, "/sl/midi_start", NULL, ControlOSC::_midi_start_handler, this);
 		lo_server_add_method(serv, "/sl/midi_stop", NULL, ControlOSC::_midi_stop_handler, this);
 		lo_server_add_method(serv, "/sl/midi_tick", NULL, ControlOSC::_midi_tick_handler, this);
-	
+
+		// brother sync:  s:leader_url  (empty to stop following)
+		lo_server_add_method(serv, "/brother_follow", "s", ControlOSC::_brother_handler, this);
+		// sent by followers to a leader:  s:follower_url
+		lo_server_add_method(serv, "/brother_register", "s", ControlOSC::_brother_handler, this);
+		lo_server_add_method(serv, "/brother_unregister", "s", ControlOSC::_brother_handler, this);
+		// sent by a leader:  d:hosttime  d:beats  d:tempo
+		lo_server_add_method(serv, "/sl/brother_clock", "ddd", ControlOSC::_brother_clock_handler, this);
+		// round trip for the clock offset:  s:follower_url  d:sent,  answered with d:sent  d:hosttime
+		lo_server_add_method(serv, "/brother_ping", "sd", ControlOSC::_brother_clock_handler, this);
+		lo_server_add_method(serv, "/sl/brother_pong", "dd", ControlOSC::_brother_clock_handler, this);
 	}
 }
 
@@ -291,80 +389,201 @@ ControlOSC::on_loop_added (int instance, bool sendupdate)
 #ifdef DEBUG
 	cerr << "loop added: " << instance << endl;
 #endif
-	lo_server srvs[2];
+	lo_server srvs[3];
 	lo_server serv;
 
-	if (instance >= 0 && instance < _max_instance) {
-		// already added this method
-		if (sendupdate) {
-			send_all_config();
+	// the methods every loop gets under /sl/<n>/
+	static const struct {
+		const char *      name;
+		const char *      types;
+		lo_method_handler handler;
+		Event::type_t     type;
+	} methods[] = {
+		{ "down", "s", ControlOSC::_updown_handler, Event::type_cmd_down },
+		{ "up", "s", ControlOSC::_updown_handler, Event::type_cmd_up },
+		{ "hit", "s", ControlOSC::_updown_handler, Event::type_cmd_hit },
+		{ "upforce", "s", ControlOSC::_updown_handler, Event::type_cmd_upforce },
+		{ "set", "sf", ControlOSC::_set_handler, Event::type_control_change },
+		{ "get", "sss", ControlOSC::_get_handler, Event::type_control_request },
+		// load loop:  s:filename  s:returl  s:retpath
+		{ "load_loop", "sss", ControlOSC::_loadloop_handler, Event::type_control_request },
+		// save loop:  s:filename  s:format s:endian s:returl  s:retpath
+		{ "save_loop", "sssss", ControlOSC::_saveloop_handler, Event::type_control_request },
+		// get audio:  s:format  s:returl  s:retpath
+		{ "get_audio", "sss", ControlOSC::_get_audio_handler, Event::type_control_request },
+		// put audio:  i:upload_id  i:channels  i:total_frames  i:offset  s:format  b:data  s:returl  s:retpath
+		{ "put_audio", "iiiisbss", ControlOSC::_put_audio_handler, Event::type_control_request },
+		// set modulator:  s:ctrl  s:shape  f:beats  f:depth  f:center  f:param  (s:returl  s:retpath)
+		{ "set_modulator", "ssffff", ControlOSC::_set_modulator_handler, Event::type_control_request },
+		{ "set_modulator", "ssffffss", ControlOSC::_set_modulator_handler, Event::type_control_request },
+		// remove modulator:  s:ctrl  (s:returl  s:retpath)
+		{ "remove_modulator", "s", ControlOSC::_remove_modulator_handler, Event::type_control_request },
+		{ "remove_modulator", "sss", ControlOSC::_remove_modulator_handler, Event::type_control_request },
+		// trigger modulator:  s:ctrl
+		{ "trigger_modulator", "s", ControlOSC::_trigger_modulator_handler, Event::type_control_request },
+		// register_update args= s:ctrl s:returl s:retpath
+		{ "register_update", "sss", ControlOSC::_register_update_handler, Event::type_control_request },
+		{ "unregister_update", "sss", ControlOSC::_unregister_update_handler, Event::type_control_request },
+		// register_auto_update args= s:ctrl i:millisec s:returl s:retpath
+		{ "register_auto_update", "siss", ControlOSC::_register_auto_update_handler, Event::type_control_request },
+		{ "unregister_auto_update", "sss", ControlOSC::_unregister_auto_update_handler, Event::type_control_request },
+	};
+
+	if (instance >= 0) {
+		// the engine already has it.  the clients hear about it with the
+		// rest of the batch from flush_config_changes()
+		begin_config_change (_engine->loop_count() - 1);
+		_config_origin.push_back (-1);
+
+		apply_update_rules (instance);
+
+		if (instance < _max_instance) {
+			// an earlier loop at this index left its methods, they stay
+			return;
 		}
-		return;
+		_max_instance = instance + 1;
 	}
 	
 	srvs[0] = _osc_server;
 	srvs[1] = _osc_unix_server;
+	srvs[2] = _osc_tcp_server;
 	
-	for (size_t i=0; i < 2; ++i) {
+	for (size_t i=0; i < 3; ++i) {
 		if (!srvs[i]) continue;
 		serv = srvs[i];
-		
-		snprintf(tmpstr, sizeof(tmpstr), "/sl/%d/down", instance);
-		lo_server_add_method(serv, tmpstr, "s", ControlOSC::_updown_handler, new CommandInfo(this, instance, Event::type_cmd_down));
-	
-		snprintf(tmpstr, sizeof(tmpstr), "/sl/%d/up", instance);
-		lo_server_add_method(serv, tmpstr, "s", ControlOSC::_updown_handler, new CommandInfo(this, instance, Event::type_cmd_up));
 
-		snprintf(tmpstr, sizeof(tmpstr), "/sl/%d/hit", instance);
-		lo_server_add_method(serv, tmpstr, "s", ControlOSC::_updown_handler, new CommandInfo(this, instance, Event::type_cmd_hit));
-		
-		snprintf(tmpstr, sizeof(tmpstr), "/sl/%d/upforce", instance);
-		lo_server_add_method(serv, tmpstr, "s", ControlOSC::_updown_handler, new CommandInfo(this, instance, Event::type_cmd_upforce));
-		
-		snprintf(tmpstr, sizeof(tmpstr), "/sl/%d/set", instance);
-		lo_server_add_method(serv, tmpstr, "sf", ControlOSC::_set_handler, new CommandInfo(this, instance, Event::type_control_change));
-	
-		snprintf(tmpstr, sizeof(tmpstr), "/sl/%d/get", instance);
-		lo_server_add_method(serv, tmpstr, "sss", ControlOSC::_get_handler, new CommandInfo(this, instance, Event::type_control_request));
+		for (size_t n=0; n < sizeof(methods)/sizeof(methods[0]); ++n) {
+			snprintf(tmpstr, sizeof(tmpstr), "/sl/%d/%s", instance, methods[n].name);
+			lo_server_add_method(serv, tmpstr, methods[n].types, methods[n].handler, new CommandInfo(this, instance, methods[n].type));
+		}
 
-		// load loop:  s:filename  s:returl  s:retpath
-		snprintf(tmpstr, sizeof(tmpstr), "/sl/%d/load_loop", instance);
-		lo_server_add_method(serv, tmpstr, "sss", ControlOSC::_loadloop_handler, new CommandInfo(this, instance, Event::type_control_request));
+		if (instance == -1) {
+			// the all loops rule can be limited to a range:  ... i:first i:last
+			lo_server_add_method(serv, "/sl/-1/register_update", "sssii", ControlOSC::_register_update_handler, new CommandInfo(this, instance, Event::type_control_request));
+			lo_server_add_method(serv, "/sl/-1/unregister_update", "sssii", ControlOSC::_unregister_update_handler, new CommandInfo(this, instance, Event::type_control_request));
+			lo_server_add_method(serv, "/sl/-1/register_auto_update", "sissii", ControlOSC::_register_auto_update_handler, new CommandInfo(this, instance, Event::type_control_request));
+			lo_server_add_method(serv, "/sl/-1/unregister_auto_update", "sssii", ControlOSC::_unregister_auto_update_handler, new CommandInfo(this, instance, Event::type_control_request));
+		}
+	}
+}
 
-		// save loop:  s:filename  s:format s:endian s:returl  s:retpath
-		snprintf(tmpstr, sizeof(tmpstr), "/sl/%d/save_loop", instance);
-		lo_server_add_method(serv, tmpstr, "sssss", ControlOSC::_saveloop_handler, new CommandInfo(this, instance, Event::type_control_request));
-	
-		// register_update args= s:ctrl s:returl s:retpath
-		snprintf(tmpstr, sizeof(tmpstr), "/sl/%d/register_update", instance);
-		lo_server_add_method(serv, tmpstr, "sss", ControlOSC::_register_update_handler, new CommandInfo(this, instance, Event::type_control_request));
+void
+ControlOSC::on_loop_removed (int instance)
+{
+	// will be called from main event loop, the engine already dropped it
+	begin_config_change (_engine->loop_count() + 1);
 
-		// unregister_update args= s:ctrl s:returl s:retpath
-		snprintf(tmpstr, sizeof(tmpstr), "/sl/%d/unregister_update", instance);
-		lo_server_add_method(serv, tmpstr, "sss", ControlOSC::_unregister_update_handler, new CommandInfo(this, instance, Event::type_control_request));
+	if (instance >= 0 && instance < (int) _config_origin.size()) {
+		_config_origin.erase (_config_origin.begin() + instance);
+	}
 
-		// register_audo_update args= s:ctrl i:millisec s:returl s:retpath
-		snprintf(tmpstr, sizeof(tmpstr), "/sl/%d/register_auto_update", instance);
-		lo_server_add_method(serv, tmpstr, "siss", ControlOSC::_register_auto_update_handler, new CommandInfo(this, instance, Event::type_control_request));
+	// the remove request cleared the row's on change registrations, see
+	// finish_loop_config_event().  the loop that moved into its place gets
+	// back what the rules give it
+	if (instance >= 0 && instance < (int) _engine->loop_count()) {
+		apply_update_rules (instance);
+	}
+}
 
-		// unregister_auto_update args= s:ctrl s:returl s:retpath
-		snprintf(tmpstr, sizeof(tmpstr), "/sl/%d/unregister_auto_update", instance);
-		lo_server_add_method(serv, tmpstr, "sss", ControlOSC::_unregister_auto_update_handler, new CommandInfo(this, instance, Event::type_control_request));
+void
+ControlOSC::begin_config_change (int old_count)
+{
+	// main loop only
+	gettimeofday (&_config_last_change, NULL);
 
+	if (_config_dirty) {
+		return;
 	}
 
-	_max_instance = instance + 1;
-	
-	if (sendupdate) {
-		send_all_config();
+	_config_dirty = true;
+	_config_first_change = _config_last_change;
+	_config_old_count = old_count;
+
+	_config_origin.resize (old_count);
+	for (int n=0; n < old_count; ++n) {
+		_config_origin[n] = n;
 	}
 }
 
 void
-ControlOSC::on_loop_removed ()
+ControlOSC::flush_config_changes (const struct timeval & now)
 {
-	// will be called from main event loop
+	if (!_config_dirty) {
+		return;
+	}
+
+	struct timeval quiet, pending;
+	timersub (&now, &_config_last_change, &quiet);
+	timersub (&now, &_config_first_change, &pending);
+
+	if (quiet.tv_sec == 0 && quiet.tv_usec < CONFIG_SETTLE_MSECS * 1000
+	    && pending.tv_sec == 0 && pending.tv_usec < CONFIG_MAX_DELAY_MSECS * 1000)
+	{
+		// still coming in
+		return;
+	}
+
+	// removed are in the old numbering, added in the new one
+	vector<int> removed, added;
+	vector<bool> kept (_config_old_count, false);
+
+	for (size_t n=0; n < _config_origin.size(); ++n) {
+		if (_config_origin[n] < 0) {
+			added.push_back (n);
+		}
+		else {
+			kept[_config_origin[n]] = true;
+		}
+	}
+	for (int n=0; n < _config_old_count; ++n) {
+		if (!kept[n]) {
+			removed.push_back (n);
+		}
+	}
+
+	_config_dirty = false;
+	_config_origin.clear();
+
+	if (removed.empty() && added.empty()) {
+		return;
+	}
+
+	++_config_version;
+
+	// old style registrations get a pingack and resync everything
 	send_all_config();
+
+	for (AddressList::iterator iter = _config_delta_registrations.begin(); iter != _config_delta_registrations.end(); ++iter)
+	{
+		send_config_delta (*iter, _engine->loop_count(), removed, added);
+	}
+}
+
+void
+ControlOSC::send_config_delta (const AddrPathPair & dest, int loopcount, const vector<int> & removed, const vector<int> & added)
+{
+	// s:hosturl i:engine_id i:version i:loopcount i:nremoved  i:removed...  i:added...
+	lo_address addr = find_or_cache_addr (dest.first);
+	if (!addr) {
+		return;
+	}
+
+	string oururl = get_server_url();
+	lo_message msg = lo_message_new();
+
+	lo_message_add_string (msg, oururl.c_str());
+	lo_message_add_int32 (msg, _engine->get_id());
+	lo_message_add_int32 (msg, (int) _config_version);
+	lo_message_add_int32 (msg, loopcount);
+	lo_message_add_int32 (msg, (int) removed.size());
+	for (size_t n=0; n < removed.size(); ++n) {
+		lo_message_add_int32 (msg, removed[n]);
+	}
+	for (size_t n=0; n < added.size(); ++n) {
+		lo_message_add_int32 (msg, added[n]);
+	}
+
+	_sender->send (dest.first, dest.second, msg);
 }
 
 
@@ -383,6 +602,21 @@ ControlOSC::get_server_url()
 	return url;
 }
 
+std::string
+ControlOSC::get_tcp_server_url()
+{
+	string url;
+	char * urlstr;
+
+	if (_osc_tcp_server) {
+		urlstr = lo_server_get_url (_osc_tcp_server);
+		url = urlstr;
+		free (urlstr);
+	}
+	
+	return url;
+}
+
 std::string
 ControlOSC::get_unix_server_url()
 {
@@ -411,12 +645,15 @@ ControlOSC::_osc_receiver(void * arg)
 void
 ControlOSC::osc_receiver()
 {
-	struct pollfd pfd[3];
-	int fds[3];
-	lo_server srvs[3];
+	struct pollfd pfd[4];
+	int fds[4];
+	lo_server srvs[4];
 	int nfds = 0;
 	int timeout = -1;
 	int ret;
+	int tcpidx = -1;
+
+	SL_TRACE_THREAD("osc");
 	
 	fds[0] = _request_pipe[0];
 	nfds++;
@@ -432,19 +669,48 @@ ControlOSC::osc_receiver()
 		srvs[nfds] = _osc_unix_server;
 		nfds++;
 	}
+
+	if (_osc_tcp_server && lo_server_get_socket_fd(_osc_tcp_server) >= 0) {
+		// only the listening socket is visible to us, the connected
+		// sockets are serviced by liblo itself, so we need to poll it regularly
+		fds[nfds] = lo_server_get_socket_fd(_osc_tcp_server);
+		srvs[nfds] = _osc_tcp_server;
+		tcpidx = nfds;
+		nfds++;
+		timeout = AUTO_UPDATE_MIN;
+	}
 	
 	
 	while (!_shutdown) {
 
+		int waitms = timeout;
+
+		if (!_get_batches.empty()) {
+			int due = get_batch_wait_ms();
+			if (due >= 0 && (waitms < 0 || due < waitms)) {
+				waitms = due;
+			}
+		}
+		
 		for (int i=0; i < nfds; ++i) {
 			pfd[i].fd = fds[i];
 			pfd[i].events = POLLIN|POLLPRI|POLLHUP|POLLERR;
 			pfd[i].revents = 0;
+
+#ifndef HAVE_LO_SERVER_ENABLE_QUEUE
+			// liblo holds future bundles itself, wake up when the next one is due
+			if (i > 0 && lo_server_events_pending (srvs[i])) {
+				int due = (int) (lo_server_next_event_delay (srvs[i]) * 1000.0) + 1;
+				if (waitms < 0 || due < waitms) {
+					waitms = due;
+				}
+			}
+#endif
 		}
 		
 	again:
-		//cerr << "poll on " << nfds << " for " << timeout << endl;
-		if ((ret = poll (pfd, nfds, timeout)) < 0) {
+		//cerr << "poll on " << nfds << " for " << waitms << endl;
+		if ((ret = poll (pfd, nfds, waitms)) < 0) {
 			if (errno == EINTR) {
 				/* gdb at work, perhaps */
 				cerr << "EINTR hit " << endl;
@@ -466,18 +732,43 @@ ControlOSC::osc_receiver()
 			cerr << "OSC: error polling extra port" << endl;
 			break;
 		}
+
+		if (pfd[0].revents & POLLIN) {
+			char buf[64];
+			while (read (_request_pipe[0], buf, sizeof(buf)) > 0) {}
+			take_get_answers();
+		}
 		
 		for (int i=1; i < nfds; ++i) {
-			if (pfd[i].revents & POLLIN)
+			if (i == tcpidx) {
+				// handles new connections and any pending messages without blocking
+				SL_TRACE_SCOPE("osc tcp dispatch");
+				while (lo_server_recv_noblock (srvs[i], 0) > 0) {}
+			}
+			else if (pfd[i].revents & POLLIN)
 			{
+				SL_TRACE_SCOPE("osc dispatch");
 				// this invokes callbacks
 				//cerr << "invoking recv on " << pfd[i].fd << endl;
 				lo_server_recv(srvs[i]);
 			}
+#ifndef HAVE_LO_SERVER_ENABLE_QUEUE
+			else if (lo_server_events_pending (srvs[i])) {
+				// dispatches any held bundles that are now due
+				lo_server_recv_noblock (srvs[i], 0);
+			}
+#endif
 		}
 
+		if (!_get_batches.empty() && get_batch_wait_ms() == 0) {
+			flush_get_replies();
+		}
 	}
 
+	// what the main loop still owes us is dropped
+	flush_get_replies();
+	_get_batches.clear();
+
 	//cerr << "SL engine shutdown" << endl;
 	
 	if (_osc_server) {
@@ -490,6 +781,11 @@ ControlOSC::osc_receiver()
 		_osc_server = 0;
 	}
 
+	if (_osc_tcp_server) {
+		lo_server_free (_osc_tcp_server);
+		_osc_tcp_server = 0;
+	}
+
 	if (_osc_unix_server) {
 		cerr << "freeing unix server" << endl;
 		lo_server_free (_osc_unix_server);
@@ -523,6 +819,13 @@ int ControlOSC::_quit_handler(const char *path, const char *types, lo_arg **argv
 
 }
 
+int ControlOSC::_save_trace_handler(const char *path, const char *types, lo_arg **argv, int argc,
+			 void *data, void *user_data)
+{
+	ControlOSC * osc = static_cast<ControlOSC*> (user_data);
+	return osc->save_trace_handler (path, types, argv, argc, data);
+}
+
 int ControlOSC::_ping_handler(const char *path, const char *types, lo_arg **argv, int argc,
 			 void *data, void *user_data)
 {
@@ -554,6 +857,41 @@ int ControlOSC::_updown_handler(const char *path, const char *types, lo_arg **ar
 	return cp->osc->updown_handler (path, types, argv, argc, data, cp);
 }
 
+int ControlOSC::_group_updown_handler(const char *path, const char *types, lo_arg **argv, int argc,
+			 void *data, void *user_data)
+{
+	CommandInfo * cp = static_cast<CommandInfo*> (user_data);
+	return cp->osc->group_updown_handler (path, types, argv, argc, data, cp);
+}
+
+int ControlOSC::_group_set_handler(const char *path, const char *types, lo_arg **argv, int argc,
+			 void *data, void *user_data)
+{
+	ControlOSC * osc = static_cast<ControlOSC*> (user_data);
+	return osc->group_set_handler (path, types, argv, argc, data);
+}
+
+int ControlOSC::_add_group_handler(const char *path, const char *types, lo_arg **argv, int argc,
+			 void *data, void *user_data)
+{
+	ControlOSC * osc = static_cast<ControlOSC*> (user_data);
+	return osc->add_group_handler (path, types, argv, argc, data);
+}
+
+int ControlOSC::_remove_group_handler(const char *path, const char *types, lo_arg **argv, int argc,
+			 void *data, void *user_data)
+{
+	ControlOSC * osc = static_cast<ControlOSC*> (user_data);
+	return osc->remove_group_handler (path, types, argv, argc, data);
+}
+
+int ControlOSC::_get_groups_handler(const char *path, const char *types, lo_arg **argv, int argc,
+			 void *data, void *user_data)
+{
+	ControlOSC * osc = static_cast<ControlOSC*> (user_data);
+	return osc->get_groups_handler (path, types, argv, argc, data);
+}
+
 int ControlOSC::_set_handler(const char *path, const char *types, lo_arg **argv, int argc,
 			 void *data, void *user_data)
 {
@@ -645,6 +983,57 @@ int ControlOSC::_saveloop_handler(const char *path, const char *types, lo_arg **
 	return cp->osc->saveloop_handler (path, types, argv, argc, data, cp);
 }
 
+int ControlOSC::_get_audio_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data)
+{
+	CommandInfo * cp = static_cast<CommandInfo*> (user_data);
+	return cp->osc->get_audio_handler (path, types, argv, argc, data, cp);
+}
+
+int ControlOSC::_put_audio_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data)
+{
+	CommandInfo * cp = static_cast<CommandInfo*> (user_data);
+	return cp->osc->put_audio_handler (path, types, argv, argc, data, cp);
+}
+
+int ControlOSC::_set_modulator_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data)
+{
+	CommandInfo * cp = static_cast<CommandInfo*> (user_data);
+	return cp->osc->set_modulator_handler (path, types, argv, argc, data, cp);
+}
+
+int ControlOSC::_remove_modulator_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data)
+{
+	CommandInfo * cp = static_cast<CommandInfo*> (user_data);
+	return cp->osc->remove_modulator_handler (path, types, argv, argc, data, cp);
+}
+
+int ControlOSC::_trigger_modulator_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data)
+{
+	CommandInfo * cp = static_cast<CommandInfo*> (user_data);
+	return cp->osc->trigger_modulator_handler (path, types, argv, argc, data, cp);
+}
+
+int ControlOSC::_get_modulators_handler(const char *path, const char *types, lo_arg **argv, int argc,
+			 void *data, void *user_data)
+{
+	ControlOSC * osc = static_cast<ControlOSC*> (user_data);
+	return osc->get_modulators_handler (path, types, argv, argc, data);
+}
+
+int ControlOSC::_get_osc_stats_handler(const char *path, const char *types, lo_arg **argv, int argc,
+			 void *data, void *user_data)
+{
+	ControlOSC * osc = static_cast<ControlOSC*> (user_data);
+	return osc->get_osc_stats_handler (path, types, argv, argc, data);
+}
+
+int ControlOSC::_bounce_handler(const char *path, const char *types, lo_arg **argv, int argc,
+			 void *data, void *user_data)
+{
+	ControlOSC * osc = static_cast<ControlOSC*> (user_data);
+	return osc->bounce_handler (path, types, argv, argc, data);
+}
+
 int ControlOSC::_global_register_update_handler(const char *path, const char *types, lo_arg **argv, int argc,
 			 void *data, void *user_data)
 {
@@ -695,6 +1084,20 @@ int ControlOSC::_midi_tick_handler(const char *path, const char *types, lo_arg *
 	return osc->midi_tick_handler (path, types, argv, argc, data);
 }
 
+int ControlOSC::_brother_handler(const char *path, const char *types, lo_arg **argv, int argc,
+				    void *data, void *user_data)
+{
+	ControlOSC * osc = static_cast<ControlOSC*> (user_data);
+	return osc->brother_handler (path, types, argv, argc, data);
+}
+
+int ControlOSC::_brother_clock_handler(const char *path, const char *types, lo_arg **argv, int argc,
+				    void *data, void *user_data)
+{
+	ControlOSC * osc = static_cast<ControlOSC*> (user_data);
+	return osc->brother_clock_handler (path, types, argv, argc, data);
+}
+
 int ControlOSC::_midi_binding_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data)
 {
 	MidiBindCommand * cp = static_cast<MidiBindCommand*> (user_data);
@@ -710,6 +1113,22 @@ int ControlOSC::quit_handler(const char *path, const char *types, lo_arg **argv,
 	return 0;
 }
 
+int ControlOSC::save_trace_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
+{
+	string fname (&argv[0]->s);
+	string returl (&argv[1]->s);
+	string retpath (&argv[2]->s);
+
+	validate_returl(returl);
+
+	// the file is written on a worker, a big trace takes a while
+	if (!_engine->queue_trace_save (fname, returl, retpath)) {
+		send_error (returl, retpath, "Trace Save Failed: busy");
+	}
+	
+	return 0;
+}
+
 
 int ControlOSC::ping_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
 {
@@ -778,7 +1197,7 @@ ControlOSC::global_register_update_handler(const char *path, const char *types,
 
 	// push this onto a queue for the main event loop to process
 	// -2 means global
-	_engine->push_nonrt_event ( new ConfigUpdateEvent (ConfigUpdateEvent::Register, -2, _cmd_map->to_control_t(ctrl), returl, retpath));
+	push_update_event (ConfigUpdateEvent::Register, -2, ctrl, returl, retpath);
 
 	return 0;
 }
@@ -795,7 +1214,7 @@ ControlOSC::global_unregister_update_handler(const char *path, const char *types
 
 	// push this onto a queue for the main event loop to process
 	// -2 means global
-	_engine->push_nonrt_event ( new ConfigUpdateEvent (ConfigUpdateEvent::Unregister, -2, _cmd_map->to_control_t(ctrl), returl, retpath));
+	push_update_event (ConfigUpdateEvent::Unregister, -2, ctrl, returl, retpath);
 
 	return 0;
 }
@@ -822,7 +1241,7 @@ ControlOSC::global_register_auto_update_handler(const char *path, const char *ty
 
 	// push this onto a queue for the main event loop to process
 	// -2 means global
-	_engine->push_nonrt_event ( new ConfigUpdateEvent (ConfigUpdateEvent::RegisterAuto, -2, _cmd_map->to_control_t(ctrl), returl, retpath,0.0,-1, millisec));
+	push_update_event (ConfigUpdateEvent::RegisterAuto, -2, ctrl, returl, retpath, millisec);
 
 	return 0;
 }
@@ -839,7 +1258,7 @@ ControlOSC::global_unregister_auto_update_handler(const char *path, const char *
 
 	// push this onto a queue for the main event loop to process
 	// -2 means global
-	_engine->push_nonrt_event ( new ConfigUpdateEvent (ConfigUpdateEvent::UnregisterAuto, -2, _cmd_map->to_control_t(ctrl), returl, retpath));
+	push_update_event (ConfigUpdateEvent::UnregisterAuto, -2, ctrl, returl, retpath);
 
 	return 0;
 }
@@ -946,10 +1365,37 @@ ControlOSC::midi_binding_handler(const char *path, const char *types, lo_arg **a
 }
 
 
+MIDI::timestamp_t
+ControlOSC::message_time (void * data)
+{
+	// the bundle timetag of the message as host time plus the safety
+	// offset, or 0 for messages that should happen immediately
+#ifdef HAVE_LO_MESSAGE_GET_TIMESTAMP
+	lo_timetag tt = lo_message_get_timestamp ((lo_message) data);
+
+	if (tt.sec == 0) {
+		return 0;
+	}
+
+	// NTP epoch is 1900, host time (gettimeofday) is 1970
+	MIDI::timestamp_t when = (MIDI::timestamp_t) (tt.sec - 2208988800UL) + (tt.frac / 4294967296.0) + _engine->get_timetag_offset();
+
+	// a timetag far ahead is most likely a broken clock, it would hold
+	// its event (and the queue space) for that long
+	struct timeval now;
+	gettimeofday (&now, NULL);
+	MIDI::timestamp_t horizon = now.tv_sec + now.tv_usec * 1e-6 + TIMETAG_HORIZON;
+
+	return min (when, horizon);
+#else
+	return 0;
+#endif
+}
+
 int
 ControlOSC::midi_start_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
 {
-	_engine->push_sync_event (Event::MidiStart);
+	_engine->push_sync_event (Event::MidiStart, -1, message_time (data));
 	return 0;
 }
 
@@ -957,7 +1403,7 @@ ControlOSC::midi_start_handler(const char *path, const char *types, lo_arg **arg
 int
 ControlOSC::midi_stop_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
 {
-	_engine->push_sync_event (Event::MidiStop);
+	_engine->push_sync_event (Event::MidiStop, -1, message_time (data));
 	return 0;
 }
 
@@ -965,10 +1411,52 @@ ControlOSC::midi_stop_handler(const char *path, const char *types, lo_arg **argv
 int
 ControlOSC::midi_tick_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
 {
-	_engine->push_sync_event (Event::MidiTick);
+	_engine->push_sync_event (Event::MidiTick, -1, message_time (data));
+	return 0;
+}
+
+
+int
+ControlOSC::brother_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
+{
+	string url (&argv[0]->s);
+	string spath (path);
+	BrotherSyncEvent::Type type = BrotherSyncEvent::Follow;
+
+	if (spath == "/brother_register") {
+		type = BrotherSyncEvent::Register;
+	}
+	else if (spath == "/brother_unregister") {
+		type = BrotherSyncEvent::Unregister;
+	}
+
+	_engine->push_nonrt_event (new BrotherSyncEvent (type, url));
 	return 0;
 }
 
+int
+ControlOSC::brother_clock_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
+{
+	BrotherClock::ClockState state;
+
+	// all of these only touch state the osc thread owns, safe from here.
+	// pings are answered right here, queueing them would skew the round trip
+	if (strcmp (path, "/brother_ping") == 0) {
+		_engine->get_brother_clock()->answer_ping (&argv[0]->s, argv[1]->d);
+		return 0;
+	}
+	else if (strcmp (path, "/sl/brother_pong") == 0) {
+		_engine->get_brother_clock()->receive_pong (argv[0]->d, argv[1]->d);
+		return 0;
+	}
+
+	state.hosttime = argv[0]->d;
+	state.beats = argv[1]->d;
+	state.tempo = argv[2]->d;
+
+	_engine->get_brother_clock()->receive (state);
+	return 0;
+}
 
 int ControlOSC::updown_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, CommandInfo *info)
 {
@@ -976,34 +1464,223 @@ int ControlOSC::updown_handler(const char *path, const char *types, lo_arg **arg
 	
 	string cmd(&argv[0]->s);
 
-	_engine->push_command_event(info->type, _cmd_map->to_command_t(cmd), info->instance);
+	_engine->push_command_event(info->type, _cmd_map->to_command_t(cmd), info->instance, message_time (data));
 	
 	return 0;
 }
 
 
-int ControlOSC::set_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, CommandInfo *info)
+int ControlOSC::group_updown_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, CommandInfo *info)
 {
+	// s:group  s:cmd
+	string name(&argv[0]->s);
+	string cmd(&argv[1]->s);
 
-	// first arg is a control string, 2nd is float val
-
-	string ctrl(&argv[0]->s);
-	float val  = argv[1]->f;
-	lo_message msg = (lo_message) data;
-	lo_address srcaddr = lo_message_get_source (msg);
-	const char * sport = lo_address_get_port(srcaddr);
-	int srcport = atoi(sport);
-	//cerr << "source is " << srcport << endl;
+	int group = _engine->find_loop_group (name);
+	if (group < 0) {
+		return 0;
+	}
 
-	_engine->push_control_event(info->type, _cmd_map->to_control_t(ctrl), val, info->instance, srcport);
+	_engine->push_group_command_event(info->type, _cmd_map->to_command_t(cmd), group, message_time (data));
 	
 	return 0;
-
 }
 
-int ControlOSC::loop_add_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
+int ControlOSC::group_set_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
 {
-	// 1st is an int #channels
+	// s:group  s:ctrl  f:val
+	string name(&argv[0]->s);
+	string ctrl(&argv[1]->s);
+	float val  = argv[2]->f;
+
+	int group = _engine->find_loop_group (name);
+	if (group < 0) {
+		return 0;
+	}
+
+	Event::control_t ctrltype = (ctrl == "gain") ? Event::GroupGain : _cmd_map->to_control_t(ctrl);
+
+	_engine->push_group_control_event(Event::type_control_change, ctrltype, val, group, 0, message_time (data));
+	
+	return 0;
+}
+
+int ControlOSC::add_group_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
+{
+	// s:name  s:returl  s:retpath
+	string name (&argv[0]->s);
+	string returl (&argv[1]->s);
+	string retpath (&argv[2]->s);
+
+	validate_returl(returl);
+
+	_engine->push_nonrt_event ( new LoopGroupEvent (LoopGroupEvent::Add, name, returl, retpath));
+
+	return 0;
+}
+
+int ControlOSC::remove_group_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
+{
+	// s:name  (s:returl  s:retpath)
+	string name (&argv[0]->s);
+	string returl, retpath;
+
+	if (argc > 2) {
+		returl = &argv[1]->s;
+		retpath = &argv[2]->s;
+		validate_returl(returl);
+	}
+
+	_engine->push_nonrt_event ( new LoopGroupEvent (LoopGroupEvent::Remove, name, returl, retpath));
+
+	return 0;
+}
+
+int ControlOSC::get_groups_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
+{
+	// s:returl  s:retpath
+	string returl (&argv[0]->s);
+	string retpath (&argv[1]->s);
+
+	validate_returl(returl);
+
+	_engine->push_nonrt_event ( new LoopGroupEvent (LoopGroupEvent::GetAll, "", returl, retpath));
+
+	return 0;
+}
+
+int ControlOSC::set_modulator_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, CommandInfo *info)
+{
+	// s:ctrl  s:shape  f:beats  f:depth  f:center  f:param  (s:returl  s:retpath)
+	string ctrl (&argv[0]->s);
+	string returl, retpath;
+
+	if (argc > 7) {
+		returl = &argv[6]->s;
+		retpath = &argv[7]->s;
+		validate_returl(returl);
+	}
+
+	ModulatorEvent * ev = new ModulatorEvent (ModulatorEvent::Set, info->instance, _cmd_map->to_control_t(ctrl), returl, retpath);
+	ev->shape = &argv[1]->s;
+	ev->beats = argv[2]->f;
+	ev->depth = argv[3]->f;
+	ev->center = argv[4]->f;
+	ev->param = argv[5]->f;
+
+	_engine->push_nonrt_event (ev);
+
+	return 0;
+}
+
+int ControlOSC::remove_modulator_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, CommandInfo *info)
+{
+	// s:ctrl  (s:returl  s:retpath)
+	string ctrl (&argv[0]->s);
+	string returl, retpath;
+
+	if (argc > 2) {
+		returl = &argv[1]->s;
+		retpath = &argv[2]->s;
+		validate_returl(returl);
+	}
+
+	_engine->push_nonrt_event ( new ModulatorEvent (ModulatorEvent::Remove, info->instance, _cmd_map->to_control_t(ctrl), returl, retpath));
+
+	return 0;
+}
+
+int ControlOSC::trigger_modulator_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, CommandInfo *info)
+{
+	// s:ctrl
+	string ctrl (&argv[0]->s);
+
+	_engine->push_nonrt_event ( new ModulatorEvent (ModulatorEvent::Trigger, info->instance, _cmd_map->to_control_t(ctrl)));
+
+	return 0;
+}
+
+int ControlOSC::get_modulators_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
+{
+	// s:returl  s:retpath
+	string returl (&argv[0]->s);
+	string retpath (&argv[1]->s);
+
+	validate_returl(returl);
+
+	_engine->push_nonrt_event ( new ModulatorEvent (ModulatorEvent::GetAll, -1, Event::Unknown, returl, retpath));
+
+	return 0;
+}
+
+int ControlOSC::get_osc_stats_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
+{
+	// s:returl  s:retpath
+	string returl (&argv[0]->s);
+	string retpath (&argv[1]->s);
+
+	validate_returl(returl);
+
+	// the sender keeps these under its own lock, no need for the main loop
+	vector<OscSender::ClientStats> stats;
+	_sender->get_stats (stats);
+
+	vector<lo_message> msgs;
+	for (size_t n=0; n < stats.size(); ++n) {
+		OscSender::ClientStats & st = stats[n];
+		lo_message msg = lo_message_new();
+		lo_message_add (msg, "siiiiiifff", st.url.c_str(), (int) st.queued, (int) st.max_queued,
+				(int) st.sent, (int) st.coalesced, (int) st.dropped, (int) st.failed,
+				(float) st.lag_ms, (float) st.max_lag_ms, (float) st.waiting_ms);
+		msgs.push_back (msg);
+	}
+
+	if (!msgs.empty()) {
+		_sender->send_bundle (returl, retpath, msgs);
+	}
+
+	return 0;
+}
+
+int ControlOSC::bounce_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
+{
+	// s:loops  i:target  i:clear_sources  (s:returl  s:retpath)
+	string loops (&argv[0]->s);
+	string returl, retpath;
+
+	if (argc > 4) {
+		returl = &argv[3]->s;
+		retpath = &argv[4]->s;
+		validate_returl(returl);
+	}
+
+	_engine->push_nonrt_event ( new BounceEvent (loops, argv[1]->i, argv[2]->i != 0, returl, retpath));
+
+	return 0;
+}
+
+int ControlOSC::set_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, CommandInfo *info)
+{
+
+	// first arg is a control string, 2nd is float val
+
+	string ctrl(&argv[0]->s);
+	float val  = argv[1]->f;
+	lo_message msg = (lo_message) data;
+	lo_address srcaddr = lo_message_get_source (msg);
+	const char * sport = lo_address_get_port(srcaddr);
+	int srcport = atoi(sport);
+	//cerr << "source is " << srcport << endl;
+
+	_engine->push_control_event(info->type, _cmd_map->to_control_t(ctrl), val, info->instance, srcport, message_time (data));
+	
+	return 0;
+
+}
+
+int ControlOSC::loop_add_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
+{
+	// 1st is an int #channels
 	// 2nd is a float #bytes per channel (if 0, use engine default) 
 	
 	int channels = argv[0]->i;
@@ -1123,6 +1800,176 @@ int ControlOSC::saveloop_handler(const char *path, const char *types, lo_arg **a
 }
 
 
+int ControlOSC::get_audio_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, CommandInfo *info)
+{
+	// get audio:  s:format  s:returl  s:retpath
+	string format (&argv[0]->s);
+	string returl (&argv[1]->s);
+	string retpath (&argv[2]->s);
+
+	validate_returl(returl);
+
+	LoopAudioEvent::SampleFormat fmt = (format == "half") ? LoopAudioEvent::FormatHalf : LoopAudioEvent::FormatFloat;
+
+	// push this onto a queue for the main event loop to process
+	_engine->push_nonrt_event ( new LoopAudioEvent (LoopAudioEvent::Get, info->instance, fmt, returl, retpath));
+	
+	return 0;
+}
+
+int ControlOSC::put_audio_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, CommandInfo *info)
+{
+	// put audio:  i:upload_id  i:channels  i:total_frames  i:offset  s:format  b:data  s:returl  s:retpath
+	int upload_id = argv[0]->i;
+	int chans = argv[1]->i;
+	int total = argv[2]->i;
+	int offset = argv[3]->i;
+	string format (&argv[4]->s);
+	lo_blob blob = (lo_blob) argv[5];
+	string returl (&argv[6]->s);
+	string retpath (&argv[7]->s);
+
+	validate_returl(returl);
+
+	LoopAudioEvent::SampleFormat fmt = (format == "half") ? LoopAudioEvent::FormatHalf : LoopAudioEvent::FormatFloat;
+	size_t samplesize = (fmt == LoopAudioEvent::FormatHalf) ? sizeof(uint16_t) : sizeof(float);
+	
+	uint32_t bsize = lo_blob_datasize (blob);
+	
+	if (chans <= 0 || total < 0 || offset < 0 || bsize % (samplesize * chans) != 0) {
+		send_error (returl, retpath, "Invalid audio block");
+		return 0;
+	}
+
+	LoopAudioEvent * ev = new LoopAudioEvent (LoopAudioEvent::Put, info->instance, fmt, returl, retpath);
+	ev->upload_id = upload_id;
+	ev->channels = chans;
+	ev->total_frames = total;
+	ev->offset = offset;
+	ev->data.resize (bsize / samplesize);
+
+	// blob data is little endian, convert it here so the main thread only needs to copy
+	const unsigned char * bdata = (const unsigned char *) lo_blob_dataptr (blob);
+	for (size_t n=0; n < ev->data.size(); ++n) {
+		if (fmt == LoopAudioEvent::FormatHalf) {
+			ev->data[n] = half_to_float ((uint16_t) (bdata[0] | (bdata[1] << 8)));
+			bdata += 2;
+		}
+		else {
+			ls_pcast32 v;
+			v.i = (int32_t) (bdata[0] | (bdata[1] << 8) | (bdata[2] << 16) | ((uint32_t) bdata[3] << 24));
+			ev->data[n] = v.f;
+			bdata += 4;
+		}
+	}
+	
+	// push this onto a queue for the main event loop to process
+	if (!_engine->push_nonrt_event (ev)) {
+		delete ev;
+		send_error (returl, retpath, "Audio block dropped");
+	}
+	
+	return 0;
+}
+
+void ControlOSC::send_loop_groups (string returl, string retpath)
+{
+	// one message per group:  i:group_index  s:name  f:gain
+	lo_address addr;
+
+	addr = find_or_cache_addr (returl);
+	if (!addr) {
+		return;
+	}
+
+	vector<string> names;
+	_engine->get_loop_groups (names);
+
+	for (size_t g=0; g < names.size(); ++g) {
+		if (names[g].empty()) continue;
+
+		lo_message msg = lo_message_new();
+		lo_message_add (msg, "isf", (int) g, names[g].c_str(), _engine->get_loop_group_gain ((int) g));
+		_sender->send (returl, retpath, msg);
+	}
+}
+
+void ControlOSC::send_modulators (string returl, string retpath)
+{
+	// one message per modulator:  i:loop_index  s:ctrl  s:shape  f:beats  f:depth  f:center  f:param
+	lo_address addr;
+
+	addr = find_or_cache_addr (returl);
+	if (!addr) {
+		return;
+	}
+
+	vector<Modulator> mods;
+	_engine->get_modulators (mods);
+
+	for (size_t m=0; m < mods.size(); ++m) {
+		lo_message msg = lo_message_new();
+		lo_message_add (msg, "issffff", mods[m].instance, _cmd_map->to_control_str (mods[m].control).c_str(),
+				Modulator::shape_to_string (mods[m].shape), mods[m].beats, mods[m].depth, mods[m].center, mods[m].param);
+		_sender->send (returl, retpath, msg);
+	}
+}
+
+bool ControlOSC::send_loop_audio (int instance, unsigned int chans, const vector<float> & audio, LoopAudioEvent::SampleFormat format,
+				  string returl, string retpath)
+{
+	// each message is  i:loop_index  i:channels  i:total_frames  i:offset  s:format  b:data
+	// data is interleaved little endian samples. an empty loop gets a single message with no data.
+	// the chunks go out as one transfer, none of them is dropped for a full queue
+	lo_address addr;
+
+	addr = find_or_cache_addr (returl);
+	if (!addr) {
+		return false;
+	}
+
+	size_t samplesize = (format == LoopAudioEvent::FormatHalf) ? sizeof(uint16_t) : sizeof(float);
+	const char * fmtstr = (format == LoopAudioEvent::FormatHalf) ? "half" : "float";
+	uint32_t total = chans ? audio.size() / chans : 0;
+	uint32_t chunkframes = chans ? AUDIO_CHUNK_BYTES / (samplesize * chans) : 1;
+	uint32_t offset = 0;
+	vector<unsigned char> buf (chunkframes * chans * samplesize);
+	vector<lo_message> msgs;
+
+	do {
+		uint32_t nframes = min (chunkframes, total - offset);
+		unsigned char * bdata = buf.empty() ? 0 : &buf[0];
+		
+		for (size_t n = offset * chans; n < (offset + nframes) * chans; ++n) {
+			if (format == LoopAudioEvent::FormatHalf) {
+				uint16_t h = float_to_half (audio[n]);
+				*bdata++ = h & 0xff;
+				*bdata++ = (h >> 8) & 0xff;
+			}
+			else {
+				ls_pcast32 v;
+				v.f = audio[n];
+				*bdata++ = v.i & 0xff;
+				*bdata++ = (v.i >> 8) & 0xff;
+				*bdata++ = (v.i >> 16) & 0xff;
+				*bdata++ = (v.i >> 24) & 0xff;
+			}
+		}
+
+		lo_blob blob = lo_blob_new (nframes * chans * samplesize, buf.empty() ? 0 : &buf[0]);
+		lo_message msg = lo_message_new();
+		lo_message_add (msg, "iiiisb", instance, chans, total, offset, fmtstr, blob);
+		lo_blob_free (blob);
+
+		msgs.push_back (msg);
+		offset += nframes;
+		
+	} while (offset < total);
+
+	return _sender->send_transfer (returl, retpath, msgs);
+}
+
+
 lo_address
 ControlOSC::find_or_cache_addr(string returl)
 {
@@ -1155,23 +2002,186 @@ int ControlOSC::get_handler(const char *path, const char *types, lo_arg **argv,
 
 	validate_returl(returl);
 
-	// push this onto a queue for the main event loop to process
-	_engine->push_nonrt_event ( new GetParamEvent (info->instance, _cmd_map->to_control_t(ctrl), returl, retpath));
+	float value;
+
+	// published values are answered right here, anything else by the main loop
+	if (_engine->get_control_snapshot().get (info->instance, _cmd_map->to_control_t(ctrl), value)) {
+		queue_get_reply (returl, retpath, info->instance, ctrl, value);
+		return 0;
+	}
+
+	// push this onto a queue for the main event loop to process, the reply
+	// waits for it in the batch
+	if (++_get_next_id == 0) {
+		++_get_next_id;
+	}
+	GetParamEvent * gp_event = new GetParamEvent (info->instance, _cmd_map->to_control_t(ctrl), returl, retpath, _get_next_id);
+
+	if (_engine->push_nonrt_event (gp_event)) {
+		queue_get_reply (returl, retpath, info->instance, ctrl, 0.0f, _get_next_id);
+	}
+	else {
+		delete gp_event;
+	}
 	
 	return 0;
 }
 
+static double
+secs_now ()
+{
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+void
+ControlOSC::queue_get_reply (const string & returl, const string & retpath, int instance, const string & ctrl, float value, unsigned int pending)
+{
+	// osc thread only
+	GetBatch * batch = 0;
+
+	for (vector<GetBatch>::iterator b = _get_batches.begin(); b != _get_batches.end(); ++b) {
+		if (b->returl == returl && b->retpath == retpath) {
+			batch = &(*b);
+			break;
+		}
+	}
+
+	if (!batch) {
+		if (_get_batches.empty()) {
+			_get_batch_start = secs_now();
+		}
+		_get_batches.push_back (GetBatch());
+		batch = &_get_batches.back();
+		batch->returl = returl;
+		batch->retpath = retpath;
+	}
+
+	GetReply reply;
+	reply.instance = instance;
+	reply.ctrl = ctrl;
+	reply.value = value;
+	reply.pending = pending;
+	batch->replies.push_back (reply);
+
+	if (batch->replies.size() >= GET_BATCH_MAX) {
+		send_get_batch (*batch);
+	}
+}
+
+void
+ControlOSC::take_get_answers ()
+{
+	// osc thread only
+	vector<GetAnswer> answers;
+
+	pthread_mutex_lock (&_get_answer_lock);
+	answers.swap (_get_answers);
+	pthread_mutex_unlock (&_get_answer_lock);
+
+	for (vector<GetAnswer>::iterator ans = answers.begin(); ans != answers.end(); ++ans) {
+		bool found = false;
+
+		for (vector<GetBatch>::iterator b = _get_batches.begin(); b != _get_batches.end() && !found; ++b) {
+			for (vector<GetReply>::iterator reply = b->replies.begin(); reply != b->replies.end(); ++reply) {
+				if (reply->pending == ans->id) {
+					reply->value = ans->value;
+					reply->pending = 0;
+					found = true;
+					break;
+				}
+			}
+		}
+	}
+}
+
+int
+ControlOSC::get_batch_wait_ms ()
+{
+	// -1 while there is nothing to send yet
+	bool ready = false;
+	for (vector<GetBatch>::iterator b = _get_batches.begin(); b != _get_batches.end() && !ready; ++b) {
+		ready = !b->replies.empty() && !b->replies.front().pending;
+	}
+	if (!ready) {
+		return -1;
+	}
+
+	int left = GET_BATCH_WINDOW_MS - (int) ((secs_now() - _get_batch_start) * 1000.0);
+	return left > 0 ? left : 0;
+}
+
+void
+ControlOSC::flush_get_replies ()
+{
+	for (vector<GetBatch>::iterator b = _get_batches.begin(); b != _get_batches.end(); ) {
+		send_get_batch (*b);
+
+		if (b->replies.empty()) {
+			b = _get_batches.erase (b);
+		}
+		else {
+			++b;
+		}
+	}
+
+	// the rest waits on the main loop, it wakes us when it answers
+	_get_batch_start = secs_now();
+}
+
+void
+ControlOSC::send_get_batch (GetBatch & batch)
+{
+	// osc thread only.  everything up to the first reply still waiting
+	// on the main loop
+	vector<GetReply>::iterator ready = batch.replies.begin();
+	while (ready != batch.replies.end() && !ready->pending) {
+		++ready;
+	}
+
+	if (ready == batch.replies.begin()) {
+		return;
+	}
+
+	vector<lo_message> msgs;
+
+	for (vector<GetReply>::iterator reply = batch.replies.begin(); reply != ready; ++reply) {
+		lo_message msg = lo_message_new();
+		lo_message_add_int32 (msg, reply->instance);
+		lo_message_add_string (msg, reply->ctrl.c_str());
+		lo_message_add_float (msg, reply->value);
+		msgs.push_back (msg);
+	}
+
+	if (msgs.size() == 1) {
+		_sender->send (batch.returl, batch.retpath, msgs[0]);
+	}
+	else {
+		_sender->send_bundle (batch.returl, batch.retpath, msgs);
+	}
+
+	batch.replies.erase (batch.replies.begin(), ready);
+}
+
 int ControlOSC::register_update_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, CommandInfo *info)
 {
 	// first arg is control string, 2nd is return URL string 3rd is retpath
 	string ctrl (&argv[0]->s);
 	string returl (&argv[1]->s);
 	string retpath (&argv[2]->s);
+	int first = 0, last = -1;
 
 	validate_returl(returl);
 
+	// optional loop range for the -1 rule, i:first i:last
+	if (argc >= 5) {
+		first = argv[3]->i;
+		last = argv[4]->i;
+	}
+
 	// push this onto a queue for the main event loop to process
-	_engine->push_nonrt_event ( new ConfigUpdateEvent (ConfigUpdateEvent::Register, info->instance, _cmd_map->to_control_t(ctrl), returl, retpath));
+	push_update_event (ConfigUpdateEvent::Register, info->instance, ctrl, returl, retpath, 0, first, last);
         //cerr << "register update recvd for " << (int)info->instance << "  ctrl: " << ctrl << endl;
 	
 	return 0;
@@ -1184,11 +2194,17 @@ int ControlOSC::unregister_update_handler(const char *path, const char *types, l
 	string ctrl (&argv[0]->s);
 	string returl (&argv[1]->s);
 	string retpath (&argv[2]->s);
+	int first = 0, last = -1;
 
 	validate_returl(returl);
 
+	if (argc >= 5) {
+		first = argv[3]->i;
+		last = argv[4]->i;
+	}
+
 	// push this onto a queue for the main event loop to process
-	_engine->push_nonrt_event ( new ConfigUpdateEvent (ConfigUpdateEvent::Unregister, info->instance, _cmd_map->to_control_t(ctrl), returl, retpath));
+	push_update_event (ConfigUpdateEvent::Unregister, info->instance, ctrl, returl, retpath, 0, first, last);
 	
 	return 0;
 }
@@ -1200,6 +2216,7 @@ int ControlOSC::register_auto_update_handler(const char *path, const char *types
 	short int millisec  = argv[1]->i;
 	string returl (&argv[2]->s);
 	string retpath (&argv[3]->s);
+	int first = 0, last = -1;
 
 	validate_returl(returl);
 
@@ -1211,8 +2228,13 @@ int ControlOSC::register_auto_update_handler(const char *path, const char *types
 	else if (millisec > AUTO_UPDATE_MAX)
 		millisec = AUTO_UPDATE_MAX;
 
+	if (argc >= 6) {
+		first = argv[4]->i;
+		last = argv[5]->i;
+	}
+
 	// push this onto a queue for the main event loop to process
-	_engine->push_nonrt_event ( new ConfigUpdateEvent (ConfigUpdateEvent::RegisterAuto, info->instance, _cmd_map->to_control_t(ctrl), returl, retpath,0.0,-1, millisec));
+	push_update_event (ConfigUpdateEvent::RegisterAuto, info->instance, ctrl, returl, retpath, millisec, first, last);
 	// cerr << "register autoupdate recvd for " << (int)info->instance << "  ctrl: " << ctrl << endl;
 	return 0;
 }
@@ -1224,15 +2246,54 @@ int ControlOSC::unregister_auto_update_handler(const char *path, const char *typ
 	string ctrl (&argv[0]->s);
 	string returl (&argv[1]->s);
 	string retpath (&argv[2]->s);
+	int first = 0, last = -1;
 
 	validate_returl(returl);
 
+	if (argc >= 5) {
+		first = argv[3]->i;
+		last = argv[4]->i;
+	}
+
 	// push this onto a queue for the main event loop to process
-	_engine->push_nonrt_event ( new ConfigUpdateEvent (ConfigUpdateEvent::UnregisterAuto, info->instance, _cmd_map->to_control_t(ctrl), returl, retpath));
+	push_update_event (ConfigUpdateEvent::UnregisterAuto, info->instance, ctrl, returl, retpath, 0, first, last);
 	
 	return 0;
 }
 
+void
+ControlOSC::push_update_event (ConfigUpdateEvent::Type type, int instance, const string & ctrl, const string & returl, const string & retpath,
+			       short int millisec, int first, int last)
+{
+	// ctrl is one control name or a comma separated list of them
+	ConfigUpdateEvent * event = new ConfigUpdateEvent (type, instance, Event::Unknown, returl, retpath, 0.0, -1, millisec);
+	string::size_type pos = 0;
+
+	while (pos <= ctrl.size())
+	{
+		string::size_type end = ctrl.find (',', pos);
+		if (end == string::npos) {
+			end = ctrl.size();
+		}
+
+		Event::control_t control = _cmd_map->to_control_t (ctrl.substr (pos, end - pos));
+		if (control != Event::Unknown) {
+			event->controls.push_back (control);
+		}
+		pos = end + 1;
+	}
+
+	if (event->controls.empty()) {
+		delete event;
+		return;
+	}
+
+	event->range_first = first < 0 ? 0 : first;
+	event->range_last = last;
+
+	_engine->push_nonrt_event (event);
+}
+
 
 int
 ControlOSC::register_config_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
@@ -1243,7 +2304,8 @@ ControlOSC::register_config_handler(const char *path, const char *types, lo_arg
 
 	validate_returl(returl);
 
-	_engine->push_nonrt_event ( new RegisterConfigEvent (RegisterConfigEvent::Register, returl, retpath));
+	RegisterConfigEvent::Type type = strcmp (path, "/register_config_delta") == 0 ? RegisterConfigEvent::RegisterDelta : RegisterConfigEvent::Register;
+	_engine->push_nonrt_event ( new RegisterConfigEvent (type, returl, retpath));
 	
 	return 0;
 }
@@ -1257,7 +2319,8 @@ ControlOSC::unregister_config_handler(const char *path, const char *types, lo_ar
 
 	validate_returl(returl);
 
-	_engine->push_nonrt_event ( new RegisterConfigEvent (RegisterConfigEvent::Unregister, returl, retpath));
+	RegisterConfigEvent::Type type = strcmp (path, "/unregister_config_delta") == 0 ? RegisterConfigEvent::UnregisterDelta : RegisterConfigEvent::Unregister;
+	_engine->push_nonrt_event ( new RegisterConfigEvent (type, returl, retpath));
 	return 0;
 }
 
@@ -1266,6 +2329,23 @@ void
 ControlOSC::finish_get_event (GetParamEvent & event)
 {
 	// called from the main event loop (not osc thread)
+	if (event.reply_id) {
+		// the osc thread sends it, in its place among the others
+		GetAnswer answer;
+		answer.id = event.reply_id;
+		answer.value = event.ret_value;
+
+		pthread_mutex_lock (&_get_answer_lock);
+		bool wake = _get_answers.empty();
+		_get_answers.push_back (answer);
+		pthread_mutex_unlock (&_get_answer_lock);
+
+		if (wake) {
+			poke_osc_thread ();
+		}
+		return;
+	}
+
 	string ctrl (_cmd_map->to_control_str(event.control));
 	string returl (event.ret_url);
 	string retpath (event.ret_path);
@@ -1278,32 +2358,130 @@ ControlOSC::finish_get_event (GetParamEvent & event)
 	
 //	 cerr << "sending to " << returl << "  path: " << retpath << "  ctrl: " << ctrl << "  val: " <<  event.ret_value << endl;
 
-	if (lo_send(addr, retpath.c_str(), "isf", event.instance, ctrl.c_str(), event.ret_value) == -1) {
-		fprintf(stderr, "OSC error %d: %s\n", lo_address_errno(addr), lo_address_errstr(addr));
+	lo_message msg = lo_message_new();
+	lo_message_add (msg, "isf", event.instance, ctrl.c_str(), event.ret_value);
+	_sender->send (returl, retpath, msg);
+	
+}
+
+void
+ControlOSC::finish_global_get_event (GlobalGetEvent & event)
+{
+	// called from the main event loop (not osc thread)
+	string param (event.param);
+	string returl (event.ret_url);
+	string retpath (event.ret_path);
+	lo_address addr;
+
+	addr = find_or_cache_addr (returl);
+	if (!addr) {
+		return;
+	}
+	
+	// cerr << "sending to " << returl << "  path: " << retpath << "  ctrl: " << param << "  val: " <<  event.ret_value << endl;
+
+	lo_message msg = lo_message_new();
+	lo_message_add (msg, "isf", -2, param.c_str(), event.ret_value);
+	_sender->send (returl, retpath, msg);
+	
+}
+
+ControlOSC::UpdateRow::UpdateRow ()
+{
+	memset (cells, 0, sizeof(cells));
+	memset (&playhead, 0, sizeof(playhead));
+}
+
+ControlOSC::UpdateCell *
+ControlOSC::get_update_cell (int instance, Event::control_t ctrl, bool create)
+{
+	int row = instance + 3;
+
+	if (row < 0 || ctrl < 0 || ctrl >= Event::LAST_CONTROL) {
+		return 0;
+	}
+
+	if (row >= (int) _update_rows.size()) {
+		if (!create) {
+			return 0;
+		}
+		_update_rows.resize (row + 1, 0);
+	}
+
+	if (!_update_rows[row]) {
+		if (!create) {
+			return 0;
+		}
+		_update_rows[row] = new UpdateRow();
+	}
+
+	return &_update_rows[row]->cells[ctrl];
+}
+
+int
+ControlOSC::find_update_client (const string & url, const string & path, bool create)
+{
+	int freeslot = -1;
+
+	for (int n=0; n < MaxUpdateClients; ++n) {
+		if (_update_clients[n].refs == 0) {
+			if (freeslot < 0) freeslot = n;
+		}
+		else if (_update_clients[n].url == url && _update_clients[n].path == path) {
+			return n;
+		}
+	}
+
+	if (!create) {
+		return -1;
+	}
+
+	if (freeslot < 0) {
+		cerr << "sooperlooper: too many clients registered for updates, max is " << (int) MaxUpdateClients << endl;
+		return -1;
+	}
+
+	UpdateClient & client = _update_clients[freeslot];
+	client.url = url;
+	client.path = path;
+	char * port = lo_url_get_port (url.c_str());
+	client.port = port ? atoi (port) : 0;
+	free (port);
+	client.refs = 0;
+
+	return freeslot;
+}
+
+void
+ControlOSC::release_update_client (int slot)
+{
+	if (_update_clients[slot].refs > 0 && --_update_clients[slot].refs == 0) {
+		_update_clients[slot].url.clear();
+		_update_clients[slot].path.clear();
 	}
-	
 }
 
 void
-ControlOSC::finish_global_get_event (GlobalGetEvent & event)
+ControlOSC::remove_auto_client (UpdateRow * row, Event::control_t ctrl, int slot)
 {
-	// called from the main event loop (not osc thread)
-	string param (event.param);
-	string returl (event.ret_url);
-	string retpath (event.ret_path);
-	lo_address addr;
+	UpdateCell & cell = row->cells[ctrl];
+	ClientMask bit = ((ClientMask) 1) << slot;
+	ClientMask any = 0;
 
-	addr = find_or_cache_addr (returl);
-	if (!addr) {
-		return;
+	for (int b=0; b < AUTO_UPDATE_RANGE; ++b) {
+		if (cell.auto_clients[b] & bit) {
+			cell.auto_clients[b] &= ~bit;
+			release_update_client (slot);
+		}
+		any |= cell.auto_clients[b];
 	}
-	
-	// cerr << "sending to " << returl << "  path: " << retpath << "  ctrl: " << param << "  val: " <<  event.ret_value << endl;
 
-	if (lo_send(addr, retpath.c_str(), "isf", -2, param.c_str(), event.ret_value) == -1) {
-		fprintf(stderr, "OSC error %d: %s\n", lo_address_errno(addr), lo_address_errstr(addr));
+	if (!any) {
+		vector<int>::iterator iter = find (row->auto_controls.begin(), row->auto_controls.end(), (int) ctrl);
+		if (iter != row->auto_controls.end()) {
+			row->auto_controls.erase (iter);
+		}
 	}
-	
 }
 
 void
@@ -1314,163 +2492,275 @@ ControlOSC::finish_update_event (ConfigUpdateEvent & event)
 	lo_address addr;
 	string retpath = event.ret_path;
 	string returl  = event.ret_url;
-	string ctrl    = _cmd_map->to_control_str (event.control);
 	int source  = event.source;
 
 	if (event.type == ConfigUpdateEvent::Send)
 	{
 		if (event.instance == -1) {
 			for (unsigned int i = 0; i < _engine->loop_count(); ++i) {
-				send_registered_updates (ctrl, event.value, (int) i, source);
+				send_registered_updates (event.control, event.value, (int) i, source);
 			}
 		} else {
-			send_registered_updates (ctrl, event.value, event.instance, source);
+			send_registered_updates (event.control, event.value, event.instance, source);
 		}
 
 	}
 	else if (event.type == ConfigUpdateEvent::Register ||
-		 event.type == ConfigUpdateEvent::RegisterAuto)
+		 event.type == ConfigUpdateEvent::RegisterAuto ||
+		 event.type == ConfigUpdateEvent::Unregister ||
+		 event.type == ConfigUpdateEvent::UnregisterAuto)
 	{
 		if ((addr = find_or_cache_addr (returl)) == 0) {
 			return;
 		}
 
-		// add this to register_ctrl map
-		InstancePair ipair(event.instance, ctrl);
-		
-		if (event.type == ConfigUpdateEvent::Register) {
-			ControlRegistrationMap::iterator iter;
-			ControlRegistrationMap * regmap;
-			regmap = &_registration_map;
-			iter = regmap->find (ipair);
-			if (iter == regmap->end()) {
-				(*regmap)[ipair] = UrlList();
-				iter = regmap->find (ipair);
+		bool reg = (event.type == ConfigUpdateEvent::Register || event.type == ConfigUpdateEvent::RegisterAuto);
+		bool autoupdate = (event.type == ConfigUpdateEvent::RegisterAuto || event.type == ConfigUpdateEvent::UnregisterAuto);
+		int slot = find_update_client (returl, retpath, reg);
+		if (slot < 0) {
+			return;
+		}
+
+		// -1 is on change, otherwise the auto update interval
+		int bucket = -1;
+		if (autoupdate) {
+			bucket = (event.update_time_ms / AUTO_UPDATE_STEP) - 1;
+			if (bucket < 0) bucket = 0;
+			if (bucket >= AUTO_UPDATE_RANGE) bucket = AUTO_UPDATE_RANGE - 1;
+		}
+
+		vector<Event::control_t> controls (event.controls);
+		if (controls.empty()) {
+			controls.push_back (event.control);
+		}
+
+		if (event.instance == -1) {
+			// one rule for all the loops in range, including later ones
+			if (reg) {
+				add_update_rule (slot, bucket, event.range_first, event.range_last, controls);
+			}
+			else {
+				remove_update_rule (slot, autoupdate, event.range_first, event.range_last, controls);
+			}
+			return;
+		}
+
+		for (vector<Event::control_t>::iterator ctrl = controls.begin(); ctrl != controls.end(); ++ctrl) {
+			if (reg) {
+				add_update_client (event.instance, *ctrl, slot, bucket);
+			}
+			else {
+				remove_update_client (event.instance, *ctrl, slot, autoupdate);
 			}
+		}
+	}
+}
 
-			UrlList & ulist = (*iter).second;
-			UrlPair upair(addr, retpath);
+void
+ControlOSC::add_update_client (int instance, Event::control_t ctrl, int slot, int bucket)
+{
+	UpdateCell * cell = get_update_cell (instance, ctrl, true);
+	if (!cell) {
+		return;
+	}
+	ClientMask bit = ((ClientMask) 1) << slot;
 
-			if (find(ulist.begin(), ulist.end(), upair) == ulist.end()) {
+	if (bucket < 0) {
+		if (!(cell->clients & bit)) {
 #ifdef DEBUG
-				cerr << "registered " << (int)event.instance << "  ctrl: " << ctrl << "  " << returl << endl;
+			cerr << "registered " << instance << "  ctrl: " << _cmd_map->to_control_str (ctrl) << "  " << _update_clients[slot].url << endl;
 #endif
-				ulist.push_back (upair);
-			}
+			cell->clients |= bit;
+			_update_clients[slot].refs++;
 		}
-		else {
-			ControlRegistrationMapAuto::iterator iter;
-			InstancePair ipair(event.instance, ctrl);
-			ControlRegistrationMapAuto * regmap;
-			regmap = &_auto_registration_map;
-			iter = regmap->find (ipair);
-			if (iter == regmap->end()) {
-				(*regmap)[ipair] = UrlListAuto();
-				iter = regmap->find (ipair);
-			}
+		return;
+	}
+
+	if (cell->auto_clients[bucket] & bit) {
+		return;
+	}
+
+	// one interval per client and control, a new one replaces the old
+	UpdateRow * row = _update_rows[instance + 3];
+	_update_clients[slot].refs++;
+	remove_auto_client (row, ctrl, slot);
 
-			UrlListAuto & ulist_auto = (*iter).second;
-			UrlListAuto::iterator list_it;
-			UrlPair upair(addr, retpath);
-			UrlPairAuto upair_auto = {upair,event.update_time_ms};
-			UrlPairAuto upair_dud = {upair,0};
-
-			for(list_it = ulist_auto.begin(); list_it != ulist_auto.end(); ++list_it) {
-				if ((*list_it).upair == upair) {
-					if((*list_it).timeout == event.update_time_ms) {
-						break;
-					} else {
 #ifdef DEBUG
-						cerr << "updated " << (int)event.instance << "  ctrl: " << ctrl << "  " << returl << "  timeout: " << event.update_time_ms << endl;
+	cerr << "registered " << instance << "  ctrl: " << _cmd_map->to_control_str (ctrl) << "  " << _update_clients[slot].url << "  timeout: " << (bucket + 1) * AUTO_UPDATE_STEP << endl;
 #endif
-						(*list_it).timeout = event.update_time_ms;
-						break;
-					}
-				} 
-			}
-			if (list_it == ulist_auto.end()) {
+	if (find (row->auto_controls.begin(), row->auto_controls.end(), (int) ctrl) == row->auto_controls.end()) {
+		row->auto_controls.push_back (ctrl);
+	}
+	cell->auto_clients[bucket] |= bit;
+	// the newcomer needs the current value, so does everyone else in there then
+	cell->auto_last[bucket] = -1e30f;
+	if (ctrl == Event::PlayheadModel) {
+		row->playhead.valid = false;
+	}
+}
+
+void
+ControlOSC::remove_update_client (int instance, Event::control_t ctrl, int slot, bool autoupdate)
+{
+	UpdateCell * cell = get_update_cell (instance, ctrl, false);
+	if (!cell) {
+		return;
+	}
+	ClientMask bit = ((ClientMask) 1) << slot;
+
+	if (autoupdate) {
+		remove_auto_client (_update_rows[instance + 3], ctrl, slot);
+	}
+	else if (cell->clients & bit) {
 #ifdef DEBUG
-				cerr << "registered " << (int)event.instance << "  ctrl: " << ctrl << "  " << returl << "  timeout: " << event.update_time_ms << endl;
+		cerr << "unregistered " << _cmd_map->to_control_str (ctrl) << "  " << _update_clients[slot].url << endl;
 #endif
-				ulist_auto.push_back(upair_auto);
+		cell->clients &= ~bit;
+		release_update_client (slot);
+	}
+}
+
+void
+ControlOSC::add_update_rule (int slot, int bucket, int first, int last, const vector<Event::control_t> & controls)
+{
+	UpdateRule * rule = 0;
+
+	for (vector<UpdateRule>::iterator iter = _update_rules.begin(); iter != _update_rules.end(); )
+	{
+		if (iter->slot != slot || iter->first != first || iter->last != last || (iter->bucket < 0) != (bucket < 0)) {
+			++iter;
+			continue;
+		}
+
+		if (iter->bucket != bucket) {
+			// a control is in one interval only
+			for (vector<Event::control_t>::const_iterator ctrl = controls.begin(); ctrl != controls.end(); ++ctrl) {
+				iter->controls.erase (remove (iter->controls.begin(), iter->controls.end(), *ctrl), iter->controls.end());
+			}
+			if (iter->controls.empty()) {
+				release_update_client (iter->slot);
+				iter = _update_rules.erase (iter);
+				continue;
 			}
 		}
+		++iter;
+	}
 
-		
+	for (vector<UpdateRule>::iterator iter = _update_rules.begin(); iter != _update_rules.end() && !rule; ++iter) {
+		if (iter->slot == slot && iter->first == first && iter->last == last && iter->bucket == bucket) {
+			rule = &(*iter);
+		}
 	}
-	else if (event.type == ConfigUpdateEvent::Unregister ||
-		 event.type == ConfigUpdateEvent::UnregisterAuto)
+
+	if (!rule) {
+		_update_rules.push_back (UpdateRule());
+		rule = &_update_rules.back();
+		rule->slot = slot;
+		rule->bucket = bucket;
+		rule->first = first;
+		rule->last = last;
+		// the rule holds the client even while no loop matches it
+		_update_clients[slot].refs++;
+	}
+
+	for (vector<Event::control_t>::const_iterator ctrl = controls.begin(); ctrl != controls.end(); ++ctrl) {
+		if (find (rule->controls.begin(), rule->controls.end(), *ctrl) == rule->controls.end()) {
+			rule->controls.push_back (*ctrl);
+		}
+	}
+
+	int count = (int) _engine->loop_count();
+	for (int n = first; n < count && (last < 0 || n <= last); ++n) {
+		for (vector<Event::control_t>::const_iterator ctrl = controls.begin(); ctrl != controls.end(); ++ctrl) {
+			add_update_client (n, *ctrl, slot, bucket);
+		}
+	}
+}
+
+void
+ControlOSC::remove_update_rule (int slot, bool autoupdate, int first, int last, const vector<Event::control_t> & controls)
+{
+	// undoes what a register with the same range did
+	for (vector<UpdateRule>::iterator iter = _update_rules.begin(); iter != _update_rules.end(); )
 	{
+		if (iter->slot != slot || iter->first != first || iter->last != last || (iter->bucket >= 0) != autoupdate) {
+			++iter;
+			continue;
+		}
 
-		if ((addr = find_or_cache_addr (returl)) == 0) {
-			return;
+		for (vector<Event::control_t>::const_iterator ctrl = controls.begin(); ctrl != controls.end(); ++ctrl) {
+			iter->controls.erase (remove (iter->controls.begin(), iter->controls.end(), *ctrl), iter->controls.end());
 		}
-		
-		// remove this from register_ctrl map
-		InstancePair ipair(event.instance, ctrl);
 
-		if (event.type == ConfigUpdateEvent::Unregister) {
-			ControlRegistrationMap * regmap;
-			ControlRegistrationMap::iterator iter;
-			regmap = &_registration_map;
-			iter = regmap->find (ipair);
+		if (iter->controls.empty()) {
+			release_update_client (iter->slot);
+			iter = _update_rules.erase (iter);
+		}
+		else {
+			++iter;
+		}
+	}
 
-			if (iter != regmap->end()) {
-				UrlList & ulist = (*iter).second;
-				UrlPair upair(addr, retpath);
-				UrlList::iterator uiter = find(ulist.begin(), ulist.end(), upair);
+	// every row, loops that are gone can still have theirs
+	for (int n = first; n + 3 < (int) _update_rows.size() && (last < 0 || n <= last); ++n) {
+		for (vector<Event::control_t>::const_iterator ctrl = controls.begin(); ctrl != controls.end(); ++ctrl) {
+			remove_update_client (n, *ctrl, slot, autoupdate);
+		}
+	}
 
-				if (uiter != ulist.end()) {
-#ifdef DEBUG
-					cerr << "unregistered " << ctrl << "  " << returl << endl;
-#endif
-					ulist.erase (uiter);
-				}
-			}
+	// the client's other rules can still cover some of those cells
+	int count = (int) _engine->loop_count();
+	for (vector<UpdateRule>::iterator rule = _update_rules.begin(); rule != _update_rules.end(); ++rule)
+	{
+		if (rule->slot != slot || (rule->bucket >= 0) != autoupdate) {
+			continue;
 		}
-		else { //UnRegisterAuto 
-			ControlRegistrationMapAuto * regmap;
-			ControlRegistrationMapAuto::iterator iter;
-			regmap = &_auto_registration_map;
-			iter = regmap->find (ipair);
-
-			if (iter != regmap->end()) {
-				UrlListAuto & ulist_auto = (*iter).second;
-				UrlPair upair(addr, retpath);
-				UrlPairAuto upair_auto = {upair, 0};
-				UrlListAuto::iterator list_it;
-				for(list_it = ulist_auto.begin(); list_it != ulist_auto.end(); ++list_it) {
-					if ((*list_it).upair == upair) 
-					break;
-				}
-				if (list_it != ulist_auto.end()) {
-#ifdef DEBUG
-					cerr << "unregistered " << ctrl << "  " << returl << endl;
-#endif
-					ulist_auto.erase (list_it);
+
+		int from = max (first, rule->first);
+		for (int n = from; n < count && (last < 0 || n <= last) && (rule->last < 0 || n <= rule->last); ++n) {
+			for (vector<Event::control_t>::const_iterator ctrl = controls.begin(); ctrl != controls.end(); ++ctrl) {
+				if (find (rule->controls.begin(), rule->controls.end(), *ctrl) != rule->controls.end()) {
+					add_update_client (n, *ctrl, slot, rule->bucket);
 				}
 			}
 		}
 	}
 }
 
+void
+ControlOSC::apply_update_rules (int instance)
+{
+	for (vector<UpdateRule>::iterator rule = _update_rules.begin(); rule != _update_rules.end(); ++rule)
+	{
+		if (instance < rule->first || (rule->last >= 0 && instance > rule->last)) {
+			continue;
+		}
+
+		for (vector<Event::control_t>::iterator ctrl = rule->controls.begin(); ctrl != rule->controls.end(); ++ctrl) {
+			add_update_client (instance, *ctrl, rule->slot, rule->bucket);
+		}
+	}
+}
+
 			
 void ControlOSC::finish_loop_config_event (ConfigLoopEvent &event)
 {
 	if (event.type == ConfigLoopEvent::Remove) {
 		// unregister everything for this instance
-		ControlRegistrationMap::iterator citer = _registration_map.begin();
-		ControlRegistrationMap::iterator tmp;
-		
-		while ( citer != _registration_map.end()) {
-			if ((*citer).first.first == event.index) {
-				tmp = citer;
-				++tmp;
-				_registration_map.erase(citer);
-				citer = tmp;
-			}
-			else {
-				++citer;
+		int row = event.index + 3;
+		if (event.index < 0 || row >= (int) _update_rows.size() || !_update_rows[row]) {
+			return;
+		}
+
+		UpdateCell * cells = _update_rows[row]->cells;
+
+		for (int c=0; c < Event::LAST_CONTROL; ++c) {
+			for (int slot=0; cells[c].clients; ++slot) {
+				ClientMask bit = ((ClientMask) 1) << slot;
+				if (cells[c].clients & bit) {
+					cells[c].clients &= ~bit;
+					release_update_client (slot);
+				}
 			}
 		}
 	}
@@ -1485,169 +2775,315 @@ void ControlOSC::finish_midi_binding_event (MidiBindingEvent & event)
 
 	if (event.type == MidiBindingEvent::Learn) {
 		// send back the event, then done
-		if (lo_send(addr, event.ret_path.c_str(), "ss", "add", event.bind_str.c_str()) == -1) {
-			fprintf(stderr, "OSC error sending binding %d: %s\n", lo_address_errno(addr), lo_address_errstr(addr));
-			return;
-		}
-		
-		lo_send(addr, event.ret_path.c_str(), "ss", "done", event.bind_str.c_str());
+		send_strings (event.ret_url, event.ret_path, "add", event.bind_str);
+		send_strings (event.ret_url, event.ret_path, "done", event.bind_str);
 	}
 	else if (event.type == MidiBindingEvent::GetNextMidi) {
-		lo_send(addr, event.ret_path.c_str(), "ss", "recv", event.bind_str.c_str());
+		send_strings (event.ret_url, event.ret_path, "recv", event.bind_str);
 	}
 	else if (event.type == MidiBindingEvent::CancelLearn)
 	{
-		lo_send(addr, event.ret_path.c_str(), "ss", "learn_cancel", "");
+		send_strings (event.ret_url, event.ret_path, "learn_cancel", "");
 	}
 	else if (event.type == MidiBindingEvent::CancelGetNext)
 	{
-		lo_send(addr, event.ret_path.c_str(), "ss", "next_cancel", "");
+		send_strings (event.ret_url, event.ret_path, "next_cancel", "");
 	}
 }
 
 void
-ControlOSC::send_registered_updates(string ctrl, float val, int instance, int source)
+ControlOSC::send_registered_updates(Event::control_t ctrl, float val, int instance, int source)
 {
-	InstancePair ipair(instance, ctrl);
-	ControlRegistrationMap::iterator iter = _registration_map.find (ipair);
-	//LastValueMap::iterator lastval;
+	UpdateCell * cell = get_update_cell (instance, ctrl, false);
+
+	if (!cell || !cell->clients) {
+		return;
+	}
+
+	const char * ctrlstr = 0;
+	string ctrlname;
+	ClientMask clients = cell->clients;
 
-	if (iter != _registration_map.end())
+	for (int slot=0; clients; ++slot, clients >>= 1)
 	{
-		if ( ! send_registered_updates (iter, ctrl, val, instance, source)) {
-			// remove ipair if false is returned.. no more good registrations
-			_registration_map.erase(ipair);
+		if (!(clients & 1)) {
+			continue;
+		}
+
+		UpdateClient & client = _update_clients[slot];
+
+		if (client.port == source) {
+			// ignore if this was caused by a set from this addr
+			continue;
 		}
+
+		if (!ctrlstr) {
+			ctrlname = _cmd_map->to_control_str (ctrl);
+			ctrlstr = ctrlname.c_str();
+		}
+
+		// a failed send unregisters the client, see drop_failed_clients()
+		lo_message msg = lo_message_new();
+		lo_message_add (msg, "isf", instance, ctrlstr, val);
+		_sender->send (client.url, client.path, msg, instance, ctrl);
 	}
-	else {
+}
+
+
+void
+ControlOSC::drop_failed_clients ()
+{
+	vector<string> failed;
+	_sender->take_failed (failed);
+
+	for (vector<string>::iterator url = failed.begin(); url != failed.end(); ++url)
+	{
+		for (int slot=0; slot < MaxUpdateClients; ++slot)
+		{
+			if (_update_clients[slot].refs == 0 || _update_clients[slot].url != *url) {
+				continue;
+			}
+
+			ClientMask bit = ((ClientMask) 1) << slot;
+
+			for (vector<UpdateRule>::iterator rule = _update_rules.begin(); rule != _update_rules.end(); ) {
+				if (rule->slot == slot) {
+					release_update_client (slot);
+					rule = _update_rules.erase (rule);
+				}
+				else {
+					++rule;
+				}
+			}
+
+			for (size_t r=0; r < _update_rows.size() && _update_clients[slot].refs > 0; ++r) {
+				UpdateRow * row = _update_rows[r];
+				if (!row) continue;
+
+				for (int c=0; c < Event::LAST_CONTROL; ++c) {
+					if (row->cells[c].clients & bit) {
+						row->cells[c].clients &= ~bit;
+						release_update_client (slot);
+					}
+				}
+				for (int c=0; c < Event::LAST_CONTROL; ++c) {
+					remove_auto_client (row, (Event::control_t) c, slot);
+				}
+			}
 #ifdef DEBUG
-		//cerr << "not in map: " << instance << " ctrL: " << ctrl << endl;
+			cerr << "unregistered all updates for " << *url << endl;
 #endif
+		}
 	}
 }
 
+void
+ControlOSC::send_strings (const string & url, const string & path, const string & first, const string & second)
+{
+	lo_message msg = lo_message_new();
+	lo_message_add_string (msg, first.c_str());
+	lo_message_add_string (msg, second.c_str());
+	_sender->send (url, path, msg);
+}
 
 void ControlOSC::send_auto_updates (const std::list<short int> timeout_list)
 {
-	ControlRegistrationMapAuto::iterator iter = _auto_registration_map.begin();
-	ControlRegistrationMapAuto::iterator tmpiter;
+	drop_failed_clients ();
 
-	while (iter != _auto_registration_map.end())
-	{
-		std::list<short int> timeout_after_opt = timeout_list;
-		const InstancePair & ipair = (*iter).first;
-		float val = _engine->get_control_value (_cmd_map->to_control_t(ipair.second), ipair.first);
-		
-		//_engine->ParamChanged(_cmd_map->to_control_t(ipair.second), ipair.first);
+	int buckets[AUTO_UPDATE_RANGE];
+	int nbuckets = 0;
 
-		if ( ! send_registered_auto_updates (iter, ipair, val, timeout_list)) {
-			// remove ipair if false is returned.. no more good registrations
-			tmpiter = iter;
-			++iter;
-			_auto_registration_map.erase(tmpiter);
-		}
-		else {
-		++iter;
-		}
+	for (std::list<short int>::const_iterator timeout = timeout_list.begin(); timeout != timeout_list.end() && nbuckets < AUTO_UPDATE_RANGE; ++timeout) {
+		buckets[nbuckets++] = (*timeout / AUTO_UPDATE_STEP) - 1;
+	}
+
+	if (nbuckets == 0) {
+		return;
+	}
 
+	// rows past the last loop can be left over from removed ones
+	size_t nrows = min (_update_rows.size(), (size_t) _engine->loop_count() + 3);
+
+	for (size_t row=0; row < nrows; ++row)
+	{
+		if (_update_rows[row] && !_update_rows[row]->auto_controls.empty()) {
+			send_registered_auto_updates ((int) row - 3, _update_rows[row], buckets, nbuckets);
+		}
 	}
 }
 
-bool
-ControlOSC::send_registered_auto_updates(ControlRegistrationMapAuto::iterator & iter,
-				    const InstancePair & ipair, float val, const std::list<short int> timeout_list)
+void
+ControlOSC::send_registered_auto_updates(int instance, UpdateRow * row, const int * buckets, int nbuckets)
 {
-	UrlListAuto::iterator tmpurl;
-	UrlListAuto & ulist_auto = (*iter).second;
-	string ctrl = ipair.second;
-	int instance = ipair.first;
-	
-	for (UrlListAuto::iterator url = ulist_auto.begin(); url != ulist_auto.end();)
+	// copy, a failed send can take a control off the list
+	vector<int> controls (row->auto_controls);
+
+	for (vector<int>::iterator ctrl = controls.begin(); ctrl != controls.end(); ++ctrl)
 	{
-		bool unregister = false;
-		lo_address addr = (*url).upair.first;
-		for (std::list<short int>::const_iterator timeout = timeout_list.begin(); timeout != timeout_list.end(); timeout++) {
-			if ((*url).timeout == (*timeout)) {
-				LastValueMap *last_value_map = &_last_value_map[(*url).upair];
-				//optimize out unecessary updates
-				LastValueMap::iterator lastval = (*last_value_map).find (ipair);
-				if (val != (*lastval).second) {
-
-					if (lo_send(addr, (*url).upair.second.c_str(), "isf", instance, ctrl.c_str(), val) == -1) 
-						unregister = true;
-					else
-						(*last_value_map)[ipair] = val;
+		UpdateCell & cell = row->cells[*ctrl];
+		bool have_val = false;
+
+		if (*ctrl == Event::PlayheadModel) {
+			// the interval is only how often it is checked
+			for (int b=0; b < nbuckets; ++b) {
+				if (buckets[b] >= 0 && buckets[b] < AUTO_UPDATE_RANGE && cell.auto_clients[buckets[b]]) {
+					send_playhead_model (instance, row);
+					break;
+				}
+			}
+			continue;
+		}
+		float val = 0.0f;
+		string ctrlstr;
+
+		for (int b=0; b < nbuckets; ++b)
+		{
+			int bucket = buckets[b];
+			if (bucket < 0 || bucket >= AUTO_UPDATE_RANGE || !cell.auto_clients[bucket]) {
+				continue;
+			}
+
+			if (!have_val) {
+				val = _engine->get_control_value ((Event::control_t) *ctrl, instance);
+				have_val = true;
+			}
+
+			//optimize out unecessary updates
+			if (val == cell.auto_last[bucket]) {
+				continue;
+			}
+			cell.auto_last[bucket] = val;
+
+			if (ctrlstr.empty()) {
+				ctrlstr = _cmd_map->to_control_str ((Event::control_t) *ctrl);
+			}
+
+			ClientMask clients = cell.auto_clients[bucket];
+
+			for (int slot=0; clients; ++slot, clients >>= 1)
+			{
+				if (!(clients & 1)) {
+					continue;
 				}
 
-				break;
+				UpdateClient & client = _update_clients[slot];
+
+				lo_message msg = lo_message_new();
+				lo_message_add (msg, "isf", instance, ctrlstr.c_str(), val);
+				_sender->send (client.url, client.path, msg, instance, *ctrl);
 			}
 		}
-		if (unregister) {
-			tmpurl = url;
-			++url;
-			ulist_auto.erase(tmpurl);
-		} else {
-			++url;
+	}
+}
+
+void
+ControlOSC::send_playhead_model (int instance, UpdateRow * row)
+{
+	PlayheadModel & model = row->playhead;
+	UpdateCell & cell = row->cells[Event::PlayheadModel];
+
+	float pos = _engine->get_control_value (Event::LoopPosition, instance);
+	float len = _engine->get_control_value (Event::LoopLength, instance);
+	// negative when the loop plays in reverse
+	float rate = _engine->get_control_value (Event::TrueRate, instance);
+	int state = (int) _engine->get_control_value (Event::State, instance);
+
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	double now = tv.tv_sec + tv.tv_usec * 1e-6;
+
+	switch (state) {
+	case LooperStateRecording:
+	case LooperStateWaitStop:
+		// the loop grows with the position
+		len = 0.0f;
+		break;
+	case LooperStatePlaying:
+	case LooperStateOverdubbing:
+	case LooperStateMultiplying:
+	case LooperStateInserting:
+	case LooperStateReplacing:
+	case LooperStateSubstitute:
+	case LooperStateMuted:
+	case LooperStateOneShot:
+	case LooperStateDelay:
+		break;
+	default:
+		rate = 0.0f;
+		break;
+	}
+
+	bool resend = (!model.valid || state != model.state || fabsf (rate - model.rate) > 1e-4f || fabsf (len - model.len) > 1e-3f);
+
+	if (!resend) {
+		double predicted = model.pos + model.rate * (now - model.time);
+		if (model.len > 0.0f) {
+			predicted = fmod (predicted, (double) model.len);
+			if (predicted < 0.0) predicted += model.len;
+		}
+
+		double err = fabs (pos - predicted);
+		if (model.len > 0.0f && err > model.len * 0.5) {
+			// across the loop point
+			err = model.len - err;
 		}
+		resend = (err > PLAYHEAD_TOLERANCE_SECS);
 	}
-	
-	if (ulist_auto.empty()) {
-		return false;
+
+	if (!resend) {
+		return;
 	}
 
-	return true;
-}
+	model.time = now;
+	model.pos = pos;
+	model.rate = rate;
+	model.len = len;
+	model.state = state;
+	model.valid = true;
 
-bool
-ControlOSC::send_registered_updates(ControlRegistrationMap::iterator & iter,
-				    string ctrl, float val, int instance, int source)
-{
-	UrlList::iterator tmpurl;
-	
-	UrlList & ulist = (*iter).second;
-	
-	for (UrlList::iterator url = ulist.begin(); url != ulist.end();)
+	// everyone gets the same model, whatever interval it checks at
+	ClientMask clients = 0;
+	for (int b=0; b < AUTO_UPDATE_RANGE; ++b) {
+		clients |= cell.auto_clients[b];
+	}
+
+	for (int slot=0; clients; ++slot, clients >>= 1)
 	{
-		lo_address addr = (*url).first;
-		const char * port = lo_address_get_port(addr);
-		int aport = atoi (port);
-		
-		if (aport == source) {
-			// ignore if this was caused by a set from this addr
-			//cerr << "ignoreing address to send update for " << ctrl << "  port: " << aport << "  " << port << endl;
-		}
-		
-		else if (lo_send(addr, (*url).second.c_str(), "isf", instance, ctrl.c_str(), val) == -1) {
-#ifdef DEBUG
-			fprintf(stderr, "OSC error %d: %s\n", lo_address_errno(addr), lo_address_errstr(addr));
-#endif
-			// auto-unregister
-			tmpurl = url;
-			++url;
-			
-			ulist.erase(tmpurl);
+		if (!(clients & 1)) {
 			continue;
 		}
-		
-		++url;
-	}
-	
-	if (ulist.empty()) {
-		return false;
-	}
 
-	return true;
-}
+		UpdateClient & client = _update_clients[slot];
 
+		lo_message msg = lo_message_new();
+		lo_message_add (msg, "isfffd", instance, "playhead", pos, rate, len, now);
+		_sender->send (client.url, client.path, msg, instance, Event::PlayheadModel);
+	}
+}
 
 void
 ControlOSC::finish_register_event (RegisterConfigEvent &event)
 {
 	AddrPathPair apair(event.ret_url, event.ret_path);
-	AddressList::iterator iter = find (_config_registrations.begin(), _config_registrations.end(), apair);
+	bool delta = (event.type == RegisterConfigEvent::RegisterDelta || event.type == RegisterConfigEvent::UnregisterDelta);
+	AddressList & alist = delta ? _config_delta_registrations : _config_registrations;
+	AddressList::iterator iter = find (alist.begin(), alist.end(), apair);
+
+	if (event.type == RegisterConfigEvent::Unregister || event.type == RegisterConfigEvent::UnregisterDelta) {
+		if (iter != alist.end()) {
+			alist.erase (iter);
+		}
+		return;
+	}
 
-	if (iter == _config_registrations.end()) {
-		_config_registrations.push_back (apair);
+	if (iter == alist.end()) {
+		alist.push_back (apair);
+	}
+
+	if (delta) {
+		// tell it where we are, what is still pending counts as the next version
+		vector<int> none;
+		send_config_delta (apair, _config_dirty ? _config_old_count : (int) _engine->loop_count(), none, none);
 	}
 }
 
@@ -1671,9 +3107,7 @@ void ControlOSC::send_error (std::string returl, std::string retpath, std::strin
 
 	string oururl = get_server_url();
 	
-	if (lo_send(addr, retpath.c_str(), "ss", oururl.c_str(), mesg.c_str()) < 0) {
-		fprintf(stderr, "OSC error %d: %s\n", lo_address_errno(addr), lo_address_errstr(addr));
-	}
+	send_strings (returl, retpath, oururl, mesg);
 }
 
 void ControlOSC::send_pingack (bool useudp, bool use_id, string returl, string retpath)
@@ -1698,17 +3132,14 @@ void ControlOSC::send_pingack (bool useudp, bool use_id, string returl, string r
 	
 	//cerr << "sooperlooper: sending ping response to " << returl << endl;
 	// sends our server URL, the SL version, the loop count, and a unique id for continuity checking
-	if (use_id)
-	{
-		if (lo_send(addr, retpath.c_str(), "ssii", oururl.c_str(), sooperlooper_version, _engine->loop_count(), _engine->get_id()) < 0) {
-			fprintf(stderr, "OSC error %d: %s\n", lo_address_errno(addr), lo_address_errstr(addr));
-		}
+	lo_message msg = lo_message_new();
+	if (use_id) {
+		lo_message_add (msg, "ssii", oururl.c_str(), sooperlooper_version, _engine->loop_count(), _engine->get_id());
 	}
 	else {
-		if (lo_send(addr, retpath.c_str(), "ssi", oururl.c_str(), sooperlooper_version, _engine->loop_count()) < 0) {
-			fprintf(stderr, "OSC error %d: %s\n", lo_address_errno(addr), lo_address_errstr(addr));
-		}
+		lo_message_add (msg, "ssi", oururl.c_str(), sooperlooper_version, _engine->loop_count());
 	}
+	_sender->send (returl, retpath, msg);
 }
 
 
@@ -1726,13 +3157,10 @@ void ControlOSC::send_all_midi_bindings (MidiBindings * bindings, string returl,
 	for (MidiBindings::BindingList::iterator biter = blist.begin(); biter != blist.end(); ++biter) {
 		MidiBindInfo & info = (*biter);
 
-		if (lo_send(addr, retpath.c_str(), "ss", "add", info.serialize().c_str()) == -1) {
-			fprintf(stderr, "OSC error sending binding %d: %s\n", lo_address_errno(addr), lo_address_errstr(addr));
-			break;
-		}
+		send_strings (returl, retpath, "add", info.serialize());
 	}
 
-	lo_send(addr, retpath.c_str(), "ss", "done", "");
+	send_strings (returl, retpath, "done", "");
 			
 }
 
@@ -23,14 +23,18 @@
 
 #include <lo/lo.h>
 #include <string>
+#include <vector>
 #include <map>
 #include <list>
 #include <utility>
+#include <sys/time.h>
 
 #include <sigc++/object.h>
+#include <midi++/types.h>
 
 #include "event.hpp"
 #include "event_nonrt.hpp"
+#include "osc_sender.hpp"
 
 //define timing for auto updates in ms
 //having STEP more often than 10ms and a different from the MIN may cause timing problems
@@ -39,6 +43,16 @@
 #define AUTO_UPDATE_MAX 100
 #define AUTO_UPDATE_RANGE (((AUTO_UPDATE_MAX - AUTO_UPDATE_MIN)/AUTO_UPDATE_STEP) + 1)
 
+// loop adds and removes are broadcast once nothing changed for SETTLE ms,
+// or at the latest MAX_DELAY ms after the first one
+#define CONFIG_SETTLE_MSECS 50
+#define CONFIG_MAX_DELAY_MSECS 500
+
+// a playhead model is sent again when the position it predicts is off by
+// more than this.  positions only move once per audio period, so less than
+// a long period would resend all the time
+#define PLAYHEAD_TOLERANCE_SECS 0.05
+
 namespace SooperLooper {
 
 class Engine;
@@ -57,16 +71,28 @@ class ControlOSC
 	int get_server_port () { return _port; }
 
 	std::string get_unix_server_url();
+	std::string get_tcp_server_url();
 	
 	bool is_ok() { return _ok; }
 
 	void send_all_config ();
+	// main loop, every tick.  broadcasts the loop changes once they settle
+	void flush_config_changes (const struct timeval & now);
 	void send_pingack (bool useudp, bool use_id, std::string returl, std::string retpath="/pingack");
 	
 	void send_all_midi_bindings (MidiBindings * bind, std::string returl, std::string retpath);
 
 	void send_auto_updates (const std::list<short int> timeout_list);
 	void send_error (std::string returl, std::string retpath, std::string mesg);
+
+	// false if none of it could be queued, the client has too much audio waiting
+	bool send_loop_audio (int instance, unsigned int chans, const std::vector<float> & audio, LoopAudioEvent::SampleFormat format,
+			      std::string returl, std::string retpath);
+
+	void send_loop_groups (std::string returl, std::string retpath);
+	void send_modulators (std::string returl, std::string retpath);
+
+	void get_send_stats (std::vector<OscSender::ClientStats> & stats) { _sender->get_stats (stats); }
 	
 	void finish_get_event (GetParamEvent & event);
 	void finish_update_event (ConfigUpdateEvent & event);
@@ -110,7 +136,7 @@ class ControlOSC
 	};
 
 	void on_loop_added(int instance, bool sendupdate=true);
-	void on_loop_removed();
+	void on_loop_removed(int instance);
 
 	void register_callbacks();
 	
@@ -118,6 +144,7 @@ class ControlOSC
 
 	
 	static int _quit_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
+	static int _save_trace_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
 	static int _global_set_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
 	static int _global_get_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
 	static int _updown_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
@@ -137,6 +164,19 @@ class ControlOSC
 	static int _unregister_config_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
 	static int _loadloop_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
 	static int _saveloop_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
+	static int _get_audio_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
+	static int _put_audio_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
+	static int _set_modulator_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
+	static int _remove_modulator_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
+	static int _trigger_modulator_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
+	static int _get_modulators_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
+	static int _get_osc_stats_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
+	static int _bounce_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
+	static int _add_group_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
+	static int _remove_group_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
+	static int _get_groups_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
+	static int _group_updown_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
+	static int _group_set_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
 	static int _global_register_update_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
 	static int _global_unregister_update_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
 	static int _global_register_auto_update_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
@@ -149,6 +189,9 @@ class ControlOSC
 
 	static int _midi_binding_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
 
+	static int _brother_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
+	static int _brother_clock_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, void *user_data);
+
 
 	bool init_osc_thread();
 	void terminate_osc_thread();
@@ -158,6 +201,7 @@ class ControlOSC
 	void osc_receiver();
 	
 	int quit_handler(const char *path, const char *types, lo_arg **argv, int argc,void *data);
+	int save_trace_handler(const char *path, const char *types, lo_arg **argv, int argc,void *data);
 	int ping_handler(const char *path, const char *types, lo_arg **argv, int argc,void *data);
 	int global_get_handler(const char *path, const char *types, lo_arg **argv, int argc,void *data);
 	int global_set_handler(const char *path, const char *types, lo_arg **argv, int argc,void *data);
@@ -167,6 +211,10 @@ class ControlOSC
 	int save_session_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
 	int register_config_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
 	int unregister_config_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
+	int add_group_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
+	int remove_group_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
+	int get_groups_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
+	int group_set_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
 
 	int global_register_update_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
 	int global_unregister_update_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
@@ -174,21 +222,38 @@ class ControlOSC
 	int global_unregister_auto_update_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
 
 	
+	MIDI::timestamp_t message_time (void * data);
+	
 	int midi_start_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
 	int midi_stop_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
 	int midi_tick_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
 	int midi_binding_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, MidiBindCommand * info);
 
+	int brother_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
+	int brother_clock_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
+
 	
 	int updown_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, CommandInfo * info);
+	int group_updown_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data, CommandInfo * info);
 	int set_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data,  CommandInfo * info);
 	int get_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data,  CommandInfo * info);
 	int register_update_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data,  CommandInfo * info);
 	int unregister_update_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data,  CommandInfo * info);
 	int register_auto_update_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data,  CommandInfo * info);
 	int unregister_auto_update_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data,  CommandInfo * info);
+	// shared by the un/register handlers, splits the control list
+	void push_update_event (ConfigUpdateEvent::Type type, int instance, const std::string & ctrl, const std::string & returl, const std::string & retpath,
+				short int millisec=0, int first=0, int last=-1);
 	int loadloop_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data,  CommandInfo * info);
 	int saveloop_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data,  CommandInfo * info);
+	int get_audio_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data,  CommandInfo * info);
+	int put_audio_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data,  CommandInfo * info);
+	int set_modulator_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data,  CommandInfo * info);
+	int remove_modulator_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data,  CommandInfo * info);
+	int trigger_modulator_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data,  CommandInfo * info);
+	int get_modulators_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
+	int get_osc_stats_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
+	int bounce_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
 
 	Event::command_t  to_command_t (std::string cmd);
 	std::string       to_command_str (Event::command_t cmd);
@@ -203,6 +268,7 @@ class ControlOSC
 	
 	lo_server _osc_server;
 	lo_server _osc_unix_server;
+	lo_server _osc_tcp_server;
 	std::string _osc_unix_socket_path;
 	
 	int _port;
@@ -212,42 +278,143 @@ class ControlOSC
 	
 	std::map<std::string, lo_address> _retaddr_map;
 
+	// gets answered from the engine's control snapshot in the osc thread.
+	// replies to one client within GET_BATCH_WINDOW_MS go out as one bundle.
+	// the ones the main loop answers keep their place in the batch, so a
+	// client gets its replies in the order it asked
+	struct GetReply {
+		int          instance;
+		std::string  ctrl;
+		float        value;
+		unsigned int pending; // the main loop's answer is due, by id
+	};
+	struct GetBatch {
+		std::string  returl;
+		std::string  retpath;
+		std::vector<GetReply> replies;
+	};
+	std::vector<GetBatch> _get_batches;
+	double                _get_batch_start;
+	unsigned int          _get_next_id;
+
+	// handed from the main loop to the osc thread
+	struct GetAnswer {
+		unsigned int id;
+		float        value;
+	};
+	std::vector<GetAnswer> _get_answers;
+	pthread_mutex_t        _get_answer_lock;
+
+	void queue_get_reply (const std::string & returl, const std::string & retpath, int instance, const std::string & ctrl, float value, unsigned int pending=0);
+	void take_get_answers ();
+	void send_get_batch (GetBatch & batch);
+	void flush_get_replies ();
+	int  get_batch_wait_ms ();
+
 	CommandMap * _cmd_map;
 	
-	typedef std::pair<int, std::string> InstancePair;
-	typedef std::pair<lo_address, std::string> UrlPair;
-	typedef std::list<UrlPair> UrlList;
-	typedef std::map<InstancePair, UrlList > ControlRegistrationMap;
-	typedef std::map<InstancePair, float> LastValueMap;
-	typedef std::map<UrlPair, LastValueMap> UrlMapToLastValueMap;
-
-	typedef struct {
-		UrlPair upair;
-		short int timeout;
-	} UrlPairAuto;
-
-	typedef std::list<UrlPairAuto> UrlListAuto;
-	typedef std::map<InstancePair, UrlListAuto > ControlRegistrationMapAuto;
-	
-	ControlRegistrationMap _registration_map;
-	ControlRegistrationMapAuto _auto_registration_map;
+	// update subscriptions, flat by (instance, control).  a client is an
+	// (address, path) pair in one of MaxUpdateClients slots, each control
+	// has a bitmap of the slots subscribed to it.  auto updates keep one
+	// bitmap per interval, everyone in it is sent the same value at the
+	// same time so the last sent value is kept once per interval.
+	enum { MaxUpdateClients = 64 };
+	typedef uint64_t ClientMask;
+
+	struct UpdateClient
+	{
+		UpdateClient() : port(-1), refs(0) {}
+		std::string  url;
+		std::string  path;
+		int          port;
+		unsigned int refs;
+	};
 
-	UrlMapToLastValueMap _last_value_map;
+	struct UpdateCell
+	{
+		ClientMask  clients;
+		ClientMask  auto_clients[AUTO_UPDATE_RANGE];
+		float       auto_last[AUTO_UPDATE_RANGE];
+	};
 
-	int compare_auto(UrlPairAuto a, UrlPairAuto b);
+	// what the playhead subscribers of a loop were last told
+	struct PlayheadModel
+	{
+		double time;
+		float  pos;
+		float  rate;
+		float  len;   // 0 while the loop grows, no wrapping then
+		int    state;
+		bool   valid;
+	};
 
-	void send_registered_updates(std::string ctrl, float val, int instance, int source=-1);
+	struct UpdateRow
+	{
+		UpdateRow();
+		UpdateCell cells[Event::LAST_CONTROL];
+		// controls with any auto update, so the timer only looks at those
+		std::vector<int> auto_controls;
+		PlayheadModel playhead;
+	};
 
-	bool send_registered_updates(ControlRegistrationMap::iterator & iter,
-				     std::string ctrl, float val, int instance, int source=-1);
-	bool send_registered_auto_updates(ControlRegistrationMapAuto::iterator & iter,
-				    const InstancePair & ipair, float val, const std::list<short int> timeout_list);
+	// row for instance n is n+3, so the selected (-3), global (-2) and
+	// all (-1) registrations have theirs too.  rows are made on first use
+	std::vector<UpdateRow*> _update_rows;
+	UpdateClient _update_clients[MaxUpdateClients];
+
+	UpdateCell * get_update_cell (int instance, Event::control_t ctrl, bool create);
+	int  find_update_client (const std::string & url, const std::string & path, bool create);
+	void release_update_client (int slot);
+	void remove_auto_client (UpdateRow * row, Event::control_t ctrl, int slot);
+	// bucket -1 is on change
+	void add_update_client (int instance, Event::control_t ctrl, int slot, int bucket);
+	void remove_update_client (int instance, Event::control_t ctrl, int slot, bool autoupdate);
+
+	// a registration on -1 is kept as a rule and applied to every loop in
+	// its range as it appears, instead of one registration per loop
+	struct UpdateRule
+	{
+		int slot;
+		int bucket; // -1 is on change
+		int first;
+		int last;   // -1 is open ended
+		std::vector<Event::control_t> controls;
+	};
+	std::vector<UpdateRule> _update_rules;
+
+	void add_update_rule (int slot, int bucket, int first, int last, const std::vector<Event::control_t> & controls);
+	void remove_update_rule (int slot, bool autoupdate, int first, int last, const std::vector<Event::control_t> & controls);
+	void apply_update_rules (int instance);
+	// unregisters every client a send failed to
+	void drop_failed_clients ();
+
+	// everything outbound goes through here, a queue and thread per client
+	OscSender * _sender;
+	void send_strings (const std::string & url, const std::string & path, const std::string & first, const std::string & second);
+
+	void send_registered_updates(Event::control_t ctrl, float val, int instance, int source=-1);
+	void send_registered_auto_updates(int instance, UpdateRow * row, const int * buckets, int nbuckets);
+	// sends a new model only when the old one went wrong
+	void send_playhead_model(int instance, UpdateRow * row);
 	
 
-	
 	typedef std::pair<std::string, std::string> AddrPathPair;
 	typedef std::list<AddrPathPair> AddressList;
 	AddressList _config_registrations;
+	AddressList _config_delta_registrations;
+
+	// loop changes since the last broadcast.  _config_origin has the old
+	// index of every current loop, -1 for the ones added since
+	void begin_config_change (int old_count);
+	void send_config_delta (const AddrPathPair & dest, int loopcount,
+				const std::vector<int> & removed, const std::vector<int> & added);
+
+	std::vector<int> _config_origin;
+	int              _config_old_count;
+	bool             _config_dirty;
+	unsigned int     _config_version;
+	struct timeval   _config_first_change;
+	struct timeval   _config_last_change;
 
 	void validate_returl(std::string & returl);
 };
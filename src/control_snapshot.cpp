@@ -0,0 +1,130 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+#include <cstring>
+
+#include "control_snapshot.hpp"
+
+using namespace SooperLooper;
+
+
+ControlSnapshot::ControlSnapshot ()
+	: _loop_count(0), _selected_loop(-1)
+{
+	for (int n=0; n <= MaxLoops; ++n) {
+		_rows[n] = 0;
+	}
+}
+
+ControlSnapshot::~ControlSnapshot ()
+{
+	for (int n=0; n <= MaxLoops; ++n) {
+		delete _rows[n];
+	}
+}
+
+void
+ControlSnapshot::publish (int row, const float * values, int count)
+{
+	if (row == -2) {
+		row = MaxLoops;
+	}
+	if (row < 0 || row > MaxLoops) {
+		return;
+	}
+	if (count > MaxControls) {
+		count = MaxControls;
+	}
+
+	if (!_rows[row]) {
+		Row * newrow = new Row;
+		__sync_synchronize();
+		_rows[row] = newrow;
+	}
+
+	Row & r = *_rows[row];
+
+	// odd sequence while writing, an invalidated row already is
+	if (!(r.seq & 1)) {
+		r.seq = r.seq + 1;
+	}
+	__sync_synchronize();
+	memcpy (r.values, values, count * sizeof(float));
+	r.count = count;
+	__sync_synchronize();
+	r.seq = r.seq + 1;
+}
+
+void
+ControlSnapshot::invalidate_from (int row)
+{
+	for (int n = row < 0 ? 0 : row; n < MaxLoops; ++n) {
+		Row * r = _rows[n];
+		if (r && !(r->seq & 1)) {
+			r->seq = r->seq + 1;
+		}
+	}
+	__sync_synchronize();
+}
+
+bool
+ControlSnapshot::get (int instance, Event::control_t ctrl, float & value) const
+{
+	int row = instance;
+
+	if (row == -3) {
+		row = _selected_loop;
+	}
+	if (row == -1) {
+		// just use the first
+		row = 0;
+	}
+
+	if (row == -2) {
+		row = MaxLoops;
+	}
+	else if (row < 0 || row >= _loop_count || row >= MaxLoops) {
+		return false;
+	}
+
+	const Row * rp = _rows[row];
+	if (!rp) {
+		return false;
+	}
+	const Row & r = *rp;
+
+	// bounded, a reader never waits on the main thread
+	for (int tries = 0; tries < 3; ++tries) {
+		unsigned int before = r.seq;
+		__sync_synchronize();
+		if (before == 0 || (before & 1)) {
+			continue;
+		}
+		if ((int) ctrl < 0 || (int) ctrl >= r.count) {
+			return false;
+		}
+		float val = r.values[ctrl];
+		__sync_synchronize();
+		if (r.seq == before) {
+			value = val;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,75 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+#ifndef __sooperlooper_control_snapshot__
+#define __sooperlooper_control_snapshot__
+
+#include "event.hpp"
+
+/*
+ * Control values of every loop and the global ones, as last published
+ * by the engine main loop.  The osc thread answers /get requests from
+ * here directly.  Each row is a sequence lock, one writer (main) and any
+ * number of readers, a reader that loses the race to a write gives up
+ * and the request takes the main loop path instead.
+ */
+
+namespace SooperLooper {
+
+class ControlSnapshot
+{
+  public:
+	enum {
+		MaxLoops = 4096, // Engine::MAX_LOOPS
+		MaxControls = 128
+	};
+
+	ControlSnapshot ();
+	~ControlSnapshot ();
+
+	// main thread.  row is a loop index, or -2 for the globals
+	void publish (int row, const float * values, int count);
+	void set_loop_count (int count) { _loop_count = count; }
+	void set_selected_loop (int sel) { _selected_loop = sel; }
+	// main thread.  the loops from row on changed, their rows read as
+	// missing until they are published again
+	void invalidate_from (int row);
+
+	// any thread.  instance as in Event, -1 means the first loop and
+	// -3 the selected one.  false if the value isn't in the snapshot
+	bool get (int instance, Event::control_t ctrl, float & value) const;
+
+  private:
+	struct Row {
+		Row() : seq(0), count(0) {}
+		volatile unsigned int seq;
+		int   count;
+		float values[MaxControls];
+	};
+
+	// allocated by the first publish, the last one holds the globals
+	Row * volatile _rows[MaxLoops + 1];
+
+	volatile int _loop_count;
+	volatile int _selected_loop;
+};
+
+};
+
+#endif
@@ -19,6 +19,7 @@
 #include <iostream>
 
 #include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <cstring>
@@ -36,10 +37,14 @@
 #include "version.h"
 #include "engine.hpp"
 #include "looper.hpp"
+#include "plugin.hpp"
 #include "control_osc.hpp"
 #include "midi_bind.hpp"
 #include "midi_bridge.hpp"
 #include "utils.hpp"
+#include "trace.hpp"
+#include "brother_clock.hpp"
+#include "worker.hpp"
 
 using namespace SooperLooper;
 using namespace std;
@@ -48,11 +53,263 @@ using namespace sigc;
 
 #define MAX_EVENTS 1024
 #define MAX_SYNC_EVENTS 1024
+// a pending bounce swap gives up when its reference stops running for this long
+#define BOUNCE_STALL_SECS 1.0
+// a bounce renders at most this many reference lengths to line its sources up
+#define BOUNCE_MAX_CYCLES 16
+// how far, in frames, a source may be from where the mix has it at the swap
+#define BOUNCE_PHASE_SLACK 16.0
 
 #define TEMPO_DIFF(t1, t2) (fabs(t1-t2) > 0.000001)
 
 //#define DEBUG 1
 
+namespace SooperLooper {
+
+// loads or saves one loop's audio file
+class LoopFileJob : public WorkerJob
+{
+  public:
+	LoopFileJob (Looper * looper, LoopFileEvent::Type type, const string & fname, ControlOSC * osc,
+		     const string & ret_url, const string & ret_path)
+		: WorkerJob (looper), _looper(looper), _type(type), _filename(fname), _osc(osc),
+		  _ret_url(ret_url), _ret_path(ret_path), _ok(false) {}
+
+	void run () {
+		if (is_cancelled()) return;
+
+		if (_type == LoopFileEvent::Load) {
+			_ok = _looper->load_loop (_filename);
+		}
+		else {
+			_ok = _looper->save_loop (_filename);
+		}
+	}
+
+	void finish () {
+		if (!_ok && !_ret_url.empty()) {
+			_osc->send_error (_ret_url, _ret_path, _type == LoopFileEvent::Load ? "Loop Load Failed" : "Loop Save Failed");
+		}
+	}
+
+  protected:
+	Looper *            _looper;
+	LoopFileEvent::Type _type;
+	string              _filename;
+	ControlOSC *        _osc;
+	string              _ret_url;
+	string              _ret_path;
+	bool                _ok;
+};
+
+// writes the loop audio of a session and then the session file itself,
+// the xml was already built in the main thread
+class SessionSaveJob : public WorkerJob
+{
+  public:
+	SessionSaveJob (XMLTree * doc, const string & fname, Engine::SessionAudioList & audiofiles, ControlOSC * osc,
+			const string & ret_url, const string & ret_path)
+		: _doc(doc), _filename(fname), _osc(osc), _ret_url(ret_url), _ret_path(ret_path), _ok(false)
+	{
+		_audiofiles.swap (audiofiles);
+		for (Engine::SessionAudioList::iterator i = _audiofiles.begin(); i != _audiofiles.end(); ++i) {
+			add_owner (i->first);
+		}
+	}
+
+	~SessionSaveJob() { delete _doc; }
+
+	void run () {
+		for (Engine::SessionAudioList::iterator i = _audiofiles.begin(); i != _audiofiles.end(); ++i) {
+			if (is_cancelled()) {
+				fprintf (stderr, "Session save of %s cancelled\n", _filename.c_str());
+				return;
+			}
+			i->first->save_loop (i->second, LoopFileEvent::FormatFloat);
+		}
+
+		if (_doc->write (_filename)) {
+			fprintf (stderr, "Stored session as %s\n", _filename.c_str());
+			_ok = true;
+		}
+		else {
+			fprintf (stderr, "Failed to store session as %s\n", _filename.c_str());
+		}
+	}
+
+	void finish () {
+		if (!_ok && !_ret_url.empty()) {
+			_osc->send_error (_ret_url, _ret_path, "Session Save Failed");
+		}
+	}
+
+  protected:
+	XMLTree *                 _doc;
+	string                    _filename;
+	Engine::SessionAudioList  _audiofiles;
+	ControlOSC *              _osc;
+	string                    _ret_url;
+	string                    _ret_path;
+	bool                      _ok;
+};
+
+// writes out the trace buffers, they are only read
+class TraceSaveJob : public WorkerJob
+{
+  public:
+	TraceSaveJob (const string & fname, ControlOSC * osc, const string & ret_url, const string & ret_path)
+		: _filename(fname), _osc(osc), _ret_url(ret_url), _ret_path(ret_path), _ok(false) {}
+
+	void run () {
+		if (is_cancelled()) return;
+		_ok = Trace::write_json (_filename);
+	}
+
+	void finish () {
+		if (!_ok && !_ret_url.empty()) {
+			_osc->send_error (_ret_url, _ret_path, "Trace Save Failed");
+		}
+	}
+
+  protected:
+	string        _filename;
+	ControlOSC *  _osc;
+	string        _ret_url;
+	string        _ret_path;
+	bool          _ok;
+};
+
+// destroys removed loops off the main thread.  all the ports go first, so
+// the graph settles early, then the loop memory and resampler state.
+// with ports_only the loops are left alone otherwise, they are still in use
+class LoopReapJob : public WorkerJob
+{
+  public:
+	LoopReapJob (const void * owner, vector<Looper*> & loopers, bool ports_only=false)
+		: WorkerJob (owner), _ports_only(ports_only) { _loopers.swap (loopers); }
+
+	~LoopReapJob() { reap(); }
+
+	void run () { reap(); }
+
+  protected:
+	void reap () {
+		// deletes even when cancelled, that only happens at shutdown
+		for (vector<Looper*>::iterator i = _loopers.begin(); i != _loopers.end(); ++i) {
+			(*i)->release_ports ();
+		}
+		if (!_ports_only) {
+			for (vector<Looper*>::iterator i = _loopers.begin(); i != _loopers.end(); ++i) {
+				delete *i;
+			}
+		}
+		_loopers.clear();
+	}
+
+	vector<Looper*> _loopers;
+	bool            _ports_only;
+};
+
+// mixes loops straight from their memory into the target loop, which is
+// left paused at its start for the rt thread to trigger when they line up
+class BounceJob : public WorkerJob
+{
+  public:
+	struct Source {
+		Looper *      looper;
+		double        offset; // loop frame heard at the first bounced frame
+		double        rate;   // loop frames per bounced frame, negative reversed
+		unsigned int  chans;
+		vector<float> gains;  // chans x target channels
+	};
+
+	BounceJob (Engine * engine, vector<Source> & sources, const Engine::BounceSwap & swap,
+		   nframes_t frames, unsigned int chans, const string & ret_url, const string & ret_path)
+		: WorkerJob (swap.target), _engine(engine), _swap(swap), _frames(frames), _chans(chans),
+		  _ret_url(ret_url), _ret_path(ret_path), _ok(false)
+	{
+		_sources.swap (sources);
+		for (vector<Source>::iterator i = _sources.begin(); i != _sources.end(); ++i) {
+			add_owner (i->looper);
+		}
+	}
+
+	void run () {
+		vector<float> mix (_frames * _chans, 0.0f);
+		vector<float> audio;
+
+		for (vector<Source>::iterator i = _sources.begin(); i != _sources.end(); ++i) {
+			if (is_cancelled()) return;
+
+			nframes_t len = 0;
+			// without the loop lock, the audio thread keeps playing it.  a
+			// loop that kept being written to meanwhile fails the bounce
+			if (!i->looper->get_loop_audio (audio, len)) {
+				return;
+			}
+			if (len > 0) {
+				mix_source (*i, audio, len, mix);
+			}
+		}
+
+		if (is_cancelled()) return;
+
+		_ok = _swap.target->load_loop_audio (&mix[0], _chans, _frames, true);
+	}
+
+	void finish () {
+		_engine->bounce_rendered (_ok, is_cancelled(), _swap, _ret_url, _ret_path);
+	}
+
+  protected:
+	void mix_source (const Source & src, const vector<float> & audio, nframes_t len, vector<float> & mix) {
+		const unsigned int ch = src.chans;
+		double pos = fmod (src.offset, (double) len);
+		if (pos < 0.0) {
+			pos += len;
+		}
+
+		for (nframes_t t=0; t < _frames; ++t) {
+			// linear interpolation, the rate is rarely far from 1
+			nframes_t i0 = (nframes_t) pos;
+			if (i0 >= len) {
+				i0 = 0;
+			}
+			nframes_t i1 = (i0 + 1 < len) ? i0 + 1 : 0;
+			float frac = (float) (pos - i0);
+			float * out = &mix[t * _chans];
+
+			for (unsigned int c=0; c < ch; ++c) {
+				float a = audio[i0 * ch + c];
+				float smp = a + frac * (audio[i1 * ch + c] - a);
+				const float * gain = &src.gains[c * _chans];
+				for (unsigned int o=0; o < _chans; ++o) {
+					out[o] += smp * gain[o];
+				}
+			}
+
+			pos += src.rate;
+			if (pos >= len) {
+				pos -= len;
+			}
+			else if (pos < 0.0) {
+				pos += len;
+			}
+		}
+	}
+
+	Engine *            _engine;
+	vector<Source>      _sources;
+	Engine::BounceSwap  _swap;
+	nframes_t           _frames;
+	unsigned int        _chans;
+	string              _ret_url;
+	string              _ret_path;
+	bool                _ok;
+};
+
+}
+
 Engine::Engine ()
 {
 	_ok = false;
@@ -60,10 +317,28 @@ Engine::Engine ()
 	_osc = 0;
 	_event_generator = 0;
 	_event_queue = 0;
+	_timed_event_queue = 0;
+	_timed_pending = 0;
+	_timed_pending_count = 0;
+	_modulator_queue = 0;
+	_bounce_queue = 0;
+	_rt_bounce_pending = false;
+	_rt_bounce_waited = 0;
+	_rt_bounce_stalled = 0;
+	_bounce_running = false;
+	_brother_clock = 0;
+	_sync_beats = 0.0;
 	_def_channel_cnt = 2;
+	_quiet = false;
 	_def_loop_secs = 200;
 	_tempo = 110.0;
 	_eighth_cycle = 16.0f;
+	_loop_tempo = 0.0f;
+	_loop_tempo_version = 1;
+	_sync_pulse_age = 0;
+	_common_in_history_pos = 0;
+	_last_history_frames = 0;
+	_snapshot_sweep = 0;
 	_sync_source = NoSync;
 	_tempo_counter = 0;
 	_tempo_frames = 0;
@@ -88,6 +363,10 @@ Engine::Engine ()
 	_use_temp_input = true; // all the time for now
 	_ignore_quit = false;
 	_selected_loop = -1; // all
+	_group_names.resize (MAX_LOOP_GROUPS);
+	for (int g=0; g < MAX_LOOP_GROUPS; ++g) {
+		_group_gains[g] = 1.0f;
+	}
 	_output_midi_clock = false;
 	_smart_eighths = true;
 	_force_next_clock_start = false;
@@ -100,6 +379,8 @@ Engine::Engine ()
 	_tempo_changed = false;
 	_beat_occurred = false;
 	_conns_changed = false;
+	_latency_dirty = false;
+	_latency_published = false;
 	_beatstamp = 0.0;
 	_prev_beatstamp = 0.0;
 
@@ -112,8 +393,16 @@ Engine::Engine ()
 	_use_sync_stop = false;
 	_send_midi_start_on_trigger = false;
 	_send_midi_start_after_next_hit = false;
+	_timetag_offset = 0.01;
+	_timetag_late_count = 0;
+	_timetag_frame_offset = 0.0f;
+	_contention_checked.tv_sec = 0;
+	_contention_checked.tv_usec = 0;
+	memset (_contention_logged, 0, sizeof(_contention_logged));
 
 	_load_sess_event = NULL;
+	_worker = 0;
+	_reaper = 0;
 
 	// for now just use the current time!
 	_unique_id = (int) ::time(NULL);
@@ -157,6 +446,11 @@ bool Engine::initialize(AudioDriver * driver, int buschans, int port, string pin
 		memset(inbuf, 0, sizeof(float) * driver->get_buffersize());
 		_temp_input_buffers.push_back(inbuf);
 
+		sample_t * histbuf = new float[COMMON_INPUT_HISTORY];
+		memset(histbuf, 0, sizeof(float) * COMMON_INPUT_HISTORY);
+		_common_in_history.push_back(histbuf);
+		_common_in_peaks.push_back(0.0f);
+
 		_common_input_buffers.push_back(0); // fill to correct size
 		
 		snprintf(tmpstr, sizeof(tmpstr), "common_out_%d", i+1);
@@ -174,19 +468,30 @@ bool Engine::initialize(AudioDriver * driver, int buschans, int port, string pin
 
 
 	_event_generator = new EventGenerator(_driver->get_samplerate());
+	_brother_clock = new BrotherClock();
+	_worker = new Worker(2);
+	_worker->JobFinished.connect (mem_fun(*this, &Engine::worker_job_finished));
+	// freeing dead loops is never urgent, it stays out of everyone's way
+	_reaper = new Worker(1, 64, true);
 	_event_queue = new RingBuffer<Event> (MAX_EVENTS);
 	_midi_event_queue = new RingBuffer<Event> (MAX_EVENTS);
 	_sync_queue = new RingBuffer<Event> (MAX_SYNC_EVENTS);
+	_timed_event_queue = new RingBuffer<Event> (MAX_EVENTS);
+	_timed_pending = new Event[MAX_EVENTS];
 	_nonrt_update_event_queue = new RingBuffer<Event> (MAX_SYNC_EVENTS);
+	// room for clearing every slot and filling it again from a session
+	_modulator_queue = new RingBuffer<ModulatorChange> (4 * MAX_MODULATORS);
+	_bounce_queue = new RingBuffer<BounceSwap> (4);
 
 	_nonrt_event_queue = new RingBuffer<EventNonRT *> (MAX_EVENTS);
 
-	_loop_manage_to_rt_queue = new RingBuffer<LoopManageEvent> (16);
-	_loop_manage_to_main_queue = new RingBuffer<LoopManageEvent> (16);
+	// a session load can have every loop removed and every new one added in flight
+	_loop_manage_to_rt_queue = new RingBuffer<LoopManageEvent> (2 * MAX_LOOPS + 2 * MAX_LOOP_GROUPS);
+	_loop_manage_to_main_queue = new RingBuffer<LoopManageEvent> (2 * MAX_LOOPS);
 
 	// reserve space in instance vectors to try to be RT safe
-	_instances.reserve(128);
-	_rt_instances.reserve(128);
+	_instances.reserve(MAX_LOOPS);
+	_rt_instances.reserve(MAX_LOOPS);
 	
 	_internal_sync_buf = new float[driver->get_buffersize()];
 	memset(_internal_sync_buf, 0, sizeof(float) * driver->get_buffersize());
@@ -214,6 +519,32 @@ bool Engine::initialize(AudioDriver * driver, int buschans, int port, string pin
 void
 Engine::cleanup()
 {
+	// before the osc, completions still report errors
+	if (_worker) {
+		delete _worker;
+		_worker = 0;
+	}
+
+	// removed loops the rt thread never handed back, and those not reaped yet
+	LoopManageEvent lmev;
+	while (_loop_manage_to_rt_queue && _loop_manage_to_rt_queue->read (&lmev, 1) == 1) {
+		if (lmev.etype == LoopManageEvent::RemoveLoop) {
+			_dead_loops.push_back (lmev.looper);
+		}
+	}
+	while (_loop_manage_to_main_queue && _loop_manage_to_main_queue->read (&lmev, 1) == 1) {
+		if (lmev.etype == LoopManageEvent::RemoveLoop) {
+			_dead_loops.push_back (lmev.looper);
+		}
+	}
+	reap_dead_loops ();
+
+	if (_reaper) {
+		// finishes what is running, the queued jobs reap as they are deleted
+		delete _reaper;
+		_reaper = 0;
+	}
+
 	if (_osc) {
 		delete _osc;
 		_osc = 0;
@@ -234,6 +565,15 @@ Engine::cleanup()
 		_sync_queue = 0;
 	}
 
+	if (_timed_event_queue) {
+		delete _timed_event_queue;
+		_timed_event_queue = 0;
+	}
+	if (_timed_pending) {
+		delete [] _timed_pending;
+		_timed_pending = 0;
+	}
+
 	if (_nonrt_event_queue) {
 		delete _nonrt_event_queue;
 		_nonrt_event_queue = 0;
@@ -243,12 +583,27 @@ Engine::cleanup()
 		delete _nonrt_update_event_queue;
 		_nonrt_update_event_queue = 0;
 	}
+
+	if (_modulator_queue) {
+		delete _modulator_queue;
+		_modulator_queue = 0;
+	}
+
+	if (_bounce_queue) {
+		delete _bounce_queue;
+		_bounce_queue = 0;
+	}
 	
 	if (_event_generator) {
 		delete _event_generator;
 		_event_generator = 0;
 	}
 
+	if (_brother_clock) {
+		delete _brother_clock;
+		_brother_clock = 0;
+	}
+
 	if (_internal_sync_buf) {
 		delete [] _internal_sync_buf;
 		_internal_sync_buf = 0;
@@ -272,6 +627,12 @@ Engine::cleanup()
 		}
 	}
 	_temp_input_buffers.clear();
+
+	for (vector<sample_t *>::iterator iter = _common_in_history.begin(); iter != _common_in_history.end(); ++iter) {
+		delete [] *iter;
+	}
+	_common_in_history.clear();
+	_common_in_peaks.clear();
 	
 	// delete temp common input buffers
 	for (vector<sample_t *>::iterator iter = _temp_output_buffers.begin(); iter != _temp_output_buffers.end(); ++iter) 
@@ -418,21 +779,41 @@ Engine::buffersize_changed (nframes_t nframes)
 		memset(_internal_sync_buf, 0, sizeof(float) * nframes);
 
 		_buffersize = nframes;
+
+		// the input delay lines are sized by period
+		_latency_dirty = true;
 	}
 }
 
 void
 Engine::connections_changed()
 {
-	// called from the audio thread callback
-	size_t m = 0;
-	for (Instances::iterator i = _rt_instances.begin(); i != _rt_instances.end(); ++i, ++m)
-	{
-		(*i)->recompute_latencies ();
+	// called from the driver's latency callback.  querying the ports is left
+	// to the main thread, which hands the results to the rt thread
+	_latency_dirty = true;
+
+	TentativeLockMonitor mon(_event_loop_lock,  __LINE__, __FILE__);
+	if (!mon.locked()) {
+		Contention::count (Contention::WakeupLockMisses);
+	}
+	pthread_cond_signal (&_event_cond);
+}
+
+void
+Engine::update_latencies ()
+{
+	// main thread
+	SL_TRACE_SCOPE("update_latencies");
+
+	_latency_dirty = false;
+
+	for (Instances::iterator i = _instances.begin(); i != _instances.end(); ++i) {
+		(*i)->update_port_latencies ();
 	}
 
-	// cause certain values to be updated
-	_conns_changed = true;
+	// make sure the values are visible before the flag
+	__sync_synchronize();
+	_latency_published = true;
 }
 
 void 
@@ -532,24 +913,222 @@ Engine::prepare_buffers(nframes_t nframes)
 	
 }
 
+void
+Engine::update_common_input_history (nframes_t nframes)
+{
+	// idle loops don't feed their input delay lines from the common inputs,
+	// they are refilled from here when the loop wakes up
+	const nframes_t mask = COMMON_INPUT_HISTORY - 1;
+
+	_common_in_history_pos = (_common_in_history_pos + _last_history_frames) & mask;
+	_last_history_frames = nframes;
+
+	for (size_t i=0; i < _common_in_history.size(); ++i)
+	{
+		sample_t * inbuf = get_common_input_buffer (i);
+		sample_t * histbuf = _common_in_history[i];
+		nframes_t pos = _common_in_history_pos;
+		float peak = 0.0f;
+
+		if (!inbuf) {
+			continue;
+		}
+
+		for (nframes_t n = 0; n < nframes; ++n) {
+			histbuf[pos] = inbuf[n];
+			pos = (pos + 1) & mask;
+			peak = f_max (peak, fabsf(inbuf[n]));
+		}
+		_common_in_peaks[i] = peak;
+	}
+}
+
+bool
+Engine::get_common_input_history (unsigned int chan, nframes_t offset, nframes_t back, sample_t * dest, nframes_t frames)
+{
+	const nframes_t mask = COMMON_INPUT_HISTORY - 1;
+
+	if (chan >= _common_in_history.size() || back > get_common_input_history_size() || frames > back) {
+		return false;
+	}
+
+	sample_t * histbuf = _common_in_history[chan];
+	nframes_t pos = (_common_in_history_pos + offset - back) & mask;
+
+	for (nframes_t n = 0; n < frames; ++n) {
+		dest[n] = histbuf[pos];
+		pos = (pos + 1) & mask;
+	}
+	return true;
+}
+
+void
+Engine::update_sync_pulse_age (nframes_t nframes)
+{
+	// the same count the loop cores keep in passthrough, from the buffer
+	// everyone but the sync source loop follows
+	sample_t * syncbuf = _internal_sync_buf;
+
+	if ((int)_sync_source > 0 && (int)_sync_source <= (int) _rt_instances.size()) {
+		syncbuf = _rt_instances[(int)_sync_source - 1]->get_sync_out_buf();
+	}
+
+	for (nframes_t n = nframes; n > 0; --n) {
+		if (syncbuf[n-1] > 1.5f) {
+			_sync_pulse_age = nframes - n;
+			return;
+		}
+	}
+	_sync_pulse_age += nframes;
+}
+
 
 bool
 Engine::add_loop (unsigned int chans, float loopsecs, bool discrete)
 {
-	int n;
-	
-	n = _instances.size();
-	
-	Looper * instance;
-	
-	instance = new Looper (_driver, (unsigned int) n, chans, loopsecs, discrete || _force_discrete);
-	
-	if (!(*instance)()) {
+	return add_loops (1, chans, loopsecs, discrete);
+}
+
+struct LooperBuildPool
+{
+	AudioDriver * driver;
+	std::vector<Engine::LooperBuild> * builds;
+	volatile int next;
+};
+
+static void
+run_looper_builds (LooperBuildPool * pool)
+{
+	int count = (int) pool->builds->size();
+	int idx;
+
+	while ((idx = __sync_fetch_and_add (&pool->next, 1)) < count) {
+		Engine::LooperBuild & b = (*pool->builds)[idx];
+		SL_TRACE_SCOPE_ARG("build looper", b.index);
+
+		// ports are registered later, in index order from the calling thread
+		if (b.node) {
+			b.looper = new Looper (pool->driver, *b.node, true);
+		}
+		else {
+			b.looper = new Looper (pool->driver, b.index, b.chans, b.loopsecs, b.discrete, true);
+		}
+	}
+}
+
+static void *
+looper_build_thread (void * arg)
+{
+	SL_TRACE_THREAD("looper build");
+	run_looper_builds ((LooperBuildPool *) arg);
+	return 0;
+}
+
+void
+Engine::build_loopers (std::vector<LooperBuild> & builds)
+{
+	// the DSP setup of each looper is independent, so
+	// spread the construction over the available cpus
+	LooperBuildPool pool;
+	pool.driver = _driver;
+	pool.builds = &builds;
+	pool.next = 0;
+
+	long ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+	size_t nthreads = (ncpus > 1) ? (size_t) ncpus : 1;
+	if (nthreads > builds.size()) {
+		nthreads = builds.size();
+	}
+
+	std::vector<pthread_t> threads;
+	for (size_t i=1; i < nthreads; ++i) {
+		pthread_t tid;
+		if (pthread_create (&tid, NULL, looper_build_thread, &pool) == 0) {
+			threads.push_back (tid);
+		}
+	}
+
+	// help out
+	run_looper_builds (&pool);
+
+	for (size_t i=0; i < threads.size(); ++i) {
+		pthread_join (threads[i], NULL);
+	}
+}
+
+static double
+msecs_between (const struct timeval & a, const struct timeval & b)
+{
+	return (b.tv_sec - a.tv_sec) * 1000.0 + (b.tv_usec - a.tv_usec) / 1000.0;
+}
+
+bool
+Engine::add_loops (unsigned int count, unsigned int chans, float loopsecs, bool discrete)
+{
+	if (count == 0) {
+		return true;
+	}
+
+	struct timeval t0, t1, t2, t3;
+	size_t n = _instances.size();
+	bool capped = false;
+
+	if (n + count > (size_t) MAX_LOOPS) {
+		cerr << "sooperlooper: at most " << MAX_LOOPS << " loops, not adding " << (n + count - MAX_LOOPS) << " of them" << endl;
+		if (n >= (size_t) MAX_LOOPS) {
+			return false;
+		}
+		count = MAX_LOOPS - n;
+		capped = true;
+	}
+
+	std::vector<LooperBuild> builds (count);
+
+	for (unsigned int i=0; i < count; ++i) {
+		builds[i].index = n + i;
+		builds[i].chans = chans;
+		builds[i].loopsecs = loopsecs;
+		builds[i].discrete = discrete || _force_discrete;
+	}
+
+	gettimeofday (&t0, NULL);
+	build_loopers (builds);
+	wait_for_reaped_ports ();
+	gettimeofday (&t1, NULL);
+
+	size_t ok = 0;
+	for (; ok < builds.size(); ++ok) {
+		if (!(*builds[ok].looper)() || !builds[ok].looper->register_ports()) {
+			break;
+		}
+	}
+	gettimeofday (&t2, NULL);
+
+	for (size_t i=0; i < ok; ++i) {
+		set_initial_loop_controls (builds[i].looper);
+		add_loop (builds[i].looper);
+	}
+	gettimeofday (&t3, NULL);
+
+	if (ok < builds.size()) {
+		// indexes must stay contiguous, so drop everything past the failure
 		cerr << "can't create a new loop!\n";
-		delete instance;
-		return false;
+		for (size_t i=ok; i < builds.size(); ++i) {
+			delete builds[i].looper;
+		}
 	}
-	
+
+	if (count > 1 && !_quiet) {
+		fprintf (stderr, "created %u loops: construction %.1f ms, port registration %.1f ms, engine add %.1f ms\n",
+			 (unsigned int) ok, msecs_between (t0, t1), msecs_between (t1, t2), msecs_between (t2, t3));
+	}
+
+	return ok == builds.size() && !capped;
+}
+
+void
+Engine::set_initial_loop_controls (Looper * instance)
+{
 	// set some initial controls
 	float quantize_value = QUANT_OFF;
 	float round_value = 0.0f;
@@ -573,16 +1152,18 @@ Engine::add_loop (unsigned int chans, float loopsecs, bool discrete)
 	instance->set_port (MuteQuantized, mutequant);
 	instance->set_port (OverdubQuantized, odubquant);
     instance->set_replace_quantized(replquant);
-	return add_loop (instance);
 }
 
 bool
 Engine::add_loop (Looper * instance)
 {
 	_instances.push_back (instance);
+	// the row may still hold a loop that was there before
+	invalidate_snapshot_from (_instances.size() - 1);
 	
 	bool val = _auto_disable_latency && _target_common_dry > 0.0f;
 	instance->set_disable_latency_compensation (val);
+	instance->update_port_latencies ();
 	instance->set_port (EighthPerCycleLoop, _eighth_cycle);
 	instance->set_port (TempoInput, _tempo);
 
@@ -601,22 +1182,43 @@ Engine::add_loop (Looper * instance)
 bool
 Engine::remove_loop (Looper * looper)
 {
+	int index = -1;
 
 	if (_instances.back() == looper) {
 		_instances.pop_back();
+		index = _instances.size();
 	}
 	else {
 		// less efficient
 		Instances::iterator iter = find (_instances.begin(), _instances.end(), looper);
 		if (iter != _instances.end()) {
+			index = iter - _instances.begin();
 			_instances.erase(iter);
 		}
 	}
-	
-	delete looper;
 
-	LoopRemoved(); // emit
+	Instances::iterator pending = find (_removing.begin(), _removing.end(), looper);
+	if (pending != _removing.end()) {
+		_removing.erase (pending);
+	}
+
+	// the modulators of the loops after it move down with them
+	modulators_loop_removed (index);
+	if (index >= 0) {
+		invalidate_snapshot_from (index);
+	}
+
+	// its own file jobs are cancelled.  a job shared with other loops, a
+	// session save, goes on and the loop is destroyed after it
+	if (_worker) {
+		_worker->release_owner (looper);
+	}
 	
+	// destroyed later by reap_dead_loops()
+	_dead_loops.push_back (looper);
+
+	LoopRemoved(index); // emit
+
 	update_sync_source();
 
 	if (_selected_loop >= (int) _instances.size()) {
@@ -668,60 +1270,129 @@ Engine::get_osc_port ()
 }
 
 
+static inline Event * queued_event_at (RingBuffer<Event>::rw_vector & vec, size_t pos, size_t limit)
+{
+	if (pos >= limit) {
+		return 0;
+	}
+	return (pos < vec.len[0]) ? &vec.buf[0][pos] : &vec.buf[1][pos - vec.len[0]];
+}
+
 static inline Event * next_rt_event (RingBuffer<Event>::rw_vector & vec, size_t & pos,
-                                     RingBuffer<Event>::rw_vector & midivec, size_t & midipos)
+                                     RingBuffer<Event>::rw_vector & midivec, size_t & midipos,
+                                     RingBuffer<Event>::rw_vector & timedvec, size_t & timedpos, size_t timedlen)
 {
-	Event * e1 = 0;
-	Event * e2 = 0;
+	Event * e1 = queued_event_at (vec, pos, vec.len[0] + vec.len[1]);
+	Event * e2 = queued_event_at (midivec, midipos, midivec.len[0] + midivec.len[1]);
+	Event * e3 = queued_event_at (timedvec, timedpos, timedlen);
+	Event * evt = e1;
+	size_t * evtpos = &pos;
 	
-	if (pos < vec.len[0]) {
-		e1 = &vec.buf[0][pos];
+	// pick the earliest fragpos
+
+	if (e2 && (!evt || e2->FragmentPos() <= evt->FragmentPos())) {
+		evt = e2;
+		evtpos = &midipos;
 	}
-	else if (pos < (vec.len[0] + vec.len[1])) {
-		e1 = &vec.buf[1][pos - vec.len[0]];
+	if (e3 && (!evt || e3->FragmentPos() < evt->FragmentPos())) {
+		evt = e3;
+		evtpos = &timedpos;
 	}
 
-	if (midipos < midivec.len[0]) {
-		e2 = &midivec.buf[0][midipos];
+	if (evt) {
+		++(*evtpos);
 	}
-	else if (midipos < (midivec.len[0] + midivec.len[1])) {
-		e2 = &midivec.buf[1][midipos - midivec.len[0]];
+
+	return evt;
+}
+
+inline void
+Engine::note_timed_event (Event * evt)
+{
+	// how far behind its intended frame a scheduled event is applied
+	double offset = _event_generator->fragmentOffset (evt->getTimestamp());
+	float late = 0.0f;
+
+	if (offset < 0.0) {
+		++_timetag_late_count;
+		late = (float) -offset;
 	}
 
-	// pick the earliest fragpos
+	_timetag_frame_offset += 0.1f * (late - _timetag_frame_offset);
+}
 
-	if (e1 && e2) {
-		if (e1->FragmentPos() < e2->FragmentPos()) {
-			++pos;
-			return e1;
-		}
-		else {
-			++midipos;
-			return e2;
+size_t
+Engine::due_timed_events (RingBuffer<Event>::rw_vector & vec)
+{
+	// timed events are held until the fragment they fall in, those in
+	// vec are in timestamp order
+	size_t avail = vec.len[0] + vec.len[1];
+	size_t due = 0;
+	Event * evt;
+	
+	while ((evt = queued_event_at (vec, due, avail)) != 0
+	       && !_event_generator->isFuture (evt->getTimestamp()))
+	{
+		if (evt->getTimestamp() > 0) {
+			note_timed_event (evt);
 		}
-	}
-	else if (e1) {
-		++pos;
-		return e1;
-	}
-	else if (e2) {
-		++midipos;
-		return e2;
+		++due;
 	}
 
-	return 0;
+	return due;
 }
 	
-void Engine::process_rt_loop_manage_events ()
+void
+Engine::collect_timed_events ()
 {
-	// pull off all loop management events from the main thread
-	LoopManageEvent * lmevt;
-	
-	while (is_ok() && _loop_manage_to_rt_queue->read_space() > 0)
+	RingBuffer<Event>::rw_vector vec;
+	_timed_event_queue->get_read_vector (&vec);
+
+	size_t avail = vec.len[0] + vec.len[1];
+	size_t taken = 0;
+	Event * evt;
+
+	// stays queued when we are full, the pushers see the drops
+	while (_timed_pending_count < (size_t) MAX_EVENTS && (evt = queued_event_at (vec, taken, avail)) != 0)
 	{
-		RingBuffer<LoopManageEvent>::rw_vector vec;
-		_loop_manage_to_rt_queue->get_read_vector(&vec);
-		lmevt = vec.buf[0];
+		// usually the latest one, after any with the same timestamp
+		size_t n = _timed_pending_count;
+		while (n > 0 && _timed_pending[n-1].getTimestamp() > evt->getTimestamp()) {
+			_timed_pending[n] = _timed_pending[n-1];
+			--n;
+		}
+		_timed_pending[n] = *evt;
+		++_timed_pending_count;
+		++taken;
+	}
+
+	_timed_event_queue->increment_read_ptr (taken);
+}
+
+void
+Engine::drop_timed_events (size_t count)
+{
+	if (count == 0) {
+		return;
+	}
+	for (size_t n = count; n < _timed_pending_count; ++n) {
+		_timed_pending[n - count] = _timed_pending[n];
+	}
+	_timed_pending_count -= count;
+}
+
+void Engine::process_rt_loop_manage_events ()
+{
+	// pull off all loop management events from the main thread
+	LoopManageEvent * lmevt;
+
+	SL_TRACE_SCOPE("process_rt_loop_manage_events");
+	
+	while (is_ok() && _loop_manage_to_rt_queue->read_space() > 0)
+	{
+		RingBuffer<LoopManageEvent>::rw_vector vec;
+		_loop_manage_to_rt_queue->get_read_vector(&vec);
+		lmevt = vec.buf[0];
 		
 		// we must remove/add this loop from our copy of the vector
 		if (lmevt->etype == LoopManageEvent::RemoveLoop)
@@ -753,12 +1424,121 @@ void Engine::process_rt_loop_manage_events ()
 			// signal main loop
 			push_loop_manage_to_main (*lmevt);
 		}
+		else if (lmevt->etype == LoopManageEvent::SetGroupGain)
+		{
+			set_rt_group_gain (lmevt->group, lmevt->value);
+		}
+		else if (lmevt->etype == LoopManageEvent::ResetGroup)
+		{
+			Event ev;
+			ev.Type = Event::type_control_change;
+			ev.Control = Event::LoopGroup;
+			ev.Value = -1.0f;
+
+			int m = 0;
+			for (Instances::iterator i = _rt_instances.begin(); i != _rt_instances.end(); ++i, ++m) {
+				if ((*i)->get_loop_group() == lmevt->group) {
+					ev.Instance = m;
+					(*i)->do_event (&ev);
+					do_push_control_event (_nonrt_update_event_queue, ev.Type, ev.Control, ev.Value, m);
+				}
+			}
+
+			set_rt_group_gain (lmevt->group, 1.0f);
+		}
 		
 		_loop_manage_to_rt_queue->increment_read_ptr(1);
 	}
 	
 }
 
+void
+Engine::set_rt_group_gain (int group, float gain)
+{
+	// rt thread, the same as a GroupGain control event
+	if (group < 0 || group >= MAX_LOOP_GROUPS) {
+		return;
+	}
+	_group_gains[group] = gain;
+	do_push_control_event (_nonrt_update_event_queue, Event::type_control_change, Event::GroupGain, gain, -4, -1, 0, (int8_t) group);
+}
+
+
+inline bool
+Engine::event_targets_loop (const Event * evt, int m)
+{
+	return (evt->Instance == -1 || evt->Instance == m
+		|| (evt->Instance == -3 && (_selected_loop == m || _selected_loop == -1))
+		|| (evt->Instance == -4 && _rt_instances[m]->get_loop_group() == evt->Group));
+}
+
+inline bool
+Engine::is_global_rt_event (const Event * evt)
+{
+	return (evt->Instance == -2 
+		|| evt->Command == Event::SOLO
+		|| evt->Command == Event::SOLO_NEXT
+		|| evt->Command == Event::SOLO_PREV
+		|| evt->Command == Event::RECORD_SOLO_NEXT
+		|| evt->Command == Event::RECORD_SOLO_PREV
+		|| evt->Command == Event::RECORD_SOLO
+		|| evt->Command == Event::RECORD_EXCLUSIVE_NEXT
+		|| evt->Command == Event::RECORD_EXCLUSIVE_PREV
+		|| evt->Command == Event::RECORD_EXCLUSIVE
+		|| evt->Command == Event::RECORD_OR_OVERDUB_SOLO
+		|| evt->Command == Event::RECORD_OR_OVERDUB_SOLO_TRIG
+		|| evt->Command == Event::RECORD_OVERDUB_END_SOLO
+		|| evt->Command == Event::RECORD_OVERDUB_END_SOLO_TRIG
+		|| evt->Command == Event::RECORD_OR_OVERDUB_EXCL_NEXT
+		|| evt->Command == Event::RECORD_OR_OVERDUB_EXCL_PREV
+		|| evt->Command == Event::RECORD_OR_OVERDUB_EXCL
+		|| evt->Command == Event::RECORD_OR_OVERDUB_SOLO_NEXT
+		|| evt->Command == Event::RECORD_OR_OVERDUB_SOLO_PREV);
+}
+
+inline bool
+Engine::is_group_gain_event (const Event * evt)
+{
+	// changes engine state the loops read, so it has to split everyone
+	return (evt->Instance == -4 && evt->Control == Event::GroupGain && evt->Type == Event::type_control_change);
+}
+
+inline bool
+Engine::loops_can_queue (const Event * evt)
+{
+	if (evt->Instance >= 0) {
+		return evt->Instance >= (int) _rt_instances.size() || _rt_instances[evt->Instance]->can_queue_event();
+	}
+
+	int m = 0;
+	for (Instances::iterator i = _rt_instances.begin(); i != _rt_instances.end(); ++i, ++m)
+	{
+		if (event_targets_loop (evt, m) && !(*i)->can_queue_event()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void
+Engine::run_loops_to (nframes_t & usedframes, nframes_t frame)
+{
+	// runs every loop up to frame, sync source first, applying their queued events
+	int m = 0;
+	int syncm = -1;
+
+	if ((int)_sync_source > 0 && (int)_sync_source <= (int) _rt_instances.size()) {
+		syncm = (int) _sync_source - 1;
+		_rt_instances[syncm]->run (usedframes, frame - usedframes);
+	}
+
+	for (Instances::iterator i = _rt_instances.begin(); i != _rt_instances.end(); ++i, ++m) {
+		if (syncm == m) continue;
+		(*i)->run (usedframes, frame - usedframes);
+	}
+
+	usedframes = frame;
+}
 
 int
 Engine::process (nframes_t nframes)
@@ -768,46 +1548,79 @@ Engine::process (nframes_t nframes)
 	//	return 0;
 	//}
 
+	SL_TRACE_SCOPE("Engine::process");
+
 	// process events
 	//cerr << "process"  << endl;
 
 	Event * evt;
 	RingBuffer<Event>::rw_vector vec;
 	RingBuffer<Event>::rw_vector midivec;
+	RingBuffer<Event>::rw_vector timedvec;
 
 	// get available events
 	_event_queue->get_read_vector (&vec);
 	_midi_event_queue->get_read_vector (&midivec);
+
+	// timed events go by their timestamp, not the order they were sent in
+	collect_timed_events ();
+	timedvec.buf[0] = _timed_pending;
+	timedvec.len[0] = _timed_pending_count;
+	timedvec.buf[1] = 0;
+	timedvec.len[1] = 0;
 		
 	// update event generator
 	_event_generator->updateFragmentTime (nframes);
 
+	size_t timed_due = due_timed_events (timedvec);
+
 	// process loop instance rt events
 	process_rt_loop_manage_events();
+
+	if (_latency_published) {
+		_latency_published = false;
+		for (Instances::iterator i = _rt_instances.begin(); i != _rt_instances.end(); ++i) {
+			(*i)->recompute_latencies ();
+		}
+		// cause certain values to be updated
+		_conns_changed = true;
+	}
 	
 	// update internal sync
 	calculate_tempo_frames ();
 	generate_sync (0, nframes);
+
+	// modulated controls are set as of the start of the period
+	run_modulators (nframes);
+
+	// before any of this period's events, which are queued after it
+	run_bounce_swap (nframes);
 	
 	// clear common output buffers
 	prepare_buffers (nframes);
+	update_common_input_history (nframes);
 
 	nframes_t usedframes = 0;
+	nframes_t queuedframes = 0;
+	bool have_queued = false;
 	nframes_t doframes;
-	size_t num = vec.len[0] + midivec.len[0];
+	size_t num = vec.len[0] + midivec.len[0] + timed_due;
 	size_t n = 0;
 	size_t midi_n = 0;
+	size_t timed_n = 0;
 	int fragpos;
 	int m, syncm;
 	
 	if (num > 0) {
 
-		evt = next_rt_event (vec, n, midivec, midi_n);
+		evt = next_rt_event (vec, n, midivec, midi_n, timedvec, timed_n, timed_due);
 		
 		while (evt)
 		{ 
 			fragpos = (nframes_t) evt->FragmentPos();
 
+			SL_TRACE_INSTANT_ARG("rt event", evt->Command);
+
 			if (fragpos < (int) usedframes || fragpos >= (int) nframes) {
 				// bad fragment pos
 #ifdef DEBUG
@@ -817,96 +1630,127 @@ Engine::process (nframes_t nframes)
 				fragpos = usedframes;
 			}
 
-			doframes = fragpos - usedframes;
-
-			// handle special global RT events
-			if (evt->Instance == -2 
-			    || evt->Command == Event::SOLO
-			    || evt->Command == Event::SOLO_NEXT
-			    || evt->Command == Event::SOLO_PREV
-			    || evt->Command == Event::RECORD_SOLO_NEXT
-			    || evt->Command == Event::RECORD_SOLO_PREV
-			    || evt->Command == Event::RECORD_SOLO
-			    || evt->Command == Event::RECORD_EXCLUSIVE_NEXT
-			    || evt->Command == Event::RECORD_EXCLUSIVE_PREV
-			    || evt->Command == Event::RECORD_EXCLUSIVE
-			    || evt->Command == Event::RECORD_OR_OVERDUB_SOLO
-			    || evt->Command == Event::RECORD_OR_OVERDUB_SOLO_TRIG
-			    || evt->Command == Event::RECORD_OVERDUB_END_SOLO
-			    || evt->Command == Event::RECORD_OVERDUB_END_SOLO_TRIG
-			    || evt->Command == Event::RECORD_OR_OVERDUB_EXCL_NEXT
-			    || evt->Command == Event::RECORD_OR_OVERDUB_EXCL_PREV
-			    || evt->Command == Event::RECORD_OR_OVERDUB_EXCL
-			    || evt->Command == Event::RECORD_OR_OVERDUB_SOLO_NEXT
-			    || evt->Command == Event::RECORD_OR_OVERDUB_SOLO_PREV )
-			{
-				do_global_rt_event (evt, usedframes + doframes, nframes - (usedframes + doframes));
-				
-				// force the position and do frames to non-zero for these to ensure synced records
-				if (doframes == 0) {
-					doframes = 1;
-				}
-			}
-
-			m = 0;
 			syncm = -1;
-
-			
 			if ((int)_sync_source > 0 && (int)_sync_source <= (int)_rt_instances.size()) {
-				// we need to run the sync source loop first
 				syncm = (int) _sync_source - 1;
-				_rt_instances[syncm]->run (usedframes, doframes);
-				
-				if (evt->Instance == -1 || evt->Instance == syncm ||
-				    (evt->Instance == -3 && (_selected_loop == syncm || _selected_loop == -1))) {
-					_rt_instances[syncm]->do_event (evt);
+			}
 
-					// if event command is trigger and send_midi_start_on_trigger is enabled, do so
-					if (evt->Command == Event::TRIGGER
-					    && (evt->Type == Event::type_cmd_down || evt->Type == Event::type_cmd_hit)) 
+			if (!is_global_rt_event (evt) && !is_group_gain_event (evt) && loops_can_queue (evt))
+			{
+				// loop local event, it goes on the targeted loops' own period
+				// lists and is applied at its frame when they run.  nobody is split here
+				// loops_can_queue() made room, should a list still be full
+				// the event is applied right there instead of being lost
+				if (evt->Instance >= 0) {
+					// a single loop, nobody else needs to look at it
+					if (evt->Instance < (int) _rt_instances.size()
+					    && !_rt_instances[evt->Instance]->queue_event (evt, fragpos))
+					{
+						run_loops_to (usedframes, max (usedframes, (nframes_t) fragpos));
+						_rt_instances[evt->Instance]->do_event (evt);
+					}
+				}
+				else {
+					m = 0;
+					for (Instances::iterator i = _rt_instances.begin(); i != _rt_instances.end(); ++i, ++m)
 					{
-						//cerr << "YES, send now" << endl;
-						if (_midi_bridge) {
-							_beatstamp = _midi_bridge->get_current_host_time();
-							_midi_bridge->tempo_clock_update(_tempo, _beatstamp, _send_midi_start_on_trigger);
+						if (event_targets_loop (evt, m) && !(*i)->queue_event (evt, fragpos)) {
+							run_loops_to (usedframes, max (usedframes, (nframes_t) fragpos));
+							(*i)->do_event (evt);
 						}
+					}
+				}
+
+				queuedframes = fragpos;
+				have_queued = true;
+			}
+			else {
+				// everything queued so far must be applied before this one
+				if (have_queued) {
+					run_loops_to (usedframes, max (usedframes, queuedframes));
+					have_queued = false;
+				}
+				if (fragpos < (int) usedframes) {
+					fragpos = usedframes;
+				}
+
+				doframes = fragpos - usedframes;
+
+				// handle special global RT events
+				if (is_global_rt_event (evt))
+				{
+					do_global_rt_event (evt, usedframes + doframes, nframes - (usedframes + doframes));
+
+					// force the position and do frames to non-zero for these to ensure synced records
+					if (doframes == 0) {
+						doframes = 1;
+					}
+				}
+
+				m = 0;
+
+				if (syncm >= 0) {
+					// we need to run the sync source loop first
+					_rt_instances[syncm]->run (usedframes, doframes);
+
+					if (event_targets_loop (evt, syncm)) {
+						_rt_instances[syncm]->do_event (evt);
+					}
+				}
+
+				for (Instances::iterator i = _rt_instances.begin(); i != _rt_instances.end(); ++i, ++m)
+				{
+					if (syncm == m) continue; // skip if we already ran it
 
-						//_send_midi_start_after_next_hit = true;
+					// run for the time before this event
+					if (!(*i)->is_dormant()) {
+						(*i)->run (usedframes, doframes);
+					}
+
+					// process event
+					if (event_targets_loop (evt, m)) {
+						(*i)->do_event (evt);
 					}
 				}
+
+				usedframes += doframes;
 			}
 
-			
-			for (Instances::iterator i = _rt_instances.begin(); i != _rt_instances.end(); ++i, ++m)
+			// if event command is trigger and send_midi_start_on_trigger is enabled, do so
+			if (syncm >= 0 && event_targets_loop (evt, syncm)
+			    && evt->Command == Event::TRIGGER
+			    && (evt->Type == Event::type_cmd_down || evt->Type == Event::type_cmd_hit)) 
 			{
-				if (syncm == m) continue; // skip if we already ran it
-				
-				// run for the time before this event
-
-				(*i)->run (usedframes, doframes);
-					
-				// process event
-				if (evt->Instance == -1 || evt->Instance == m || 
-				    (evt->Instance == -3 && (_selected_loop == m || _selected_loop == -1))) {
-					(*i)->do_event (evt);
+				//cerr << "YES, send now" << endl;
+				if (_midi_bridge) {
+					_beatstamp = _midi_bridge->get_current_host_time();
+					_midi_bridge->tempo_clock_update(_tempo, _beatstamp, _send_midi_start_on_trigger);
 				}
+
+				//_send_midi_start_after_next_hit = true;
 			}
 
-			usedframes += doframes;
+			// group gain takes effect from here on, the loopers ramp to it
+			if (evt->Instance == -4 && evt->Control == Event::GroupGain && evt->Type == Event::type_control_change
+			    && evt->Group >= 0 && evt->Group < MAX_LOOP_GROUPS)
+			{
+				_group_gains[(int) evt->Group] = evt->Value;
+			}
 
 			// event is committed, if it is a control event, push it onto the nonrt update queue
 			if (evt->Type == Event::type_control_change || evt->Type == Event::type_global_control_change) {
 				do_push_control_event (_nonrt_update_event_queue, 
 				                       evt->Type, evt->Control, evt->Value, 
-				                       evt->Instance, evt->source);
+				                       evt->Instance, evt->source, 0, evt->Group);
 			}
 
-			evt = next_rt_event (vec, n, midivec, midi_n);
+			evt = next_rt_event (vec, n, midivec, midi_n, timedvec, timed_n, timed_due);
 		}
 
 		// advance events
 		_event_queue->increment_read_ptr (vec.len[0] + vec.len[1]);
 		_midi_event_queue->increment_read_ptr (midivec.len[0] + midivec.len[1]);
+		drop_timed_events (timed_n);
 
 
 		m = 0;
@@ -921,7 +1765,7 @@ Engine::process (nframes_t nframes)
 		
 		// run the rest of the frames
 		for (Instances::iterator i = _rt_instances.begin(); i != _rt_instances.end(); ++i ,++m) {
-			if (syncm == m) continue;
+			if (syncm == m || (*i)->is_dormant()) continue;
 
 			(*i)->run (usedframes, nframes - usedframes);
 		}
@@ -940,14 +1784,27 @@ Engine::process (nframes_t nframes)
 		}
 
 		for (Instances::iterator i = _rt_instances.begin(); i != _rt_instances.end(); ++i, ++m) {
-			if (syncm == m) continue;
+			// a dormant loop has nothing to do, it catches up when it runs again
+			if (syncm == m || (*i)->is_dormant()) continue;
 			(*i)->run (0, nframes);
 		}
 
 	}
 
+	// the loops' seconds valued outputs only need to be current once per period
+	for (Instances::iterator i = _rt_instances.begin(); i != _rt_instances.end(); ++i) {
+		if (!(*i)->is_dormant()) {
+			(*i)->publish_outputs ();
+		}
+	}
+
+	update_sync_pulse_age (nframes);
+
 	// scales output and mixes common dry
-	fill_common_outs (nframes);
+	{
+		SL_TRACE_SCOPE("fill_common_outs");
+		fill_common_outs (nframes);
+	}
 
 	_running_frames += nframes;
 	
@@ -981,11 +1838,21 @@ Engine::do_global_rt_event (Event * ev, nframes_t offset, nframes_t nframes)
 
 			//cerr << "TAP: new tempo: " << _tempo  << "  off: " << offset << endl;
 			ntempo = avg_tempo(ntempo);
+
+			if (_sync_source == InternalTempoSync && _quarter_note_frames > 0.0) {
+				// generate_sync already ran over the whole period, back the position up to the tap
+				_sync_beats -= (nframes - offset) / _quarter_note_frames;
+			}
 			
 			set_tempo(ntempo, true);
 			calculate_tempo_frames ();
 
 			if (_sync_source == InternalTempoSync) {
+				// the beat restarts at the tap, the regenerated sync
+				// publishes the position as of the start of the period
+				if (_quarter_note_frames > 0.0) {
+					_sync_beats -= offset / _quarter_note_frames;
+				}
 				generate_sync (offset, nframes);
 			}
 
@@ -1162,6 +2029,16 @@ Engine::do_global_rt_event (Event * ev, nframes_t offset, nframes_t nframes)
 	{
 		_smart_eighths = ev->Value;
 	}
+	else if (ev->Control == Event::TimetagOffset)
+	{
+		_timetag_offset = max (0.0f, ev->Value);
+	}
+	else if (ev->Control == Event::TimetagLateCount)
+	{
+		// setting it resets the stats
+		_timetag_late_count = 0;
+		_timetag_frame_offset = 0.0f;
+	}
 	else if (ev->Control == Event::SelectedLoopNum)
 	{
 		_selected_loop = (int) ev->Value;
@@ -1199,11 +2076,7 @@ Engine::do_global_rt_event (Event * ev, nframes_t offset, nframes_t nframes)
 	else if (ev->Control == Event::EighthPerCycle) {
 		if (ev->Value > 0.0f) {
 			_eighth_cycle = ev->Value;
-			
-			// update all loops
-			for (unsigned int n=0; n < _rt_instances.size(); ++n) {
-				_rt_instances[n]->set_port(EighthPerCycleLoop, _eighth_cycle);
-			}
+			__sync_add_and_fetch (&_loop_tempo_version, 1);
 
 			if (_jack_timebase_master) {
 				TransportInfo tinfo;
@@ -1232,6 +2105,7 @@ bool Engine::push_loop_manage_to_rt (LoopManageEvent & lme)
 #ifdef DEBUG
 		cerr << "event loopmanage_to_main full, dropping event" << endl;
 #endif
+		Contention::count (Contention::LoopManageDrops);
 		return false;
 	}
 	return true;
@@ -1243,15 +2117,23 @@ bool Engine::push_loop_manage_to_main (LoopManageEvent & lme)
 #ifdef DEBUG
 		cerr << "event loopmanage_to_main full, dropping event" << endl;
 #endif
+		Contention::count (Contention::LoopManageDrops);
 		return false;
 	}
 	return true;
 }
 
 bool
-Engine::push_command_event (Event::type_t type, Event::command_t cmd, int8_t instance)
+Engine::push_command_event (Event::type_t type, Event::command_t cmd, int instance, MIDI::timestamp_t timestamp)
 {
-	bool ret = do_push_command_event (_event_queue, type, cmd, instance);
+	bool ret;
+
+	if (timestamp > 0) {
+		ret = do_push_command_event (_timed_event_queue, type, cmd, instance, -1, -1, timestamp);
+	}
+	else {
+		ret = do_push_command_event (_event_queue, type, cmd, instance);
+	}
 
 	
 	// this is a known race condition, if the osc thread is changing controls
@@ -1266,7 +2148,7 @@ Engine::push_command_event (Event::type_t type, Event::command_t cmd, int8_t ins
 }
 
 void
-Engine::push_midi_command_event (Event::type_t type, Event::command_t cmd, int8_t instance, long framepos)
+Engine::push_midi_command_event (Event::type_t type, Event::command_t cmd, int instance, long framepos)
 {
 	do_push_command_event (_midi_event_queue, type, cmd, instance, framepos);
 
@@ -1281,7 +2163,7 @@ Engine::push_midi_command_event (Event::type_t type, Event::command_t cmd, int8_
 
 
 bool
-Engine::do_push_command_event (RingBuffer<Event> * evqueue, Event::type_t type, Event::command_t cmd, int8_t instance, long framepos)
+Engine::do_push_command_event (RingBuffer<Event> * evqueue, Event::type_t type, Event::command_t cmd, int instance, long framepos, int8_t group, MIDI::timestamp_t timestamp)
 {
 	// todo support more than one simulataneous pusher safely
 	RingBuffer<Event>::rw_vector vec;
@@ -1292,24 +2174,31 @@ Engine::do_push_command_event (RingBuffer<Event> * evqueue, Event::type_t type,
 #ifdef DEBUG
 		cerr << "cmd event queue full, dropping event" << endl;
 #endif
+		note_queue_push (evqueue, false);
 		return false;
 	}
 	
 	Event * evt = vec.buf[0];
-	*evt = get_event_generator().createEvent(framepos);
+	if (timestamp > 0) {
+		*evt = get_event_generator().createTimestampedEvent(timestamp);
+	} else {
+		*evt = get_event_generator().createEvent(framepos);
+	}
 
 	evt->Type = type;
 	evt->Command = cmd;
 	evt->Instance = instance;
+	evt->Group = group;
 
 	evqueue->increment_write_ptr (1);
+	note_queue_push (evqueue, true);
 
 	return true;
 }
 
 
 bool
-Engine::do_push_control_event (RingBuffer<Event> * evqueue, Event::type_t type, Event::control_t ctrl, float val, int8_t instance, long framepos, int src)
+Engine::do_push_control_event (RingBuffer<Event> * evqueue, Event::type_t type, Event::control_t ctrl, float val, int instance, long framepos, int src, int8_t group, MIDI::timestamp_t timestamp)
 {
 	// todo support more than one simulataneous pusher safely
 
@@ -1321,27 +2210,116 @@ Engine::do_push_control_event (RingBuffer<Event> * evqueue, Event::type_t type,
 #ifdef DEBUG
 		cerr << "ctrl event queue full, dropping event" << endl;
 #endif
+		note_queue_push (evqueue, false);
 		return false;
 	}
 	
 	Event * evt = vec.buf[0];
-	*evt = get_event_generator().createEvent(framepos);
+	if (timestamp > 0) {
+		*evt = get_event_generator().createTimestampedEvent(timestamp);
+	} else {
+		*evt = get_event_generator().createEvent(framepos);
+	}
 
 	evt->Type = type;
 	evt->Control = ctrl;
 	evt->Value = val;
 	evt->Instance = instance;
+	evt->Group = group;
 	evt->source = src;
 
 	evqueue->increment_write_ptr (1);
+	note_queue_push (evqueue, true);
 	
 	return true;
 }
 
 void
-Engine::push_control_event (Event::type_t type, Event::control_t ctrl, float val, int8_t instance, int src)
+Engine::note_queue_push (RingBuffer<Event> * evqueue, bool pushed)
+{
+	Contention::Counter drops, high;
+
+	if (evqueue == _event_queue) {
+		drops = Contention::EventDrops;
+		high = Contention::EventQueueHigh;
+	}
+	else if (evqueue == _midi_event_queue) {
+		drops = Contention::MidiEventDrops;
+		high = Contention::MidiEventQueueHigh;
+	}
+	else if (evqueue == _timed_event_queue) {
+		drops = Contention::TimedEventDrops;
+		high = Contention::TimedEventQueueHigh;
+	}
+	else if (evqueue == _nonrt_update_event_queue) {
+		drops = Contention::UpdateDrops;
+		high = Contention::UpdateQueueHigh;
+	}
+	else {
+		return;
+	}
+
+	if (pushed) {
+		Contention::note_level (high, evqueue->read_space());
+	}
+	else {
+		Contention::count (drops);
+	}
+}
+
+void
+Engine::check_contention (const struct timeval & now)
+{
+	// main thread, at most once a second
+	struct timeval diff;
+	timersub (&now, &_contention_checked, &diff);
+	if (diff.tv_sec < 1) {
+		return;
+	}
+	_contention_checked = now;
+
+	Contention::set_total (Contention::WorkerRejects, _worker->get_rejected_count());
+
+	vector<OscSender::ClientStats> stats;
+	unsigned long osc_dropped = 0;
+	_osc->get_send_stats (stats);
+	for (size_t n=0; n < stats.size(); ++n) {
+		osc_dropped += stats[n].dropped;
+	}
+	Contention::set_total (Contention::OscDrops, osc_dropped);
+
+	string changes;
+	char buf[80];
+
+	for (int n=0; n < Contention::CounterCount; ++n) {
+		unsigned long val = Contention::get ((Contention::Counter) n);
+		if (val == _contention_logged[n]) {
+			continue;
+		}
+		if (val > _contention_logged[n]) {
+			snprintf (buf, sizeof(buf), " %s %lu (+%lu)", Contention::name ((Contention::Counter) n), val, val - _contention_logged[n]);
+		}
+		else {
+			snprintf (buf, sizeof(buf), " %s %lu", Contention::name ((Contention::Counter) n), val);
+		}
+		changes += buf;
+		_contention_logged[n] = val;
+	}
+
+	if (!changes.empty()) {
+		fprintf (stderr, "sooperlooper: contention:%s\n", changes.c_str());
+	}
+}
+
+void
+Engine::push_control_event (Event::type_t type, Event::control_t ctrl, float val, int instance, int src, MIDI::timestamp_t timestamp)
 {
-	do_push_control_event (_event_queue, type, ctrl, val, instance);
+	if (timestamp > 0) {
+		do_push_control_event (_timed_event_queue, type, ctrl, val, instance, -1, 0, -1, timestamp);
+	}
+	else {
+		do_push_control_event (_event_queue, type, ctrl, val, instance);
+	}
 
         // the nonrt update queue is now pushed on the realtime thread
 
@@ -1351,12 +2329,15 @@ Engine::push_control_event (Event::type_t type, Event::control_t ctrl, float val
 
 	// wakeup nonrt loop... this lock should really not block... but still
 	TentativeLockMonitor mon(_event_loop_lock,  __LINE__, __FILE__);
+	if (!mon.locked()) {
+		Contention::count (Contention::WakeupLockMisses);
+	}
 	pthread_cond_signal (&_event_cond);
 	
 }
 
 void
-Engine::push_midi_control_event (Event::type_t type, Event::control_t ctrl, float val, int8_t instance, long framepos)
+Engine::push_midi_control_event (Event::type_t type, Event::control_t ctrl, float val, int instance, long framepos)
 {
 	do_push_control_event (_midi_event_queue, type, ctrl, val, instance, framepos);
 
@@ -1368,75 +2349,604 @@ Engine::push_midi_control_event (Event::type_t type, Event::control_t ctrl, floa
 
 	// wakeup nonrt loop... this lock should really not block... but still
 	TentativeLockMonitor mon(_event_loop_lock,  __LINE__, __FILE__);
+	if (!mon.locked()) {
+		Contention::count (Contention::WakeupLockMisses);
+	}
 	pthread_cond_signal (&_event_cond);
 }
 
-void
-Engine::push_sync_event (Event::control_t ctrl, long framepos, MIDI::timestamp_t timestamp)
+bool
+Engine::push_group_command_event (Event::type_t type, Event::command_t cmd, int group, MIDI::timestamp_t timestamp)
 {
-	// todo support more than one simulataneous pusher safely
+	if (group < 0 || group >= MAX_LOOP_GROUPS) {
+		return false;
+	}
 
-	if (_sync_source != MidiClockSync 
-	    && (!_use_sync_stop || ctrl != Event::MidiStop)
-	    && (!_use_sync_start || ctrl != Event::MidiStart)) {
+	return do_push_command_event (timestamp > 0 ? _timed_event_queue : _event_queue, type, cmd, -4, -1, (int8_t) group, timestamp);
+}
+
+void
+Engine::push_group_control_event (Event::type_t type, Event::control_t ctrl, float val, int group, int src, MIDI::timestamp_t timestamp)
+{
+	if (group < 0 || group >= MAX_LOOP_GROUPS) {
 		return;
 	}
-	
-	RingBuffer<Event>::rw_vector vec;
 
-	_sync_queue->get_write_vector (&vec);
+	do_push_control_event (timestamp > 0 ? _timed_event_queue : _event_queue, type, ctrl, val, -4, -1, src, (int8_t) group, timestamp);
 
-	if (vec.len[0] == 0) {
-#ifdef DEBUG
-		cerr << "sync event queue full, dropping event" << endl;
-#endif
-		return;
+	// wakeup nonrt loop... this lock should really not block... but still
+	TentativeLockMonitor mon(_event_loop_lock,  __LINE__, __FILE__);
+	if (!mon.locked()) {
+		Contention::count (Contention::WakeupLockMisses);
 	}
-	
-	Event * evt = vec.buf[0];
-	if (timestamp == 0) {
-		//fprintf(stderr, "creating sync event at frame %ld\n", framepos);
-		*evt = get_event_generator().createEvent(framepos);
-	} else {
-		//fprintf(stderr, "creating sync event at time %.14g\n", timestamp);
-		*evt = get_event_generator().createTimestampedEvent(timestamp);
+	pthread_cond_signal (&_event_cond);
+}
+
+int
+Engine::add_loop_group (const std::string & name)
+{
+	// called from the main event loop
+	if (name.empty()) {
+		return -1;
 	}
 
-	evt->Type = Event::type_sync;
-	evt->Control = ctrl;
+	int group = find_loop_group (name);
+	if (group >= 0) {
+		return group;
+	}
 
-	_sync_queue->increment_write_ptr (1);
-	
-	return;
+	LockMonitor lm (_group_lock, __LINE__, __FILE__);
+
+	for (group = 0; group < MAX_LOOP_GROUPS; ++group) {
+		if (_group_names[group].empty()) {
+			_group_names[group] = name;
+			return group;
+		}
+	}
+
+	cerr << "sooperlooper: no room for another loop group: " << name << endl;
+	return -1;
 }
 
-//load functions are here rather than in midi_bindings.cpp for easy access to instance values
-//to initialize the toggle values.
 bool
-Engine::load_midi_bindings (string filename, bool append, CommandMap & cmdmap)
+Engine::remove_loop_group (const std::string & name)
 {
-	//FILE * bindfile = 0;
-	std::ifstream bindfile;
+	// called from the main event loop
+	int group = find_loop_group (name);
+	if (group < 0) {
+		return false;
+	}
 
-	bindfile.open(filename.c_str(), ios::in);
-	
-	if (!bindfile.is_open()) {
-		cerr << "sooperlooper warning: could not open for reading: " << filename << endl;
+	// take the members out and reset the gain so a new group in this slot starts clean,
+	// the rt thread does it, like it does loop removal
+	LoopManageEvent lmev (LoopManageEvent::ResetGroup, group, 1.0f);
+	if (!push_loop_manage_to_rt (lmev)) {
 		return false;
 	}
-	// todo: look for is in systemwide and ~/.sooperlooper/bindings/
 
+	LockMonitor lm (_group_lock, __LINE__, __FILE__);
+	_group_names[group] = "";
 
-	return load_midi_bindings (bindfile, append, cmdmap);
+	return true;
 }
 
-bool
-Engine::load_midi_bindings (std::istream & instream, bool append, CommandMap & cmdmap)
+int
+Engine::find_loop_group (const std::string & name)
 {
-	char  line[200];
+	// may be called from any non-rt thread
+	LockMonitor lm (_group_lock, __LINE__, __FILE__);
 
-	if (!_midi_bridge) {
-        return false;
+	for (int group = 0; group < MAX_LOOP_GROUPS; ++group) {
+		if (!name.empty() && _group_names[group] == name) {
+			return group;
+		}
+	}
+
+	return -1;
+}
+
+void
+Engine::get_loop_groups (std::vector<std::string> & names)
+{
+	LockMonitor lm (_group_lock, __LINE__, __FILE__);
+	names = _group_names;
+}
+
+int
+Engine::find_modulator (int instance, Event::control_t ctrl)
+{
+	for (int slot = 0; slot < MAX_MODULATORS; ++slot) {
+		if (_modulators[slot].active && _modulators[slot].instance == instance
+		    && _modulators[slot].control == ctrl) {
+			return slot;
+		}
+	}
+	return -1;
+}
+
+bool
+Engine::push_modulator_change (ModulatorChange & chg)
+{
+	if (_modulator_queue->write (&chg, 1) != 1) {
+#ifdef DEBUG
+		cerr << "modulator queue full, dropping change" << endl;
+#endif
+		return false;
+	}
+	return true;
+}
+
+bool
+Engine::set_modulator (const Modulator & mod)
+{
+	// called from the main event loop
+	int slot = find_modulator (mod.instance, mod.control);
+
+	for (int n = 0; slot < 0 && n < MAX_MODULATORS; ++n) {
+		if (!_modulators[n].active) {
+			slot = n;
+		}
+	}
+
+	if (slot < 0) {
+		cerr << "sooperlooper: no room for another modulator" << endl;
+		return false;
+	}
+
+	ModulatorChange chg (ModulatorChange::Set, slot);
+	chg.mod = mod;
+	chg.mod.active = true;
+
+	if (mod.instance >= 0) {
+		// the rt copy is already numbered without the loops on their way out
+		chg.mod.instance = queued_instance_index (mod.instance);
+		if (chg.mod.instance < 0) {
+			return false;
+		}
+	}
+
+	if (!push_modulator_change (chg)) {
+		return false;
+	}
+
+	_modulators[slot] = mod;
+	_modulators[slot].active = true;
+	return true;
+}
+
+bool
+Engine::remove_modulator (int instance, Event::control_t ctrl)
+{
+	// called from the main event loop
+	int slot = find_modulator (instance, ctrl);
+	if (slot < 0) {
+		return false;
+	}
+
+	ModulatorChange chg (ModulatorChange::Remove, slot, true);
+	if (!push_modulator_change (chg)) {
+		return false;
+	}
+
+	_modulators[slot].active = false;
+	return true;
+}
+
+bool
+Engine::trigger_modulator (int instance, Event::control_t ctrl)
+{
+	// called from the main event loop
+	int slot = find_modulator (instance, ctrl);
+	if (slot < 0) {
+		return false;
+	}
+
+	ModulatorChange chg (ModulatorChange::Trigger, slot);
+	return push_modulator_change (chg);
+}
+
+void
+Engine::get_modulators (std::vector<Modulator> & mods)
+{
+	mods.clear();
+	for (int slot = 0; slot < MAX_MODULATORS; ++slot) {
+		if (_modulators[slot].active) {
+			mods.push_back (_modulators[slot]);
+		}
+	}
+}
+
+void
+Engine::clear_modulators ()
+{
+	// called from the main event loop, the controls are left where they are
+	for (int slot = 0; slot < MAX_MODULATORS; ++slot) {
+		if (_modulators[slot].active) {
+			ModulatorChange chg (ModulatorChange::Remove, slot);
+			push_modulator_change (chg);
+			_modulators[slot].active = false;
+		}
+	}
+}
+
+int
+Engine::queued_instance_index (int index)
+{
+	// main thread.  index into _instances, as the modulator queue numbers it
+	// once the loops pending removal have gone.  -1 for one of those loops
+	int queued = index;
+
+	for (Instances::iterator iter = _removing.begin(); iter != _removing.end(); ++iter) {
+		Instances::iterator pos = find (_instances.begin(), _instances.end(), *iter);
+		if (pos == _instances.end()) {
+			continue;
+		}
+
+		int other = pos - _instances.begin();
+		if (other == index) {
+			return -1;
+		}
+		else if (other < index) {
+			--queued;
+		}
+	}
+
+	return queued;
+}
+
+void
+Engine::modulators_loop_removed (int index)
+{
+	// main thread, the loops after index moved down one, their modulators
+	// go with them
+	if (index < 0) {
+		return;
+	}
+
+	for (int slot = 0; slot < MAX_MODULATORS; ++slot) {
+		Modulator & mod = _modulators[slot];
+
+		if (!mod.active || mod.instance < index) {
+			continue;
+		}
+
+		if (mod.instance == index) {
+			mod.active = false;
+		}
+		else {
+			mod.instance -= 1;
+		}
+	}
+}
+
+void
+Engine::rt_modulators_loop_removed (int index)
+{
+	// rt thread, the same for our copy
+	for (int slot = 0; slot < MAX_MODULATORS; ++slot) {
+		Modulator & mod = _rt_modulators[slot];
+
+		if (!mod.active || mod.instance < index) {
+			continue;
+		}
+
+		if (mod.instance == index) {
+			mod.active = false;
+		}
+		else {
+			mod.instance -= 1;
+		}
+	}
+}
+
+bool
+Engine::push_loop_removal (int index)
+{
+	// main thread.  the rt thread renumbers its modulators in the queue order,
+	// but not before the loop is out of its list.  ours follow in remove_loop,
+	// when the loop leaves _instances
+	Looper * looper = _instances[index];
+
+	if (find (_removing.begin(), _removing.end(), looper) != _removing.end()) {
+		return false;
+	}
+
+	// we are the only writer, both are sure to go in
+	if (_modulator_queue->write_space() < 1 || _loop_manage_to_rt_queue->write_space() < 1) {
+		cerr << "sooperlooper: too busy to remove loop " << index + 1 << endl;
+		return false;
+	}
+
+	ModulatorChange chg (ModulatorChange::LoopRemoved, queued_instance_index (index));
+	chg.looper = looper;
+	push_modulator_change (chg);
+
+	LoopManageEvent lmev (LoopManageEvent::RemoveLoop, looper);
+	push_loop_manage_to_rt (lmev);
+	_removing.push_back (looper);
+
+	return true;
+}
+
+void
+Engine::apply_modulator (const Modulator & mod, float val)
+{
+	Event ev;
+	ev.Type = Event::type_control_change;
+	ev.Control = mod.control;
+	ev.Value = val;
+	ev.source = -1; // generated, loops don't record it as automation
+
+	if (mod.instance >= 0) {
+		if (mod.instance < (int) _rt_instances.size()) {
+			ev.Instance = mod.instance;
+			_rt_instances[mod.instance]->do_event (&ev);
+		}
+		return;
+	}
+
+	int m = 0;
+	for (Instances::iterator i = _rt_instances.begin(); i != _rt_instances.end(); ++i, ++m) {
+		ev.Instance = m;
+		(*i)->do_event (&ev);
+	}
+}
+
+void
+Engine::run_modulators (nframes_t nframes)
+{
+	// rt thread, after generate_sync().  the sync beat position as of the
+	// start of this period, the loops ramp the controls that need it
+	double pos = _sync_beats;
+	if (_sync_source != BrotherSync && _quarter_note_frames > 0.0) {
+		pos -= nframes / _quarter_note_frames;
+	}
+
+	RingBuffer<ModulatorChange>::rw_vector vec;
+
+	while (_modulator_queue->read_space() > 0) {
+		_modulator_queue->get_read_vector (&vec);
+		ModulatorChange & chg = *vec.buf[0];
+
+		if (chg.op == ModulatorChange::LoopRemoved) {
+			if (find_rt_instance (chg.looper) >= 0) {
+				// the loop manage event hasn't reached us yet, what comes
+				// after this is numbered without the loop
+				break;
+			}
+			rt_modulators_loop_removed (chg.slot);
+		}
+		else if (chg.slot >= 0 && chg.slot < MAX_MODULATORS) {
+			Modulator & mod = _rt_modulators[chg.slot];
+
+			if (chg.op == ModulatorChange::Set) {
+				mod = chg.mod;
+			}
+			else if (chg.op == ModulatorChange::Remove) {
+				if (chg.restore && mod.active) {
+					apply_modulator (mod, f_clamp (mod.center, mod.min_value, mod.max_value));
+				}
+				mod.active = false;
+			}
+			else if (chg.op == ModulatorChange::Trigger) {
+				mod.trigger (pos);
+			}
+		}
+
+		_modulator_queue->increment_read_ptr (1);
+	}
+
+	if (_rt_instances.empty()) {
+		return;
+	}
+
+	for (int slot = 0; slot < MAX_MODULATORS; ++slot) {
+		Modulator & mod = _rt_modulators[slot];
+
+		if (mod.active) {
+			apply_modulator (mod, mod.value_at (pos));
+		}
+	}
+}
+
+int
+Engine::find_rt_instance (const Looper * looper) const
+{
+	for (unsigned int n=0; n < _rt_instances.size(); ++n) {
+		if (_rt_instances[n] == looper) {
+			return (int) n;
+		}
+	}
+	return -1;
+}
+
+void
+Engine::run_bounce_swap (nframes_t nframes)
+{
+	// rt thread, at the start of the period.  waits for the reference loop
+	// to wrap, where the bounced audio starts
+	if (!_rt_bounce_pending) {
+		if (_bounce_queue->read (&_rt_bounce, 1) != 1) {
+			return;
+		}
+		_rt_bounce_pending = true;
+		_rt_bounce_waited = 0;
+		_rt_bounce_stalled = 0;
+	}
+
+	// the loops may have been removed in the meantime
+	int refidx = find_rt_instance (_rt_bounce.reference);
+	int targidx = find_rt_instance (_rt_bounce.target);
+	if (refidx < 0 || targidx < 0) {
+		_rt_bounce_pending = false;
+		return;
+	}
+
+	Looper * ref = _rt_instances[refidx];
+	nframes_t pos, length, cycle;
+	ref->get_loop_frames (pos, length, cycle);
+	float rate = ref->get_control_value (Event::TrueRate);
+
+	if (length == 0) {
+		// cleared, there is nothing to line up with any more
+		_rt_bounce_pending = false;
+		return;
+	}
+	// a reference that was paused or stopped, or never wraps, gives up the
+	// swap.  the target keeps the mix, paused, for a manual trigger
+	double srate = _driver->get_samplerate();
+	_rt_bounce_waited += nframes;
+
+	if (rate == 0.0f || !ref->automation_running()) {
+		_rt_bounce_stalled += nframes;
+		if (_rt_bounce_stalled > srate * BOUNCE_STALL_SECS) {
+			_rt_bounce_pending = false;
+		}
+		return;
+	}
+	_rt_bounce_stalled = 0;
+
+	// every wrap within the mix's cycles is a candidate, one of them has
+	// the sources lined up unless they were moved meanwhile
+	if (_rt_bounce_waited > (_rt_bounce.cycles + 1.0) * length / fabsf (rate) + srate * BOUNCE_STALL_SECS) {
+		_rt_bounce_pending = false;
+		return;
+	}
+
+	double dist = 0.0;
+	if (pos > 0) {
+		dist = (rate > 0.0f) ? (double) (length - pos) : (double) pos;
+	}
+	nframes_t frame = (nframes_t) ceil (dist / fabsf (rate));
+	if (frame >= nframes) {
+		return;
+	}
+
+	// where the sources will really be at the wrap, against where the mix has them
+	for (int n=0; n < _rt_bounce.source_count; ++n) {
+		if (_rt_bounce.phases[n] < 0.0 || find_rt_instance (_rt_bounce.sources[n]) < 0) {
+			continue;
+		}
+		Looper * src = _rt_bounce.sources[n];
+		nframes_t spos, slength, scycle;
+		src->get_loop_frames (spos, slength, scycle);
+		if (slength == 0) {
+			continue;
+		}
+		double off = fmod (spos + frame * (double) src->get_control_value (Event::TrueRate) - _rt_bounce.phases[n], (double) slength);
+		if (off < 0.0) {
+			off += slength;
+		}
+		if (min (off, slength - off) > BOUNCE_PHASE_SLACK) {
+			// not this wrap
+			return;
+		}
+	}
+
+	// the swap goes in whole or waits for the next wrap
+	if (!_rt_bounce.target->can_queue_event()) {
+		Contention::count (Contention::PeriodEventDrops);
+		return;
+	}
+	for (int n=0; n < _rt_bounce.source_count; ++n) {
+		if (find_rt_instance (_rt_bounce.sources[n]) >= 0 && !_rt_bounce.sources[n]->can_queue_event()) {
+			Contention::count (Contention::PeriodEventDrops);
+			return;
+		}
+	}
+
+	Event ev;
+	ev.Type = Event::type_cmd_hit;
+	ev.source = -1;
+
+	ev.Command = Event::TRIGGER;
+	ev.Instance = targidx;
+	if (!_rt_bounce.target->queue_event (&ev, frame)) {
+		return;
+	}
+
+	ev.Command = _rt_bounce.clear_sources ? Event::UNDO_ALL : Event::MUTE_ON;
+	for (int n=0; n < _rt_bounce.source_count; ++n) {
+		int idx = find_rt_instance (_rt_bounce.sources[n]);
+		if (idx >= 0) {
+			ev.Instance = idx;
+			if (!_rt_bounce.sources[n]->queue_event (&ev, frame)) {
+				// checked above, the source keeps playing into the mix
+				continue;
+			}
+		}
+	}
+
+	_rt_bounce_pending = false;
+}
+
+void
+Engine::push_sync_event (Event::control_t ctrl, long framepos, MIDI::timestamp_t timestamp)
+{
+	// todo support more than one simulataneous pusher safely
+
+	if (_sync_source != MidiClockSync 
+	    && (!_use_sync_stop || ctrl != Event::MidiStop)
+	    && (!_use_sync_start || ctrl != Event::MidiStart)) {
+		return;
+	}
+	
+	RingBuffer<Event>::rw_vector vec;
+
+	_sync_queue->get_write_vector (&vec);
+
+	if (vec.len[0] == 0) {
+#ifdef DEBUG
+		cerr << "sync event queue full, dropping event" << endl;
+#endif
+		Contention::count (Contention::SyncEventDrops);
+		return;
+	}
+	
+	Event * evt = vec.buf[0];
+	if (timestamp == 0) {
+		//fprintf(stderr, "creating sync event at frame %ld\n", framepos);
+		*evt = get_event_generator().createEvent(framepos);
+	} else {
+		//fprintf(stderr, "creating sync event at time %.14g\n", timestamp);
+		*evt = get_event_generator().createTimestampedEvent(timestamp);
+	}
+
+	evt->Type = Event::type_sync;
+	evt->Control = ctrl;
+
+	_sync_queue->increment_write_ptr (1);
+	
+	return;
+}
+
+//load functions are here rather than in midi_bindings.cpp for easy access to instance values
+//to initialize the toggle values.
+bool
+Engine::load_midi_bindings (string filename, bool append, CommandMap & cmdmap)
+{
+	//FILE * bindfile = 0;
+	std::ifstream bindfile;
+
+	bindfile.open(filename.c_str(), ios::in);
+	
+	if (!bindfile.is_open()) {
+		cerr << "sooperlooper warning: could not open for reading: " << filename << endl;
+		return false;
+	}
+	// todo: look for is in systemwide and ~/.sooperlooper/bindings/
+
+
+	return load_midi_bindings (bindfile, append, cmdmap);
+}
+
+bool
+Engine::load_midi_bindings (std::istream & instream, bool append, CommandMap & cmdmap)
+{
+	char  line[200];
+
+	if (!_midi_bridge) {
+        return false;
     }
     
 	if (!append) {
@@ -1471,7 +2981,7 @@ Engine::load_midi_bindings (std::istream & instream, bool append, CommandMap & c
 }
 
 float
-Engine::get_control_value (Event::control_t ctrl, int8_t instance)
+Engine::get_control_value (Event::control_t ctrl, int instance)
 {
 	// not really anymore, this is only called from the nonrt work thread
 	// that does the allocating of instances
@@ -1537,6 +3047,15 @@ Engine::get_control_value (Event::control_t ctrl, int8_t instance)
 		else if (ctrl == Event::JackTimebaseMaster) {
 			return _jack_timebase_master ? 1.0f: 0.0f;
 		}
+		else if (ctrl == Event::TimetagOffset) {
+			return _timetag_offset;
+		}
+		else if (ctrl == Event::TimetagLateCount) {
+			return (float) _timetag_late_count;
+		}
+		else if (ctrl == Event::TimetagFrameOffset) {
+			return _timetag_frame_offset;
+		}
 
 	}
 
@@ -1550,6 +3069,7 @@ Engine::push_nonrt_event (EventNonRT * event)
 
         if (_nonrt_event_queue->write_space() > 0) {
                 _nonrt_event_queue->write(&event, 1);
+                Contention::note_level (Contention::NonRTQueueHigh, _nonrt_event_queue->read_space());
                 
                 LockMonitor mon(_event_loop_lock,  __LINE__, __FILE__);
                 pthread_cond_signal (&_event_cond);
@@ -1558,6 +3078,7 @@ Engine::push_nonrt_event (EventNonRT * event)
         }
         else {
                 //cerr << "UGH, couldn't push event, no writespace" << endl;
+                Contention::count (Contention::NonRTDrops);
                 return false;
         }
 }
@@ -1606,9 +3127,13 @@ Engine::mainloop()
 		auto_update_timer_v[i].tv_usec = ((AUTO_UPDATE_STEP*(i+1)))*1000;
 	}
 	
+	SL_TRACE_THREAD("main");
+	
 	// non-rt event processing loop
 	while (is_ok())
 	{
+		SL_TRACE_INSTANT("mainloop wakeup");
+		
 		// pull off all loop management events from the rt thread
 		while (is_ok() && _loop_manage_to_main_queue->read_space() > 0)
 		{
@@ -1627,10 +3152,16 @@ Engine::mainloop()
 			
 			_loop_manage_to_main_queue->increment_read_ptr(1);
 		}
+
+		reap_dead_loops();
+		
+		// finish up what the workers got done
+		_worker->process_completions();
 		
 		// pull off all events from nonrt ringbuffer
 		while (is_ok() && _nonrt_event_queue->read_space() > 0 && _nonrt_event_queue->read(&event, 1) == 1)
 		{
+			SL_TRACE_SCOPE("process_nonrt_event");
 			process_nonrt_event (event);
 			delete event;
 		}
@@ -1648,12 +3179,29 @@ Engine::mainloop()
 				// save with no filename will autogenerate a unique name
 				for (unsigned int n=0; n < _instances.size(); ++n) {
 					if (instance < 0 || instance == (int)n) {
-						_instances[n]->save_loop ();
+						queue_loop_file_job (_instances[n], LoopFileEvent::Save, "", "", "");
+					}
+				}
+			}
+			else if (evt->Type == Event::type_control_change && evt->Instance == -4) {
+				// group gain has no per-loop listeners, loop controls go out for each member
+				if (evt->Control != Event::GroupGain) {
+					for (unsigned int n=0; n < _instances.size(); ++n) {
+						if (_instances[n]->get_loop_group() == evt->Group) {
+							mark_snapshot_dirty (n);
+
+							ConfigUpdateEvent cuev (ConfigUpdateEvent::Send, n, evt->Control, "", "", evt->Value);
+							cuev.source = evt->source;
+							_osc->finish_update_event (cuev);
+
+							ParamChanged(evt->Control, n); // emit
+						}
 					}
 				}
 			}
 			else if (evt->Type == Event::type_control_change) {
 				int instance = evt->Instance == -3 ? _selected_loop : evt->Instance;
+				mark_snapshot_dirty (instance);
 				ConfigUpdateEvent cuev (ConfigUpdateEvent::Send, instance, evt->Control, "", "", evt->Value);
 				cuev.source = evt->source;
 				_osc->finish_update_event (cuev);
@@ -1708,6 +3256,10 @@ Engine::mainloop()
 			_timebase_changed = false;
 		}
 
+		if (_latency_dirty) {
+			update_latencies ();
+		}
+
 		if (_conns_changed)
 		{
 			// send latency updates
@@ -1745,6 +3297,8 @@ Engine::mainloop()
 		if (wait_ret == ETIMEDOUT || timercmp (&now, &timeoutv, >=)) {
 			std::list<short int> timeout_list;
 
+			SL_TRACE_SCOPE("auto updates");
+			
 			//work out for which auto timeouts it is time to update
 			for (short int i = 0; i < AUTO_UPDATE_RANGE; i++) {
 				struct timeval timer_diff = {0,0};
@@ -1756,9 +3310,28 @@ Engine::mainloop()
 			}
 
 			_osc->send_auto_updates(timeout_list);
+			_osc->flush_config_changes (now);
+
+			_brother_clock->service (now.tv_sec + now.tv_usec * 1e-6);
+
+			for (unsigned int n=0; n < _instances.size(); ++n) {
+				_instances[n]->drop_stale_upload (now.tv_sec + now.tv_usec * 1e-6);
+			}
+
+			check_contention (now);
 			
-			// emit a parameter changed for state and others
+			// emit a parameter changed for state and others.  these don't
+			// move on an idle loop, it gets a last round when it goes idle
+			if (_loop_activity.size() != _instances.size()) {
+				_loop_activity.assign (_instances.size(), LoopActivity());
+			}
 			for (unsigned int n=0; n < _instances.size(); ++n) {
+				bool idle = _instances[n]->is_idle();
+				if (idle && _loop_activity[n].tick_idle) {
+					continue;
+				}
+				_loop_activity[n].tick_idle = idle;
+
 				ParamChanged(Event::State, n); // emit
 				ParamChanged(Event::Waiting, n);
 				ParamChanged(Event::LoopPosition, n);
@@ -1781,6 +3354,8 @@ Engine::mainloop()
 			timeoutv.tv_usec = timeout.tv_nsec / 1000;
 		}
 		
+		publish_control_snapshot();
+		
 		// sleep on condition
 		{
 			LockMonitor mon(_event_loop_lock, __LINE__, __FILE__);
@@ -1799,6 +3374,11 @@ Engine::process_nonrt_event (EventNonRT * event)
 	PingEvent *         ping_event;
 	RegisterConfigEvent * rc_event;
 	LoopFileEvent      * lf_event;
+	LoopAudioEvent     * la_event;
+	LoopGroupEvent     * lg_event;
+	ModulatorEvent     * mod_event;
+	BounceEvent        * bounce_event;
+	BrotherSyncEvent   * bs_event;
 	GlobalGetEvent     * gg_event;
 	GlobalSetEvent     * gs_event;
 	MidiBindingEvent   * mb_event;
@@ -1855,6 +3435,64 @@ Engine::process_nonrt_event (EventNonRT * event)
 		else if (gg_event->param == "eighth_per_cycle") {
 			gg_event->ret_value = _eighth_cycle;
 		}
+		else if (gg_event->param == "timetag_offset") {
+			gg_event->ret_value = (float) _timetag_offset;
+		}
+		else if (gg_event->param == "timetag_late_count") {
+			gg_event->ret_value = (float) _timetag_late_count;
+		}
+		else if (gg_event->param == "timetag_frame_offset") {
+			gg_event->ret_value = _timetag_frame_offset;
+		}
+		else if (gg_event->param == "brother_locked") {
+			gg_event->ret_value = _brother_clock->is_locked() ? 1.0f : 0.0f;
+		}
+		else if (gg_event->param == "brother_phase_error") {
+			gg_event->ret_value = (float) _brother_clock->get_phase_error();
+		}
+		else if (gg_event->param == "brother_followers") {
+			gg_event->ret_value = (float) _brother_clock->follower_count();
+		}
+		else if (gg_event->param == "loop_memory_mode") {
+			gg_event->ret_value = (float) sl_get_loop_memory_mode();
+		}
+		else if (gg_event->param == "huge_page_loops") {
+			// what the kernel really gave, not what we asked for
+			vector<LADSPA_Handle> handles;
+			vector<size_t> firsts;
+			for (unsigned int n=0; n < _instances.size(); ++n) {
+				firsts.push_back (handles.size());
+				_instances[n]->get_memory_handles (handles);
+			}
+			firsts.push_back (handles.size());
+
+			vector<unsigned long> bytes (handles.size(), 0);
+			if (!handles.empty()) {
+				sl_get_loop_memory_huge_bytes (&handles[0], handles.size(), &bytes[0]);
+			}
+
+			int count = 0;
+			for (unsigned int n=0; n < _instances.size(); ++n) {
+				for (size_t h = firsts[n]; h < firsts[n+1]; ++h) {
+					if (bytes[h] > 0) {
+						++count;
+						break;
+					}
+				}
+			}
+			gg_event->ret_value = (float) count;
+		}
+		else if (gg_event->param == "loop_memory_pool") {
+			unsigned long maxbytes = 0;
+			sl_get_loop_memory_pool (&maxbytes);
+			gg_event->ret_value = (float) (maxbytes / 1048576.0);
+		}
+		else if (gg_event->param == "loop_memory_pooled") {
+			gg_event->ret_value = (float) (sl_get_loop_memory_pool () / 1048576.0);
+		}
+		else if (Contention::find (gg_event->param) >= 0) {
+			gg_event->ret_value = (float) Contention::get ((Contention::Counter) Contention::find (gg_event->param));
+		}
 		
 		_osc->finish_global_get_event (*gg_event);
 	}
@@ -1900,6 +3538,20 @@ Engine::process_nonrt_event (EventNonRT * event)
 		else if (gs_event->param == "smart_eighths") {
 			_smart_eighths = gs_event->value > 0.0f;
 		}
+		else if (gs_event->param == "timetag_offset") {
+			_timetag_offset = max (0.0f, gs_event->value);
+		}
+		else if (gs_event->param == "loop_memory_mode") {
+			sl_set_loop_memory_mode ((int) gs_event->value);
+		}
+		else if (gs_event->param == "loop_memory_pool") {
+			sl_set_loop_memory_pool ((unsigned long) (max (0.0f, gs_event->value) * 1048576.0f));
+		}
+		else if (Contention::find (gs_event->param) >= 0) {
+			// setting any of them resets them all
+			Contention::reset();
+			memset (_contention_logged, 0, sizeof(_contention_logged));
+		}
 		else if (gs_event->param == "selected_loop_num") {
 			_selected_loop = (int) gs_event->value;
 		}
@@ -1919,11 +3571,7 @@ Engine::process_nonrt_event (EventNonRT * event)
 		else if (gs_event->param == "eighth_per_cycle") {
 			if (gs_event->value > 0.0f) {
 				_eighth_cycle = gs_event->value;
-
-				// update all loops
-				for (unsigned int n=0; n < _instances.size(); ++n) {
-					_instances[n]->set_port(EighthPerCycleLoop, _eighth_cycle);
-				}
+				__sync_add_and_fetch (&_loop_tempo_version, 1);
 
 				if (_jack_timebase_master) {
 					TransportInfo tinfo;
@@ -1968,8 +3616,7 @@ Engine::process_nonrt_event (EventNonRT * event)
 			// we do the real cleanup when it tells us to
 			if (cl_event->index >= 0 && cl_event->index < (int) _instances.size())
 			{
-				LoopManageEvent lmev (LoopManageEvent::RemoveLoop, _instances[cl_event->index]);
-				push_loop_manage_to_rt (lmev);
+				push_loop_removal (cl_event->index);
 			}
 			
 			_osc->finish_loop_config_event (*cl_event);
@@ -2062,19 +3709,114 @@ Engine::process_nonrt_event (EventNonRT * event)
 	{
 		for (unsigned int n=0; n < _instances.size(); ++n) {
 			if (lf_event->instance == -1 || lf_event->instance == (int)n) {
-				if (lf_event->type == LoopFileEvent::Load) {
-					if (!_instances[n]->load_loop (lf_event->filename)) {
-						_osc->send_error(lf_event->ret_url, lf_event->ret_path, "Loop Load Failed");
+				queue_loop_file_job (_instances[n], lf_event->type, lf_event->filename, lf_event->ret_url, lf_event->ret_path);
+			}
+		}
+	}
+	else if ((la_event = dynamic_cast<LoopAudioEvent*> (event)) != 0)
+	{
+		for (unsigned int n=0; n < _instances.size(); ++n) {
+			if (la_event->instance == -1 || la_event->instance == (int)n) {
+				if (la_event->type == LoopAudioEvent::Get) {
+					vector<float> audio;
+					nframes_t nframes = 0;
+					
+					if (!_instances[n]->get_loop_audio (audio, nframes)) {
+						_osc->send_error(la_event->ret_url, la_event->ret_path, "Loop Audio Get Failed");
+					}
+					else if (!_osc->send_loop_audio (n, _instances[n]->get_channel_count(), audio, la_event->format,
+									  la_event->ret_url, la_event->ret_path)) {
+						_osc->send_error(la_event->ret_url, la_event->ret_path, "Loop Audio Get Failed: busy");
 					}
 				}
 				else {
-					if (!_instances[n]->save_loop (lf_event->filename)) {
-						_osc->send_error(lf_event->ret_url, lf_event->ret_path, "Loop Save Failed");
+					if (!_instances[n]->put_loop_audio (la_event->upload_id, la_event->channels, la_event->total_frames, la_event->offset, la_event->data)) {
+						_osc->send_error(la_event->ret_url, la_event->ret_path, "Loop Audio Put Failed");
 					}
 				}
 			}
 		}
 	}
+	else if ((bs_event = dynamic_cast<BrotherSyncEvent*> (event)) != 0)
+	{
+		if (bs_event->type == BrotherSyncEvent::Follow) {
+			_brother_clock->set_leader (bs_event->url, _osc->get_server_url());
+		}
+		else if (bs_event->type == BrotherSyncEvent::Register) {
+			_brother_clock->add_follower (bs_event->url);
+		}
+		else if (bs_event->type == BrotherSyncEvent::Unregister) {
+			_brother_clock->remove_follower (bs_event->url);
+		}
+	}
+	else if ((lg_event = dynamic_cast<LoopGroupEvent*> (event)) != 0)
+	{
+		if (lg_event->type == LoopGroupEvent::Add) {
+			int group = add_loop_group (lg_event->name);
+			if (group < 0) {
+				_osc->send_error(lg_event->ret_url, lg_event->ret_path, "Loop Group Add Failed");
+			}
+			else {
+				_osc->send_loop_groups (lg_event->ret_url, lg_event->ret_path);
+			}
+		}
+		else if (lg_event->type == LoopGroupEvent::Remove) {
+			if (!remove_loop_group (lg_event->name)) {
+				_osc->send_error(lg_event->ret_url, lg_event->ret_path, "Loop Group Remove Failed");
+			}
+		}
+		else {
+			_osc->send_loop_groups (lg_event->ret_url, lg_event->ret_path);
+		}
+	}
+	else if ((mod_event = dynamic_cast<ModulatorEvent*> (event)) != 0)
+	{
+		int instance = mod_event->instance;
+		if (instance == -3) {
+			instance = _selected_loop;
+		}
+
+		if (mod_event->type == ModulatorEvent::Set) {
+			Modulator mod;
+			CommandMap::ControlInfo info;
+			string ctrlname = cmdmap.to_control_str (mod_event->control);
+
+			mod.instance = instance;
+			mod.control = mod_event->control;
+			mod.beats = mod_event->beats;
+			mod.depth = mod_event->depth;
+			mod.center = mod_event->center;
+			mod.param = mod_event->param;
+
+			if (instance < -1 || mod.beats <= 0.0f
+			    || !cmdmap.is_input_control (ctrlname) || !cmdmap.get_control_info (ctrlname, info)
+			    || !Modulator::shape_from_string (mod_event->shape, mod.shape))
+			{
+				_osc->send_error(mod_event->ret_url, mod_event->ret_path, "Modulator Set Failed");
+			}
+			else {
+				mod.set_range (info.minValue, info.maxValue);
+				if (!set_modulator (mod)) {
+					_osc->send_error(mod_event->ret_url, mod_event->ret_path, "Modulator Set Failed");
+				}
+			}
+		}
+		else if (mod_event->type == ModulatorEvent::Remove) {
+			if (!remove_modulator (instance, mod_event->control)) {
+				_osc->send_error(mod_event->ret_url, mod_event->ret_path, "Modulator Remove Failed");
+			}
+		}
+		else if (mod_event->type == ModulatorEvent::Trigger) {
+			trigger_modulator (instance, mod_event->control);
+		}
+		else {
+			_osc->send_modulators (mod_event->ret_url, mod_event->ret_path);
+		}
+	}
+	else if ((bounce_event = dynamic_cast<BounceEvent*> (event)) != 0)
+	{
+		start_bounce (*bounce_event);
+	}
 	else if ((sess_event = dynamic_cast<SessionEvent*> (event)) != 0)
 	{
 		if (sess_event->type == SessionEvent::Load) {
@@ -2084,7 +3826,7 @@ Engine::process_nonrt_event (EventNonRT * event)
 			push_loop_manage_to_rt (lmev);
 		}
 		else {
-			if (!save_session (sess_event->filename, sess_event->write_audio)) {
+			if (!queue_save_session (*sess_event)) {
 				_osc->send_error(sess_event->ret_url, sess_event->ret_path, "Session Save Failed");
 			}
 		}
@@ -2122,6 +3864,7 @@ void Engine::update_sync_source ()
 	}
 
 	_quarter_counter = 0;
+	_tempo_counter = 0;
 
 	set_tempo(_tempo, false);
 }
@@ -2133,6 +3876,11 @@ Engine::set_tempo (double tempo, bool rt)
 	_tempo = tempo;
 	_quarter_counter = 0;
 	_tempo_counter = 0;
+	if (_sync_source == InternalTempoSync) {
+		// the counters restart on a beat, the position followers see
+		// carries on from the next whole one instead of from zero
+		_sync_beats = ceil (_sync_beats);
+	}
 
 
 	// adjust eighths per cycle if tempo is > 240 or < 60
@@ -2151,17 +3899,7 @@ Engine::set_tempo (double tempo, bool rt)
 			//_tempo *= 2.0;
 		}
 
-		// update all loops
-		if (rt) {
-			for (unsigned int n=0; n < _rt_instances.size(); ++n) {
-				_rt_instances[n]->set_port(EighthPerCycleLoop, _eighth_cycle);
-			}
-		}
-		else {
-			for (unsigned int n=0; n < _instances.size(); ++n) {
-				_instances[n]->set_port(EighthPerCycleLoop, _eighth_cycle);
-			}
-		}
+		// the loops get it along with the tempo below
 		calculate_midi_tick(rt);		
 		
 		// is this safe?  hard to say :)
@@ -2177,19 +3915,10 @@ Engine::set_tempo (double tempo, bool rt)
 		tempo = 0.0;
 	}
 
-	// update all loops
-	if (rt) {
-		for (Instances::iterator i = _rt_instances.begin(); i != _rt_instances.end(); ++i)
-		{
-			(*i)->set_port(TempoInput, tempo);
-		}
-	}
-	else {
-		for (Instances::iterator i = _instances.begin(); i != _instances.end(); ++i)
-		{
-			(*i)->set_port(TempoInput, tempo);
-		}
-	}
+	// the loops pull it in on their next run
+	_loop_tempo = tempo;
+	__sync_synchronize();
+	__sync_add_and_fetch (&_loop_tempo_version, 1);
 
 	if (_jack_timebase_master) {
 		TransportInfo tinfo;
@@ -2206,13 +3935,12 @@ Engine::set_tempo (double tempo, bool rt)
 			nframes_t cycleframes = (nframes_t) _tempo_frames;
 			nframes_t currpos = 0;
 			if (_sync_source > 0) {
+				nframes_t loopframes;
 				if (rt) {
-					cycleframes = (nframes_t) (_rt_instances[_sync_source-1]->get_control_value(Event::CycleLength) * srate);
-					currpos  = (nframes_t) (_rt_instances[_sync_source-1]->get_control_value(Event::LoopPosition) * srate);
+					_rt_instances[_sync_source-1]->get_loop_frames (currpos, loopframes, cycleframes);
 				}
 				else {
-					cycleframes = (nframes_t) (_instances[_sync_source-1]->get_control_value(Event::CycleLength) * srate);
-					currpos  = (nframes_t) (_instances[_sync_source-1]->get_control_value(Event::LoopPosition) * srate);
+					_instances[_sync_source-1]->get_loop_frames (currpos, loopframes, cycleframes);
 				}
 			}
 			else {
@@ -2277,7 +4005,7 @@ Engine::calculate_tempo_frames ()
 		
 		// cerr << "tempo frames is " << _tempo_frames << endl;
 	}
-	else if (_sync_source == MidiClockSync) {
+	else if (_sync_source == MidiClockSync || _sync_source == BrotherSync) {
 		calculate_midi_tick (true);
 	}
 
@@ -2317,6 +4045,7 @@ Engine::calculate_midi_tick (bool rt)
 int
 Engine::generate_sync (nframes_t offset, nframes_t nframes)
 {
+	SL_TRACE_SCOPE("generate_sync");
 	nframes_t npos = offset;
 	int hit_at = -1;
 	
@@ -2371,19 +4100,32 @@ Engine::generate_sync (nframes_t offset, nframes_t nframes)
 			//cerr << "tempo counter is now: " << _tempo_counter << endl;
 		}
 	}
+	else if (_sync_source == BrotherSync) {
+		// phase locked to another engine, pulse every midi loop tick worth of beats
+		double tempo = _tempo;
+
+		hit_at = _brother_clock->run (_internal_sync_buf, offset, nframes, _event_generator->fragmentEndTime(),
+					     _driver->get_samplerate(), _midi_loop_tick / 24.0, tempo);
+
+		if (TEMPO_DIFF(tempo, _tempo)) {
+			set_tempo (tempo, true);
+			_tempo_changed = true;
+			// wake up mainloop safely
+			pthread_cond_signal (&_event_cond);
+		}
+	}
 	else if (_sync_source == MidiClockSync) {
 
 		RingBuffer<Event>::rw_vector vec;
 		Event *evt;
 
-		// get available events
+		// get available events, timed ones stay queued until due
 		_sync_queue->get_read_vector (&vec);
 		
 		nframes_t usedframes = 0;
 		nframes_t doframes;
-		size_t num = vec.len[0];
+		size_t num = due_timed_events (vec);
 		size_t n = 0;
-		size_t vecn = 0;
 		nframes_t fragpos;
 		MIDI::timestamp_t timestamp = 0;
 
@@ -2392,17 +4134,11 @@ Engine::generate_sync (nframes_t offset, nframes_t nframes)
 			
 			while (n < num)
 			{ 
-				evt = vec.buf[vecn] + n;
+				evt = queued_event_at (vec, n, num);
 				fragpos = (nframes_t) (evt->FragmentPos() % nframes);
 				timestamp = evt->getTimestamp();
 
 				++n;
-				// to avoid code copying
-				if (n == num && vecn == 0) {
-					++vecn;
-					n = 0;
-					num = vec.len[1];
-				}
 				
 				if (fragpos < usedframes || fragpos >= nframes) {
 					// bad fragment pos
@@ -2488,7 +4224,7 @@ Engine::generate_sync (nframes_t offset, nframes_t nframes)
 			}
 			
 			// advance events
-			_sync_queue->increment_read_ptr (vec.len[0] + vec.len[1]);
+			_sync_queue->increment_read_ptr (num);
 
 			// zero the rest
 			memset (&(_internal_sync_buf[usedframes]), 0, (nframes - usedframes) * sizeof(float));
@@ -2572,7 +4308,8 @@ Engine::generate_sync (nframes_t offset, nframes_t nframes)
 
 		if (_rt_instances[_sync_source-1]->get_control_value(Event::State) != LooperStateRecording) {
 			// calc new tempo
-			nframes_t cycleframes = (nframes_t) (_rt_instances[_sync_source-1]->get_control_value(Event::CycleLength) * _driver->get_samplerate());
+			nframes_t currpos, loopframes, cycleframes;
+			_rt_instances[_sync_source-1]->get_loop_frames (currpos, loopframes, cycleframes);
 			double ntempo = 0.0;
 			if (cycleframes > 0) {
 				ntempo = (_driver->get_samplerate() * 30.0 * _eighth_cycle / cycleframes);
@@ -2596,8 +4333,6 @@ Engine::generate_sync (nframes_t offset, nframes_t nframes)
 			
 			// just calculate quarter note beats for update
 			if (_quarter_note_frames > 0.0) {
-				nframes_t currpos  = (nframes_t) (_rt_instances[_sync_source-1]->get_control_value(Event::LoopPosition) * _driver->get_samplerate());
-				nframes_t loopframes = (nframes_t) (_rt_instances[_sync_source-1]->get_control_value(Event::LoopLength) * _driver->get_samplerate());
 				if (loopframes > 0) {
 					nframes_t testval = (((currpos + nframes) % loopframes) % (nframes_t)_quarter_note_frames);
 					
@@ -2616,18 +4351,17 @@ Engine::generate_sync (nframes_t offset, nframes_t nframes)
 	{
 		RingBuffer<Event>::rw_vector vec;
 		Event *evt;
-		// get available events
+		// get available events, timed ones stay queued until due
 		_sync_queue->get_read_vector (&vec);
 
-		size_t num = vec.len[0];
+		size_t num = due_timed_events (vec);
 		size_t n = 0;
-		size_t vecn = 0;
 		nframes_t fragpos;
 		MIDI::timestamp_t timestamp = 0;
 		
 		while (n < num)
 		{ 
-			evt = vec.buf[vecn] + n;
+			evt = queued_event_at (vec, n, num);
 			fragpos = (nframes_t) (evt->FragmentPos() % nframes);
 			timestamp = evt->getTimestamp();
 			Event tmpevt;
@@ -2671,18 +4405,27 @@ Engine::generate_sync (nframes_t offset, nframes_t nframes)
 			}
 			
 			++n;
-			// to avoid code copying
-			if (n == num && vecn == 0) {
-				++vecn;
-				n = 0;
-				num = vec.len[1];
-			}
 		}
 
 		// advance events
-		_sync_queue->increment_read_ptr (vec.len[0] + vec.len[1]);
+		_sync_queue->increment_read_ptr (num);
 	}
 		
+	// keep a running beat position for brother sync followers, as of the start of this period
+	if (_sync_source == BrotherSync) {
+		_sync_beats = _brother_clock->get_period_beats();
+		_brother_clock->publish (_event_generator->fragmentEndTime(), _sync_beats, _tempo);
+	}
+	else if (_quarter_note_frames > 0.0) {
+		if (hit_at >= 0) {
+			// there is a quarter note at hit_at, take the phase from it
+			double hitbeats = (hit_at - (double) offset) / _quarter_note_frames;
+			_sync_beats = floor (_sync_beats + hitbeats + 0.5) - hitbeats;
+		}
+		_brother_clock->publish (_event_generator->fragmentEndTime(), _sync_beats, _tempo);
+		_sync_beats += (nframes - offset) / _quarter_note_frames;
+	}
+	
 	if (hit_at >= 0 && _tempo < 240.0) {
 		_beat_occurred = true;
 		
@@ -2716,6 +4459,9 @@ Engine::handle_load_session_event ()
 	{
 		remove_loop(_instances.back());
 	}
+	// let them go while the new ones are built
+	reap_dead_loops();
+
 	if (!_load_sess_event)
 	{
 		_loading = false;
@@ -2820,16 +4566,79 @@ Engine::load_session (std::string fname, string * readstr)
 
 	}
 	
-	
-	// just remove everything for now
-	while (_instances.size() > 0) {
-		LoopManageEvent lmev (LoopManageEvent::RemoveLoop, _instances.back());
-		// remove it now so indexes for new ones work out
-		_instances.pop_back();
-		// will be deleted later by us when the RT thread finishes with it
-		push_loop_manage_to_rt (lmev);
-	}
-
+	
+	// just remove everything for now
+	while (_instances.size() > 0) {
+		LoopManageEvent lmev (LoopManageEvent::RemoveLoop, _instances.back());
+		// remove it now so indexes for new ones work out
+		_instances.pop_back();
+		invalidate_snapshot_from (_instances.size());
+		// will be deleted later by us when the RT thread finishes with it,
+		// unless it is already on its way out
+		if (find (_removing.begin(), _removing.end(), lmev.looper) == _removing.end()) {
+			_removing.push_back (lmev.looper);
+			push_loop_manage_to_rt (lmev);
+		}
+	}
+
+	// groups keep their index, the loopers refer to it
+	{
+		LockMonitor lm (_group_lock, __LINE__, __FILE__);
+		for (int g=0; g < MAX_LOOP_GROUPS; ++g) {
+			_group_names[g] = "";
+		}
+	}
+	for (int g=0; g < MAX_LOOP_GROUPS; ++g) {
+		if (_group_gains[g] != 1.0f) {
+			LoopManageEvent lmev (LoopManageEvent::SetGroupGain, g, 1.0f);
+			push_loop_manage_to_rt (lmev);
+		}
+	}
+
+	XMLNode * groups_node = root_node->find_named_node ("LoopGroups");
+	if (groups_node) {
+		XMLNodeList group_kids = groups_node->children ("LoopGroup");
+
+		for (XMLNodeConstIterator niter = group_kids.begin(); niter != group_kids.end(); ++niter)
+		{
+			int group = -1;
+			float gain = 1.0f;
+
+			if ((prop = (*niter)->property ("index")) != 0) {
+				sscanf (prop->value().c_str(), "%d", &group);
+			}
+			if ((prop = (*niter)->property ("gain")) != 0) {
+				sscanf (prop->value().c_str(), "%g", &gain);
+			}
+			if (group < 0 || group >= MAX_LOOP_GROUPS || (prop = (*niter)->property ("name")) == 0) {
+				continue;
+			}
+
+			{
+				LockMonitor lm (_group_lock, __LINE__, __FILE__);
+				_group_names[group] = prop->value();
+			}
+			// ahead of the loops' AddLoop, so they start at this gain
+			LoopManageEvent lmev (LoopManageEvent::SetGroupGain, group, gain);
+			push_loop_manage_to_rt (lmev);
+		}
+	}
+
+	clear_modulators ();
+
+	XMLNode * mods_node = root_node->find_named_node ("Modulators");
+	if (mods_node) {
+		XMLNodeList mod_kids = mods_node->children ("Modulator");
+
+		for (XMLNodeConstIterator niter = mod_kids.begin(); niter != mod_kids.end(); ++niter)
+		{
+			Modulator mod;
+			if (mod.set_state (**niter) == 0) {
+				set_modulator (mod);
+			}
+		}
+	}
+	
 	XMLNode * loopers_node = root_node->find_named_node ("Loopers");
 	if (!loopers_node) {
 		return false;
@@ -2838,40 +4647,78 @@ Engine::load_session (std::string fname, string * readstr)
 	looper_kids = loopers_node->children ("Looper");
 
 	_loading = true;
-	
+
+	std::vector<LooperBuild> builds;
 	for (XMLNodeConstIterator niter = looper_kids.begin(); niter != looper_kids.end(); ++niter)
 	{
 		XMLNode *child;
 		child = (*niter);
 
+		if (builds.size() >= (size_t) MAX_LOOPS) {
+			cerr << "sooperlooper: at most " << MAX_LOOPS << " loops, the rest of the session is skipped" << endl;
+			break;
+		}
+
 		// add temporary attribute with the pathname for the session file
 		child->add_property("session_filename", fname);
 
-		Looper * instance = new Looper (_driver, *child);
-		add_loop (instance);
+		builds.push_back (LooperBuild());
+		builds.back().node = child;
+	}
+
+	struct timeval t0, t1, t2, t3;
+	gettimeofday (&t0, NULL);
+	build_loopers (builds);
+	wait_for_reaped_ports ();
+	gettimeofday (&t1, NULL);
+
+	size_t ok = 0;
+	for (; ok < builds.size(); ++ok) {
+		if (!(*builds[ok].looper)() || !builds[ok].looper->register_ports()) {
+			break;
+		}
+	}
+	gettimeofday (&t2, NULL);
+
+	for (size_t i=0; i < ok; ++i) {
+		add_loop (builds[i].looper);
+	}
+	gettimeofday (&t3, NULL);
+
+	if (ok < builds.size()) {
+		// indexes must stay contiguous, so drop everything past the failure
+		cerr << "sooperlooper: could only load " << ok << " of " << builds.size() << " loops from the session" << endl;
+		for (size_t i=ok; i < builds.size(); ++i) {
+			delete builds[i].looper;
+		}
 	}
 
 	_loading = false;
 
+	if (!_quiet) {
+		fprintf (stderr, "loaded %u loops: construction %.1f ms, port registration %.1f ms, engine add %.1f ms\n",
+			 (unsigned int) ok, msecs_between (t0, t1), msecs_between (t1, t2), msecs_between (t2, t3));
+	}
+
 	_driver->set_timebase_master(_jack_timebase_master);
-	
-	_osc->send_all_config();
-	
+
+	// the clients hear about the whole load in one go, from flush_config_changes()
+
 	return true;
 }
 
-bool
-Engine::save_session (std::string fname, bool write_audio, string * writestr)
+XMLTree *
+Engine::build_session_tree (const std::string & fname, bool write_audio, SessionAudioList & audiofiles)
 {
 	// make xmltree
 	LocaleGuard lg ("POSIX");
-	XMLTree sessiondoc;
+	XMLTree * sessiondoc = new XMLTree();
 	char buf[120];
 
 	
 	XMLNode * root_node = new XMLNode("SLSession");
 	root_node->add_property("version", sooperlooper_version);
-	sessiondoc.set_root (root_node);
+	sessiondoc->set_root (root_node);
 
 	XMLNode * globals_node = root_node->add_child ("Globals");
 	
@@ -2913,6 +4760,29 @@ Engine::save_session (std::string fname, bool write_audio, string * writestr)
 	globals_node->add_property ("smart_eighths", buf);
 
 	
+	XMLNode * groups_node = root_node->add_child ("LoopGroups");
+	vector<string> group_names;
+	get_loop_groups (group_names);
+
+	for (size_t g=0; g < group_names.size(); ++g) {
+		if (group_names[g].empty()) continue;
+
+		XMLNode * group_node = groups_node->add_child ("LoopGroup");
+		group_node->add_property ("name", group_names[g]);
+		snprintf(buf, sizeof(buf), "%d", (int) g);
+		group_node->add_property ("index", buf);
+		snprintf(buf, sizeof(buf), "%.10g", _group_gains[g]);
+		group_node->add_property ("gain", buf);
+	}
+
+	XMLNode * mods_node = root_node->add_child ("Modulators");
+	vector<Modulator> mods;
+	get_modulators (mods);
+
+	for (size_t m=0; m < mods.size(); ++m) {
+		mods_node->add_child_nocopy (mods[m].get_state());
+	}
+	
 	XMLNode * loopers_node = root_node->add_child ("Loopers");
 
 	int n=0;
@@ -2927,29 +4797,493 @@ Engine::save_session (std::string fname, bool write_audio, string * writestr)
 
 			node->add_property("loop_audio", pathstr);
 
-			(*i)->save_loop(pathstr, LoopFileEvent::FormatFloat);
+			audiofiles.push_back (make_pair (*i, string(pathstr)));
 		}
 
 		loopers_node->add_child_nocopy (*node);
 	}
 
+	return sessiondoc;
+}
+
+bool
+Engine::save_session (std::string fname, bool write_audio, string * writestr)
+{
+	SessionAudioList audiofiles;
+	XMLTree * sessiondoc = build_session_tree (fname, write_audio, audiofiles);
+	bool ret = true;
+
+	for (SessionAudioList::iterator i = audiofiles.begin(); i != audiofiles.end(); ++i) {
+		i->first->save_loop (i->second, LoopFileEvent::FormatFloat);
+	}
 
 	if (writestr) {
-		*writestr = sessiondoc.write_buffer();
+		*writestr = sessiondoc->write_buffer();
 	}
 	
 	// write doc to file
 	if (!fname.empty()) {
-		if (sessiondoc.write (fname))
+		if (sessiondoc->write (fname))
 		{	    
 			fprintf (stderr, "Stored session as %s\n", fname.c_str());
-			return true;
 		}
 		else {
 			fprintf (stderr, "Failed to store session as %s\n", fname.c_str());
+			ret = false;
+		}
+	}
+
+	delete sessiondoc;
+	return ret;
+}
+
+bool
+Engine::queue_save_session (const SessionEvent & event)
+{
+	if (event.filename.empty()) {
+		return save_session (event.filename, event.write_audio);
+	}
+
+	// the loop state is captured here, the slow part happens on a worker
+	SessionAudioList audiofiles;
+	XMLTree * sessiondoc = build_session_tree (event.filename, event.write_audio, audiofiles);
+
+	SessionSaveJob * job = new SessionSaveJob (sessiondoc, event.filename, audiofiles, _osc, event.ret_url, event.ret_path);
+
+	if (!_worker->push (job, Worker::PriorityLow)) {
+		fprintf (stderr, "Too many pending saves, not storing session as %s\n", event.filename.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool
+Engine::queue_trace_save (const std::string & fname, const std::string & ret_url, const std::string & ret_path)
+{
+	TraceSaveJob * job = new TraceSaveJob (fname, _osc, ret_url, ret_path);
+
+	return _worker->push (job, Worker::PriorityLow) != 0;
+}
+
+void
+Engine::queue_loop_file_job (Looper * looper, LoopFileEvent::Type type, const std::string & fname,
+			     const std::string & ret_url, const std::string & ret_path)
+{
+	LoopFileJob * job = new LoopFileJob (looper, type, fname, _osc, ret_url, ret_path);
+
+	if (!_worker->push (job, type == LoopFileEvent::Load ? Worker::PriorityHigh : Worker::PriorityNormal)) {
+		if (!ret_url.empty()) {
+			_osc->send_error (ret_url, ret_path, type == LoopFileEvent::Load ? "Loop Load Failed: busy" : "Loop Save Failed: busy");
+		}
+	}
+}
+
+bool
+Engine::start_bounce (BounceEvent & event)
+{
+	// main thread
+	if (_bounce_running) {
+		_osc->send_error (event.ret_url, event.ret_path, "Bounce Failed: busy");
+		return false;
+	}
+
+	// a group name or a list of loop numbers
+	vector<int> indices;
+	int group = find_loop_group (event.loops);
+
+	if (group >= 0) {
+		for (unsigned int n=0; n < _instances.size(); ++n) {
+			if (_instances[n]->get_loop_group() == group) {
+				indices.push_back ((int) n);
+			}
+		}
+	}
+	else {
+		const char * str = event.loops.c_str();
+		char * end;
+
+		while (*str) {
+			long idx = strtol (str, &end, 10);
+			if (end == str) {
+				break;
+			}
+			indices.push_back (idx == -3 ? _selected_loop : (int) idx);
+
+			str = end;
+			while (*str == ',' || *str == ' ') {
+				++str;
+			}
+		}
+	}
+
+	BounceSwap swap;
+	swap.reference = 0;
+	swap.target = 0;
+	swap.source_count = 0;
+	swap.clear_sources = event.clear_sources;
+	swap.added = false;
+
+	for (vector<int>::iterator i = indices.begin(); i != indices.end(); ++i) {
+		if (*i < 0 || *i >= (int) _instances.size() || *i == event.target) {
+			_osc->send_error (event.ret_url, event.ret_path, "Bounce Failed: bad loop");
+			return false;
+		}
+		Looper * looper = _instances[*i];
+		if (find (swap.sources, swap.sources + swap.source_count, looper) != swap.sources + swap.source_count) {
+			continue;
+		}
+		if (swap.source_count == MAX_BOUNCE_SOURCES) {
+			_osc->send_error (event.ret_url, event.ret_path, "Bounce Failed: too many loops");
+			return false;
+		}
+		swap.sources[swap.source_count++] = looper;
+	}
+
+	if (event.target < -1 || event.target >= (int) _instances.size()) {
+		_osc->send_error (event.ret_url, event.ret_path, "Bounce Failed: bad target");
+		return false;
+	}
+
+	// the positions must all come from the same period
+	struct Snap {
+		nframes_t pos;
+		nframes_t length;
+		float     rate;
+		bool      audible;
+	};
+	vector<Snap> snaps (swap.source_count);
+	const volatile nframes_t & running_frames = _running_frames;
+
+	for (int tries = 0; tries < 4; ++tries) {
+		nframes_t period = running_frames;
+
+		for (int n=0; n < swap.source_count; ++n) {
+			Looper * looper = swap.sources[n];
+			nframes_t cycle;
+			looper->get_loop_frames (snaps[n].pos, snaps[n].length, cycle);
+			snaps[n].rate = looper->get_control_value (Event::TrueRate);
+			snaps[n].audible = snaps[n].length > 0 && snaps[n].rate != 0.0f && looper->automation_running()
+				&& (int) looper->get_control_value (Event::State) != LooperStateMuted;
+		}
+
+		if (period == running_frames) {
+			break;
+		}
+	}
+
+	// the longest of them sets the length and is what the swap waits for
+	int ref = -1;
+	double reflen = 0.0;
+	unsigned int maxchans = 1;
+
+	for (int n=0; n < swap.source_count; ++n) {
+		if (!snaps[n].audible) {
+			continue;
+		}
+		double len = snaps[n].length / fabs (snaps[n].rate);
+		if (len > reflen) {
+			reflen = len;
+			ref = n;
+		}
+		maxchans = max (maxchans, (unsigned int) swap.sources[n]->get_control_value (Event::ChannelCount));
+	}
+
+	if (ref < 0) {
+		_osc->send_error (event.ret_url, event.ret_path, "Bounce Failed: nothing playing");
+		return false;
+	}
+
+	swap.reference = swap.sources[ref];
+	double srate = _driver->get_samplerate();
+
+	// the mix must repeat where all of its sources do.  that takes the
+	// fewest reference lengths each of them fits into a whole number of times
+	swap.cycles = 0;
+	for (int k=1; k <= BOUNCE_MAX_CYCLES && swap.cycles == 0; ++k) {
+		bool fits = true;
+		for (int n=0; n < swap.source_count && fits; ++n) {
+			if (!snaps[n].audible) {
+				continue;
+			}
+			double len = snaps[n].length / fabs (snaps[n].rate);
+			double reps = k * reflen / len;
+			fits = fabs (reps - floor (reps + 0.5)) * len <= 1.0;
+		}
+		if (fits) {
+			swap.cycles = k;
+		}
+	}
+
+	if (swap.cycles == 0) {
+		_osc->send_error (event.ret_url, event.ret_path, "Bounce Failed: loop lengths don't line up");
+		return false;
+	}
+
+	nframes_t frames = (nframes_t) lrint (reflen * swap.cycles);
+
+	// mixed as the common outputs hear it, a stereo result plays back
+	// hard panned.  without them channels stay as they are
+	bool panned = get_common_output_count() > 1;
+	unsigned int chans = panned ? 2 : maxchans;
+
+	if (event.target >= 0) {
+		swap.target = _instances[event.target];
+		if (frames > swap.target->get_control_value (Event::FreeTime) * srate) {
+			_osc->send_error (event.ret_url, event.ret_path, "Bounce Failed: target too short");
+			return false;
+		}
+		chans = (unsigned int) swap.target->get_control_value (Event::ChannelCount);
+	}
+	else {
+		if (!add_loop (chans, (float) (frames / srate) + 1.0f)) {
+			_osc->send_error (event.ret_url, event.ret_path, "Bounce Failed: could not add loop");
 			return false;
 		}
+		swap.target = _instances.back();
+		swap.added = true;
+	}
+
+	// bounced frames from now until the reference wraps, where they start
+	double ahead = (snaps[ref].rate > 0.0f) ? (double) (snaps[ref].length - snaps[ref].pos) : (double) snaps[ref].pos;
+	ahead /= fabs (snaps[ref].rate);
+
+	const float scale = 2.0f - 4.0f * powf (10.0f, -3.0f / 20.0f);
+	vector<BounceJob::Source> sources;
+
+	for (int n=0; n < swap.source_count; ++n) {
+		swap.phases[n] = -1.0;
+		if (!snaps[n].audible) {
+			continue;
+		}
+
+		Looper * looper = swap.sources[n];
+		BounceJob::Source src;
+		src.looper = looper;
+		src.rate = snaps[n].rate;
+		src.offset = snaps[n].pos + ahead * src.rate;
+		swap.phases[n] = fmod (src.offset, (double) snaps[n].length);
+		if (swap.phases[n] < 0.0) {
+			swap.phases[n] += snaps[n].length;
+		}
+		src.chans = (unsigned int) looper->get_control_value (Event::ChannelCount);
+		src.gains.assign (src.chans * chans, 0.0f);
+
+		float wet = looper->get_control_value (Event::WetLevel) * get_loop_group_gain (looper->get_loop_group());
+
+		for (unsigned int c=0; c < src.chans; ++c) {
+			if (panned && chans == 2) {
+				// the same law as the loop's panner
+				float panR = (c < 4) ? looper->get_control_value ((Event::control_t) (Event::PanChannel1 + c)) : 0.5f;
+				float panL = 1.0f - panR;
+				src.gains[c * chans] = wet * panL * (scale * panL + 1.0f - scale);
+				src.gains[c * chans + 1] = wet * panR * (scale * panR + 1.0f - scale);
+			}
+			else {
+				src.gains[c * chans + min (c, chans - 1)] = wet;
+			}
+		}
+
+		sources.push_back (src);
+	}
+
+	BounceJob * job = new BounceJob (this, sources, swap, frames, chans, event.ret_url, event.ret_path);
+
+	if (!_worker->push (job, Worker::PriorityNormal)) {
+		if (event.target < 0) {
+			// don't leave the empty loop we added for it behind
+			push_loop_removal ((int) _instances.size() - 1);
+		}
+		_osc->send_error (event.ret_url, event.ret_path, "Bounce Failed: busy");
+		return false;
 	}
 
+	_bounce_running = true;
 	return true;
 }
+
+void
+Engine::bounce_rendered (bool ok, bool cancelled, const BounceSwap & swap, const std::string & ret_url, const std::string & ret_path)
+{
+	// main thread, the target holds the mix now
+	_bounce_running = false;
+
+	BounceSwap sw = swap;
+
+	if (!ok) {
+		_osc->send_error (ret_url, ret_path, cancelled ? "Bounce Cancelled" : "Bounce Failed");
+	}
+	else if (_bounce_queue->write (&sw, 1) != 1) {
+		_osc->send_error (ret_url, ret_path, "Bounce Failed: busy");
+	}
+	else {
+		return;
+	}
+
+	if (swap.added) {
+		// don't leave the loop we added for it behind, unless it is gone already
+		Instances::iterator iter = find (_instances.begin(), _instances.end(), swap.target);
+		if (iter != _instances.end()) {
+			push_loop_removal ((int) (iter - _instances.begin()));
+		}
+	}
+}
+
+void
+Engine::reap_dead_loops ()
+{
+	if (_reaper) {
+		// the jobs have nothing to finish, this just frees them
+		_reaper->process_completions();
+	}
+
+	// loops a worker job still uses lose their ports now, so new loops can
+	// have the names, and are destroyed once the job is done with them
+	vector<Looper*> busy;
+
+	for (vector<Looper*>::iterator i = _draining_loops.begin(); i != _draining_loops.end(); ) {
+		if (!_worker || !_worker->is_owner_busy (*i)) {
+			_dead_loops.push_back (*i);
+			i = _draining_loops.erase (i);
+		}
+		else {
+			++i;
+		}
+	}
+	for (vector<Looper*>::iterator i = _dead_loops.begin(); i != _dead_loops.end(); ) {
+		if (_worker && _worker->is_owner_busy (*i)) {
+			if (find (_draining_loops.begin(), _draining_loops.end(), *i) == _draining_loops.end()) {
+				busy.push_back (*i);
+				_draining_loops.push_back (*i);
+			}
+			i = _dead_loops.erase (i);
+		}
+		else {
+			++i;
+		}
+	}
+
+	if (!busy.empty()) {
+		LoopReapJob * job = new LoopReapJob (&_dead_loops, busy, true);
+		if (!_reaper) {
+			delete job;
+		}
+		else {
+			_reaper->push (job);
+		}
+	}
+
+	if (_dead_loops.empty()) {
+		return;
+	}
+
+	LoopReapJob * job = new LoopReapJob (&_dead_loops, _dead_loops);
+
+	if (!_reaper) {
+		delete job;
+		return;
+	}
+	// a rejected job is deleted, which destroys them right here
+	_reaper->push (job);
+}
+
+void
+Engine::wait_for_reaped_ports ()
+{
+	// new loops reuse the port names of removed ones, which must be gone first.
+	// the reaper has its own thread, so this never waits behind file jobs
+	if (_reaper) {
+		_reaper->wait_owner (&_dead_loops);
+	}
+}
+
+void
+Engine::publish_control_snapshot ()
+{
+	SL_TRACE_SCOPE("publish control snapshot");
+
+	// controls added past the last one here are answered by the main loop
+	const int count = (int) Event::TimetagFrameOffset + 1;
+	float values[ControlSnapshot::MaxControls];
+	int nloops = min ((int) _instances.size(), (int) ControlSnapshot::MaxLoops);
+
+	if ((int) _loop_activity.size() != nloops) {
+		_loop_activity.assign (nloops, LoopActivity());
+		_snapshot_sweep = 0;
+	}
+
+	// busy loops every pass.  an idle one once when it goes idle, when one of
+	// its controls changed, and otherwise a few per pass in turn for the rest
+	const int sweep_count = 8;
+	int sweep_start = (int) _snapshot_sweep;
+
+	for (int n=0; n < nloops; ++n) {
+		LoopActivity & act = _loop_activity[n];
+		bool idle = _instances[n]->is_idle();
+		bool in_sweep = ((n - sweep_start + nloops) % nloops) < sweep_count;
+
+		if (idle && act.snap_idle && !act.snap_dirty && !in_sweep) {
+			continue;
+		}
+		act.snap_idle = idle;
+		act.snap_dirty = false;
+
+		for (int c=0; c < count; ++c) {
+			values[c] = _instances[n]->get_control_value ((Event::control_t) c);
+		}
+		_snapshot.publish (n, values, count);
+	}
+
+	if (nloops > 0) {
+		_snapshot_sweep = (_snapshot_sweep + sweep_count) % nloops;
+	}
+
+	for (int c=0; c < count; ++c) {
+		values[c] = get_control_value ((Event::control_t) c, -2);
+	}
+	_snapshot.publish (-2, values, count);
+
+	_snapshot.set_selected_loop (_selected_loop);
+	_snapshot.set_loop_count (nloops);
+}
+
+void
+Engine::invalidate_snapshot_from (int index)
+{
+	// main thread, the loops from index on are not the ones the snapshot
+	// has.  gets for them go to the main loop until they are republished
+	_snapshot.invalidate_from (index);
+
+	for (size_t n = index; n < _loop_activity.size(); ++n) {
+		_loop_activity[n].snap_dirty = true;
+	}
+}
+
+void
+Engine::mark_snapshot_dirty (int instance)
+{
+	if (instance == -3) {
+		instance = _selected_loop;
+	}
+
+	if (instance >= 0) {
+		if (instance < (int) _loop_activity.size()) {
+			_loop_activity[instance].snap_dirty = true;
+		}
+	}
+	else if (instance == -1) {
+		for (size_t n=0; n < _loop_activity.size(); ++n) {
+			_loop_activity[n].snap_dirty = true;
+		}
+	}
+}
+
+void
+Engine::worker_job_finished ()
+{
+	// wake up the main loop to run the completion.  the worker emits this
+	// without its own lock held, the main loop may be waiting on a job
+	// while holding ours
+	LockMonitor mon(_event_loop_lock, __LINE__, __FILE__);
+	pthread_cond_signal (&_event_cond);
+}
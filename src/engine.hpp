@@ -32,12 +32,20 @@
 #include "audio_driver.hpp"
 #include "midi_bind.hpp"
 #include "command_map.hpp"
+#include "control_snapshot.hpp"
+#include "modulator.hpp"
+#include "contention.hpp"
+
+class XMLNode;
+class XMLTree;
 
 namespace SooperLooper {
 
 class Looper;
 class ControlOSC;
 class MidiBridge;
+class BrotherClock;
+class Worker;
 	
 class Engine
 	: public sigc::trackable
@@ -46,6 +54,13 @@ class Engine
 
 	static const int TEMPO_WINDOW_SIZE = 4;
 	static const int TEMPO_WINDOW_SIZE_MASK = 3;
+	static const int MAX_LOOP_GROUPS = 32;
+	static const int MAX_MODULATORS = 64;
+	static const int MAX_BOUNCE_SOURCES = 32;
+	// instance vectors and loop management queues are sized for this many
+	static const int MAX_LOOPS = 4096;
+	// frames of common input kept for loops waking up from idle
+	static const nframes_t COMMON_INPUT_HISTORY = 65536;
 	
 	Engine();
 	virtual ~Engine();
@@ -58,6 +73,8 @@ class Engine
 
 	void set_default_loop_secs (float secs) { _def_loop_secs = secs; }
 	void set_default_channels (int chan) { _def_channel_cnt = chan; }
+	// no status output (loop creation timings) on stderr
+	void set_quiet (bool flag) { _quiet = flag; }
 	
 	void set_midi_bridge (MidiBridge * bridge);
 	MidiBridge * get_midi_bridge() { return _midi_bridge; }
@@ -71,6 +88,20 @@ class Engine
 
 	bool add_loop (unsigned int chans, float loopsecs=40.0f, bool discrete = true);
 	bool add_loop (Looper * instance);
+	struct LooperBuild
+	{
+		LooperBuild() : node(0), index(0), chans(1), loopsecs(40.0f), discrete(true), looper(0) {}
+
+		XMLNode *    node;  // when set, the loop is built from this state
+		unsigned int index;
+		unsigned int chans;
+		float        loopsecs;
+		bool         discrete;
+		Looper *     looper;
+	};
+
+	// builds count loops at once, the loopers are constructed in parallel
+	bool add_loops (unsigned int count, unsigned int chans, float loopsecs=40.0f, bool discrete = true);
 	bool remove_loop (Looper * loop);
 	
 	void set_force_discrete(bool flag) { _force_discrete = flag; }
@@ -83,6 +114,8 @@ class Engine
 	int process (nframes_t);
 
 	void buffersize_changed (nframes_t);
+	// rt safe, the main loop will requery the port latencies soon
+	void request_latency_update() { _latency_dirty = true; }
 	
 	//RingBuffer<Event> & get_event_queue() { return *_event_queue; }
 
@@ -96,13 +129,92 @@ class Engine
 	
 	EventGenerator & get_event_generator() { return *_event_generator;}
 
-	bool push_command_event (Event::type_t type, Event::command_t cmd, int8_t instance);
-	void push_control_event (Event::type_t type, Event::control_t ctrl, float val, int8_t instance, int src=0);
+	BrotherClock * get_brother_clock() { return _brother_clock; }
+
+	Worker * get_worker() { return _worker; }
 
-	void push_midi_command_event (Event::type_t type, Event::command_t cmd, int8_t instance, long framepos=-1);
-	void push_midi_control_event (Event::type_t type, Event::control_t ctrl, float val, int8_t instance, long framepos=-1);
+	// any thread, the trace file is written by a worker
+	bool queue_trace_save (const std::string & fname, const std::string & ret_url, const std::string & ret_path);
+
+	// control values as of the last main loop pass, readable from any thread
+	const ControlSnapshot & get_control_snapshot() const { return _snapshot; }
+
+	// a non-zero timestamp (host time, as in MIDI::timestamp_t) schedules the event
+	// for the fragment that time falls in, instead of as soon as possible
+	bool push_command_event (Event::type_t type, Event::command_t cmd, int instance, MIDI::timestamp_t timestamp=0);
+	void push_control_event (Event::type_t type, Event::control_t ctrl, float val, int instance, int src=0, MIDI::timestamp_t timestamp=0);
+
+	void push_midi_command_event (Event::type_t type, Event::command_t cmd, int instance, long framepos=-1);
+	void push_midi_control_event (Event::type_t type, Event::control_t ctrl, float val, int instance, long framepos=-1);
 	
 	void push_sync_event (Event::control_t ctrl, long framepos=-1, MIDI::timestamp_t timestamp=0);
+
+	// a group command or control is a single rt event applied to all members (Instance -4)
+	bool push_group_command_event (Event::type_t type, Event::command_t cmd, int group, MIDI::timestamp_t timestamp=0);
+	void push_group_control_event (Event::type_t type, Event::control_t ctrl, float val, int group, int src=0, MIDI::timestamp_t timestamp=0);
+
+	// seconds added to remote timetags, so they can arrive before they are due
+	double get_timetag_offset() const { return _timetag_offset; }
+
+	// loop groups, the group index is what loops refer to in their "group" control
+	int  add_loop_group (const std::string & name);
+	bool remove_loop_group (const std::string & name);
+	int  find_loop_group (const std::string & name);
+	void get_loop_groups (std::vector<std::string> & names);
+
+	// called from the rt thread by the loopers when mixing their outputs
+	float get_loop_group_gain (int group) const {
+		return (group >= 0 && group < MAX_LOOP_GROUPS) ? _group_gains[group] : 1.0f;
+	}
+
+	// tempo synced modulators, at most one per loop (or all loops) and control.
+	// called from the main event loop, the rt thread picks the changes up
+	bool set_modulator (const Modulator & mod);
+	bool remove_modulator (int instance, Event::control_t ctrl);
+	bool trigger_modulator (int instance, Event::control_t ctrl);
+	void get_modulators (std::vector<Modulator> & mods);
+	void clear_modulators ();
+
+	// what the rt thread does once a bounce is rendered: when reference
+	// wraps with every source where the mix starts, the target is
+	// triggered and the sources cleared or muted
+	struct BounceSwap {
+		Looper * reference;
+		Looper * target;
+		Looper * sources[MAX_BOUNCE_SOURCES];
+		// loop frame of each source at the first bounced frame, -1 for
+		// those that aren't in the mix
+		double   phases[MAX_BOUNCE_SOURCES];
+		int      source_count;
+		// reference lengths the mix lasts before it repeats
+		int      cycles;
+		bool     clear_sources;
+		// the target was added for it
+		bool     added;
+	};
+
+	// mixes loops into one on the worker.  main thread
+	bool start_bounce (BounceEvent & event);
+	// main thread, from the bounce job when it is done
+	void bounce_rendered (bool ok, bool cancelled, const BounceSwap & swap, const std::string & ret_url, const std::string & ret_path);
+
+	// rt thread, the loopers pull the tempo and eighths when the version moves
+	unsigned int get_loop_tempo_version () const { return _loop_tempo_version; }
+	float get_loop_tempo () const { return _loop_tempo; }
+	float get_eighth_cycle () const { return _eighth_cycle; }
+
+	// rt thread, for loops coming back from idle.  frames since the last
+	// strong sync pulse as of the start of this period
+	nframes_t get_sync_pulse_age () const { return _sync_pulse_age; }
+	// frames processed before the current period
+	nframes_t get_running_frames () const { return _running_frames; }
+	// peak of a common input over this period
+	float get_common_input_peak (unsigned int chan) const {
+		return chan < _common_in_peaks.size() ? _common_in_peaks[chan] : 0.0f;
+	}
+	// the frames of a common input that start back frames before offset in this period
+	bool get_common_input_history (unsigned int chan, nframes_t offset, nframes_t back, sample_t * dest, nframes_t frames);
+	nframes_t get_common_input_history_size () const { return COMMON_INPUT_HISTORY - _buffersize; }
 	
 	std::string get_osc_url (bool udp=true);
 	int get_osc_port ();
@@ -110,10 +222,10 @@ class Engine
 	bool load_midi_bindings (std::string filename, bool append, CommandMap & cmdmap);
 	bool load_midi_bindings (std::istream & instream, bool append, CommandMap & cmdmap);
 
-	float get_control_value (Event::control_t, int8_t instance);
+	float get_control_value (Event::control_t, int instance);
 	
 	sigc::signal2<void, int, bool> LoopAdded;
-	sigc::signal0<void> LoopRemoved;
+	sigc::signal1<void, int> LoopRemoved;
 
 	sigc::signal2<void, int , int> ParamChanged;
 
@@ -126,8 +238,12 @@ class Engine
 	void next_midi_received(MidiBindInfo info);
 
 	// session state
+	typedef std::vector<std::pair<Looper*, std::string> > SessionAudioList;
+
 	bool load_session (std::string fname, std::string * readstr=0);
 	bool save_session (std::string fname, bool write_audio = false, std::string * writestr=0);
+	// same, but the loop audio and the file are written on a worker thread
+	bool queue_save_session (const SessionEvent & event);
 	
 	int get_id() const { return _unique_id; }
 
@@ -141,15 +257,25 @@ class Engine
 		enum EventType {
 			AddLoop = 0,
 			RemoveLoop,
-			LoadSession
+			LoadSession,
+			SetGroupGain,
+			ResetGroup    // members leave the group, gain back to unity
 		};
 
 		LoopManageEvent () {}
-		LoopManageEvent (EventType et, Looper *loop) : etype(et), looper(loop) {}
+		LoopManageEvent (EventType et, Looper *loop) : etype(et), looper(loop), group(-1), value(0.0f) {}
+		LoopManageEvent (EventType et, int grp, float val) : etype(et), looper(0), group(grp), value(val) {}
 
 		EventType etype;
 		Looper * looper;
+		int      group;
+		float    value;
 	};
+
+	void set_rt_group_gain (int group, float gain);
+
+	void build_loopers (std::vector<LooperBuild> & builds);
+	void set_initial_loop_controls (Looper * instance);
 	
 
 	bool process_nonrt_event (EventNonRT * event);
@@ -159,13 +285,61 @@ class Engine
 	int generate_sync (nframes_t offset, nframes_t nframes);
 	
 	void update_sync_source ();
+	void update_latencies ();
 	void calculate_tempo_frames ();
 	void calculate_midi_tick (bool rt=true);
 
 	void do_global_rt_event (Event * ev, nframes_t offset, nframes_t nframes);
 
-	bool do_push_command_event (RingBuffer<Event> * rb, Event::type_t type, Event::command_t cmd, int8_t instance, long framepos=-1);
-	bool do_push_control_event (RingBuffer<Event> * rb, Event::type_t type, Event::control_t ctrl, float val, int8_t instance, long framepos=-1, int src=0);
+	struct ModulatorChange
+	{
+		enum Op {
+			Set = 0,
+			Remove,
+			Trigger,
+			LoopRemoved   // slot is the loop index, applied once looper is out of the rt list
+		};
+
+		ModulatorChange () {}
+		ModulatorChange (Op o, int s, bool rest=false) : op(o), slot(s), restore(rest), looper(0) {}
+
+		Op        op;
+		int       slot;
+		bool      restore; // Remove puts the control back to the center value
+		Looper *  looper;
+		Modulator mod;
+	};
+
+	int  find_modulator (int instance, Event::control_t ctrl);
+	bool push_modulator_change (ModulatorChange & chg);
+	int  queued_instance_index (int index);
+	void modulators_loop_removed (int index);
+	void rt_modulators_loop_removed (int index);
+	bool push_loop_removal (int index);
+	void run_modulators (nframes_t nframes);
+
+	int  find_rt_instance (const Looper * looper) const;
+	void run_bounce_swap (nframes_t nframes);
+	void apply_modulator (const Modulator & mod, float val);
+
+	bool do_push_command_event (RingBuffer<Event> * rb, Event::type_t type, Event::command_t cmd, int instance, long framepos=-1, int8_t group=-1, MIDI::timestamp_t timestamp=0);
+	bool do_push_control_event (RingBuffer<Event> * rb, Event::type_t type, Event::control_t ctrl, float val, int instance, long framepos=-1, int src=0, int8_t group=-1, MIDI::timestamp_t timestamp=0);
+
+	size_t due_timed_events (RingBuffer<Event>::rw_vector & vec);
+	// moves new timed events into _timed_pending, and drops the first count of them
+	void collect_timed_events ();
+	void drop_timed_events (size_t count);
+	inline void note_timed_event (Event * evt);
+	// counts a drop or notes the fill level of one of the event queues
+	void note_queue_push (RingBuffer<Event> * evqueue, bool pushed);
+	// main loop, polls the outside counters and logs what changed
+	void check_contention (const struct timeval & now);
+
+	inline bool event_targets_loop (const Event * evt, int m);
+	inline bool is_global_rt_event (const Event * evt);
+	inline bool is_group_gain_event (const Event * evt);
+	inline bool loops_can_queue (const Event * evt);
+	void run_loops_to (nframes_t & usedframes, nframes_t frame);
 
 	bool push_loop_manage_to_rt (LoopManageEvent & lme);
 	bool push_loop_manage_to_main (LoopManageEvent & lme);
@@ -177,11 +351,44 @@ class Engine
 
 	void fill_common_outs(nframes_t nframes);
 	void prepare_buffers(nframes_t nframes);
+	void update_common_input_history(nframes_t nframes);
+	void update_sync_pulse_age(nframes_t nframes);
 
 	void connections_changed();
 
 	void handle_load_session_event();
 
+	XMLTree * build_session_tree (const std::string & fname, bool write_audio, SessionAudioList & audiofiles);
+
+	void queue_loop_file_job (Looper * looper, LoopFileEvent::Type type, const std::string & fname,
+				  const std::string & ret_url, const std::string & ret_path);
+	void worker_job_finished();
+
+	// removed loops are collected here and destroyed in one batch by a worker
+	void reap_dead_loops();
+	void wait_for_reaped_ports();
+	std::vector<Looper*> _dead_loops;
+	// removed, with their ports gone, but a shared worker job still uses them
+	std::vector<Looper*> _draining_loops;
+	// sent to the rt thread for removal, not handed back yet
+	std::vector<Looper*> _removing;
+
+	void publish_control_snapshot();
+	void invalidate_snapshot_from (int index);
+	void mark_snapshot_dirty(int instance);
+	ControlSnapshot _snapshot;
+
+	// main thread view of which loops were idle, so only the busy ones are
+	// looked at every pass.  reset whenever the loop count changes
+	struct LoopActivity {
+		LoopActivity() : tick_idle(false), snap_idle(false), snap_dirty(true) {}
+		bool tick_idle;
+		bool snap_idle;
+		bool snap_dirty;
+	};
+	std::vector<LoopActivity> _loop_activity;
+	size_t _snapshot_sweep;
+
 	
 	AudioDriver * _driver;
 	
@@ -213,9 +420,18 @@ class Engine
 	RingBuffer<Event> * _event_queue;
 	RingBuffer<Event> * _midi_event_queue;
 	RingBuffer<Event> * _sync_queue;
+	RingBuffer<Event> * _timed_event_queue;
 	RingBuffer<Event> * _nonrt_update_event_queue;
 
+	// timed events taken off their queue, in timestamp order until they are due.  rt only
+	Event *  _timed_pending;
+	size_t   _timed_pending_count;
+
 	EventGenerator * _event_generator;
+	BrotherClock *   _brother_clock;
+	Worker *         _worker;
+	// one thread of its own, new loops wait on it for the port names of removed ones
+	Worker *         _reaper;
 
 	// non-rt event stuff
 
@@ -225,6 +441,7 @@ class Engine
 	pthread_cond_t  _event_cond;
 
 	int _def_channel_cnt;
+	bool _quiet;
 	float _def_loop_secs;
 	nframes_t _buffersize;
 	
@@ -243,14 +460,29 @@ class Engine
 	int _sync_source;
 
 	volatile double    _tempo;        // bpm
+	double             _sync_beats;   // running beat position published to brother sync followers
 	volatile MIDI::timestamp_t _beatstamp; // timestamp at the beat of the last tempo change
 	volatile MIDI::timestamp_t _prev_beatstamp; 
 	bool _force_next_clock_start;
 	volatile bool _send_midi_start_after_next_hit;
 	bool _send_midi_start_on_trigger;
 
+	// timetag scheduling, the stats are only written by the rt thread
+	double _timetag_offset;
+	unsigned long _timetag_late_count;
+	float  _timetag_frame_offset;
+
+	// main thread, what the contention counters were when last logged
+	struct timeval _contention_checked;
+	unsigned long _contention_logged[Contention::CounterCount];
+
 	float    _eighth_cycle; // eighth notes per loop cycle
 
+	// what the loops should have in their tempo input, see set_tempo
+	volatile float        _loop_tempo;
+	volatile unsigned int _loop_tempo_version;
+	nframes_t             _sync_pulse_age;
+
 	std::vector<port_id_t>  _common_inputs;
 	std::vector<port_id_t>  _common_outputs;
 
@@ -259,6 +491,13 @@ class Engine
 	std::vector<sample_t *>    _temp_input_buffers;              
 	std::vector<sample_t *>    _temp_output_buffers;              
 	bool                    _use_temp_input;
+
+	// ring of COMMON_INPUT_HISTORY frames per common input, the current
+	// period starts at _common_in_history_pos
+	std::vector<sample_t *>    _common_in_history;
+	nframes_t                  _common_in_history_pos;
+	nframes_t                  _last_history_frames;
+	std::vector<float>         _common_in_peaks;
 	
 	float              _curr_common_dry;
 	float              _target_common_dry;
@@ -277,6 +516,26 @@ class Engine
 	int                _selected_loop;
 	bool               _jack_timebase_master;
 
+	// group names are indexed by group number, an empty name is an unused slot
+	std::vector<std::string> _group_names;
+	PBD::NonBlockingLock _group_lock;
+	// only changed by the rt thread
+	float              _group_gains[MAX_LOOP_GROUPS];
+
+	// a free slot is one that isn't active.  the main loop keeps the first
+	// copy, the rt thread its own one, changes go through the queue
+	Modulator          _modulators[MAX_MODULATORS];
+	Modulator          _rt_modulators[MAX_MODULATORS];
+	RingBuffer<ModulatorChange> * _modulator_queue;
+
+	// a rendered bounce waiting for its swap, the queue hands them to the rt thread
+	RingBuffer<BounceSwap> * _bounce_queue;
+	BounceSwap         _rt_bounce;
+	bool               _rt_bounce_pending;
+	nframes_t          _rt_bounce_waited;   // frames since it became pending
+	nframes_t          _rt_bounce_stalled;  // of those, with the reference not running
+	bool               _bounce_running;
+
 	bool               _output_midi_clock;
 	bool               _smart_eighths;
 	bool               _force_discrete;
@@ -299,6 +558,8 @@ class Engine
 	volatile bool _tempo_changed;
 	volatile bool _beat_occurred;
 	volatile bool _conns_changed;
+	volatile bool _latency_dirty;     // main thread should requery latencies
+	volatile bool _latency_published; // rt thread should apply them
 	volatile bool _sel_loop_changed;
 	volatile bool _timebase_changed;
 
@@ -107,11 +107,14 @@ namespace SooperLooper {
         pEventGenerator = pGenerator;
         TimeStamp       = Time;
         iFragmentPos    = -1;
+        Group           = -1;
     }
 
     Event::Event(EventGenerator* pGenerator, int fragmentpos) {
         pEventGenerator = pGenerator;
+        TimeStamp       = 0;
         iFragmentPos    = fragmentpos;
+        Group           = -1;
     }
 	
 } // namespace LinuxSampler
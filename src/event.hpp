@@ -45,9 +45,27 @@ namespace SooperLooper {
 	protected:
 
 		inline uint32_t toFragmentPos(time_stamp_t timeStamp) {
+			// late events land at the start of the fragment
+			if (timeStamp <= fragmentTime.begin) return 0;
 			return uint32_t ((timeStamp - fragmentTime.begin) * fragmentTime.sample_ratio);
 		}
 
+	public:
+		/// True if the time stamp belongs to a later audio fragment than the current one.
+		inline bool isFuture(time_stamp_t timeStamp) const {
+			return timeStamp >= fragmentTime.end;
+		}
+
+		/// Real time stamp taken at the start of processing the current fragment.
+		inline time_stamp_t fragmentEndTime() const {
+			return fragmentTime.end;
+		}
+
+		/// Signed offset in sample points of a time stamp from the start of the current fragment.
+		inline double fragmentOffset(time_stamp_t timeStamp) const {
+			return (timeStamp - fragmentTime.begin) * fragmentTime.sample_ratio;
+		}
+
 		friend class Event;
         private:
 		uint32_t uiSampleRate;
@@ -73,7 +91,7 @@ namespace SooperLooper {
     class Event {
         public:
 	    
-            Event() : Type(type_cmd_down),Command(UNKNOWN),Control(Unknown),Instance(0), Value(0) {}
+            Event() : Type(type_cmd_down),Command(UNKNOWN),Control(Unknown),Instance(0), Group(-1), Value(0), source(0) {}
 
             enum type_t {
 		    type_cmd_down,
@@ -219,10 +237,20 @@ namespace SooperLooper {
 		    PanChannel4,
 		    // Put all new controls at the end to avoid screwing up the order of existing AU sessions (who store these numbers)
 		    ReplaceQuantized,
-		    SendMidiStartOnTrigger
+		    SendMidiStartOnTrigger,
+		    LoopGroup,
+		    GroupGain,
+		    TimetagOffset,
+		    TimetagLateCount,
+		    TimetagFrameOffset,
+		    PlayheadModel,
+		    AutomationMode,
+		    LAST_CONTROL
 	    } Control;
 	    
-	    int8_t  Instance;
+	    int     Instance;
+
+	    int8_t  Group;  // only used when Instance == -4 (all loops in a group)
 	    
 	    float Value;
 
@@ -234,6 +262,7 @@ namespace SooperLooper {
 	    typedef EventGenerator::time_stamp_t timestamp_t;
 	    EventGenerator::time_stamp_t getTimestamp() const { return TimeStamp; }
 
+	    // osc port of the client it came from, -1 for values the engine makes itself
 	    int source;
 
     protected:
@@ -23,6 +23,7 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #include "event.hpp"
 
@@ -114,19 +115,138 @@ namespace SooperLooper {
 		std::string      ret_path;
 	};
 	
+	class LoopAudioEvent : public EventNonRT
+	{
+	public:
+		enum Type {
+			Get,
+			Put
+		} type;
+
+		enum SampleFormat
+		{
+			FormatFloat = 0,
+			FormatHalf
+		};
+		
+		LoopAudioEvent(Type tp, int inst, SampleFormat fmt, std::string returl, std::string retpath)
+			: type(tp), instance(inst), format(fmt), upload_id(0), channels(0), total_frames(0), offset(0),
+			  ret_url(returl), ret_path(retpath) {}
+
+		virtual ~LoopAudioEvent() {}
+
+		int              instance;
+		SampleFormat     format;
+
+		// only used for Put, data is interleaved and already converted to float
+		int              upload_id;
+		unsigned int     channels;
+		uint32_t         total_frames;
+		uint32_t         offset;
+		std::vector<float> data;
+		
+		std::string      ret_url;
+		std::string      ret_path;
+	};
+	
+	class LoopGroupEvent : public EventNonRT
+	{
+	public:
+		enum Type {
+			Add,
+			Remove,
+			GetAll
+		} type;
+
+		LoopGroupEvent(Type tp, std::string nm, std::string returl="", std::string retpath="")
+			: type(tp), name(nm), ret_url(returl), ret_path(retpath) {}
+
+		virtual ~LoopGroupEvent() {}
+
+		std::string      name;
+		std::string      ret_url;
+		std::string      ret_path;
+	};
+	
+	class ModulatorEvent : public EventNonRT
+	{
+	public:
+		enum Type {
+			Set,
+			Remove,
+			Trigger,
+			GetAll
+		} type;
+
+		ModulatorEvent(Type tp, int inst, Event::control_t ctrl, std::string returl="", std::string retpath="")
+			: type(tp), instance(inst), control(ctrl), beats(0.0f), depth(0.0f), center(0.0f), param(0.0f),
+			  ret_url(returl), ret_path(retpath) {}
+
+		virtual ~ModulatorEvent() {}
+
+		int              instance;
+		Event::control_t control;
+
+		// only used for Set
+		std::string      shape;
+		float            beats;
+		float            depth;
+		float            center;
+		float            param;
+
+		std::string      ret_url;
+		std::string      ret_path;
+	};
+
+	class BounceEvent : public EventNonRT
+	{
+	public:
+		BounceEvent(std::string lps, int targ, bool clr, std::string returl="", std::string retpath="")
+			: loops(lps), target(targ), clear_sources(clr), ret_url(returl), ret_path(retpath) {}
+
+		virtual ~BounceEvent() {}
+
+		// comma separated loop numbers, or a loop group name
+		std::string      loops;
+		// -1 for a new loop
+		int              target;
+		bool             clear_sources;
+		std::string      ret_url;
+		std::string      ret_path;
+	};
+
+	class BrotherSyncEvent : public EventNonRT
+	{
+	public:
+		enum Type {
+			Follow,
+			Register,
+			Unregister
+		} type;
+
+		BrotherSyncEvent(Type tp, std::string addr)
+			: type(tp), url(addr) {}
+
+		virtual ~BrotherSyncEvent() {}
+
+		std::string      url;
+	};
+	
 	class GetParamEvent : public EventNonRT
 	{
 	public:
-		GetParamEvent( int8_t inst, Event::control_t ctrl, std::string returl, std::string retpath)
-			: control(ctrl), instance(inst), ret_url(returl), ret_path(retpath), ret_value(0.0f) {}
+		GetParamEvent( int inst, Event::control_t ctrl, std::string returl, std::string retpath, unsigned int replyid=0)
+			: control(ctrl), instance(inst), ret_url(returl), ret_path(retpath), ret_value(0.0f), reply_id(replyid) {}
 		virtual ~GetParamEvent() {}
 		
 		Event::control_t       control;
-		int8_t           instance;
+		int              instance;
 		std::string      ret_url;
 		std::string      ret_path;
 
 		float            ret_value;
+		// nonzero when the osc thread holds a place for the reply
+		unsigned int     reply_id;
 	};
 
 	class ConfigUpdateEvent : public EventNonRT
@@ -145,22 +265,29 @@ namespace SooperLooper {
 			SendCmd,
 		} type;
 
-		ConfigUpdateEvent(Type tp, int8_t inst,  Event::control_t ctrl, std::string returl="", std::string retpath="",float val=0.0, int src=-1, short int ms=0)
-			: type(tp), control(ctrl), instance(inst), ret_url(returl), ret_path(retpath), value(val), source(src),update_time_ms(ms) {}
-		ConfigUpdateEvent(Type tp, int8_t inst,  Event::command_t cmd, std::string returl="", std::string retpath="", int src=-1)
-			: type(tp), command(cmd), instance(inst), ret_url(returl), ret_path(retpath), value(0.0f), source(src) {}
+		ConfigUpdateEvent(Type tp, int inst,  Event::control_t ctrl, std::string returl="", std::string retpath="",float val=0.0, int src=-1, short int ms=0)
+			: type(tp), control(ctrl), instance(inst), ret_url(returl), ret_path(retpath), value(val), source(src),update_time_ms(ms), range_first(0), range_last(-1) {}
+		ConfigUpdateEvent(Type tp, int inst,  Event::command_t cmd, std::string returl="", std::string retpath="", int src=-1)
+			: type(tp), command(cmd), instance(inst), ret_url(returl), ret_path(retpath), value(0.0f), source(src), range_first(0), range_last(-1) {}
 
 		virtual ~ConfigUpdateEvent() {}
 
 		
 		Event::control_t       control;
 		Event::command_t       command;
-		int8_t                 instance;
+		int                    instance;
 		std::string            ret_url;
 		std::string            ret_path;
 		float                  value;
 		int                    source;
 		short int              update_time_ms;
+
+		// un/register with a list of controls, control is unused then
+		std::vector<Event::control_t> controls;
+		// instance -1 un/registers a rule for these loops, now and later.
+		// range_last -1 is open ended
+		int                    range_first;
+		int                    range_last;
 	};
 
 	class PingEvent : public EventNonRT
@@ -182,7 +309,9 @@ namespace SooperLooper {
 		enum Type
 		{
 			Register,
-			Unregister
+			Unregister,
+			RegisterDelta,
+			UnregisterDelta
 		} type;
 
 		RegisterConfigEvent(Type tp, std::string returl, std::string retpath)
@@ -20,13 +20,17 @@
 #include <cstdio>
 #include <iostream>
 #include <cerrno>
+#include <cstring>
+#include <algorithm>
 #include "loop_control.hpp"
 
 #include <wx/filename.h>
 
 #include <sys/poll.h>
+#include <sys/time.h>
 #include <unistd.h>
 #include <time.h>
+#include <cmath>
 #include <fcntl.h>
 
 #include <midi_bind.hpp>
@@ -163,6 +167,24 @@ int LoopControl::SpawnConfig::set_state (const XMLNode& node)
 }
 
 
+// what each loop and the engine as a whole are registered for, as control
+// lists so each is one message
+static const char * loop_auto_update_controls =
+	"state,next_state,loop_len,cycle_len,free_time,total_time,waiting,rate_output,"
+	"in_peak_meter,out_peak_meter,is_soloed,stretch_ratio,pitch_shift";
+
+static const char * loop_input_controls =
+	"rec_thresh,feedback,use_feedback_play,dry,wet,input_gain,rate,scratch_pos,delay_trigger,"
+	"quantize,fade_samples,round,sync,playback_sync,redo_is_tap,use_rate,use_common_ins,"
+	"use_common_outs,relative_sync,input_latency,output_latency,trigger_latency,autoset_latency,"
+	"mute_quantized,overdub_quantized,replace_quantized,round_integer_tempo,tempo_stretch,"
+	"pan_1,pan_2,pan_3,pan_4";
+
+static const char * global_update_controls =
+	"tempo,sync_source,eighth_per_cycle,tap_tempo,wet,dry,input_gain,auto_disable_latency,"
+	"output_midi_clock,use_midi_stop,use_midi_start,send_midi_start_on_trigger,smart_eighths,"
+	"selected_loop_num";
+
 LoopControl::LoopControl (const wxString & rcdir)
 	: _spawn_config(wxT("current")), _default_spawn_config(wxT("default"))
 {
@@ -174,6 +196,11 @@ LoopControl::LoopControl (const wxString & rcdir)
 	_lastchance = false;
 	_we_spawned = false;
 	_engine_id = 0;
+	_config_version = 0;
+	_loop_count = 0;
+	_loop_rules = false;
+	_clock_offset = 0.0;
+	_have_clock_offset = false;
 
 	setup_param_map();
 	
@@ -192,10 +219,16 @@ LoopControl::LoopControl (const wxString & rcdir)
 	/* add handler for control param callbacks, first is loop index , 2nd arg ctrl string, 3nd arg value */
 	lo_server_add_method(_osc_server, "/ctrl", "isf", LoopControl::_control_handler, this);
 
+	// playhead model: i:loop# s:"playhead" f:pos f:rate f:loop_len d:engine_time
+	lo_server_add_method(_osc_server, "/ctrl", "isfffd", LoopControl::_playhead_handler, this);
+
 	// pingack expects: s:engine_url s:version i:loopcount
 	lo_server_add_method(_osc_server, "/pingack", "ssi", LoopControl::_pingack_handler, this);
 	lo_server_add_method(_osc_server, "/pingack", "ssii", LoopControl::_pingack_handler, this);
 
+	// loop add/remove deltas:  s:engine_url i:id i:version i:loopcount i:nremoved i:removed... i:added...
+	lo_server_add_method(_osc_server, "/config_delta", NULL, LoopControl::_config_delta_handler, this);
+
 	lo_server_add_method(_osc_server, "/alive_resp", "ssi", LoopControl::_alive_handler, this);
 	lo_server_add_method(_osc_server, "/alive_resp", "ssii", LoopControl::_alive_handler, this);
 
@@ -324,6 +357,10 @@ LoopControl::connect()
 	}
 
 	_pingack = false;
+	_config_version = 0;
+	_loop_rules = false;
+	_have_clock_offset = false;
+	_playheads.clear();
 
 	_registeredauto_loop_map.clear();
 	_registeredin_loop_map.clear();
@@ -363,37 +400,45 @@ LoopControl::register_global_updates(bool unreg)
 	}
 
 	// results will come back with instance = -2
-	lo_send(_osc_addr, buf, "sss", "tempo", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "sync_source", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "eighth_per_cycle", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "tap_tempo", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "wet", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "dry", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "input_gain", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "auto_disable_latency", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "output_midi_clock", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "use_midi_stop", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "use_midi_start", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "send_midi_start_on_trigger", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "smart_eighths", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "selected_loop_num", _our_url.c_str(), "/ctrl");
+	lo_send(_osc_addr, buf, "sss", global_update_controls, _our_url.c_str(), "/ctrl");
 	
 	if (unreg) {
-		lo_send(_osc_addr, "/unregister_auto_update", "siss", "in_peak_meter", 100, _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, "/unregister_auto_update", "siss", "out_peak_meter", 100, _our_url.c_str(), "/ctrl");
+		lo_send(_osc_addr, "/unregister_auto_update", "sss", "in_peak_meter,out_peak_meter", _our_url.c_str(), "/ctrl");
 	}
 	else {
-		lo_send(_osc_addr, "/register_auto_update", "siss", "in_peak_meter", 100, _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, "/register_auto_update", "siss", "out_peak_meter", 100, _our_url.c_str(), "/ctrl");
+		lo_send(_osc_addr, "/register_auto_update", "siss", "in_peak_meter,out_peak_meter", 100, _our_url.c_str(), "/ctrl");
 	}
 }
 
+void
+LoopControl::register_loop_rules(bool unreg)
+{
+	if (!_osc_addr) return;
+
+	// one registration for all loops, the engine applies it to every
+	// loop there is and every loop added later
+	if (unreg) {
+		lo_send(_osc_addr, "/sl/-1/unregister_auto_update", "sss", loop_auto_update_controls, _our_url.c_str(), "/ctrl");
+		lo_send(_osc_addr, "/sl/-1/unregister_auto_update", "sss", "playhead", _our_url.c_str(), "/ctrl");
+		lo_send(_osc_addr, "/sl/-1/unregister_update", "sss", loop_input_controls, _our_url.c_str(), "/ctrl");
+	}
+	else {
+		lo_send(_osc_addr, "/sl/-1/register_auto_update", "siss", loop_auto_update_controls, 100, _our_url.c_str(), "/ctrl");
+		// checked often, but only sent when our extrapolation would go wrong
+		lo_send(_osc_addr, "/sl/-1/register_auto_update", "siss", "playhead", 10, _our_url.c_str(), "/ctrl");
+		lo_send(_osc_addr, "/sl/-1/register_update", "sss", loop_input_controls, _our_url.c_str(), "/ctrl");
+	}
+
+	_loop_rules = !unreg;
+}
+
 bool
 LoopControl::disconnect (bool killit)
 {
 
 	if (_osc_addr) {
 		register_global_updates(true); // unregister
+		lo_send(_osc_addr, "/unregister_config_delta", "ss", _our_url.c_str(), "/config_delta");
 		
 		if (killit) {
 			send_quit();
@@ -723,28 +768,97 @@ LoopControl::pingack_handler(const char *path, const char *types, lo_arg **argv,
 	if (_engine_id != 0 && _engine_id != uid && uid != 0) {
 		cerr << "new engine ID pingacked us!, re-registering" << endl;
 		_pingack = false;
+		_config_version = 0;
 	}
         if (uid != 0) {
                 _engine_id = uid;
         }
 
-	if (!_pingack) {
-		// register future configs with it once
-		lo_send(_osc_addr, "/register", "ss", _our_url.c_str(), "/pingack");
+	_loop_count = loopcount;
 
+	if (!_pingack) {
 		register_global_updates();		
+		register_loop_rules();
 
 		request_all_midi_bindings();
 
 		_pingack = true;
 	}
 
-	
+	if (_config_version == 0) {
+		// future loop adds and removes come as deltas, it answers with where it is at
+		lo_send(_osc_addr, "/register_config_delta", "ss", _our_url.c_str(), "/config_delta");
+	}
+
 	LooperConnected (loopcount); // emit
 
 	return 0;
 }
 
+int
+LoopControl::_config_delta_handler(const char *path, const char *types, lo_arg **argv, int argc,
+			      void *data, void *user_data)
+{
+	LoopControl * lc = static_cast<LoopControl*> (user_data);
+	return lc->config_delta_handler (path, types, argv, argc, data);
+}
+
+int
+LoopControl::config_delta_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
+{
+	// s:hosturl i:id i:version i:loopcount i:nremoved  i:removed...  i:added...
+	// removed are indices before the change, added ones after it
+	if (argc < 5 || strncmp (types, "siiii", 5) != 0 || strspn (types + 5, "i") != strlen (types + 5)) {
+		return 0;
+	}
+
+	int uid = argv[1]->i;
+	unsigned int version = (unsigned int) argv[2]->i;
+	int loopcount = argv[3]->i;
+	int first = loopcount;
+
+	if (!_osc_addr || (uid != _engine_id && uid != 0)) {
+		// a pingack from the new engine redoes everything
+		return 0;
+	}
+
+	if (_config_version == 0) {
+		// answer to our registration, only a count we did not know about is a change
+		first = min (loopcount, _loop_count);
+	}
+	else if (version == _config_version) {
+		return 0;
+	}
+	else if (version != _config_version + 1) {
+		// missed one, go the long way
+		cerr << "slgui: missed a loop config change, resyncing" << endl;
+		_config_version = 0;
+		lo_send(_osc_addr, "/ping", "ssi", _our_url.c_str(), "/pingack", 1);
+		return 0;
+	}
+
+	_config_version = version;
+
+	// every loop from the first removed or added one on is new or moved down
+	for (int n=5; n < argc; ++n) {
+		first = min (first, argv[n]->i);
+	}
+
+	if (first >= loopcount && loopcount == _loop_count) {
+		return 0;
+	}
+
+	_loop_count = loopcount;
+
+	// the engine drops the registrations of removed loops
+	_registeredin_loop_map.erase (_registeredin_loop_map.lower_bound (first), _registeredin_loop_map.end());
+	_registeredauto_loop_map.erase (_registeredauto_loop_map.lower_bound (first), _registeredauto_loop_map.end());
+
+	LoopsChanged (loopcount, first); // emit
+
+	return 0;
+}
+
 int
 LoopControl::_alive_handler(const char *path, const char *types, lo_arg **argv, int argc,
 			      void *data, void *user_data)
@@ -798,6 +912,101 @@ LoopControl::_control_handler(const char *path, const char *types, lo_arg **argv
 	return lc->control_handler (path, types, argv, argc, data);
 }
 
+int
+LoopControl::_playhead_handler(const char *path, const char *types, lo_arg **argv, int argc,
+			      void *data, void *user_data)
+{
+	LoopControl * lc = static_cast<LoopControl*> (user_data);
+	return lc->playhead_handler (path, types, argv, argc, data);
+}
+
+static double
+local_time ()
+{
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+int
+LoopControl::playhead_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
+{
+	// i:loop# s:"playhead" f:pos f:rate f:loop_len d:engine_time
+
+	int index = argv[0]->i;
+
+	if (index < 0) {
+		return 0;
+	}
+	if (index >= (int) _playheads.size()) {
+		_playheads.resize (index + 1);
+	}
+
+	PlayheadModel & model = _playheads[index];
+	model.pos = argv[2]->f;
+	model.rate = argv[3]->f;
+	model.len = argv[4]->f;
+	model.time = argv[5]->d;
+	model.valid = true;
+
+	// the engine clock against ours.  the message that got here quickest
+	// is the best guess, that also takes out the network latency
+	double offset = local_time() - model.time;
+	if (!_have_clock_offset || offset < _clock_offset) {
+		_clock_offset = offset;
+		_have_clock_offset = true;
+	}
+
+	set_playhead_pos (index, model.pos);
+
+	return 0;
+}
+
+bool
+LoopControl::update_playheads()
+{
+	// moves every running playhead along to now, true if any moved
+	bool changed = false;
+	double now = local_time() - _clock_offset;
+
+	for (int n=0; n < (int) _playheads.size(); ++n)
+	{
+		PlayheadModel & model = _playheads[n];
+
+		if (!model.valid || model.rate == 0.0f) {
+			continue;
+		}
+
+		double pos = model.pos + model.rate * (now - model.time);
+		if (model.len > 0.0f) {
+			pos = fmod (pos, (double) model.len);
+			if (pos < 0.0) pos += model.len;
+		}
+
+		changed |= set_playhead_pos (n, (float) pos);
+	}
+
+	return changed;
+}
+
+bool
+LoopControl::set_playhead_pos (int index, float pos)
+{
+	if (index >= (int) _params_val_map.size()) {
+		_params_val_map.resize(index + 1);
+		_updated.resize(index + 1);
+	}
+
+	ControlValMap::iterator iter = _params_val_map[index].find (wxT("loop_pos"));
+	if (iter != _params_val_map[index].end() && (*iter).second == pos) {
+		return false;
+	}
+
+	_params_val_map[index][wxT("loop_pos")] = pos;
+	_updated[index][wxT("loop_pos")] = true;
+	return true;
+}
+
 
 int
 LoopControl::control_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data)
@@ -1093,12 +1302,23 @@ LoopControl::save_midi_bindings(const wxString & filename)
 
 
 int
-LoopControl::register_all_in_new_thread(int number_of_loops)
+LoopControl::register_all_in_new_thread(int number_of_loops, int first_loop)
 {
 
 	pthread_t register_thread;
 	get_spawn_config().num_loops = number_of_loops; //XXX why don't we have the right num_loops already?
-	return pthread_create (&register_thread, NULL, &LoopControl::_register_all, this);
+
+	// the thread gets its own copy of the range, nothing it reads is ours to change
+	RegisterRange * range = new RegisterRange;
+	range->lc = this;
+	range->first = first_loop;
+	range->count = number_of_loops;
+
+	int ret = pthread_create (&register_thread, NULL, &LoopControl::_register_all, range);
+	if (ret != 0) {
+		delete range;
+	}
+	return ret;
 
 }
 
@@ -1107,13 +1327,15 @@ LoopControl::_register_all (void *arg)
 {
 	//send all registrations pausing inbetween toavoid losing osc messages
 
-	LoopControl * lc = static_cast<LoopControl *>(arg);
+	RegisterRange * range = static_cast<RegisterRange *>(arg);
+	LoopControl * lc = range->lc;
+	int first = range->first;
+	int num_of_loops = range->count;
+	delete range;
 
 	lc->request_global_values ();
 
-	int num_of_loops = lc->get_spawn_config().num_loops;
-
-	for (int i = 0; i < num_of_loops; i++) {
+	for (int i = first; i < num_of_loops; i++) {
 			lc->register_auto_updates(i);
 			lc->register_input_controls(i);
 			lc->request_all_values (i);
@@ -1130,54 +1352,28 @@ void
 LoopControl::register_auto_updates(int index, bool unreg)
 {
 	if (!_osc_addr) return;
-	char buf[30];
-
+	char buf[50];
 
 	if (unreg) {
 		snprintf(buf, sizeof(buf), "/sl/%d/unregister_auto_update", index);
-		lo_send(_osc_addr, buf, "sss", "state", _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "sss", "next_state", _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "sss", "loop_pos", _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "sss", "loop_len", _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "sss", "cycle_len", _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "sss", "free_time", _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "sss", "total_time", _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "sss", "waiting", _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "sss", "rate_output", _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "sss", "in_peak_meter", _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "sss", "out_peak_meter", _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "sss", "is_soloed", _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "sss", "stretch_ratio", _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "sss", "pitch_shift", _our_url.c_str(), "/ctrl");
+		lo_send(_osc_addr, buf, "sss", loop_auto_update_controls, _our_url.c_str(), "/ctrl");
+		lo_send(_osc_addr, buf, "sss", "playhead", _our_url.c_str(), "/ctrl");
+		_registeredauto_loop_map.erase(index);
 	} else {
                 if (_registeredauto_loop_map.find(index) != _registeredauto_loop_map.end()) {
                         // already registered
                         return;
                 }
-                
 
-		snprintf(buf, sizeof(buf), "/sl/%d/register_auto_update", index);
-		// send request for auto updates
-		lo_send(_osc_addr, buf, "siss", "state",     100, _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "siss", "next_state",     100, _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "siss", "loop_pos",  100, _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "siss", "loop_len",  100, _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "siss", "cycle_len", 100, _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "siss", "free_time", 100, _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "siss", "total_time",100,  _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "siss", "waiting",   100, _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "siss", "rate_output",100, _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "siss", "in_peak_meter", 100, _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "siss", "out_peak_meter", 100, _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "siss",  "is_soloed", 100, _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "siss", "stretch_ratio", 100, _our_url.c_str(), "/ctrl");
-		lo_send(_osc_addr, buf, "siss", "pitch_shift", 100, _our_url.c_str(), "/ctrl");
+		// the all loops rule already covers it
+		if (!_loop_rules) {
+			snprintf(buf, sizeof(buf), "/sl/%d/register_auto_update", index);
+			lo_send(_osc_addr, buf, "siss", loop_auto_update_controls, 100, _our_url.c_str(), "/ctrl");
+			lo_send(_osc_addr, buf, "siss", "playhead", 10, _our_url.c_str(), "/ctrl");
+		}
 
                 _registeredauto_loop_map[index] = true;
 	}
-
-	
-
 }
 
 void
@@ -1186,7 +1382,7 @@ LoopControl::register_input_controls(int index, bool unreg)
 	if (!_osc_addr) return;
 	char buf[50];
 
-        if (_registeredin_loop_map.find(index) != _registeredin_loop_map.end()) {
+        if (!unreg && _registeredin_loop_map.find(index) != _registeredin_loop_map.end()) {
                 // already registered
                 return;
         }
@@ -1203,48 +1399,16 @@ LoopControl::register_input_controls(int index, bool unreg)
 	
 	if (unreg) {
 		snprintf(buf, sizeof(buf), "/sl/%d/unregister_update", index);
+		lo_send(_osc_addr, buf, "sss", loop_input_controls, _our_url.c_str(), "/ctrl");
+		_registeredin_loop_map.erase(index);
+		return;
+	}
 
-	} else {
+	// the all loops rule already covers it
+	if (!_loop_rules) {
 		snprintf(buf, sizeof(buf), "/sl/%d/register_update", index);
+		lo_send(_osc_addr, buf, "sss", loop_input_controls, _our_url.c_str(), "/ctrl");
 	}
-	
-	// send request for updates
-	lo_send(_osc_addr, buf, "sss", "rec_thresh", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "feedback", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "use_feedback_play", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "dry", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "wet", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "input_gain", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "rate", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "scratch_pos", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "delay_trigger", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "quantize", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "fade_samples", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "round", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "sync", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "playback_sync", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "redo_is_tap", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "use_rate", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "use_common_ins", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "use_common_outs", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "relative_sync", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "input_latency", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "output_latency", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "trigger_latency", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "autoset_latency", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "mute_quantized", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "overdub_quantized", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "replace_quantized", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "round_integer_tempo", _our_url.c_str(), "/ctrl");
-	//lo_send(_osc_addr, buf, "sss", "pitch_shift", _our_url.c_str(), "/ctrl");
-	//lo_send(_osc_addr, buf, "sss", "stretch_ratio", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "tempo_stretch", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "pan_1", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "pan_2", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "pan_3", _our_url.c_str(), "/ctrl");
-	lo_send(_osc_addr, buf, "sss", "pan_4", _our_url.c_str(), "/ctrl");
-
-        // cerr << "SENT REGISTERS FOR ALL index: " << index << endl;
 
         _registeredin_loop_map[index] = true;
 }
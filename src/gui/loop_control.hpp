@@ -127,11 +127,23 @@ class LoopControl
 	const SooperLooper::MidiBindings & midi_bindings() { return *_midi_bindings; }
 	
 	void update_values();
+	// extrapolates loop_pos from the engine's playhead models,
+	// true if any of them moved
+	bool update_playheads();
 
-	int register_all_in_new_thread(int num_of_loops);
+	// registers and requests everything for loops first_loop..num_of_loops-1
+	int register_all_in_new_thread(int num_of_loops, int first_loop=0);
 	static void* _register_all(void* arg);
+	// handed to the register thread, it owns it
+	struct RegisterRange {
+		LoopControl * lc;
+		int           first;
+		int           count;
+	};
 
 	void register_global_updates(bool unreg=false);
+	// every loop, present and future, in one go
+	void register_loop_rules(bool unreg=false);
 	void register_auto_updates(int index, bool unreg=false);
 	void register_input_controls(int index, bool unreg=false);
 	void register_control (int index, wxString ctrl, bool unreg=false);
@@ -151,6 +163,8 @@ class LoopControl
 	void pingtimer_expired();
 
 	sigc::signal1<void,int> LooperConnected;
+	// loops were added or removed: new loop count, first index that changed
+	sigc::signal2<void,int,int> LoopsChanged;
 	sigc::signal1<void, const std::string&> ConnectFailed;
 	sigc::signal1<void, const std::string&> LostConnection;
 	sigc::signal1<void, const std::string&> ErrorReceived;
@@ -169,11 +183,21 @@ class LoopControl
 
 	int control_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
 
+	static int _playhead_handler(const char *path, const char *types, lo_arg **argv, int argc,
+				    void *data, void *user_data);
+	int playhead_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
+	bool set_playhead_pos (int index, float pos);
+
 	static int _pingack_handler(const char *path, const char *types, lo_arg **argv, int argc,
 				    void *data, void *user_data);
 
 	int pingack_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
 
+	static int _config_delta_handler(const char *path, const char *types, lo_arg **argv, int argc,
+				    void *data, void *user_data);
+
+	int config_delta_handler(const char *path, const char *types, lo_arg **argv, int argc, void *data);
+
 	static int _midi_binding_handler(const char *path, const char *types, lo_arg **argv, int argc,
 				    void *data, void *user_data);
 
@@ -236,6 +260,27 @@ class LoopControl
 	long _engine_pid;
 
 	int  _engine_id;
+	// last loop config version from the engine, 0 until it told us
+	unsigned int _config_version;
+	int  _loop_count;
+	// registered through the all loops rule, no per loop registrations then
+	volatile bool _loop_rules;
+
+	// the engine only sends a playhead when it changes course, in between
+	// loop_pos is worked out here.  times are the engine's clock
+	struct PlayheadModel
+	{
+		PlayheadModel() : time(0.0), pos(0.0f), rate(0.0f), len(0.0f), valid(false) {}
+		double time;
+		float  pos;
+		float  rate;
+		float  len; // 0 is no wrapping
+		bool   valid;
+	};
+	std::vector<PlayheadModel> _playheads;
+	// our clock minus the engine's
+	double _clock_offset;
+	bool   _have_clock_offset;
 
 	bool init_traffic_thread();
 	void terminate_traffic_thread();
@@ -92,7 +92,8 @@ enum {
 	ID_MuteQuantCheck,
 	ID_OdubQuantCheck,
 	ID_SmartEighthCheck,
-	ID_ReplQuantCheck
+	ID_ReplQuantCheck,
+	ID_PlayheadTimer
 };
 
 
@@ -103,6 +104,7 @@ BEGIN_EVENT_TABLE(MainPanel, wxPanel)
 	EVT_PAINT(MainPanel::OnPaint)
 	EVT_TIMER(ID_UpdateTimer, MainPanel::OnUpdateTimer)
 	EVT_TIMER(ID_TapTempoTimer, MainPanel::on_taptempo_timer)
+	EVT_TIMER(ID_PlayheadTimer, MainPanel::OnPlayheadTimer)
 
     EVT_ACTIVATE (MainPanel::OnActivate)
 	EVT_ACTIVATE_APP (MainPanel::OnActivate)
@@ -146,6 +148,10 @@ END_EVENT_TABLE()
 
 	_taptempo_button_timer = new wxTimer(this, ID_TapTempoTimer);
 
+	// the engine sends playhead positions only when they change course
+	_playhead_timer = new wxTimer(this, ID_PlayheadTimer);
+	_playhead_timer->Start(40);
+
 	_connect_failed_connection = _loop_control->ConnectFailed.connect (mem_fun (*this,  &MainPanel::on_connect_failed));
 	_lost_connect_connection = _loop_control->LostConnection.connect (mem_fun (*this,  &MainPanel::on_connection_lost));
 	_isalive_connection = _loop_control->IsAlive.connect (mem_fun (*this,  &MainPanel::on_engine_alive));
@@ -158,22 +164,12 @@ MainPanel::~MainPanel()
     //wxLogWarning(wxT("Mainpanel destroy"));
 	save_rc();
 	
-	for (unsigned int i=0; i < _looper_panels.size(); ++i) {
-		// unregister
-		_loop_control->register_auto_updates((int) i, true);
-		_loop_control->register_input_controls((int) i, true);
-
-                // sleep for a little bit so the UDP isn't lost during this barrage
-#if wxCHECK_VERSION(2,5,3)
-                ::wxMilliSleep(50);
-#else
-                ::wxUsleep(50);
-#endif
-
-	}
+	// unregister, the loops all came from the one rule
+	_loop_control->register_loop_rules(true);
 
     _loop_connect_connection.disconnect();
 	_loop_disconnect_connection.disconnect();
+	_loops_changed_connection.disconnect();
 	_loop_update_connection.disconnect();
 
     _connect_failed_connection.disconnect();
@@ -188,6 +184,7 @@ MainPanel::~MainPanel()
 
 	delete _update_timer;
 	delete _taptempo_button_timer;
+	delete _playhead_timer;
 }
 
 void
@@ -380,6 +377,7 @@ MainPanel::init()
 	// todo request how many loopers to construct based on connection
 	_loop_connect_connection = _loop_control->LooperConnected.connect (mem_fun (*this, &MainPanel::init_loopers));
 	_loop_disconnect_connection = _loop_control->Disconnected.connect (bind (mem_fun (*this, &MainPanel::init_loopers), 0));
+	_loops_changed_connection = _loop_control->LoopsChanged.connect (mem_fun (*this, &MainPanel::loops_changed));
 	_loop_update_connection = _loop_control->NewDataReady.connect (mem_fun (*this, &MainPanel::osc_data_ready));
 
 
@@ -433,6 +431,12 @@ MainPanel::init_syncto_choice()
 
 void
 MainPanel::init_loopers (int count)
+{
+	loops_changed (count, 0);
+}
+
+void
+MainPanel::loops_changed (int count, int first_changed)
 {
 	LooperPanel * looperpan;	
 
@@ -482,8 +486,8 @@ MainPanel::init_loopers (int count)
 	//_main_sizer->Fit(_scroller);
 	//_main_sizer->SetSizeHints( _scroller );   // set size hints to honour mininum size
 	
-	// request all values for initial state
-	_loop_control->register_all_in_new_thread(_looper_panels.size());
+	// request all values for initial state, the loops before first_changed have it
+	_loop_control->register_all_in_new_thread(_looper_panels.size(), first_changed);
 
 	init_syncto_choice ();
 
@@ -556,6 +560,18 @@ MainPanel::OnUpdateTimer(wxTimerEvent &ev)
 	_update_timer->Start(_update_timer_time, true);
 }
 
+void
+MainPanel::OnPlayheadTimer(wxTimerEvent &ev)
+{
+	if (!_loop_control->connected() || !_loop_control->update_playheads()) {
+		return;
+	}
+
+	for (unsigned int i=0; i < _looper_panels.size(); ++i) {
+		_looper_panels[i]->update_controls();
+	}
+}
+
 void MainPanel::set_never_timeout(bool flag) 
 { 
 	_never_timeout = flag; 
@@ -574,9 +590,11 @@ MainPanel::do_close(bool quitengine)
 	_loop_update_connection.disconnect();
         _loop_disconnect_connection.disconnect();
         _loop_connect_connection.disconnect();
+        _loops_changed_connection.disconnect();
 
 	_update_timer->Stop();
 	_taptempo_button_timer->Stop();
+	_playhead_timer->Stop();
 
 	// sleep for a short period before stopping engine
 #if wxCHECK_VERSION(2,5,3)
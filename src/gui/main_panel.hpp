@@ -64,6 +64,7 @@ public:
 	
 	void OnIdle(wxIdleEvent& event);
 	void OnUpdateTimer(wxTimerEvent &ev);
+	void OnPlayheadTimer(wxTimerEvent &ev);
 	void OnActivate(wxActivateEvent &ev);
 	
 	void process_key_event (wxKeyEvent &ev);
@@ -91,6 +92,8 @@ public:
     bool get_force_local() const { return _force_local; }
     
 	void init_loopers (int count);
+	// count loops now, the ones from first_changed on are new or moved
+	void loops_changed (int count, int first_changed);
 
 	bool load_rc();
 	bool save_rc();
@@ -159,6 +162,7 @@ protected:
 	sigc::connection  _loop_update_connection;
 	sigc::connection  _loop_connect_connection;
 	sigc::connection  _loop_disconnect_connection;
+	sigc::connection  _loops_changed_connection;
 
     sigc::connection  _connect_failed_connection;
     sigc::connection  _lost_connect_connection;
@@ -170,6 +174,7 @@ protected:
 	
 	wxTimer * _update_timer;
 	wxTimer * _taptempo_button_timer;
+	wxTimer * _playhead_timer;
 
 	wxScrolledWindow * _scroller;
 	wxBoxSizer * _main_sizer;
@@ -585,6 +585,11 @@ void MidiBindPanel::update_entry_area(MidiBindInfo * usethis)
 		}
 	}
 
+	// the list starts with 16 loops, a binding can name any of them
+	while ((int) _loopnum_combo->GetCount() < info->instance + 4) {
+		long i = _loopnum_combo->GetCount() - 2;
+		_loopnum_combo->Append (wxString::Format(wxT("%ld"), i), (void *) i);
+	}
 	_loopnum_combo->SetSelection(info->instance + 3);
 	_chan_spin->SetValue(info->channel + 1);
 
@@ -17,6 +17,10 @@
 **  
 */
 
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include <string>
 #include <iostream>
 
@@ -24,6 +28,7 @@
 
 #include "jack_audio_driver.hpp"
 #include "engine.hpp"
+#include "trace.hpp"
 
 using namespace SooperLooper;
 using namespace PBD;
@@ -174,8 +179,14 @@ JackAudioDriver::connect_to_jack ()
 #endif
 	
 	jack_set_xrun_callback (_jack, _xrun_callback, this);
+	jack_set_thread_init_callback (_jack, _thread_init_callback, this);
 	jack_on_shutdown (_jack, _shutdown_callback, this);
+#ifdef HAVE_JACK_LATENCY_RANGE
+	// also called after graph changes that affect latency
+	jack_set_latency_callback (_jack, _latency_callback, this);
+#else
 	jack_set_graph_order_callback (_jack, _conn_changed_callback, this);
+#endif
 
 	set_timebase_master(_timebase_master);
 	
@@ -185,10 +196,17 @@ JackAudioDriver::connect_to_jack ()
 int
 JackAudioDriver::_xrun_callback (void* arg)
 {
+	SL_TRACE_INSTANT("xrun");
 	cerr << "got xrun" << endl;
 	return 0;
 }
 
+void
+JackAudioDriver::_thread_init_callback (void* arg)
+{
+	SL_TRACE_THREAD("jack process");
+}
+
 void
 JackAudioDriver::_shutdown_callback (void* arg)
 {
@@ -240,6 +258,50 @@ int JackAudioDriver::conn_changed_callback ()
 	ConnectionsChanged(); // emit
 	return 0;
 }
+
+#ifdef HAVE_JACK_LATENCY_RANGE
+void JackAudioDriver::_latency_callback (jack_latency_callback_mode_t mode, void* arg)
+{
+	static_cast<JackAudioDriver*> (arg)->latency_callback (mode);
+}
+
+void JackAudioDriver::latency_callback (jack_latency_callback_mode_t mode)
+{
+	// not the process thread.  a client with a latency callback has to set
+	// its own port latencies, do what jack does by default: every output
+	// depends on every input, with nothing added by us
+	LockMonitor mon(_port_lock, __LINE__, __FILE__);
+
+	std::vector<jack_port_t *> & fromports = (mode == JackCaptureLatency) ? _input_ports : _output_ports;
+	std::vector<jack_port_t *> & toports = (mode == JackCaptureLatency) ? _output_ports : _input_ports;
+	jack_latency_range_t range, portrange;
+	bool first = true;
+
+	range.min = range.max = 0;
+	
+	for (size_t n=0; n < fromports.size(); ++n) {
+		if (!fromports[n]) continue;
+
+		jack_port_get_latency_range (fromports[n], mode, &portrange);
+		if (first) {
+			range = portrange;
+			first = false;
+		}
+		else {
+			range.min = min (range.min, portrange.min);
+			range.max = max (range.max, portrange.max);
+		}
+	}
+
+	for (size_t n=0; n < toports.size(); ++n) {
+		if (toports[n]) {
+			jack_port_set_latency_range (toports[n], mode, &range);
+		}
+	}
+
+	ConnectionsChanged(); // emit
+}
+#endif
 	
 bool
 JackAudioDriver::create_input_port (std::string name, port_id_t & portid)
@@ -256,7 +318,7 @@ JackAudioDriver::create_input_port (std::string name, port_id_t & portid)
 	}
 
 	{
-		//LockMonitor mon(_port_lock, __LINE__, __FILE__);
+		LockMonitor mon(_port_lock, __LINE__, __FILE__);
 		_input_ports.push_back (port);
 		portid = _input_ports.size();
 	}
@@ -278,7 +340,7 @@ JackAudioDriver::create_output_port (std::string name, port_id_t & portid)
 	}
 
 	{
-		//LockMonitor mon(_port_lock, __LINE__, __FILE__);
+		LockMonitor mon(_port_lock, __LINE__, __FILE__);
 		_output_ports.push_back (port);
 		portid = _output_ports.size();
 
@@ -293,11 +355,12 @@ JackAudioDriver::destroy_output_port (port_id_t portid)
 {
 	jack_port_t * port = 0;
 
-	//LockMonitor mon(_port_lock, __LINE__, __FILE__);
-	
 	if (portid <= _output_ports.size() && portid > 0) {
-		port = _output_ports[portid-1];
-		_output_ports[portid-1] = 0;
+		{
+			LockMonitor mon(_port_lock, __LINE__, __FILE__);
+			port = _output_ports[portid-1];
+			_output_ports[portid-1] = 0;
+		}
 		return (jack_port_unregister (_jack, port) == 0);
 	}
 	
@@ -309,10 +372,12 @@ JackAudioDriver::destroy_input_port (port_id_t portid)
 {
 	jack_port_t * port = 0;
 
-	//LockMonitor mon(_port_lock, __LINE__, __FILE__);
 	if (portid <= _input_ports.size() && portid > 0) {
-		port = _input_ports[portid-1];
-		_input_ports[portid-1] = 0;
+		{
+			LockMonitor mon(_port_lock, __LINE__, __FILE__);
+			port = _input_ports[portid-1];
+			_input_ports[portid-1] = 0;
+		}
 		return (jack_port_unregister (_jack, port) == 0);
 	}
 	
@@ -341,17 +406,31 @@ JackAudioDriver::get_output_port_buffer (port_id_t port, nframes_t nframes)
 nframes_t
 JackAudioDriver::get_input_port_latency (port_id_t port)
 {
-	if (!_jack || port > _input_ports.size() || port == 0) return 0;
+	// not rt safe
+	if (!_jack || port > _input_ports.size() || port == 0 || !_input_ports[port-1]) return 0;
 
+#ifdef HAVE_JACK_LATENCY_RANGE
+	jack_latency_range_t range;
+	jack_port_get_latency_range (_input_ports[port-1], JackCaptureLatency, &range);
+	return range.max;
+#else
 	return jack_port_get_total_latency (_jack, _input_ports[port-1]);
+#endif
 }
 
 nframes_t
 JackAudioDriver::get_output_port_latency (port_id_t port)
 {
-	if (!_jack || port > _output_ports.size() || port == 0) return 0;
+	// not rt safe
+	if (!_jack || port > _output_ports.size() || port == 0 || !_output_ports[port-1]) return 0;
 
+#ifdef HAVE_JACK_LATENCY_RANGE
+	jack_latency_range_t range;
+	jack_port_get_latency_range (_output_ports[port-1], JackPlaybackLatency, &range);
+	return range.max;
+#else
 	return jack_port_get_total_latency (_jack, _output_ports[port-1]);
+#endif
 }
 
 void
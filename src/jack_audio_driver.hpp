@@ -74,6 +74,7 @@ class JackAudioDriver
 	static int _process_callback (jack_nframes_t, void*);
 	static int _xrun_callback (void*);
 	static void _shutdown_callback (void*);
+	static void _thread_init_callback (void*);
 	static void _timebase_callback(jack_transport_state_t state,
 				       jack_nframes_t nframes, 
 				       jack_position_t *pos,
@@ -91,6 +92,11 @@ class JackAudioDriver
 
 	int conn_changed_callback ();
 	static int _conn_changed_callback (void*);
+
+#ifdef HAVE_JACK_LATENCY_RANGE
+	void latency_callback (jack_latency_callback_mode_t mode);
+	static void _latency_callback (jack_latency_callback_mode_t mode, void*);
+#endif
 	
 	jack_client_t *_jack;
 
@@ -31,6 +31,7 @@
 #include <sys/time.h>
 #include <time.h>
 #include <libgen.h>
+#include <unistd.h>
 
 #ifdef HAVE_SNDFILE
 #include <sndfile.h>
@@ -45,6 +46,8 @@
 #include "utils.hpp"
 #include "panner.hpp"
 #include "command_map.hpp"
+#include "trace.hpp"
+#include "contention.hpp"
 
 
 
@@ -53,6 +56,9 @@ using namespace SooperLooper;
 using namespace PBD;
 using namespace RubberBand;
 
+// a partial upload with no new block for this long is dropped
+#define UPLOAD_TIMEOUT 30.0
+
 extern	LADSPA_Descriptor* create_sl_descriptor ();
 extern	void cleanup_sl_descriptor (LADSPA_Descriptor *);
 
@@ -61,16 +67,21 @@ extern	void cleanup_sl_descriptor (LADSPA_Descriptor *);
 static const double MinResamplingRate = 0.25f;
 static const double MaxResamplingRate = 8.0f;
 static const int SrcAudioQuality = SRC_LINEAR;
+static const nframes_t MaxInputLatency = 32768;
+
+// loops may be initialized from several threads at once, and the
+// fft planning underneath rubberband is not guaranteed to be thread safe
+static PBD::NonBlockingLock stretcher_create_lock;
 
 
-Looper::Looper (AudioDriver * driver, unsigned int index, unsigned int chan_count, float loopsecs, bool discrete)
-	: _driver (driver), _index(index), _chan_count(chan_count), _loopsecs(loopsecs)
+Looper::Looper (AudioDriver * driver, unsigned int index, unsigned int chan_count, float loopsecs, bool discrete, bool defer_ports)
+	: _driver (driver), _index(index), _chan_count(chan_count), _loopsecs(loopsecs), _defer_ports(defer_ports)
 {
 	initialize (index, chan_count, loopsecs, discrete);
 }
 
-Looper::Looper (AudioDriver * driver, XMLNode & node)
-	: _driver (driver)
+Looper::Looper (AudioDriver * driver, XMLNode & node, bool defer_ports)
+	: _driver (driver), _defer_ports(defer_ports)
 {
 	_index = 0; // set from state
 	_chan_count = 1; // set from state
@@ -87,18 +98,31 @@ Looper::Looper (AudioDriver * driver, XMLNode & node)
 bool
 Looper::initialize (unsigned int index, unsigned int chan_count, float loopsecs, bool discrete)
 {
-	char tmpstr[100];
 	int dummyerror;
 
 	_index = index;
 	_chan_count = chan_count;
 	
 	_ok = false;
-	requested_cmd = -1;
-	last_requested_cmd = -1;
-	request_pending = false;
+	_period_event_count = 0;
+	_period_event_pos = 0;
+	_pending_cmd_count = 0;
+	_idle = false;
+	_idle_input_stale = false;
+	_idle_published = false;
+	_idle_ran = false;
+	_dormant = false;
+	_dormant_since = 0;
+	_dormant_frames = 0;
+	_wake_request = false;
+	_core_undos = 0;
+	_core_undo_alls = 0;
+	_core_redos = 0;
+	_tempo_version = 0;
+	_automation = new Automation();
 	_input_ports = 0;
 	_output_ports = 0;
+	_ports_registered = false;
 	_instances = 0;
 	_buffersize = 0;
 	_use_sync_buf = 0;
@@ -114,6 +138,10 @@ Looper::initialize (unsigned int index, unsigned int chan_count, float loopsecs,
 	_last_trigger_latency = 0.0f;
 	_last_input_latency = 0.0f;
 	_last_output_latency = 0.0f;
+	_port_input_latency = 0.0f;
+	_port_output_latency = 0.0f;
+	_input_delay_capacity = 0;
+	_requested_input_latency = 0.0f;
 	_have_discrete_io = discrete;
 	_curr_dry = 0.0f;
 	_target_dry = 0.0f;
@@ -123,6 +151,8 @@ Looper::initialize (unsigned int index, unsigned int chan_count, float loopsecs,
 	_output_peak = 0.0f;
 	_panner = 0;
 	_relative_sync = false;
+	_loop_group = -1;
+	_curr_group_gain = 1.0f;
 	descriptor = 0;
 	_pre_solo_muted = false;
 	_stretch_ratio = 1.0;
@@ -132,6 +162,11 @@ Looper::initialize (unsigned int index, unsigned int chan_count, float loopsecs,
 	_pending_stretch = false;
 	_pending_stretch_ratio = 0.0;
 	_is_soloed = false;
+	_staged_chans = 0;
+	_staged_frames = 0;
+	_staged_id = 0;
+	_completed_id = 0;
+	_staged_time = 0.0;
 
 	if (!descriptor) {
 		descriptor = create_sl_descriptor ();
@@ -167,10 +202,13 @@ Looper::initialize (unsigned int index, unsigned int chan_count, float loopsecs,
 	nframes_t srate = _driver->get_samplerate();
 	
 	// rubberband stretch stuff
-	_in_stretcher = new RubberBandStretcher(srate, _chan_count, 
-					     RubberBandStretcher::OptionProcessRealTime | RubberBandStretcher::OptionTransientsCrisp);
-	_out_stretcher = new RubberBandStretcher(srate, _chan_count, 
-					     RubberBandStretcher::OptionProcessRealTime | RubberBandStretcher::OptionTransientsCrisp);
+	{
+		LockMonitor lm (stretcher_create_lock, __LINE__, __FILE__);
+		_in_stretcher = new RubberBandStretcher(srate, _chan_count, 
+						     RubberBandStretcher::OptionProcessRealTime | RubberBandStretcher::OptionTransientsCrisp);
+		_out_stretcher = new RubberBandStretcher(srate, _chan_count, 
+						     RubberBandStretcher::OptionProcessRealTime | RubberBandStretcher::OptionTransientsCrisp);
+	}
 
 	
 	set_buffer_size(_driver->get_buffersize());
@@ -212,10 +250,8 @@ Looper::initialize (unsigned int index, unsigned int chan_count, float loopsecs,
 	_slave_sync_port = (_relative_sync && ports[Sync]) ? 2.0f : 1.0f;
 
 	// TODO: fix hack to specify loop length
-	char looptimestr[20];
-	snprintf(looptimestr, sizeof(looptimestr), "%f", loopsecs);
-	setenv("SL_SAMPLE_TIME", looptimestr, 1);
-
+	// this is per-thread, so loops can be initialized in parallel
+	sl_set_instantiate_secs (loopsecs);
 	
 	for (unsigned int i=0; i < _chan_count; ++i)
 	{
@@ -226,25 +262,6 @@ Looper::initialize (unsigned int index, unsigned int chan_count, float loopsecs,
 		}
 
 		sl_set_loop_index(_instances[i], (int)_index, i);
-		
-		if (_have_discrete_io) 
-		{
-			snprintf(tmpstr, sizeof(tmpstr), "loop%d_in_%d", _index, i+1);
-			
-			if (!_driver->create_input_port (tmpstr, _input_ports[i])) {
-				
-				cerr << "cannot register loop input port\n";
-				_have_discrete_io = false;
-			}
-			
-			snprintf(tmpstr, sizeof(tmpstr), "loop%d_out_%d", _index, i+1);
-			
-			if (!_driver->create_output_port (tmpstr, _output_ports[i]))
-			{
-				cerr << "cannot register loop output port\n";
-				_have_discrete_io = false;
-			}
-		}
 
 		/* connect all scalar ports to data values */
 		
@@ -265,6 +282,10 @@ Looper::initialize (unsigned int index, unsigned int chan_count, float loopsecs,
 			descriptor->connect_port (_instances[i], Waiting, &_slave_dummy_port);
 			descriptor->connect_port (_instances[i], TrueRate, &_slave_dummy_port);
 		}
+
+		// only the first channel reports, and its seconds outputs are
+		// published once per period by the engine (see publish_outputs)
+		sl_set_control_output_mode (_instances[i], (i == 0) ? OUTPUTS_DEFERRED : OUTPUTS_NONE);
 		
 		descriptor->activate (_instances[i]);
 
@@ -278,6 +299,9 @@ Looper::initialize (unsigned int index, unsigned int chan_count, float loopsecs,
 		
 	}
 
+	// sized for real in update_port_latencies
+	_input_delay_capacity = sl_get_input_latency_capacity (_instances[0]);
+
 	size_t comnouts = _driver->get_engine()->get_common_output_count();
 	_panner = 0;
 	if (comnouts > 1) {
@@ -299,6 +323,44 @@ Looper::initialize (unsigned int index, unsigned int chan_count, float loopsecs,
 
 	_ok = true;
 
+	if (!_defer_ports) {
+		register_ports();
+	}
+	
+	return _ok;
+}
+
+bool
+Looper::register_ports ()
+{
+	// not thread safe with respect to the driver, call from the main thread only
+	char tmpstr[100];
+
+	if (_ports_registered || !_ok) {
+		return _ok;
+	}
+	
+	for (unsigned int i=0; i < _chan_count && _have_discrete_io; ++i)
+	{
+		snprintf(tmpstr, sizeof(tmpstr), "loop%d_in_%d", _index, i+1);
+		
+		if (!_driver->create_input_port (tmpstr, _input_ports[i])) {
+			
+			cerr << "cannot register loop input port\n";
+			_have_discrete_io = false;
+		}
+		
+		snprintf(tmpstr, sizeof(tmpstr), "loop%d_out_%d", _index, i+1);
+		
+		if (!_driver->create_output_port (tmpstr, _output_ports[i]))
+		{
+			cerr << "cannot register loop output port\n";
+			_have_discrete_io = false;
+		}
+	}
+
+	_ports_registered = true;
+	
 	return _ok;
 }
 
@@ -314,9 +376,30 @@ Looper::~Looper ()
 }
 
 
+void
+Looper::release_ports ()
+{
+	for (unsigned int i=0; i < _chan_count && _input_ports && _output_ports; ++i)
+	{
+		if (_input_ports[i]) {
+			_driver->destroy_input_port (_input_ports[i]);
+			_input_ports[i] = 0;
+		}
+		
+		if (_output_ports[i]) {
+			_driver->destroy_output_port (_output_ports[i]);
+			_output_ports[i] = 0;
+		}
+	}
+
+	_ports_registered = false;
+}
+
 void
 Looper::destroy()
 {
+	release_ports ();
+
 	for (unsigned int i=0; i < _chan_count; ++i)
 	{
 		if (_instances[i]) {
@@ -329,16 +412,6 @@ Looper::destroy()
 			_instances[i] = 0;
 		}
 
-		if (_input_ports[i]) {
-			_driver->destroy_input_port (_input_ports[i]);
-			_input_ports[i] = 0;
-		}
-		
-		if (_output_ports[i]) {
-			_driver->destroy_output_port (_output_ports[i]);
-			_output_ports[i] = 0;
-		}
-
 
 		if (_out_src_states[i]) {
 			src_delete (_out_src_states[i]);
@@ -378,6 +451,9 @@ Looper::destroy()
 	if (_panner) {
 		delete _panner;
 	}
+
+	delete _automation;
+	_automation = 0;
 	
 	// SRC stuff
 	delete [] _in_src_states;
@@ -419,6 +495,8 @@ Looper::set_use_common_outs (bool val)
 void
 Looper::use_sync_buf(sample_t * buf)
 {
+	request_wake ();
+
 	if (buf) {
 		_use_sync_buf = buf;
 	}
@@ -431,6 +509,7 @@ void
 Looper::set_samples_since_sync(nframes_t ssync)
 {
 	// this is a bit of a hack
+	request_wake ();
 	for (unsigned int i=0; i < _chan_count; ++i)
 	{
 		sl_set_samples_since_sync(_instances[i], ssync);
@@ -441,6 +520,7 @@ void
 Looper::set_replace_quantized(bool flag)
 {
 	// this is a bit of a hack
+	request_wake ();
 	for (unsigned int i=0; i < _chan_count; ++i)
 	{
 		sl_set_replace_quantized(_instances[i], flag);
@@ -597,6 +677,9 @@ void Looper::set_disable_latency_compensation(bool val)
 			ports[TriggerLatency] = _last_trigger_latency;
 			ports[InputLatency] = _last_input_latency;
 			ports[OutputLatency] = _last_output_latency;
+			if (!_auto_latency) {
+				_requested_input_latency = _last_input_latency;
+			}
 		}
 
 		recompute_latencies(); 
@@ -606,28 +689,17 @@ void Looper::set_disable_latency_compensation(bool val)
 void
 Looper::recompute_latencies()
 {
-	// auto?
+	// this may be called from the rt thread, it must not query the driver
+	request_wake ();
+
 	if (_auto_latency)
 	{
 		ports[TriggerLatency] = _buffersize; // jitter correction
-
-
-		ports[InputLatency] = _driver->get_input_port_latency(_input_ports[0]);
-		if (_use_common_ins) {
-			port_id_t comnport = 0;
-			if (_driver->get_engine()->get_common_input (0, comnport)) {
-				ports[InputLatency] = _driver->get_input_port_latency(comnport);
-			}
-		}
-	
-		ports[OutputLatency] = _driver->get_output_port_latency(_output_ports[0]);
-		if (_use_common_outs) {
-			port_id_t comnport = 0;
-			if (_driver->get_engine()->get_common_output (0, comnport)) {
-				ports[OutputLatency] = _driver->get_output_port_latency(comnport);
-			}
-		}
-
+		ports[InputLatency] = _port_input_latency;
+		ports[OutputLatency] = _port_output_latency;
+	}
+	else {
+		ports[InputLatency] = _requested_input_latency;
 	}
 	
 	if (_disable_latency) {
@@ -636,6 +708,17 @@ Looper::recompute_latencies()
 		ports[OutputLatency] = 0;
 	}
 
+	// never read further back than the input delay line holds
+	ports[InputLatency] = min (ports[InputLatency], (LADSPA_Data) MaxInputLatency);
+	LADSPA_Data maxinput = (_input_delay_capacity > _buffersize) ? (LADSPA_Data) (_input_delay_capacity - _buffersize) : 0.0f;
+	if (ports[InputLatency] > maxinput) {
+		ports[InputLatency] = maxinput;
+		if (_ok) {
+			// have the main thread grow it, we'll be called again when it has
+			_driver->get_engine()->request_latency_update();
+		}
+	}
+
 	// add any latency due to timestretch
 	if (_stretch_ratio != 1.0) {
 		//ports[OutputLatency] += _out_stretcher->getLatency();
@@ -647,6 +730,61 @@ Looper::recompute_latencies()
 	//cerr << "output lat: " << ports[OutputLatency] << endl;
 }
 
+void
+Looper::update_port_latencies()
+{
+	// main thread only
+	float inlat = _driver->get_input_port_latency(_input_ports[0]);
+	if (_use_common_ins) {
+		port_id_t comnport = 0;
+		if (_driver->get_engine()->get_common_input (0, comnport)) {
+			inlat = _driver->get_input_port_latency(comnport);
+		}
+	}
+
+	float outlat = _driver->get_output_port_latency(_output_ports[0]);
+	if (_use_common_outs) {
+		port_id_t comnport = 0;
+		if (_driver->get_engine()->get_common_output (0, comnport)) {
+			outlat = _driver->get_output_port_latency(comnport);
+		}
+	}
+
+	// size the delay line for whichever input latency can be applied
+	resize_input_delay ((nframes_t) min (max (inlat, _requested_input_latency), (float) MaxInputLatency));
+
+	_port_input_latency = inlat;
+	_port_output_latency = outlat;
+}
+
+void
+Looper::resize_input_delay (nframes_t latency)
+{
+	if (!_instances || !_instances[0]) {
+		return;
+	}
+
+	unsigned long needed = latency + _buffersize;
+	unsigned long capacity = sl_get_input_latency_capacity (_instances[0]);
+
+	// only shrink when it is much larger than needed
+	if (needed > capacity || needed < capacity / 4)
+	{
+		// the rt thread bypasses us while this is held
+		LockMonitor lm (_loop_lock, __LINE__, __FILE__);
+		request_wake ();
+
+		for (unsigned int i=0; i < _chan_count; ++i) {
+			if (!sl_resize_input_latency_buffer (_instances[i], needed)) {
+				cerr << "sooperlooper: cannot resize input latency buffer" << endl;
+			}
+		}
+		capacity = sl_get_input_latency_capacity (_instances[0]);
+	}
+
+	_input_delay_capacity = capacity;
+}
+
 bool Looper::has_loop() const
 {
 	return (_instances && _instances[0] && sl_has_loop(_instances[0]));
@@ -662,6 +800,12 @@ Looper::get_control_value (Event::control_t ctrl)
 		//return _curr_dry;
 		return _target_dry;
 	}
+	else if (ctrl == Event::PlayheadModel) {
+		return ports[LoopPosition];
+	}
+	else if (ctrl == Event::AutomationMode) {
+		return (float) _automation->get_mode();
+	}
 	else if (index >= 0 && index < LASTPORT) {
 		return ports[index];
 	}
@@ -671,6 +815,15 @@ Looper::get_control_value (Event::control_t ctrl)
 	}
 	else if (ctrl == Event::InPeakMeter) 
 	{
+		if (is_dormant()) {
+			// not run, all we would see are the common inputs
+			Engine * engine = _driver->get_engine();
+			float peak = 0.0f;
+			for (unsigned int i=0; i < _chan_count; ++i) {
+				peak = f_max (peak, _curr_input_gain * engine->get_common_input_peak (i));
+			}
+			return peak;
+		}
 		return _input_peak;
 	}
 	else if (ctrl == Event::InputGain) {
@@ -682,6 +835,9 @@ Looper::get_control_value (Event::control_t ctrl)
 	else if (ctrl == Event::RelativeSync) {
 		return _relative_sync;
 	}
+	else if (ctrl == Event::LoopGroup) {
+		return (float) _loop_group;
+	}
 	else if (ctrl == Event::UseCommonOuts) {
 		return _use_common_outs;
 	}
@@ -740,6 +896,8 @@ Looper::get_control_value (Event::control_t ctrl)
 
 void Looper::set_port (ControlPort n, float val)
 {
+	request_wake ();
+
 	switch ((int)n)
 	{
 		case DryLevel:
@@ -781,13 +939,56 @@ Looper::is_longpress (int cmd)
 }
 
 
+bool
+Looper::queue_event (Event *ev, nframes_t frame)
+{
+	if (_period_event_count >= MAX_PERIOD_EVENTS) {
+		Contention::count (Contention::PeriodEventDrops);
+		return false;
+	}
+
+	// values we normalize are fixed here so the engine reports what gets applied
+	if (ev->Type == Event::type_control_change && ev->Control == Event::Quantize) {
+		ev->Value = roundf(ev->Value);
+	}
+
+	// kept in frame order.  a bounce swap is queued at the start of the
+	// period, the period's own earlier events slot in before it.  equal
+	// frames keep the order they came in
+	unsigned int n = _period_event_count;
+	while (n > _period_event_pos && _period_events[n-1].frame > frame) {
+		_period_events[n] = _period_events[n-1];
+		--n;
+	}
+
+	_period_events[n].event = *ev;
+	_period_events[n].frame = frame;
+	++_period_event_count;
+	request_wake ();
+
+	return true;
+}
+
+void
+Looper::queue_command (int cmd)
+{
+	if (_pending_cmd_count < MAX_PENDING_CMDS) {
+		_pending_cmds[_pending_cmd_count++] = cmd;
+	}
+	else {
+		// saturated, the latest one wins
+		Contention::count (Contention::CommandOverwrites);
+		_pending_cmds[MAX_PENDING_CMDS-1] = cmd;
+	}
+}
+
 void
 Looper::do_event (Event *ev)
 {
+	request_wake ();
+
 	if (ev->Type == Event::type_cmd_hit) {
-		Event::command_t cmd = ev->Command;
-		requested_cmd = cmd;
-		request_pending = true;
+		int cmd = ev->Command;
 		//fprintf(stderr, "Got HIT cmd: %d\n", cmd);
 
 		// a few special commands have double-tap logic
@@ -795,17 +996,18 @@ Looper::do_event (Event *ev)
 			if (_down_stamps[cmd] > 0 && _running_frames < (_down_stamps[cmd] + _doubletap_frames))
 			{
 				// we actually need to undo twice!
-				requested_cmd = Event::UNDO_TWICE; 
+				cmd = Event::UNDO_TWICE; 
 			}
-			_down_stamps[cmd] = _running_frames;
+			_down_stamps[ev->Command] = _running_frames;
 		}
+
+		queue_command (cmd);
 	}
 	else if (ev->Type == Event::type_cmd_down)
 	{
 		Event::command_t cmd = ev->Command;
 		if ((int) cmd >= 0 && (int) cmd < (int) Event::LAST_COMMAND) {
-			requested_cmd = cmd;
-			request_pending = true;
+			int reqcmd = cmd;
 
 			// fprintf(stderr, "Got DOWN cmd: %d\n", cmd);
 
@@ -814,11 +1016,12 @@ Looper::do_event (Event *ev)
 				if (_down_stamps[cmd] > 0 && _running_frames < (_down_stamps[cmd] + _doubletap_frames))
 				{
 					// we actually need to undo twice!
-					requested_cmd = Event::UNDO_TWICE; 
+					reqcmd = Event::UNDO_TWICE; 
 				}
 			}
 			
 			_down_stamps[cmd] = _running_frames;
+			queue_command (reqcmd);
 		}
 	}
 	else if (ev->Type == Event::type_cmd_up || ev->Type == Event::type_cmd_upforce)
@@ -842,35 +1045,35 @@ Looper::do_event (Event *ev)
 								|| (ports[State] == LooperStateInserting && cmd == Event::INSERT)))
 					{
 						// this really should be handled down in the plugin
-						cmd = Event::RECORD;
+						queue_command (Event::RECORD);
+					}
+					else {
+						queue_command (cmd);
 					}
 
 					//cerr << "force up" << endl;
-
-					requested_cmd = cmd;
-					request_pending = true;
-
 				}
 				else if (_down_stamps[cmd] > 0 && _running_frames > (_down_stamps[cmd] + _longpress_frames))
 				{
 					//cerr << "long up" << endl;
-					requested_cmd = cmd;
-					request_pending = true;
 
 					// long press undo and redo become their -all versions
 					if (cmd == Event::UNDO) {
-						requested_cmd = Event::UNDO_ALL;
+						queue_command (Event::UNDO_ALL);
 					}
 					else if (cmd == Event::REDO) {
-						requested_cmd = Event::REDO_ALL;
+						queue_command (Event::REDO_ALL);
 					}
 					else if (cmd == Event::RECORD_OR_OVERDUB || cmd == Event::RECORD_OR_OVERDUB_EXCL || cmd == Event::RECORD_OR_OVERDUB_SOLO || cmd == Event::RECORD_OVERDUB_END_SOLO) {
 						// longpress of this turns into undo all for one-button goodness
-						requested_cmd = Event::UNDO_ALL;
+						queue_command (Event::UNDO_ALL);
+					}
+					else {
+						queue_command (cmd);
 					}
 				}
 			}
-			//fprintf(stderr, "Got UP cmd: %d  req: %d\n", cmd, requested_cmd);
+			//fprintf(stderr, "Got UP cmd: %d\n", cmd);
 
 
 			_down_stamps[cmd] = 0;
@@ -878,6 +1081,13 @@ Looper::do_event (Event *ev)
 	}
 	else if (ev->Type == Event::type_control_change)
 	{
+		// engine generated values (source -1) are not hand made changes
+		if (ev->source >= 0 && _automation->get_mode() == Automation::Record && automation_running()) {
+			nframes_t pos, length, cycle;
+			get_loop_frames (pos, length, cycle);
+			_automation->record (ev->Control, ev->Value, pos, length);
+		}
+
 		// todo: specially handle TriggerThreshold to work across all channels
 
 		if ((int)ev->Control >= (int)Event::TriggerThreshold && (int)ev->Control < (int) Event::State) {
@@ -904,6 +1114,10 @@ Looper::do_event (Event *ev)
 			case Event::DryLevel:
 				_target_dry = ev->Value;
 				break;
+			case Event::InputLatency:
+				_requested_input_latency = ev->Value;
+				recompute_latencies();
+				break;
 			case  Event::Quantize:
 				ev->Value = roundf(ev->Value);
 				// passthru is intentional
@@ -922,6 +1136,11 @@ Looper::do_event (Event *ev)
 		{
 			_relative_sync = ev->Value > 0.0f;
 		}
+		else if (ev->Control == Event::LoopGroup)
+		{
+			int group = (int) roundf (ev->Value);
+			_loop_group = (group >= 0 && group < Engine::MAX_LOOP_GROUPS) ? group : -1;
+		}
 		else if (ev->Control == Event::UseCommonIns) 
 		{
 			_use_common_ins = ev->Value > 0.0f;
@@ -958,6 +1177,10 @@ Looper::do_event (Event *ev)
 		else if (ev->Control == Event::ReplaceQuantized) {
 			set_replace_quantized(ev->Value > 0.0f ? true : false);
 		}
+		else if (ev->Control == Event::AutomationMode) {
+			int mode = (int) roundf (ev->Value);
+			_automation->set_mode ((mode >= Automation::Off && mode <= Automation::Record) ? (Automation::Mode) mode : Automation::Off);
+		}
 		else if (ev->Control == Event::PitchShift) {
 			_pitch_shift = ev->Value; // in semitones
 			_out_stretcher->setPitchScale(pow(2.0, _pitch_shift / 12.0));
@@ -989,10 +1212,211 @@ void
 Looper::run (nframes_t offset, nframes_t nframes)
 {
 	// this is the audio thread
+	nframes_t end = offset + nframes;
+	Engine * engine = _driver->get_engine();
+
+	if (_dormant) {
+		_dormant_frames += engine->get_running_frames() + offset - _dormant_since;
+		_dormant = false;
+	}
+	_wake_request = false;
+	_idle_ran = false;
+
+	// tempo changes are picked up here rather than pushed into every loop
+	if (_tempo_version != engine->get_loop_tempo_version()) {
+		_tempo_version = engine->get_loop_tempo_version();
+		set_port (EighthPerCycleLoop, engine->get_eighth_cycle());
+		set_port (TempoInput, engine->get_loop_tempo());
+	}
+
+	// split only at our own events and automation breakpoints, all of
+	// the events due by end are applied here
+	while (_period_event_pos < _period_event_count && _period_events[_period_event_pos].frame <= end)
+	{
+		PeriodEvent & pev = _period_events[_period_event_pos++];
+
+		if (pev.frame > offset) {
+			run_automated (offset, pev.frame - offset);
+			offset = pev.frame;
+		}
+
+		do_event (&pev.event);
+	}
+
+	if (_period_event_pos == _period_event_count) {
+		_period_event_pos = _period_event_count = 0;
+	}
+
+	run_automated (offset, end - offset);
+
+	// idle with the meters settled and published, nothing but bookkeeping
+	// is left until something stirs us.  loops with their own ports still
+	// pass their input through every period
+	if (_idle && _idle_ran && _idle_published && !_wake_request && !_have_discrete_io
+	    && _period_event_count == 0 && _pending_cmd_count == 0 && _output_peak == 0.0f)
+	{
+		_dormant = true;
+		_dormant_since = engine->get_running_frames() + end;
+	}
+}
+
+bool
+Looper::automation_running () const
+{
+	// the states where the position moves through a loop of known length
+	switch ((int) ports[State]) {
+	case LooperStatePlaying:
+	case LooperStateOverdubbing:
+	case LooperStateReplacing:
+	case LooperStateSubstitute:
+	case LooperStateMuted:
+	case LooperStateOneShot:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void
+Looper::run_automated (nframes_t offset, nframes_t nframes)
+{
+	if (!_automation->is_active() || !automation_running()) {
+		run_segment (offset, nframes);
+		return;
+	}
+
+	Event::control_t ctrls[Automation::MaxLanes];
+	float values[Automation::MaxLanes];
+	Event ev;
+
+	ev.Type = Event::type_control_change;
+	ev.Instance = _index;
+	ev.source = -1; // not recorded again
+
+	while (nframes > 0)
+	{
+		nframes_t pos, newpos, length, cycle;
+		get_loop_frames (pos, length, cycle);
+
+		// the next breakpoint ends this piece, going by the current rate
+		float rate = ports[TrueRate];
+		bool forward = (rate >= 0.0f);
+		nframes_t todo = nframes;
+
+		if (length > 0 && rate != 0.0f) {
+			nframes_t dist = _automation->distance_to_next (pos, length, forward);
+			if (dist > 0) {
+				nframes_t frames = (nframes_t) ceilf (dist / fabsf (rate));
+				if (frames > 0 && frames < todo) {
+					todo = frames;
+				}
+			}
+		}
+
+		run_segment (offset, todo);
+		offset += todo;
+		nframes -= todo;
+
+		// whatever was passed is applied, a resampled or stretched
+		// loop may get there a few frames off
+		get_loop_frames (newpos, length, cycle);
+		int count = _automation->advance (pos, newpos, length, forward, ctrls, values);
+
+		for (int n=0; n < count; ++n) {
+			ev.Control = ctrls[n];
+			ev.Value = values[n];
+			do_event (&ev);
+		}
+
+		if (!automation_running()) {
+			run_segment (offset, nframes);
+			break;
+		}
+	}
+}
+
+void
+Looper::run_core_now ()
+{
+	// run the core for 0 frames so a command takes effect right here.
+	// nothing is read or written, the audio ports just need to be valid
+	for (unsigned int i=0; i < _chan_count; ++i)
+	{
+		descriptor->connect_port (_instances[i], AudioInputPort, _dummy_buf);
+		descriptor->connect_port (_instances[i], AudioOutputPort, _dummy_buf);
+		descriptor->run (_instances[i], 0);
+	}
+
+	follow_core_undo ();
+}
+
+void
+Looper::follow_core_undo ()
+{
+	// the automation goes back and forth with the audio, but only when
+	// the core really did, an undo with nothing to undo leaves it be
+	unsigned long undos, undo_alls, redos;
+	sl_get_undo_counts (_instances[0], undos, undo_alls, redos);
+
+	if (undo_alls != _core_undo_alls) {
+		_automation->clear ();
+	}
+	else if (undos != _core_undos) {
+		_automation->undo ();
+	}
+	else if (redos != _core_redos) {
+		_automation->redo ();
+	}
+
+	_core_undos = undos;
+	_core_undo_alls = undo_alls;
+	_core_redos = redos;
+}
+
+void
+Looper::apply_pending_commands ()
+{
+	for (unsigned int n=0; n < _pending_cmd_count; ++n)
+	{
+		int cmd = _pending_cmds[n];
+
+		if (ports[Multi] == cmd) {
+			// the core only acts on a change of the command port, so
+			// a repeated command gets a reset in between instead of
+			// waiting for the next run
+			ports[Multi] = -1;
+			run_core_now ();
+		}
+
+		ports[Multi] = cmd;
+		//fprintf(stderr,"Requested mode: %d\n", cmd);
+
+		if (cmd == Event::RECORD && ports[State] != LooperStateRecording) {
+			// record cmd, lets reset stretch and pitch ratios to 1 always
+			_pending_stretch_ratio = _stretch_ratio = 1.0;
+			_pending_stretch = true;
+			_pitch_shift = 0.0;
+			_out_stretcher->setPitchScale(pow(2.0, _pitch_shift / 12.0));
+		}
+
+		// the last one goes in with the frames we are about to run
+		if (n + 1 < _pending_cmd_count) {
+			run_core_now ();
+		}
+	}
+
+	_pending_cmd_count = 0;
+}
+
+void
+Looper::run_segment (nframes_t offset, nframes_t nframes)
+{
+	SL_TRACE_SCOPE_ARG("Looper::run", _index);
 	
 	TentativeLockMonitor lm (_loop_lock, __LINE__, __FILE__);
 
 	if (!lm.locked()) {
+		Contention::count (Contention::LoopLockMisses);
 
 		// treat as bypassed
 		if (_have_discrete_io) {
@@ -1011,34 +1435,38 @@ Looper::run (nframes_t offset, nframes_t nframes)
 		return;
 	}
 
-	_running_frames += nframes;
-	
-	if (request_pending) {
-		
-		if (ports[Multi] == requested_cmd) {
-			/* defer till next call */
-			ports[Multi] = -1;
-                        //fprintf(stderr,"Deferred to next run\n");
-		} else {
-			ports[Multi] = requested_cmd;
-			request_pending = false;
-                        //fprintf(stderr,"Requested mode: %d\n", requested_cmd);
-                         
-			if (requested_cmd == Event::RECORD && ports[State] != LooperStateRecording) {
-				// record cmd, lets reset stretch and pitch ratios to 1 always
-				_pending_stretch_ratio = _stretch_ratio = 1.0;
-				_pending_stretch = true;
-				_pitch_shift = 0.0;
-				_out_stretcher->setPitchScale(pow(2.0, _pitch_shift / 12.0));
-			}
+	if (_dormant_frames > 0) {
+		// the frames the engine skipped us for, spent as run_idle would have
+		_running_frames += _dormant_frames;
+		peak_falloff (_dormant_frames);
+		for (unsigned int i=0; i < _chan_count; ++i) {
+			sl_run_idle (_instances[i], 0, _dormant_frames);
 		}
+		_idle_input_stale = true;
+		_dormant_frames = 0;
+	}
 
-	} else if (ports[Multi] >= 0) {
+	_running_frames += nframes;
+	
+	if (_pending_cmd_count == 0 && ports[Multi] >= 0) {
 		ports[Multi] = -1;
                 //fprintf(stderr,"Reset to -1\n");
 		//cerr << "reset to -1\n";
 	}
 
+	if (_pending_cmd_count == 0 && can_idle()) {
+		run_idle (offset, nframes);
+		return;
+	}
+	else if (_idle) {
+		// before any command gets to the cores
+		wake_from_idle (offset);
+	}
+
+	if (_pending_cmd_count > 0) {
+		apply_pending_commands ();
+	}
+
 	// deal with any pending stretch ratio change from non-rt context
 	if (_pending_stretch) {
 		double newratio = _pending_stretch_ratio;
@@ -1069,13 +1497,10 @@ Looper::run (nframes_t offset, nframes_t nframes)
 		_slave_sync_port = 1.0;
 	}
 
-	// do fixed peak meter falloff
-	_input_peak = flush_to_zero (f_clamp (DB_CO (CO_DB(_input_peak) - nframes * _falloff_per_sample), 0.0f, 20.0f));
-	_output_peak = flush_to_zero (f_clamp (DB_CO (CO_DB(_output_peak) - nframes * _falloff_per_sample), 0.0f, 20.0f));
-	
-	
+	peak_falloff (nframes);
 	
 	run_loops (offset, nframes);
+	follow_core_undo ();
 /*
 	if (ports[Rate] == 1.0f) {
 		run_loops (offset, nframes);
@@ -1093,14 +1518,188 @@ Looper::run (nframes_t offset, nframes_t nframes)
 
 
 void
-Looper::run_loops (nframes_t offset, nframes_t nframes)
+Looper::peak_falloff (nframes_t nframes)
 {
-	//LADSPA_Data * inbuf = 0 , *outbuf = 0, *real_inbuf = 0;
-	nframes_t alt_frames = nframes;
-	float currdry = _curr_dry;
+	// do fixed peak meter falloff, a silent meter stays at zero
+	if (_input_peak != 0.0f) {
+		_input_peak = flush_to_zero (f_clamp (DB_CO (CO_DB(_input_peak) - nframes * _falloff_per_sample), 0.0f, 20.0f));
+	}
+	if (_output_peak != 0.0f) {
+		_output_peak = flush_to_zero (f_clamp (DB_CO (CO_DB(_output_peak) - nframes * _falloff_per_sample), 0.0f, 20.0f));
+	}
+}
+
+bool
+Looper::can_idle () const
+{
+	// the sync source feeds everyone else from its cores, and anything
+	// still ramping or resampling needs the normal path
+	if (_pending_stretch || _use_sync_buf == _our_syncout_buf
+	    || ports[Rate] != 1.0f || _stretch_ratio != 1.0 || _pitch_shift != 0.0
+	    || _curr_dry != _target_dry || _curr_input_gain != _targ_input_gain)
+	{
+		return false;
+	}
+
+	for (unsigned int i=0; i < _chan_count; ++i) {
+		if (!sl_is_idle (_instances[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void
+Looper::run_idle (nframes_t offset, nframes_t nframes)
+{
+	// the cores would only pass the input through with the dry level at
+	// zero, so all that comes out of us is our own dry mix.  they still
+	// get their input delay lines fed when we have inputs of our own,
+	// the common inputs are refilled from the engine history on wake.
+	Engine * engine = _driver->get_engine();
+
+	_idle = true;
+	_idle_ran = true;
+	_curr_group_gain = engine->get_loop_group_gain (_loop_group);
+
+	peak_falloff (nframes);
+
+	if (!_have_discrete_io) {
+		for (unsigned int i=0; i < _chan_count; ++i) {
+			_input_peak = f_max (_input_peak, _curr_input_gain * engine->get_common_input_peak (i));
+			sl_run_idle (_instances[i], 0, nframes);
+		}
+		_idle_input_stale = true;
+		return;
+	}
+
+	size_t comnouts = engine->get_common_output_count();
+	sample_t* com_obufs[comnouts];
+	for (size_t n=0; n < comnouts; ++n) {
+		com_obufs[n] = engine->get_common_output_buffer (n);
+		if (com_obufs[n]) {
+			com_obufs[n] += offset;
+		}
+	}
+
+	for (unsigned int i=0; i < _chan_count; ++i)
+	{
+		sample_t * real_inbuf = _driver->get_input_port_buffer (_input_ports[i], _buffersize);
+		sample_t * outbuf = _driver->get_output_port_buffer (_output_ports[i], _buffersize);
+		sample_t * comin = 0;
+
+		if (real_inbuf) {
+			real_inbuf += offset;
+		}
+		if (_use_common_ins || !real_inbuf) {
+			comin = engine->get_common_input_buffer (i);
+			if (comin) {
+				comin += offset;
+			}
+		}
+
+		if (real_inbuf && comin) {
+			for (nframes_t pos=0; pos < nframes; ++pos) {
+				_tmp_io_bufs[i][pos] = _curr_input_gain * (real_inbuf[pos] + comin[pos]);
+			}
+		}
+		else if (real_inbuf || comin) {
+			sample_t * inbuf = real_inbuf ? real_inbuf : comin;
+			for (nframes_t pos=0; pos < nframes; ++pos) {
+				_tmp_io_bufs[i][pos] = _curr_input_gain * inbuf[pos];
+			}
+		}
+
+		if (real_inbuf || comin) {
+			compute_peak (_tmp_io_bufs[i], nframes, _input_peak);
+			sl_run_idle (_instances[i], _tmp_io_bufs[i], nframes);
+		}
+		else {
+			sl_run_idle (_instances[i], 0, nframes);
+			_idle_input_stale = true;
+		}
+
+		if (!outbuf) {
+			continue;
+		}
+		outbuf += offset;
+
+		if (real_inbuf) {
+			for (nframes_t pos=0; pos < nframes; ++pos) {
+				outbuf[pos] = _curr_dry * real_inbuf[pos];
+			}
+		}
+		else {
+			memset (outbuf, 0, nframes * sizeof(sample_t));
+		}
+
+		if (_panner && _use_common_outs) {
+			(*_panner)[i]->distribute (outbuf, com_obufs, 1.0f, nframes);
+		}
+
+		compute_peak (outbuf, nframes, _output_peak);
+	}
+}
+
+void
+Looper::wake_from_idle (nframes_t offset)
+{
+	Engine * engine = _driver->get_engine();
+
+	// the cores stopped counting from the last sync pulse while idle
+	nframes_t since_sync = engine->get_sync_pulse_age() + offset;
+	for (nframes_t n = offset; n > 0; --n) {
+		if (_use_sync_buf[n-1] > 1.5f) {
+			since_sync = offset - n;
+			break;
+		}
+	}
+
+	for (unsigned int i=0; i < _chan_count; ++i) {
+		sl_set_samples_since_sync (_instances[i], since_sync);
+	}
+
+	if (_idle_input_stale) {
+		// what the cores will read back as latency compensated input
+		nframes_t latency = min ((nframes_t) ports[InputLatency], engine->get_common_input_history_size());
+
+		for (unsigned int i=0; i < _chan_count; ++i)
+		{
+			for (nframes_t done = 0; done < latency; ) {
+				nframes_t chunk = min (latency - done, _buffersize);
+
+				if (engine->get_common_input_history (i, offset, done + chunk, _tmp_io_bufs[i], chunk)) {
+					for (nframes_t pos=0; pos < chunk; ++pos) {
+						_tmp_io_bufs[i][pos] *= _curr_input_gain;
+					}
+				}
+				else {
+					memset (_tmp_io_bufs[i], 0, chunk * sizeof(sample_t));
+				}
+
+				sl_fill_input_history (_instances[i], _tmp_io_bufs[i], chunk, done);
+				done += chunk;
+			}
+		}
+	}
+
+	_idle_input_stale = false;
+	_idle_published = false;
+	_idle = false;
+}
+
+void
+Looper::run_loops (nframes_t offset, nframes_t nframes)
+{
+	//LADSPA_Data * inbuf = 0 , *outbuf = 0, *real_inbuf = 0;
+	nframes_t alt_frames = nframes;
+	float currdry = _curr_dry;
 	float curr_ing = _curr_input_gain;
 	float ing_delta = flush_to_zero (_targ_input_gain - _curr_input_gain) / max((nframes_t) 1, (nframes - 1));
 	float dry_delta = flush_to_zero (_target_dry - _curr_dry) / max((nframes_t) 1, (nframes - 1));
+	float currgroup = _curr_group_gain;
+	float targ_group_gain = _driver->get_engine()->get_loop_group_gain (_loop_group);
+	float group_delta = flush_to_zero (targ_group_gain - _curr_group_gain) / max((nframes_t) 1, (nframes - 1));
 	bool  resampled = ports[Rate] != 1.0f;
 	bool  stretched = _stretch_ratio != 1.0;
 	bool  pitched = _pitch_shift != 0.0;
@@ -1381,7 +1980,16 @@ Looper::run_loops (nframes_t offset, nframes_t nframes)
 		
 	for (unsigned int i=0; i < _chan_count; ++i)
 	{
+		// group gain only scales the loop output, not the dry signal
+		if (group_delta != 0.0f || _curr_group_gain != 1.0f) {
+			currgroup = _curr_group_gain;
 
+			for (nframes_t pos=0; pos < nframes; ++pos) {
+				currgroup += group_delta;
+
+				outbufs[i][pos] *= currgroup;
+			}
+		}
 
 		if (_have_discrete_io && real_inbufs[i]) {
 			// just mix the dry into the outputs
@@ -1431,8 +2039,134 @@ Looper::run_loops (nframes_t offset, nframes_t nframes)
 		_curr_dry = _target_dry;
 	}
 
+	_curr_group_gain = flush_to_zero (currgroup);
+	if (fabsf (group_delta) <= 0.00003f) {
+		// force to == target
+		_curr_group_gain = targ_group_gain;
+	}
+}
+
+
+void
+Looper::begin_direct_record (DirectRecordState & st, sample_t ** inbufs, sample_t * dummyout)
+{
+	// caller must be holding _loop_lock
+	
+	for (unsigned int i=0; i < _chan_count; ++i)
+	{
+		/* connect audio ports */
+		descriptor->connect_port (_instances[i], AudioInputPort, (LADSPA_Data*) inbufs[i]);
+		descriptor->connect_port (_instances[i], AudioOutputPort, (LADSPA_Data*) dummyout);
+		descriptor->connect_port (_instances[i], SyncInputPort, (LADSPA_Data*) dummyout);
+		descriptor->connect_port (_instances[i], SyncOutputPort, (LADSPA_Data*) dummyout);
+	}
+	
+	// ok, first we need to store some current values
+	st.recthresh = ports[TriggerThreshold];
+	st.syncmode = ports[Sync];
+	st.xfadesamples = ports[FadeSamples];
+	st.state  = ports[State];
+	st.in_latency = ports[InputLatency];
+	st.out_latency = ports[OutputLatency];
+	st.trig_latency = ports[TriggerLatency];
+	st.round_tempo = ports[RoundIntegerTempo];
+	st.quantize = ports[Quantize];
+
+	ports[TriggerThreshold] = 0.0f;
+	ports[Sync] = 0.0f;
+	ports[FadeSamples] = 0.0f;
+	ports[InputLatency] = 0.0f;
+	ports[OutputLatency] = 0.0f;
+	ports[TriggerLatency] = 0.0f;
+	ports[RoundIntegerTempo] = 0.0f;
+	ports[Quantize] = (float) QUANT_OFF;
+	_slave_sync_port = 0.0f;
+	
+	// now set it to mute just to make sure we weren't already recording
+	for (unsigned int i=0; i < _chan_count; ++i)
+	{
+		// run it for 0 frames just to change state
+		ports[Multi] = Event::MUTE_ON;
+		descriptor->run (_instances[i], 0);
+		ports[Multi] = Event::RECORD;
+		descriptor->run (_instances[i], 0);
+	}
+}
+
+void
+Looper::run_direct_record (sample_t ** inbufs, const float * srcbuf, unsigned int srcchans, nframes_t nframes)
+{
+	nframes_t bpos;
+	sample_t * databuf;
+	
+	// deinterleave
+	unsigned int n;
+	for (n=0; n < _chan_count && n < srcchans; ++n) {
+		databuf = inbufs[n];
+		bpos = n;
+		for (nframes_t m=0; m < nframes; ++m) {
+			
+			databuf[m] = srcbuf[bpos];
+			bpos += srcchans;
+		}
+	}
+	for (; n < _chan_count; ++n) {
+		// clear leftover channels (maybe we should duplicate last one, we'll see)
+		//memset(inbufs[n], 0, sizeof(float) * nframes);
+
+		// duplicate last one
+		memcpy (inbufs[n], inbufs[srcchans-1], sizeof(float) * nframes);
+	}
+	
+	for (unsigned int i=0; i < _chan_count; ++i)
+	{
+		// run it for nframes
+		descriptor->run (_instances[i], nframes);
+	}
 }
 
+void
+Looper::end_direct_record (const DirectRecordState & st, bool empty)
+{
+	// change state to unknown, then the end record (with mute optionally)
+	for (unsigned int i=0; i < _chan_count; ++i)
+	{
+		// in the case of an empty file, run undo_all
+		if (empty) {
+			ports[Multi] = Event::UNDO_ALL;
+			descriptor->run (_instances[i], 0);
+			continue;
+		}
+
+		ports[Multi] = Event::UNKNOWN;
+		descriptor->run (_instances[i], 0);
+
+		if ((int)st.state == LooperStateMuted) {
+			ports[Multi] = Event::MUTE_ON;
+		}
+		else if ((int)st.state == LooperStatePaused || (int)st.state == LooperStateOff) {
+			ports[Multi] = Event::PAUSE_ON;
+		}
+		else {
+			ports[Multi] = Event::RECORD;
+		}
+		descriptor->run (_instances[i], 0);
+
+	}
+
+	// a load isn't an undo, the automation stays as it is
+	sl_get_undo_counts (_instances[0], _core_undos, _core_undo_alls, _core_redos);
+
+	ports[TriggerThreshold] = st.recthresh;
+	ports[Sync] = st.syncmode;
+	ports[FadeSamples] = st.xfadesamples;
+	ports[InputLatency] = st.in_latency;
+	ports[OutputLatency] = st.out_latency;
+	ports[TriggerLatency] = st.trig_latency;
+	ports[RoundIntegerTempo] = st.round_tempo;
+	ports[Quantize] = st.quantize;
+	_slave_sync_port = _relative_sync ? 2.0f: 1.0f;
+}
 
 bool
 Looper::load_loop (string fname)
@@ -1440,9 +2174,12 @@ Looper::load_loop (string fname)
 	bool ret = false;
 
 #ifdef HAVE_SNDFILE
-	// this is not called from the audio thread
+	SL_TRACE_SCOPE_ARG("Looper::load_loop", _index);
+	
+	// this is called from an engine worker thread, not the audio thread,
 	// so we take the loop_lock during the whole procedure
 	LockMonitor lm (_loop_lock, __LINE__, __FILE__);
+	request_wake ();
 
 	SNDFILE * sfile = 0;
 	SF_INFO   sinfo;
@@ -1477,53 +2214,14 @@ Looper::load_loop (string fname)
 	}
 
 	sample_t * dummyout = new float[bufsize];
-	
-	for (unsigned int i=0; i < _chan_count; ++i)
-	{
-		/* connect audio ports */
-		descriptor->connect_port (_instances[i], AudioInputPort, (LADSPA_Data*) inbufs[i]);
-		descriptor->connect_port (_instances[i], AudioOutputPort, (LADSPA_Data*) dummyout);
-		descriptor->connect_port (_instances[i], SyncInputPort, (LADSPA_Data*) dummyout);
-		descriptor->connect_port (_instances[i], SyncOutputPort, (LADSPA_Data*) dummyout);
-	}
-	
-	// ok, first we need to store some current values
-	float old_recthresh = ports[TriggerThreshold];
-	float old_syncmode = ports[Sync];
-	float old_xfadesamples = ports[FadeSamples];
-	float old_state  = ports[State];
-	float old_in_latency = ports[InputLatency];
-	float old_out_latency = ports[OutputLatency];
-	float old_trig_latency = ports[TriggerLatency];
-	float old_round_tempo = ports[RoundIntegerTempo];
-	float old_quantize = ports[Quantize];
 
-	ports[TriggerThreshold] = 0.0f;
-	ports[Sync] = 0.0f;
-	ports[FadeSamples] = 0.0f;
-	ports[InputLatency] = 0.0f;
-	ports[OutputLatency] = 0.0f;
-	ports[TriggerLatency] = 0.0f;
-	ports[RoundIntegerTempo] = 0.0f;
-	ports[Quantize] = (float) QUANT_OFF;
-	_slave_sync_port = 0.0f;
-	
-	// now set it to mute just to make sure we weren't already recording
-	for (unsigned int i=0; i < _chan_count; ++i)
-	{
-		// run it for 0 frames just to change state
-		ports[Multi] = Event::MUTE_ON;
-		descriptor->run (_instances[i], 0);
-		ports[Multi] = Event::RECORD;
-		descriptor->run (_instances[i], 0);
-	}
+	DirectRecordState st;
+	begin_direct_record (st, inbufs, dummyout);
 
 	// now start recording and run for sinfo.frames total
 	nframes_t nframes = bufsize;
 	nframes_t frames_left = sinfo.frames;
 	nframes_t filechans = sinfo.channels;
-	nframes_t bpos;
-	sample_t * databuf;
 	sample_t * bigbuf  = new float[bufsize * filechans];
 	
 	while (frames_left > 0)
@@ -1535,86 +2233,330 @@ Looper::load_loop (string fname)
 		// fill input buffers
 		nframes = sf_readf_float (sfile, bigbuf, nframes);
 
-		// deinterleave
-		unsigned int n;
-		for (n=0; n < _chan_count && n < filechans; ++n) {
-			databuf = inbufs[n];
-			bpos = n;
-			for (nframes_t m=0; m < nframes; ++m) {
-				
-				databuf[m] = bigbuf[bpos];
-				bpos += filechans;
-			}
+		run_direct_record (inbufs, bigbuf, filechans, nframes);
+
+		frames_left -= nframes;
+	}
+
+	end_direct_record (st, sinfo.frames == 0);
+	
+	ret = true;
+
+	sf_close (sfile);
+
+	for (unsigned int i=0; i < _chan_count; ++i) {
+		delete [] inbufs[i];
+	}
+	delete [] inbufs;
+	delete [] dummyout;
+	delete [] bigbuf;
+#endif
+
+	return ret;
+}
+
+void
+Looper::publish_outputs ()
+{
+	if (_idle) {
+		// nothing moves while idle, once is enough
+		if (_idle_published) {
+			return;
+		}
+		_idle_published = true;
+	}
+
+	if (_chan_count > 0 && _instances[0]) {
+		sl_publish_control_outputs (_instances[0]);
+	}
+}
+
+void
+Looper::get_loop_frames (nframes_t & pos, nframes_t & length, nframes_t & cycle) const
+{
+	unsigned long lpos = 0, llen = 0, lcycle = 0;
+
+	if (_chan_count > 0 && _instances[0]) {
+		sl_get_loop_frames (_instances[0], lpos, llen, lcycle);
+	}
+	pos = lpos;
+	length = llen;
+	cycle = lcycle;
+}
+
+void
+Looper::get_memory_handles (std::vector<LADSPA_Handle> & handles) const
+{
+	for (unsigned int i=0; i < _chan_count; ++i) {
+		if (_instances[i]) {
+			handles.push_back (_instances[i]);
 		}
-		for (; n < _chan_count; ++n) {
-			// clear leftover channels (maybe we should duplicate last one, we'll see)
-			//memset(inbufs[n], 0, sizeof(float) * nframes);
+	}
+}
+
+bool
+Looper::get_loop_audio (vector<float> & dest, nframes_t & nframes)
+{
+	// called from the main work thread and the bounce worker.  the copy
+	// runs without the loop lock, the audio thread keeps playing the loop.
+	// one that was written to while we copied (recorded, overdubbed,
+	// undone or loaded) is copied again a little later
+	SL_TRACE_SCOPE_ARG("Looper::get_loop_audio", _index);
 
-			// duplicate last one
-			memcpy (inbufs[n], inbufs[filechans-1], sizeof(float) * nframes);
+	for (int tries = 0; tries < 8; ++tries) {
+		if (tries > 0) {
+			usleep (20000 * tries);
 		}
-		
-		
-		for (unsigned int i=0; i < _chan_count; ++i)
-		{
-			// run it for nframes
-			descriptor->run (_instances[i], nframes);
+		if (copy_loop_audio (dest, nframes)) {
+			return true;
 		}
+	}
 
-		
+	cerr << "loop " << _index << " kept changing, couldn't get a consistent copy" << endl;
+	dest.clear();
+	nframes = 0;
+	return false;
+}
 
-		frames_left -= nframes;
+bool
+Looper::get_loop_generation (unsigned long & gen) const
+{
+	// the sum of the channels moves on if any of them does
+	gen = 0;
+	for (unsigned int i=0; i < _chan_count; ++i) {
+		unsigned long g = sl_get_loop_generation (_instances[i]);
+		if (g & 1) {
+			return false;
+		}
+		gen += g;
 	}
+	return true;
+}
+
+bool
+Looper::copy_loop_audio (vector<float> & dest, nframes_t & nframes)
+{
+	nframes_t total, dummypos, dummycycle;
+	nframes_t bufsize = 16384;
+	nframes_t looppos = 0;
+	nframes_t bpos;
+	sample_t * databuf;
+	unsigned long gen, endgen;
+
+	dest.clear();
+	nframes = 0;
+
+	if (!get_loop_generation (gen)) {
+		return false;
+	}
+	get_loop_frames (dummypos, total, dummycycle);
+
+	dest.resize (total * _chan_count);
 	
-	// change state to unknown, then the end record (with mute optionally)
-	for (unsigned int i=0; i < _chan_count; ++i)
+	sample_t ** outbufs = new float*[_chan_count];
+	for (unsigned int i=0; i < _chan_count; ++i) {
+		outbufs[i] = new float[bufsize];
+	}
+
+	while (looppos < total)
 	{
-		// in the case of an empty file, run undo_all
-		if (sinfo.frames == 0) {
-			ports[Multi] = Event::UNDO_ALL;
-			descriptor->run (_instances[i], 0);
-			continue;
+		nframes_t nread = bufsize;
+		if (nread > total - looppos) {
+			nread = total - looppos;
 		}
 
-		ports[Multi] = Event::UNKNOWN;
-		descriptor->run (_instances[i], 0);
+		for (unsigned int i=0; i < _chan_count; ++i) {
+			nread = sl_read_current_loop_audio (_instances[i], outbufs[i], nread, looppos);
+		}
 
-		if ((int)old_state == LooperStateMuted) {
-			ports[Multi] = Event::MUTE_ON;
+		if (nread == 0) {
+			break;
 		}
-		else if ((int)old_state == LooperStatePaused || (int)old_state == LooperStateOff) {
-			ports[Multi] = Event::PAUSE_ON;
+
+		// interleave
+		for (unsigned int n=0; n < _chan_count; ++n) {
+			databuf = outbufs[n];
+			bpos = looppos * _chan_count + n;
+			for (nframes_t m=0; m < nread; ++m) {
+				dest[bpos] = databuf[m];
+				bpos += _chan_count;
+			}
 		}
-		else {
-			ports[Multi] = Event::RECORD;
+
+		looppos += nread;
+	}
+
+	nframes = looppos;
+	dest.resize (nframes * _chan_count);
+	
+	for (unsigned int i=0; i < _chan_count; ++i) {
+		delete [] outbufs[i];
+	}
+	delete [] outbufs;
+
+	// nothing may have run over the loop memory in the meantime
+	return get_loop_generation (endgen) && endgen == gen && nframes == total;
+}
+
+bool
+Looper::put_loop_audio (int id, unsigned int chans, nframes_t total, nframes_t offset, const vector<float> & data)
+{
+	// called from the main work thread with a block of interleaved audio.
+	// blocks accumulate in the staging buffer, the loop itself is
+	// untouched until every frame has arrived.  blocks may come more
+	// than once over udp, so what arrived is kept as ranges.
+
+	if (chans == 0 || data.size() % chans != 0) {
+		return false;
+	}
+
+	if (id == _completed_id && id != 0 && _staged_frames == 0) {
+		// a late repeat of an upload that is already in
+		return true;
+	}
+
+	nframes_t nframes = data.size() / chans;
+
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	_staged_time = tv.tv_sec + tv.tv_usec * 1e-6;
+
+	if (id != _staged_id || _staged_frames == 0 || chans != _staged_chans || total != _staged_frames) {
+		// a new upload, drop anything partial
+		vector<float>().swap (_staged_audio);
+		_staged_ranges.clear();
+		_staged_id = id;
+		_staged_chans = chans;
+		_staged_frames = total;
+
+		nframes_t freesamps = (nframes_t) (ports[LoopFreeMemory] * _driver->get_samplerate());
+		if (total > freesamps) {
+			cerr << "upload is too long for available space: " << total << "  free: " << freesamps << endl;
+			_staged_frames = 0;
+			return false;
 		}
-		descriptor->run (_instances[i], 0);
+		
+		_staged_audio.resize (total * chans);
+	}
 
+	if (offset + nframes > _staged_frames) {
+		return false;
 	}
 
-	ports[TriggerThreshold] = old_recthresh;
-	ports[Sync] = old_syncmode;
-	ports[FadeSamples] = old_xfadesamples;
-	ports[InputLatency] = old_in_latency;
-	ports[OutputLatency] = old_out_latency;
-	ports[TriggerLatency] = old_trig_latency;
-	ports[RoundIntegerTempo] = old_round_tempo;
-	ports[Quantize] = old_quantize;
-	_slave_sync_port = _relative_sync ? 2.0f: 1.0f;
+	if (nframes > 0) {
+		memcpy (&_staged_audio[offset * chans], &data[0], sizeof(float) * nframes * chans);
+		add_staged_range (offset, offset + nframes);
+	}
+
+	if (_staged_frames > 0 && !staged_covers (0, _staged_frames)) {
+		return true;
+	}
+
+	// complete, swap it in
+	bool ret = load_loop_audio (_staged_audio.empty() ? 0 : &_staged_audio[0], _staged_chans, _staged_frames);
+
+	vector<float>().swap (_staged_audio);
+	_staged_ranges.clear();
+	_staged_frames = 0;
+	_completed_id = _staged_id;
 	
-	ret = true;
+	return ret;
+}
 
-	sf_close (sfile);
+void
+Looper::drop_stale_upload (double now)
+{
+	if (_staged_audio.empty() || (now - _staged_time) < UPLOAD_TIMEOUT) {
+		return;
+	}
+
+	cerr << "loop " << _index << ": dropping an unfinished audio upload" << endl;
+	vector<float>().swap (_staged_audio);
+	_staged_ranges.clear();
+	_staged_frames = 0;
+}
+
+void
+Looper::add_staged_range (nframes_t start, nframes_t end)
+{
+	// ranges never touch each other, merge with any this overlaps or meets
+	map<nframes_t, nframes_t>::iterator i = _staged_ranges.upper_bound (start);
+
+	if (i != _staged_ranges.begin()) {
+		map<nframes_t, nframes_t>::iterator prev = i;
+		--prev;
+		if (prev->second >= start) {
+			start = prev->first;
+			end = max (end, prev->second);
+			_staged_ranges.erase (prev);
+		}
+	}
+
+	while (i != _staged_ranges.end() && i->first <= end) {
+		end = max (end, i->second);
+		_staged_ranges.erase (i++);
+	}
+
+	_staged_ranges[start] = end;
+}
+
+bool
+Looper::staged_covers (nframes_t start, nframes_t end) const
+{
+	map<nframes_t, nframes_t>::const_iterator i = _staged_ranges.upper_bound (start);
+
+	if (i == _staged_ranges.begin()) {
+		return false;
+	}
+	--i;
+	return i->first <= start && i->second >= end;
+}
+
+bool
+Looper::load_loop_audio (const float * data, unsigned int chans, nframes_t total, bool paused)
+{
+	// the whole replacement happens with the loop lock held, so the
+	// audio thread sees either the old loop or the new one
+	SL_TRACE_SCOPE_ARG("Looper::load_loop_audio", _index);
+	LockMonitor lm (_loop_lock, __LINE__, __FILE__);
+	// a dormant loop only goes dormant again from a run that held the lock
+	request_wake ();
+
+	nframes_t bufsize = 65536;
+	sample_t ** inbufs = new float*[_chan_count];
+	for (unsigned int i=0; i < _chan_count; ++i) {
+		inbufs[i] = new float[bufsize];
+	}
+	sample_t * dummyout = new float[bufsize];
+
+	DirectRecordState st;
+	begin_direct_record (st, inbufs, dummyout);
+
+	nframes_t pos = 0;
+	while (pos < total)
+	{
+		nframes_t nframes = bufsize;
+		if (nframes > total - pos) {
+			nframes = total - pos;
+		}
 
+		run_direct_record (inbufs, data + pos * chans, chans, nframes);
+
+		pos += nframes;
+	}
+
+	if (paused) {
+		st.state = LooperStatePaused;
+	}
+	end_direct_record (st, total == 0);
+	
 	for (unsigned int i=0; i < _chan_count; ++i) {
 		delete [] inbufs[i];
 	}
 	delete [] inbufs;
 	delete [] dummyout;
-	delete [] bigbuf;
-#endif
 
-	return ret;
+	return true;
 }
 
 
@@ -1625,6 +2567,7 @@ Looper::save_loop (string fname, LoopFileEvent::FileFormat format)
 	char tmpname[200];
 
 #ifdef HAVE_SNDFILE
+	SL_TRACE_SCOPE_ARG("Looper::save_loop", _index);
 	
 	// if empty fname, generate name based on loop # and date
 	if (fname.empty()) {
@@ -1640,10 +2583,12 @@ Looper::save_loop (string fname, LoopFileEvent::FileFormat format)
 		fname = tmpname;
 	}
 	
-	// this is called from the main work thread which controls
-	// the allocation of loops and jack ports
-	// thus, our readonly activity to the current loop does not
-	// need a lock to operate safely (because we know it will be safe :)
+	// this is called from an engine worker thread.  the main work thread
+	// which controls the allocation of loops and jack ports cancels and
+	// waits for our job before deleting us, and jobs on one loop run one
+	// at a time.  the audio thread keeps playing it, so it is read without
+	// the loop lock the way get_loop_audio does it, and a loop that was
+	// written to meanwhile is saved again from the start
 
 	SNDFILE * sfile = 0;
 	SF_INFO   sinfo;
@@ -1674,7 +2619,7 @@ Looper::save_loop (string fname, LoopFileEvent::FileFormat format)
 	}
 
 	// make some temporary buffers
-	nframes_t bufsize = 65536;
+	nframes_t bufsize = 16384;
 	sample_t ** outbufs = new float*[_chan_count];
 	for (unsigned int i=0; i < _chan_count; ++i) {
 		outbufs[i] = new float[bufsize];
@@ -1683,56 +2628,81 @@ Looper::save_loop (string fname, LoopFileEvent::FileFormat format)
 	sample_t * bigbuf   = new float[bufsize * _chan_count];
 
 	nframes_t nframes = bufsize;
-	nframes_t frames_left = (nframes_t) lrintf(ports[LoopLength] * _driver->get_samplerate());
+	nframes_t total, frames_left, dummypos, dummycycle;
 
 	nframes_t bpos;
 	sample_t * databuf;
 	nframes_t looppos = 0;
+	unsigned long gen, endgen;
 
-	
-	while (frames_left > 0)
+	for (int tries = 0; !ret && tries < 8; ++tries)
 	{
-		nframes = bufsize;
-		
-		if (nframes > frames_left) {
-			nframes = frames_left;
+		if (tries > 0) {
+			// give whatever is writing to it a moment, then start the file over
+			usleep (20000 * tries);
+			sf_close (sfile);
+			if ((sfile = sf_open (fname.c_str(), SFM_WRITE, &sinfo)) == 0) {
+				cerr << "error opening " << fname << endl;
+				break;
+			}
 		}
 
-		for (unsigned int i=0; i < _chan_count; ++i)
-		{
-			// run it for nframes
-			nframes = sl_read_current_loop_audio (_instances[i], outbufs[i], nframes, looppos);
+		if (!get_loop_generation (gen)) {
+			continue;
 		}
+		get_loop_frames (dummypos, total, dummycycle);
+		frames_left = total;
+		looppos = 0;
 
-		if (nframes == 0) {
-			// we're done, it shorted us somehow
-			//cerr << "shorted" << endl;
-			break;
-		}
-		
-		// interleave
-		unsigned int n;
-		for (n=0; n < _chan_count; ++n) {
-			databuf = outbufs[n];
-			bpos = n;
-			for (nframes_t m=0; m < nframes; ++m) {
-				bigbuf[bpos] = databuf[m];
-				bpos += _chan_count;
+		while (frames_left > 0)
+		{
+			nframes = bufsize;
+
+			if (nframes > frames_left) {
+				nframes = frames_left;
 			}
-		}
 
-		// write out big buffer
-		sf_writef_float (sfile, bigbuf, nframes);
-		
+			for (unsigned int i=0; i < _chan_count; ++i)
+			{
+				// run it for nframes
+				nframes = sl_read_current_loop_audio (_instances[i], outbufs[i], nframes, looppos);
+			}
 
-		frames_left -= nframes;
-		looppos += nframes;
-	}
+			if (nframes == 0) {
+				// we're done, it shorted us somehow
+				//cerr << "shorted" << endl;
+				break;
+			}
 
-	
-	ret = true;
+			// interleave
+			unsigned int n;
+			for (n=0; n < _chan_count; ++n) {
+				databuf = outbufs[n];
+				bpos = n;
+				for (nframes_t m=0; m < nframes; ++m) {
+					bigbuf[bpos] = databuf[m];
+					bpos += _chan_count;
+				}
+			}
+
+			// write out big buffer
+			sf_writef_float (sfile, bigbuf, nframes);
 
-	sf_close (sfile);
+
+			frames_left -= nframes;
+			looppos += nframes;
+		}
+
+		// nothing may have run over the loop memory in the meantime
+		ret = get_loop_generation (endgen) && endgen == gen;
+	}
+
+	if (sfile) {
+		sf_close (sfile);
+	}
+	if (!ret) {
+		cerr << "couldn't save a consistent copy of loop " << _index << " to " << fname << endl;
+	}
 
 	for (unsigned int i=0; i < _chan_count; ++i) {
 		delete [] outbufs[i];
@@ -1776,6 +2746,9 @@ Looper::get_state () const
 	snprintf(buf, sizeof(buf), "%s", _relative_sync ? "yes": "no");
 	node->add_property ("relative_sync", buf);
 
+	snprintf(buf, sizeof(buf), "%d", _loop_group);
+	node->add_property ("group", buf);
+
 	snprintf(buf, sizeof(buf), "%s", _auto_latency ? "yes": "no");
 	node->add_property ("auto_latency", buf);
 
@@ -1792,6 +2765,8 @@ Looper::get_state () const
 	if (_panner) {
 		node->add_child_nocopy (_panner->state (true));
 	}
+
+	node->add_child_nocopy (_automation->get_state ());
 	
 	XMLNode *controls = new XMLNode ("Controls");
 	
@@ -1872,6 +2847,12 @@ Looper::set_state (const XMLNode& node)
 		_relative_sync = (prop->value() == "yes");
 	}
 
+	if ((prop = node.property ("group")) != 0) {
+		int group = -1;
+		sscanf (prop->value().c_str(), "%d", &group);
+		_loop_group = (group >= 0 && group < Engine::MAX_LOOP_GROUPS) ? group : -1;
+	}
+
 	if ((prop = node.property ("auto_latency")) != 0) {
 		_auto_latency = (prop->value() == "yes");
 	}
@@ -1898,6 +2879,9 @@ Looper::set_state (const XMLNode& node)
 				_panner->set_state (**iter);
 			}
 		}
+		else if ((*iter)->name() == "Automation") {
+			_automation->set_state (**iter);
+		}
 	}
 
 	
@@ -1938,6 +2922,7 @@ Looper::set_state (const XMLNode& node)
 		
 	}
 
+	_requested_input_latency = ports[InputLatency];
 	recompute_latencies();
 
 	// load audio if we should
@@ -21,6 +21,8 @@
 #define __sooperlooper_looper__
 
 #include <string>
+#include <vector>
+#include <map>
 
 #if HAVE_CONFIG_H
 #include <config.h>
@@ -38,6 +40,7 @@
 #include "event.hpp"
 #include "event_nonrt.hpp"
 #include "utils.hpp"
+#include "automation.hpp"
 
 #include <pbd/xml++.h>
 
@@ -55,25 +58,50 @@ class Panner;
 class Looper 
 {
   public:
-	Looper (AudioDriver * driver, unsigned int index, unsigned int channel_count=1, float loopsecs=40.0, bool discrete=true);
-	Looper (AudioDriver * driver, XMLNode & node);
+	// with defer_ports, construction touches nothing but our own state and can be
+	// done from any thread.  register_ports() must then be called from the main thread.
+	Looper (AudioDriver * driver, unsigned int index, unsigned int channel_count=1, float loopsecs=40.0, bool discrete=true, bool defer_ports=false);
+	Looper (AudioDriver * driver, XMLNode & node, bool defer_ports=false);
 	~Looper ();
 
 	bool initialize (unsigned int index, unsigned int channel_count=1, float loopsecs=40.0, bool discrete=true);
+	bool register_ports ();
+	// unregisters our ports ahead of destroy(), which skips them then
+	void release_ports ();
 	void destroy();
 	
 	bool operator() () const { return _ok; }
+	// runs this loop for a span of the period, applying any queued
+	// events at their frames within it
 	void run (nframes_t offset, nframes_t nframes);
 
 	void do_event (Event *ev);
 
+	// rt thread, queues an event to be applied at frame within the current period.
+	// returns false if the period list is full.
+	bool queue_event (Event *ev, nframes_t frame);
+	bool can_queue_event () const { return _period_event_count < MAX_PERIOD_EVENTS; }
+
 	float get_control_value (Event::control_t ctrl);
+	// the position moves through a loop of known length
+	bool automation_running () const;
 	
 	void set_port (ControlPort n, LADSPA_Data val);
 
 	bool load_loop (std::string fname);
 	bool save_loop (std::string fname = "", LoopFileEvent::FileFormat format = LoopFileEvent::FormatFloat);
 
+	// interleaved snapshot of the current loop audio
+	bool get_loop_audio (std::vector<float> & dest, nframes_t & nframes);
+	// replaces the loop with interleaved audio, paused leaves it paused at
+	// the start instead of going back to its previous state
+	bool load_loop_audio (const float * data, unsigned int chans, nframes_t total, bool paused = false);
+	// stages a block of upload id, interleaved.  the loop is replaced when the
+	// last block arrives, a new id starts over
+	bool put_loop_audio (int id, unsigned int chans, nframes_t total, nframes_t offset, const std::vector<float> & data);
+	// frees a partial upload that got no block for a while.  main thread
+	void drop_stale_upload (double now);
+
 	void set_buffer_size (nframes_t bufsize);
 
 	sample_t * get_sync_in_buf() { return _our_syncin_buf; }
@@ -83,6 +111,7 @@ class Looper
 
 	unsigned int get_index() const { return _index; }
 	unsigned int get_channel_count() const { return _chan_count; }
+	int get_loop_group() const { return _loop_group; }
 	
 	void set_use_common_ins (bool val);
 	bool get_use_common_ins () const { return _use_common_ins; }
@@ -91,6 +120,19 @@ class Looper
 
 	bool get_have_discrete_io () const { return _have_discrete_io; }
 
+	// rt thread, writes the seconds valued outputs (position, lengths) once per period
+	void publish_outputs ();
+	// an empty loop with nothing pending skips its cores until something happens
+	bool is_idle () const { return _idle; }
+	// an idle loop without ports of its own has nothing to do at all, the
+	// engine skips run() and publish_outputs() for it until it is stirred
+	bool is_dormant () const { return _dormant && !_wake_request; }
+	// current loop position, length and cycle length in frames, never stale
+	void get_loop_frames (nframes_t & pos, nframes_t & length, nframes_t & cycle) const;
+
+	// adds our channels' plugin instances, for sl_get_loop_memory_huge_bytes()
+	void get_memory_handles (std::vector<LADSPA_Handle> & handles) const;
+
 	void set_auto_latency (bool val) { _auto_latency = val; }
 	bool get_auto_latency () const { return _auto_latency; }
 
@@ -116,12 +158,55 @@ class Looper
 	XMLNode& get_state () const;
 	int set_state (const XMLNode&);
 
+	// rt safe, applies the last published port latencies to the controls
 	void recompute_latencies();
+	// not rt safe, queries the driver and sizes the input delay line.
+	// the engine tells the rt thread to pick the new values up
+	void update_port_latencies();
 	
   protected:
 
+	void resize_input_delay (nframes_t latency);
+
+	void run_segment (nframes_t offset, nframes_t nframes);
 	void run_loops (nframes_t offset, nframes_t nframes);
+	void peak_falloff (nframes_t nframes);
+	bool can_idle () const;
+	void run_idle (nframes_t offset, nframes_t nframes);
+	void wake_from_idle (nframes_t offset);
+	void request_wake () { _wake_request = true; }
+	void queue_command (int cmd);
+	void follow_core_undo ();
+	void apply_pending_commands ();
+	void run_core_now ();
 	void run_loops_resampled (nframes_t offset, nframes_t nframes);
+	// run_segment split at the automation breakpoints
+	void run_automated (nframes_t offset, nframes_t nframes);
+
+	struct DirectRecordState {
+		float recthresh;
+		float syncmode;
+		float xfadesamples;
+		float state;
+		float in_latency;
+		float out_latency;
+		float trig_latency;
+		float round_tempo;
+		float quantize;
+	};
+
+	// used to record audio straight into the loop from a non-rt thread, _loop_lock must be held
+	void begin_direct_record (DirectRecordState & st, sample_t ** inbufs, sample_t * dummyout);
+	void run_direct_record (sample_t ** inbufs, const float * srcbuf, unsigned int srcchans, nframes_t nframes);
+	void end_direct_record (const DirectRecordState & st, bool empty);
+
+	void add_staged_range (nframes_t start, nframes_t end);
+	bool staged_covers (nframes_t start, nframes_t end) const;
+
+	// false if the loop changed while it was copied
+	bool copy_loop_audio (std::vector<float> & dest, nframes_t & nframes);
+	// false while a run may be changing the loop memory, gen moves on after one that may have
+	bool get_loop_generation (unsigned long & gen) const;
 
 	static void compute_peak (sample_t *buf, nframes_t nsamples, float& peak) {
 		float p = peak;
@@ -133,9 +218,46 @@ class Looper
 		peak = p;
 	}	
 	
-		
-	int requested_cmd;
-	int last_requested_cmd;
+
+	enum {
+		MAX_PERIOD_EVENTS = 64,
+		MAX_PENDING_CMDS = 16
+	};
+
+	// events for this loop in the current period, in frame order
+	struct PeriodEvent {
+		Event     event;
+		nframes_t frame;
+	};
+	PeriodEvent        _period_events[MAX_PERIOD_EVENTS];
+	unsigned int       _period_event_count;
+	unsigned int       _period_event_pos;
+
+	// commands waiting to go into the core, applied in order at the next run
+	int                _pending_cmds[MAX_PENDING_CMDS];
+	unsigned int       _pending_cmd_count;
+
+	// set by the rt thread while the cores are skipped
+	volatile bool      _idle;
+	// the cores' input delay lines were not fed while idle
+	bool               _idle_input_stale;
+	bool               _idle_published;
+	// the last run went idle with the loop lock held
+	bool               _idle_ran;
+	bool               _dormant;
+	nframes_t          _dormant_since;
+	// skipped while dormant, run_segment catches up on them
+	nframes_t          _dormant_frames;
+	// anything that could end idling sets this, the engine runs us again
+	volatile bool      _wake_request;
+	// engine tempo and eighths last applied to our ports
+	unsigned int       _tempo_version;
+
+	Automation *       _automation;
+	// the core's undo counts last seen, the automation follows what it did
+	unsigned long      _core_undos;
+	unsigned long      _core_undo_alls;
+	unsigned long      _core_redos;
 	
 	AudioDriver *      _driver;
 
@@ -146,6 +268,8 @@ class Looper
 	unsigned int _chan_count;
 	LADSPA_Handle *      _instances;
 	float _loopsecs;
+	bool  _defer_ports;
+	bool  _ports_registered;
 	
 	LADSPA_Descriptor* descriptor;
 
@@ -158,6 +282,10 @@ class Looper
 	float              _targ_input_gain;
 	
 	bool               _relative_sync;
+
+	// group this loop belongs to, -1 for none
+	int                _loop_group;
+	float              _curr_group_gain;
 	
 	// keeps track of down/up commands for SUS purposes
 	nframes_t          _down_stamps[Event::LAST_COMMAND+1];
@@ -191,6 +319,13 @@ class Looper
 	LADSPA_Data         _last_input_latency;
 	LADSPA_Data         _last_output_latency;
 
+	// written by the main thread, read in the rt thread
+	volatile float      _port_input_latency;
+	volatile float      _port_output_latency;
+	volatile unsigned long _input_delay_capacity;
+	// manual input latency, applied while auto latency is off
+	float               _requested_input_latency;
+
 	bool                _pre_solo_muted;
 	bool                _is_soloed;
 
@@ -221,8 +356,16 @@ class Looper
 	volatile bool                      _pending_stretch;
 	volatile double                    _pending_stretch_ratio;
 
+	// staged upload from put_loop_audio
+	std::vector<float>                 _staged_audio;
+	unsigned int                       _staged_chans;
+	nframes_t                          _staged_frames;
+	std::map<nframes_t, nframes_t>     _staged_ranges; // frames arrived, start -> end
+	int                                _staged_id;
+	int                                _completed_id;  // late repeats of it are ignored
+	double                             _staged_time;   // of the last block
+
 	bool _ok;
-	volatile bool request_pending;
 
 	PBD::NonBlockingLock _loop_lock;
 };
@@ -36,6 +36,8 @@
 #include "command_map.hpp"
 #include "utils.hpp"
 #include "engine.hpp"
+#include "trace.hpp"
+#include "contention.hpp"
 
 using namespace SooperLooper;
 using namespace std;
@@ -100,8 +102,7 @@ MidiBridge::MidiBridge (string name, string oscurl, PortRequest & req)
 		return;
 	}
 
-	// this is a callback that will be made from the parser
-	_port->input()->any.connect (mem_fun (*this, &MidiBridge::incoming_midi));
+	connect_input ();
 
 	init_thread();
 	init_clock_thread();
@@ -133,8 +134,7 @@ MidiBridge::MidiBridge (string name,  PortRequest & req)
 		return;
 	}
 
-	// this is a callback that will be made from the parser
-	_port->input()->any.connect (mem_fun (*this, &MidiBridge::incoming_midi));
+	connect_input ();
 
 	init_thread();
 	init_clock_thread();
@@ -318,6 +318,7 @@ MidiBridge::finish_learn(MIDI::byte chcmd, MIDI::byte param, MIDI::byte val)
 	TentativeLockMonitor lm (_bindings_lock, __LINE__, __FILE__);
 	if (!lm.locked()) {
 		// just drop it if we don't get the lock
+		Contention::count (Contention::MidiLockDrops);
 		return;
 	}
 
@@ -389,26 +390,30 @@ MidiBridge::cancel_get_next()
 
 
 void
-MidiBridge::incoming_midi (Parser &p, byte *msg, size_t len, timestamp_t timestamp)
+MidiBridge::connect_input ()
 {
-	/* we only respond to channel messages */
-
-	byte b1 = msg[0];
-	byte b2 = len>1 ? msg[1]: 0;
-	byte b3 = len>2 ? msg[2]: 0;
+	if (_port->supports_event_sink()) {
+		// complete messages go straight to the binding lookup, either
+		// as typed events from the port or from the parser's lean mode
+		_port->set_event_sink (&MidiBridge::_incoming_event, this);
+	}
+}
 
-// 	if ((msg[0] & 0xF0) < 0x80 || (msg[0] & 0xF0) > 0xE0) {
-// 		return;
-// 	}
+void
+MidiBridge::_incoming_event (void * arg, MIDI::byte status, MIDI::byte d1, MIDI::byte d2, MIDI::timestamp_t timestamp)
+{
+	static_cast<MidiBridge*>(arg)->incoming_event (status, d1, d2, timestamp);
+}
 
+void
+MidiBridge::incoming_event (MIDI::byte b1, MIDI::byte b2, MIDI::byte b3, MIDI::timestamp_t timestamp)
+{
 	// convert noteoffs to noteons with val = 0
-	if ((msg[0] & 0xF0) == MIDI::off) {
+	if ((b1 & 0xF0) == MIDI::off) {
  		b1 = MIDI::on | (b1 & 0x0F);
 		b3 = 0;
 	}
 	
-	// fprintf(stderr, "incmoing: %02x  %02x  %02x\n", (int) b1,(int) b2, (int) b3);
-	
 	if (_learning || _getnext) {
 		finish_learn(b1, b2, b3);
 	}
@@ -417,7 +422,6 @@ MidiBridge::incoming_midi (Parser &p, byte *msg, size_t len, timestamp_t timesta
 	}
 }
 
-
 void
 MidiBridge::inject_midi (MIDI::byte chcmd, MIDI::byte param, MIDI::byte val, long framepos)
 {
@@ -440,9 +444,12 @@ MidiBridge::inject_midi (MIDI::byte chcmd, MIDI::byte param, MIDI::byte val, lon
 void
 MidiBridge::queue_midi (MIDI::byte chcmd, MIDI::byte param, MIDI::byte val, long framepos, timestamp_t timestamp)
 {
+	SL_TRACE_SCOPE_ARG("queue_midi", chcmd);
+	
 	TentativeLockMonitor lm (_bindings_lock, __LINE__, __FILE__);
 	if (!lm.locked()) {
 		// just drop it if we don't get the lock
+		Contention::count (Contention::MidiLockDrops);
 		return;
 	}
 
@@ -571,7 +578,7 @@ MidiBridge::send_event (const MidiBindInfo & info, float val, long framepos)
 			}
 		}
 		
-		MidiControlEvent (optype, ctrltype, val, (int8_t) info.instance, framepos); // emit
+		MidiControlEvent (optype, ctrltype, val, info.instance, framepos); // emit
 	}
 	else {
 		if (cmd == "note") {
@@ -604,7 +611,7 @@ MidiBridge::send_event (const MidiBindInfo & info, float val, long framepos)
 			}
 		}
 		
-		MidiCommandEvent (optype, cmdtype, (int8_t) info.instance, framepos); // emit
+		MidiCommandEvent (optype, cmdtype, info.instance, framepos); // emit
 	}
 }
 
@@ -625,6 +632,8 @@ void  MidiBridge::midi_receiver()
 	int timeout = -1;
 	MIDI::byte buf[512];
 
+	SL_TRACE_THREAD("midi");
+	
 	while (!_done) {
 		nfds = 0;
 
@@ -721,6 +730,8 @@ void * MidiBridge::clock_thread_entry()
 
 	if (!_port) return 0;
 
+	SL_TRACE_THREAD("midi clock");
+	
 	//cerr << "entering clock thread" << endl;
 	
 	while (!_clockdone) {
@@ -68,8 +68,8 @@ class MidiBridge
 	sigc::signal1<void, MidiBindInfo> NextMidiReceived;
 
 	// type, command, loop index, framepos (-1 if not set)
-	sigc::signal4<void, Event::type_t, Event::command_t, int8_t, long> MidiCommandEvent;
-	sigc::signal5<void, Event::type_t, Event::control_t, float, int8_t, long> MidiControlEvent;
+	sigc::signal4<void, Event::type_t, Event::command_t, int, long> MidiCommandEvent;
+	sigc::signal5<void, Event::type_t, Event::control_t, float, int, long> MidiControlEvent;
 
 	sigc::signal3<void, Event::control_t, long, MIDI::timestamp_t> MidiSyncEvent;
 	
@@ -93,7 +93,9 @@ class MidiBridge
 	void terminate_midi_thread();
 	void poke_midi_thread();
 	
-	void incoming_midi (MIDI::Parser &p, MIDI::byte *msg, size_t len, MIDI::timestamp_t timestamp);
+	void incoming_event (MIDI::byte status, MIDI::byte d1, MIDI::byte d2, MIDI::timestamp_t timestamp);
+	static void _incoming_event (void * arg, MIDI::byte status, MIDI::byte d1, MIDI::byte d2, MIDI::timestamp_t timestamp);
+	void connect_input ();
 	
 	void queue_midi (MIDI::byte chcmd, MIDI::byte param, MIDI::byte val, long framepos=-1, MIDI::timestamp_t timestamp=0);
 
@@ -0,0 +1,215 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <cmath>
+
+#include <pbd/xml++.h>
+
+#include "modulator.hpp"
+#include "command_map.hpp"
+#include "utils.hpp"
+
+using namespace SooperLooper;
+using namespace std;
+
+static const char * shape_names[] = {
+	"sine",
+	"triangle",
+	"ramp_up",
+	"ramp_down",
+	"square",
+	"random",
+	"envelope"
+};
+
+Modulator::Modulator ()
+	: active(false), instance(-1), control(Event::Unknown), shape(Sine),
+	  beats(4.0f), depth(0.0f), center(0.0f), param(0.0f),
+	  min_value(0.0f), max_value(1.0f),
+	  _trigger_beat(0.0), _triggered(false)
+{
+}
+
+bool
+Modulator::shape_from_string (const string & name, Shape & shape)
+{
+	for (int n=0; n < ShapeCount; ++n) {
+		if (name == shape_names[n]) {
+			shape = (Shape) n;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *
+Modulator::shape_to_string (Shape shape)
+{
+	if (shape < 0 || shape >= ShapeCount) {
+		return "unknown";
+	}
+	return shape_names[shape];
+}
+
+float
+Modulator::value_at (double pos)
+{
+	float val = 0.0f;
+
+	if (beats <= 0.0f) {
+		return center;
+	}
+
+	if (shape == Envelope) {
+		if (_triggered) {
+			if (pos < _trigger_beat) {
+				// the sync position restarted (tempo change), so does the envelope
+				_trigger_beat = pos;
+			}
+
+			double t = (pos - _trigger_beat) / beats;
+			float attack = f_clamp (param, 0.0f, 1.0f);
+
+			if (t >= 1.0) {
+				_triggered = false;
+			}
+			else if (t < attack) {
+				val = (float) (t / attack);
+			}
+			else {
+				val = (float) (1.0 - (t - attack) / (1.0 - attack));
+			}
+		}
+	}
+	else {
+		double cycles = pos / beats + param;
+		double frac = cycles - floor (cycles);
+
+		switch (shape) {
+		case Sine:
+			val = (float) sin (2.0 * M_PI * frac);
+			break;
+		case Triangle:
+			val = (float) (frac < 0.5 ? 4.0 * frac - 1.0 : 3.0 - 4.0 * frac);
+			break;
+		case RampUp:
+			val = (float) (2.0 * frac - 1.0);
+			break;
+		case RampDown:
+			val = (float) (1.0 - 2.0 * frac);
+			break;
+		case Square:
+			val = frac < 0.5 ? 1.0f : -1.0f;
+			break;
+		case Random:
+		{
+			// a hash of the cycle number, the same cycle always gets the same value
+			unsigned int h = (unsigned int) (long) floor (cycles);
+			h ^= ((unsigned int) control << 16) ^ (unsigned int) instance;
+			h = (h ^ 61) ^ (h >> 16);
+			h *= 9;
+			h ^= h >> 4;
+			h *= 0x27d4eb2d;
+			h ^= h >> 15;
+			val = (h & 0xffff) / 32767.5f - 1.0f;
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	return f_clamp (center + depth * val, min_value, max_value);
+}
+
+XMLNode &
+Modulator::get_state () const
+{
+	CommandMap & cmap = CommandMap::instance();
+	LocaleGuard lg ("POSIX");
+
+	XMLNode *node = new XMLNode ("Modulator");
+	char buf[120];
+
+	snprintf(buf, sizeof(buf), "%d", instance);
+	node->add_property ("loop", buf);
+
+	node->add_property ("control", cmap.to_control_str (control));
+	node->add_property ("shape", shape_to_string (shape));
+
+	snprintf(buf, sizeof(buf), "%.10g", beats);
+	node->add_property ("beats", buf);
+	snprintf(buf, sizeof(buf), "%.10g", depth);
+	node->add_property ("depth", buf);
+	snprintf(buf, sizeof(buf), "%.10g", center);
+	node->add_property ("center", buf);
+	snprintf(buf, sizeof(buf), "%.10g", param);
+	node->add_property ("param", buf);
+
+	return *node;
+}
+
+int
+Modulator::set_state (const XMLNode & node)
+{
+	LocaleGuard lg ("POSIX");
+	const XMLProperty* prop;
+	CommandMap & cmap = CommandMap::instance();
+	CommandMap::ControlInfo info;
+
+	if (node.name() != "Modulator") {
+		cerr << "incorrect XML node passed to Modulator: " << node.name() << endl;
+		return -1;
+	}
+
+	if ((prop = node.property ("control")) == 0 || !cmap.is_input_control (prop->value())
+	    || !cmap.get_control_info (prop->value(), info))
+	{
+		return -1;
+	}
+	control = info.ctrl;
+	set_range (info.minValue, info.maxValue);
+
+	if ((prop = node.property ("shape")) == 0 || !shape_from_string (prop->value(), shape)) {
+		return -1;
+	}
+
+	if ((prop = node.property ("loop")) != 0) {
+		sscanf (prop->value().c_str(), "%d", &instance);
+	}
+	if ((prop = node.property ("beats")) != 0) {
+		sscanf (prop->value().c_str(), "%g", &beats);
+	}
+	if ((prop = node.property ("depth")) != 0) {
+		sscanf (prop->value().c_str(), "%g", &depth);
+	}
+	if ((prop = node.property ("center")) != 0) {
+		sscanf (prop->value().c_str(), "%g", &center);
+	}
+	if ((prop = node.property ("param")) != 0) {
+		sscanf (prop->value().c_str(), "%g", &param);
+	}
+
+	_triggered = false;
+	active = true;
+
+	return 0;
+}
@@ -0,0 +1,89 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+#ifndef __sooperlooper_modulator__
+#define __sooperlooper_modulator__
+
+#include <string>
+
+#include "event.hpp"
+
+class XMLNode;
+
+/*
+ * A tempo synced control source for one loop control, evaluated by the
+ * engine in the rt thread once per period.  The cycle is a number of
+ * beats of the engine tempo, so the phase follows the sync position.
+ * The lfo shapes swing depth either way around center, an envelope
+ * rests at center and goes up to center + depth when triggered.
+ * The engine keeps a main thread copy and an rt copy of each one,
+ * nothing here allocates or locks.
+ */
+
+namespace SooperLooper {
+
+class Modulator
+{
+  public:
+	enum Shape {
+		Sine = 0,
+		Triangle,
+		RampUp,
+		RampDown,
+		Square,
+		Random,    // a new random value every cycle
+		Envelope,  // one shot of a cycle, param is the attack part of it
+		ShapeCount
+	};
+
+	Modulator ();
+
+	static bool shape_from_string (const std::string & name, Shape & shape);
+	static const char * shape_to_string (Shape shape);
+
+	// rt thread.  pos is the sync beat position this value is for
+	float value_at (double pos);
+	void  trigger (double pos) { _trigger_beat = pos; _triggered = true; }
+
+	// the range of the target control, values are kept inside it
+	void set_range (float minval, float maxval) { min_value = minval; max_value = maxval; }
+
+	XMLNode & get_state () const;
+	int set_state (const XMLNode & node);
+
+	bool  active;
+	int   instance;   // loop index, -1 for all of them
+	Event::control_t control;
+	Shape shape;
+	float beats;      // cycle length
+	float depth;
+	float center;
+	float param;      // phase offset in cycles, or the envelope attack fraction
+
+	float min_value;
+	float max_value;
+
+  private:
+	double _trigger_beat;
+	bool   _triggered;
+};
+
+};
+
+#endif
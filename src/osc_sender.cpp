@@ -0,0 +1,493 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <cerrno>
+#include <sys/time.h>
+
+#include "osc_sender.hpp"
+#include "trace.hpp"
+
+using namespace SooperLooper;
+using namespace std;
+
+// a client whose messages wait longer than this gets logged, once
+#define LAG_WARN_MS  250.0
+#define LAG_OK_MS    50.0
+// a client thread with nothing to send for this long exits
+#define CLIENT_IDLE_SECS  60.0
+// transfer messages waiting per client before another transfer is refused
+#define MAX_TRANSFER_QUEUED  16384
+// how long stop() waits for the client threads to finish their send
+#define STOP_WAIT_SECS  1.0
+
+static double
+secs_now ()
+{
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+
+OscSender::OscSender (size_t max_queued)
+	: _max_queued(max_queued), _stopped(false), _full_warned(false), _abandoned(0)
+{
+	_lock = new pthread_mutex_t;
+	pthread_mutex_init (_lock, NULL);
+}
+
+OscSender::~OscSender ()
+{
+	stop ();
+
+	if (_abandoned == 0) {
+		pthread_mutex_destroy (_lock);
+		delete _lock;
+	}
+	// otherwise the lock stays, a thread we gave up on still takes it
+}
+
+void
+OscSender::stop ()
+{
+	vector<Client*> clients;
+
+	pthread_mutex_lock (_lock);
+	_stopped = true;
+	for (map<string, Client*>::iterator c = _clients.begin(); c != _clients.end(); ++c) {
+		c->second->quit = true;
+		pthread_cond_signal (&c->second->cond);
+		clients.push_back (c->second);
+	}
+	_clients.clear();
+
+	// a thread blocked sending to a tcp peer that stopped reading would
+	// hold up a join forever, wait a little for them and no longer
+	double until = secs_now() + STOP_WAIT_SECS;
+	struct timespec timeout;
+	timeout.tv_sec = (time_t) until;
+	timeout.tv_nsec = (long) ((until - timeout.tv_sec) * 1e9);
+
+	for (size_t n=0; n < clients.size(); ++n) {
+		while (!clients[n]->done) {
+			if (pthread_cond_timedwait (&clients[n]->cond, _lock, &timeout) == ETIMEDOUT) {
+				break;
+			}
+		}
+	}
+
+	vector<Client*> finished;
+	for (size_t n=0; n < clients.size(); ++n) {
+		Client * client = clients[n];
+		if (client->done) {
+			finished.push_back (client);
+			continue;
+		}
+		// it frees its own address once the send returns, the client
+		// and the lock are left for it
+		fprintf (stderr, "sooperlooper: OSC client %s still blocked in a send, leaving it\n", client->url.c_str());
+		for (deque<Item>::iterator i = client->queue.begin(); i != client->queue.end(); ++i) {
+			free_item (*i);
+		}
+		client->queue.clear();
+		pthread_detach (client->thread);
+		++_abandoned;
+	}
+	pthread_mutex_unlock (_lock);
+
+	for (size_t n=0; n < finished.size(); ++n) {
+		Client * client = finished[n];
+		pthread_join (client->thread, NULL);
+
+		for (deque<Item>::iterator i = client->queue.begin(); i != client->queue.end(); ++i) {
+			free_item (*i);
+		}
+		pthread_cond_destroy (&client->cond);
+		delete client;
+	}
+
+	join_exited ();
+}
+
+void
+OscSender::client_exiting (Client * client)
+{
+	// with the lock held.  a new message to the url gets a new client
+	map<string, Client*>::iterator found = _clients.find (client->url);
+	if (found != _clients.end() && found->second == client) {
+		_clients.erase (found);
+	}
+	_exited.push_back (client);
+}
+
+void
+OscSender::join_exited ()
+{
+	vector<Client*> exited;
+
+	pthread_mutex_lock (_lock);
+	exited.swap (_exited);
+	pthread_mutex_unlock (_lock);
+
+	for (size_t n=0; n < exited.size(); ++n) {
+		Client * client = exited[n];
+		pthread_join (client->thread, NULL);
+
+		for (deque<Item>::iterator i = client->queue.begin(); i != client->queue.end(); ++i) {
+			free_item (*i);
+		}
+		pthread_cond_destroy (&client->cond);
+		delete client;
+	}
+}
+
+void
+OscSender::send (const string & url, const string & path, lo_message msg, int key_instance, int key_control)
+{
+	Item item;
+	item.path = path;
+	item.msgs.push_back (msg);
+	item.key_instance = key_instance;
+	item.key_control = key_control;
+	item.transfer = false;
+
+	push (url, item);
+}
+
+void
+OscSender::send_bundle (const string & url, const string & path, const vector<lo_message> & msgs)
+{
+	Item item;
+	item.path = path;
+	item.msgs = msgs;
+	item.key_instance = 0;
+	item.key_control = -1;
+	item.transfer = false;
+
+	push (url, item);
+}
+
+bool
+OscSender::send_transfer (const string & url, const string & path, const vector<lo_message> & msgs)
+{
+	Item item;
+	item.path = path;
+	item.key_instance = 0;
+	item.key_control = -1;
+	item.transfer = true;
+	item.queued_at = secs_now();
+
+	pthread_mutex_lock (_lock);
+
+	Client * client = _stopped ? 0 : get_client (url);
+
+	if (!client || client->transfer_queued + msgs.size() > MAX_TRANSFER_QUEUED) {
+		if (client) {
+			client->stats.dropped += msgs.size();
+		}
+		pthread_mutex_unlock (_lock);
+		item.msgs = msgs;
+		free_item (item);
+		return false;
+	}
+
+	for (size_t n=0; n < msgs.size(); ++n) {
+		client->queue.push_back (item);
+		client->queue.back().msgs.push_back (msgs[n]);
+	}
+	client->transfer_queued += msgs.size();
+
+	client->stats.queued = client->queue.size();
+	if (client->queue.size() > client->stats.max_queued) {
+		client->stats.max_queued = client->queue.size();
+	}
+
+	pthread_cond_signal (&client->cond);
+	pthread_mutex_unlock (_lock);
+
+	return true;
+}
+
+OscSender::Client *
+OscSender::get_client (const string & url)
+{
+	// with the lock held
+	map<string, Client*>::iterator found = _clients.find (url);
+	if (found != _clients.end()) {
+		return found->second;
+	}
+
+	if (_clients.size() >= MaxClients) {
+		if (!_full_warned) {
+			cerr << "sooperlooper: too many OSC clients, max is " << (int) MaxClients << ", dropping messages to " << url << endl;
+			_full_warned = true;
+		}
+		return 0;
+	}
+	_full_warned = false;
+
+	Client * client = new Client;
+	client->sender = this;
+	client->url = url;
+	client->stats.url = url;
+	pthread_cond_init (&client->cond, NULL);
+
+	if (pthread_create (&client->thread, NULL, OscSender::_thread_entry, client) != 0) {
+		cerr << "sooperlooper: could not start OSC sender thread for " << url << endl;
+		pthread_cond_destroy (&client->cond);
+		delete client;
+		return 0;
+	}
+
+	_clients[url] = client;
+	return client;
+}
+
+void
+OscSender::push (const string & url, Item & item)
+{
+	item.queued_at = secs_now();
+
+	pthread_mutex_lock (_lock);
+
+	Client * client = _stopped ? 0 : get_client (url);
+
+	if (!client) {
+		pthread_mutex_unlock (_lock);
+		free_item (item);
+		return;
+	}
+
+	deque<Item> & queue = client->queue;
+	// transfers waiting don't count, they are bounded on their own
+	size_t queued = queue.size() - client->transfer_queued;
+
+	if (item.key_control >= 0 && queued >= _max_queued) {
+		// full, a newer value for the same control takes the old one's place
+		for (deque<Item>::reverse_iterator i = queue.rbegin(); i != queue.rend(); ++i) {
+			if (i->key_control == item.key_control && i->key_instance == item.key_instance && i->path == item.path) {
+				free_item (*i);
+				i->msgs.swap (item.msgs);
+				client->stats.coalesced++;
+				pthread_mutex_unlock (_lock);
+				return;
+			}
+		}
+
+		// otherwise the oldest control value goes
+		for (deque<Item>::iterator i = queue.begin(); i != queue.end(); ++i) {
+			if (i->key_control >= 0) {
+				free_item (*i);
+				queue.erase (i);
+				client->stats.dropped++;
+				break;
+			}
+		}
+	}
+	else if (queued >= _max_queued * 4) {
+		// the oldest that isn't part of a transfer
+		for (deque<Item>::iterator i = queue.begin(); i != queue.end(); ++i) {
+			if (!i->transfer) {
+				free_item (*i);
+				queue.erase (i);
+				client->stats.dropped++;
+				break;
+			}
+		}
+	}
+
+	queue.push_back (item);
+
+	client->stats.queued = queue.size();
+	if (queue.size() > client->stats.max_queued) {
+		client->stats.max_queued = queue.size();
+	}
+
+	pthread_cond_signal (&client->cond);
+	pthread_mutex_unlock (_lock);
+}
+
+void
+OscSender::free_item (Item & item)
+{
+	for (size_t n=0; n < item.msgs.size(); ++n) {
+		lo_message_free (item.msgs[n]);
+	}
+	item.msgs.clear();
+}
+
+void
+OscSender::get_stats (vector<ClientStats> & stats)
+{
+	double now = secs_now();
+
+	pthread_mutex_lock (_lock);
+	stats.clear();
+	for (map<string, Client*>::iterator c = _clients.begin(); c != _clients.end(); ++c) {
+		stats.push_back (c->second->stats);
+		if (!c->second->queue.empty()) {
+			stats.back().waiting_ms = (now - c->second->queue.front().queued_at) * 1000.0;
+		}
+	}
+	pthread_mutex_unlock (_lock);
+}
+
+void
+OscSender::take_failed (vector<string> & urls)
+{
+	pthread_mutex_lock (_lock);
+	urls.swap (_failed);
+	_failed.clear();
+	pthread_mutex_unlock (_lock);
+
+	join_exited ();
+}
+
+void *
+OscSender::_thread_entry (void * arg)
+{
+	Client * client = static_cast<Client*> (arg);
+	client->sender->thread_run (client);
+	return 0;
+}
+
+void
+OscSender::thread_run (Client * client)
+{
+	SL_TRACE_THREAD("osc sender");
+
+	// once stop() gave up on this thread the sender may be gone, only
+	// the lock and the client can be touched after a send
+	pthread_mutex_t * lock = _lock;
+
+	pthread_mutex_lock (lock);
+
+	double idle_since = secs_now();
+
+	while (!client->quit)
+	{
+		if (client->queue.empty()) {
+			double now = secs_now();
+
+			if (now - idle_since >= CLIENT_IDLE_SECS) {
+				// nothing for a while, don't keep a thread around for it
+				client_exiting (client);
+				break;
+			}
+
+			double until = idle_since + CLIENT_IDLE_SECS;
+			struct timespec timeout;
+			timeout.tv_sec = (time_t) until;
+			timeout.tv_nsec = (long) ((until - timeout.tv_sec) * 1e9);
+			pthread_cond_timedwait (&client->cond, lock, &timeout);
+			continue;
+		}
+
+		Item item;
+		item.msgs.swap (client->queue.front().msgs);
+		item.path.swap (client->queue.front().path);
+		item.queued_at = client->queue.front().queued_at;
+		if (client->queue.front().transfer) {
+			client->transfer_queued--;
+		}
+		client->queue.pop_front();
+		client->stats.queued = client->queue.size();
+
+		pthread_mutex_unlock (lock);
+
+		if (!client->addr) {
+			client->addr = lo_address_new_from_url (client->url.c_str());
+		}
+
+		int ret = -1;
+
+		if (client->addr) {
+			SL_TRACE_SCOPE("osc send");
+
+			if (item.msgs.size() == 1) {
+				ret = lo_send_message (client->addr, item.path.c_str(), item.msgs[0]);
+			}
+			else {
+				lo_bundle bundle = lo_bundle_new (LO_TT_IMMEDIATE);
+				for (size_t n=0; n < item.msgs.size(); ++n) {
+					lo_bundle_add_message (bundle, item.path.c_str(), item.msgs[n]);
+				}
+				ret = lo_send_bundle (client->addr, bundle);
+				lo_bundle_free (bundle);
+			}
+		}
+
+		double lag = (secs_now() - item.queued_at) * 1000.0;
+		free_item (item);
+
+		pthread_mutex_lock (lock);
+
+		ClientStats & stats = client->stats;
+
+		if (ret < 0) {
+			if (client->addr) {
+				fprintf(stderr, "OSC error %d: %s\n", lo_address_errno(client->addr), lo_address_errstr(client->addr));
+				// a new address next time, a tcp peer may come back
+				lo_address_free (client->addr);
+				client->addr = 0;
+			}
+			stats.failed++;
+			stats.dropped += client->queue.size();
+			for (deque<Item>::iterator i = client->queue.begin(); i != client->queue.end(); ++i) {
+				free_item (*i);
+			}
+			client->queue.clear();
+			client->transfer_queued = 0;
+			stats.queued = 0;
+			_failed.push_back (client->url);
+			// a tcp peer may come back, it gets a new thread then
+			client_exiting (client);
+			break;
+		}
+
+		idle_since = secs_now();
+
+		stats.sent++;
+		stats.lag_ms = lag;
+		if (lag > stats.max_lag_ms) {
+			stats.max_lag_ms = lag;
+		}
+
+		if (!client->lagging && lag > LAG_WARN_MS) {
+			client->lagging = true;
+			fprintf (stderr, "sooperlooper: OSC client %s is %.0f ms behind, %u queued, %lu coalesced, %lu dropped\n",
+				 client->url.c_str(), lag, (unsigned int) client->queue.size(), stats.coalesced, stats.dropped);
+		}
+		else if (client->lagging && lag < LAG_OK_MS && client->queue.empty()) {
+			client->lagging = false;
+			fprintf (stderr, "sooperlooper: OSC client %s caught up\n", client->url.c_str());
+		}
+	}
+
+	client->done = true;
+	pthread_cond_signal (&client->cond);
+	pthread_mutex_unlock (lock);
+
+	if (client->addr) {
+		lo_address_free (client->addr);
+		client->addr = 0;
+	}
+}
@@ -0,0 +1,151 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+#ifndef __sooperlooper_osc_sender__
+#define __sooperlooper_osc_sender__
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include <lo/lo.h>
+
+/*
+ * Outbound OSC, one bounded queue per client url with its own sender
+ * thread, so a client that stops reading (a full unix socket, a stuck
+ * tcp peer) only ever blocks its own thread.  liblo has no non-blocking
+ * send, a thread per client is what keeps the others going.
+ *
+ * Messages that carry a value for one control can be given a key
+ * (instance, control).  When the queue is full, a newer message
+ * replaces the queued one with the same key and path, otherwise the
+ * oldest keyed message is dropped.  Unkeyed messages (replies, errors)
+ * are only dropped once the queue is far past its size.  Transfers
+ * (loop audio) are queued whole or refused, and are never dropped to
+ * make room.
+ *
+ * A client thread goes away when a send to it fails or after it has
+ * been idle for a while, the next message to that url starts a new one.
+ * There are at most MaxClients at once, messages to any other url are
+ * dropped until one goes away.
+ */
+
+namespace SooperLooper {
+
+class OscSender
+{
+  public:
+	enum { MaxClients = 64 };
+
+	OscSender (size_t max_queued=1024);
+	~OscSender ();
+
+	// takes ownership of msg.  key_control < 0 means it is never coalesced
+	void send (const std::string & url, const std::string & path, lo_message msg,
+		   int key_instance=0, int key_control=-1);
+
+	// every message to the same path in one bundle, takes ownership of msgs
+	void send_bundle (const std::string & url, const std::string & path, const std::vector<lo_message> & msgs);
+
+	// queues every message in order, or none of them and returns false when
+	// the client already has too much transfer data waiting.  takes ownership of msgs
+	bool send_transfer (const std::string & url, const std::string & path, const std::vector<lo_message> & msgs);
+
+	struct ClientStats
+	{
+		ClientStats() : queued(0), max_queued(0), sent(0), coalesced(0), dropped(0),
+				failed(0), lag_ms(0.0), max_lag_ms(0.0), waiting_ms(0.0) {}
+
+		std::string   url;
+		size_t        queued;
+		size_t        max_queued;
+		unsigned long sent;
+		unsigned long coalesced;
+		unsigned long dropped;
+		unsigned long failed;
+		double        lag_ms;     // how long the last sent message waited
+		double        max_lag_ms;
+		double        waiting_ms; // how long the oldest queued message has waited so far
+	};
+
+	void get_stats (std::vector<ClientStats> & stats);
+
+	// urls a send failed to since the last call, their queue is dropped.
+	// also cleans up the threads of clients that went away
+	void take_failed (std::vector<std::string> & urls);
+
+	// stops the threads, whatever is still queued is dropped.  a thread
+	// still stuck in a send after a short wait is left to finish on its own
+	void stop ();
+
+  private:
+	struct Item
+	{
+		std::string              path;
+		std::vector<lo_message>  msgs;
+		int                      key_instance;
+		int                      key_control;
+		bool                     transfer;
+		double                   queued_at;
+	};
+
+	struct Client
+	{
+		Client() : sender(0), transfer_queued(0), addr(0), quit(false), done(false), lagging(false) {}
+
+		OscSender *        sender;
+		std::string        url;
+		std::deque<Item>   queue;
+		size_t             transfer_queued;
+		lo_address         addr;  // sender thread only
+		pthread_t          thread;
+		pthread_cond_t     cond;
+		bool               quit;
+		bool               done;  // the thread is past its last use of the sender
+		bool               lagging;
+		ClientStats        stats;
+	};
+
+	Client * get_client (const std::string & url);
+	void push (const std::string & url, Item & item);
+	static void free_item (Item & item);
+	// with the lock held, the client's thread is on its way out
+	void client_exiting (Client * client);
+	void join_exited ();
+
+	static void * _thread_entry (void * arg);
+	void thread_run (Client * client);
+
+	std::map<std::string, Client*> _clients;
+	std::vector<std::string>       _failed;
+	std::vector<Client*>           _exited;
+
+	// on the heap, a thread left behind by stop() may still take it
+	pthread_mutex_t *  _lock;
+	size_t             _max_queued;
+	bool               _stopped;
+	bool               _full_warned;
+	int                _abandoned;
+};
+
+};
+
+#endif
@@ -31,6 +31,12 @@
 #include <cfloat>
 #include <iostream>
 
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <pthread.h>
+
 using namespace std;
 
 /*****************************************************************************/
@@ -72,6 +78,12 @@ using namespace SooperLooper;
 // another thing that shouldn't be hardcoded
 #define MAX_LOOPS 512
 
+// input latency delay line sizes (frames, powers of two).  it must hold
+// the input latency plus one period, latency itself is limited to 32k
+#define INPUT_LATENCY_BUF_MIN     256
+#define INPUT_LATENCY_BUF_DEFAULT 4096
+#define INPUT_LATENCY_BUF_MAX     65536
+
 
 #define SAFETY_FEEDBACK 0.96f
 
@@ -210,6 +222,392 @@ sl_read_current_loop_audio (LADSPA_Handle instance, float * buf, unsigned long f
 	return frames;
 }
 
+void
+sl_get_undo_counts (const LADSPA_Handle instance, unsigned long & undos, unsigned long & undo_alls, unsigned long & redos)
+{
+	const SooperLooperI * pLS = (const SooperLooperI *)instance;
+
+	if (!pLS) {
+		undos = undo_alls = redos = 0;
+		return;
+	}
+	undos = pLS->lUndoCount;
+	undo_alls = pLS->lUndoAllCount;
+	redos = pLS->lRedoCount;
+}
+
+unsigned long
+sl_get_loop_generation (const LADSPA_Handle instance)
+{
+	const SooperLooperI * pLS = (const SooperLooperI *)instance;
+
+	if (!pLS) return 0;
+
+	// ordered against the reads of the loop memory around it
+	__sync_synchronize();
+	unsigned long gen = pLS->lLoopGeneration;
+	__sync_synchronize();
+	return gen;
+}
+
+// true when a run() from the current state leaves the loop memory as it is.
+// conservative, anything that might write to it or switch loops is a change
+static inline bool loopMemoryQuiet (const SooperLooperI * pLS, int lMultiCtrl, bool feedbackPlay)
+{
+	switch (pLS->state) {
+	case STATE_PLAY:
+	case STATE_MUTE:
+	case STATE_PAUSED:
+	case STATE_OFF:
+	case STATE_OFF_MUTE:
+	case STATE_ONESHOT:
+	case STATE_TRIGGER_PLAY:
+		break;
+	default:
+		return false;
+	}
+
+	if (lMultiCtrl >= 0 || pLS->waitingForSync || feedbackPlay
+	    || pLS->fLoopFadeAtten != 0.0f || pLS->fFeedFadeAtten != 1.0f) {
+		return false;
+	}
+
+	// what fillLoops would still write
+	for (const LoopChunk * loop = pLS->headLoopChunk; loop; loop = loop->srcloop) {
+		if (!loop->valid || !(loop->frontfill || loop->backfill)) break;
+		return false;
+	}
+
+	return true;
+}
+
+static __thread float sl_instantiate_secs = 0.0f;
+
+void
+sl_set_instantiate_secs (float secs)
+{
+	sl_instantiate_secs = secs;
+}
+
+static volatile int sl_loop_memory_mode = LoopMemoryHeap;
+
+void
+sl_set_loop_memory_mode (int mode)
+{
+	if (mode < LoopMemoryHeap || mode > LoopMemoryHugeTLB) {
+		mode = LoopMemoryHeap;
+	}
+	sl_loop_memory_mode = mode;
+}
+
+int
+sl_get_loop_memory_mode ()
+{
+	return sl_loop_memory_mode;
+}
+
+int
+sl_get_loop_memory_backing (const LADSPA_Handle instance)
+{
+	const SooperLooperI * pLS = (const SooperLooperI *)instance;
+
+	if (!pLS || !pLS->pSampleBuf) return LoopMemoryHeap;
+
+	return pLS->iSampleBufBacking;
+}
+
+void
+sl_get_loop_memory_huge_bytes (const LADSPA_Handle * instances, unsigned long count, unsigned long * bytes)
+{
+	bool want_smaps = false;
+
+	for (unsigned long n=0; n < count; ++n) {
+		const SooperLooperI * pLS = (const SooperLooperI *)instances[n];
+		bytes[n] = 0;
+
+		if (!pLS || !pLS->pSampleBuf) continue;
+
+		if (pLS->iSampleBufBacking == LoopMemoryHugeTLB) {
+			// nothing else can back those
+			bytes[n] = pLS->lSampleBufBytes;
+		}
+		else if (pLS->iSampleBufBacking == LoopMemoryTransparentHuge) {
+			want_smaps = true;
+		}
+	}
+
+#ifdef __linux__
+	if (!want_smaps) {
+		return;
+	}
+
+	FILE * smaps = fopen ("/proc/self/smaps", "r");
+	if (!smaps) {
+		return;
+	}
+
+	char line[256];
+	unsigned long lo = 0, hi = 0, kb;
+
+	while (fgets (line, sizeof(line), smaps)) {
+		unsigned long start, end;
+
+		if (sscanf (line, "%lx-%lx ", &start, &end) == 2) {
+			lo = start;
+			hi = end;
+			continue;
+		}
+		if (sscanf (line, "AnonHugePages: %lu kB", &kb) != 1 || kb == 0) {
+			continue;
+		}
+
+		for (unsigned long n=0; n < count; ++n) {
+			const SooperLooperI * pLS = (const SooperLooperI *)instances[n];
+
+			if (!pLS || !pLS->pSampleBuf || pLS->iSampleBufBacking != LoopMemoryTransparentHuge) continue;
+
+			unsigned long mstart = (unsigned long) pLS->pSampleBuf;
+			unsigned long mend = mstart + pLS->lSampleBufBytes;
+			if (mstart >= hi || mend <= lo) continue;
+
+			unsigned long overlap = min (mend, hi) - max (mstart, lo);
+			bytes[n] = min (bytes[n] + min (kb * 1024, overlap), pLS->lSampleBufBytes);
+		}
+	}
+
+	fclose (smaps);
+#endif
+}
+
+#ifdef __linux__
+
+#define HUGEPAGE_DEFAULT_BYTES (2UL * 1024 * 1024)
+
+static unsigned long
+huge_page_bytes ()
+{
+	static unsigned long hpbytes = 0;
+
+	if (hpbytes == 0) {
+		unsigned long kb = 0;
+		char line[128];
+		FILE * meminfo = fopen ("/proc/meminfo", "r");
+
+		if (meminfo) {
+			while (fgets (line, sizeof(line), meminfo)) {
+				if (sscanf (line, "Hugepagesize: %lu kB", &kb) == 1) {
+					break;
+				}
+			}
+			fclose (meminfo);
+		}
+
+		hpbytes = kb ? kb * 1024 : HUGEPAGE_DEFAULT_BYTES;
+	}
+
+	return hpbytes;
+}
+
+#endif
+
+/* allocate zeroed loop sample memory, trying the requested backing first.
+   anonymous mappings come zeroed and untouched, like calloc. */
+#ifdef __linux__
+
+/* released loop memory kept for reuse instead of going back to the os.
+   only mapped memory is kept, after MADV_DONTNEED so it holds no pages
+   and reads back zeroed.  a buffer is only reused for the same size
+   and requested mode, which is the common case of loops of equal length. */
+
+#define LOOP_MEMORY_POOL_MAX 256
+
+struct LoopMemoryPoolEntry
+{
+	void *        mem;
+	unsigned long nbytes;
+	int           mode;
+	int           backing;
+};
+
+static pthread_mutex_t sl_loop_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static LoopMemoryPoolEntry sl_loop_pool[LOOP_MEMORY_POOL_MAX];
+static int sl_loop_pool_count = 0;
+static unsigned long sl_loop_pool_bytes = 0;
+static unsigned long sl_loop_pool_max_bytes = 0;
+
+static void *
+pool_take (unsigned long nbytes, int mode, int * backing)
+{
+	void * mem = 0;
+
+	pthread_mutex_lock (&sl_loop_pool_lock);
+	for (int n=0; n < sl_loop_pool_count; ++n) {
+		if (sl_loop_pool[n].nbytes == nbytes && sl_loop_pool[n].mode == mode) {
+			mem = sl_loop_pool[n].mem;
+			*backing = sl_loop_pool[n].backing;
+			sl_loop_pool_bytes -= nbytes;
+			sl_loop_pool[n] = sl_loop_pool[--sl_loop_pool_count];
+			break;
+		}
+	}
+	pthread_mutex_unlock (&sl_loop_pool_lock);
+
+	return mem;
+}
+
+static bool
+pool_give (void * mem, unsigned long nbytes, int mode, int backing)
+{
+	bool kept = false;
+
+	pthread_mutex_lock (&sl_loop_pool_lock);
+	if (sl_loop_pool_count < LOOP_MEMORY_POOL_MAX && sl_loop_pool_bytes + nbytes <= sl_loop_pool_max_bytes) {
+		sl_loop_pool[sl_loop_pool_count].mem = mem;
+		sl_loop_pool[sl_loop_pool_count].nbytes = nbytes;
+		sl_loop_pool[sl_loop_pool_count].mode = mode;
+		sl_loop_pool[sl_loop_pool_count].backing = backing;
+		++sl_loop_pool_count;
+		sl_loop_pool_bytes += nbytes;
+		kept = true;
+	}
+	pthread_mutex_unlock (&sl_loop_pool_lock);
+
+	return kept;
+}
+
+#endif
+
+void
+sl_set_loop_memory_pool (unsigned long maxbytes)
+{
+#ifdef __linux__
+	pthread_mutex_lock (&sl_loop_pool_lock);
+	sl_loop_pool_max_bytes = maxbytes;
+
+	// drop what no longer fits
+	while (sl_loop_pool_count > 0 && sl_loop_pool_bytes > sl_loop_pool_max_bytes) {
+		LoopMemoryPoolEntry & entry = sl_loop_pool[--sl_loop_pool_count];
+		munmap (entry.mem, entry.nbytes);
+		sl_loop_pool_bytes -= entry.nbytes;
+	}
+	pthread_mutex_unlock (&sl_loop_pool_lock);
+#endif
+}
+
+unsigned long
+sl_get_loop_memory_pool (unsigned long * maxbytes)
+{
+	unsigned long bytes = 0;
+
+#ifdef __linux__
+	pthread_mutex_lock (&sl_loop_pool_lock);
+	bytes = sl_loop_pool_bytes;
+	if (maxbytes) *maxbytes = sl_loop_pool_max_bytes;
+	pthread_mutex_unlock (&sl_loop_pool_lock);
+#else
+	if (maxbytes) *maxbytes = 0;
+#endif
+	return bytes;
+}
+
+static LADSPA_Data *
+alloc_loop_memory (unsigned long frames, int mode, int * backing, unsigned long * nbytes)
+{
+	unsigned long bytes = frames * sizeof(LADSPA_Data);
+	void * mem;
+
+#ifdef __linux__
+	static bool warned = false;
+	unsigned long hpbytes = huge_page_bytes();
+	unsigned long hpsize = (bytes + hpbytes - 1) & ~(hpbytes - 1);
+	unsigned long pgbytes = sysconf (_SC_PAGESIZE);
+	unsigned long pgsize = (bytes + pgbytes - 1) & ~(pgbytes - 1);
+
+	if ((mem = pool_take (mode == LoopMemoryHeap ? pgsize : hpsize, mode, backing)) != 0) {
+		*nbytes = mode == LoopMemoryHeap ? pgsize : hpsize;
+		return (LADSPA_Data *) mem;
+	}
+
+#ifdef MAP_HUGETLB
+	if (mode == LoopMemoryHugeTLB) {
+		mem = mmap (0, hpsize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+		if (mem != MAP_FAILED) {
+			*backing = LoopMemoryHugeTLB;
+			*nbytes = hpsize;
+			return (LADSPA_Data *) mem;
+		}
+		if (!warned) {
+			fprintf (stderr, "sooperlooper: no hugetlb pages available for loop memory (see /proc/sys/vm/nr_hugepages), trying transparent huge pages\n");
+			warned = true;
+		}
+		mode = LoopMemoryTransparentHuge;
+	}
+#endif
+
+#ifdef MADV_HUGEPAGE
+	if (mode == LoopMemoryTransparentHuge) {
+		// over map by one huge page so the region can be trimmed to alignment
+		char * base = (char *) mmap (0, hpsize + hpbytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+
+		if (base != MAP_FAILED) {
+			char * aligned = (char *) (((unsigned long) base + hpbytes - 1) & ~(hpbytes - 1));
+			unsigned long head = aligned - base;
+
+			if (head) {
+				munmap (base, head);
+			}
+			munmap (aligned + hpsize, hpbytes - head);
+
+			if (madvise (aligned, hpsize, MADV_HUGEPAGE) == 0) {
+				*backing = LoopMemoryTransparentHuge;
+			}
+			else {
+				if (!warned) {
+					fprintf (stderr, "sooperlooper: transparent huge pages not available for loop memory\n");
+					warned = true;
+				}
+				*backing = LoopMemoryHeap;
+			}
+			*nbytes = hpsize;
+			return (LADSPA_Data *) aligned;
+		}
+	}
+#endif
+
+	// with a pool, plain heap loops are mapped too so they can go back in it
+	if (sl_loop_pool_max_bytes > 0) {
+		mem = mmap (0, pgsize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (mem != MAP_FAILED) {
+			*backing = LoopMemoryHeap;
+			*nbytes = pgsize;
+			return (LADSPA_Data *) mem;
+		}
+	}
+#endif
+
+	mem = calloc (frames, sizeof(LADSPA_Data));
+	*backing = LoopMemoryHeap;
+	*nbytes = 0;
+	return (LADSPA_Data *) mem;
+}
+
+static void
+free_loop_memory (LADSPA_Data * mem, unsigned long nbytes, int mode, int backing)
+{
+#ifdef __linux__
+	if (nbytes) {
+		// drop the pages either way, a pooled buffer keeps only the mapping
+		if (sl_loop_pool_max_bytes > 0 && madvise (mem, nbytes, MADV_DONTNEED) == 0
+		    && pool_give (mem, nbytes, mode, backing)) {
+			return;
+		}
+		munmap (mem, nbytes);
+		return;
+	}
+#endif
+	free (mem);
+}
+
 void
 sl_set_samples_since_sync (LADSPA_Handle instance, unsigned long frames)
 {
@@ -256,6 +654,159 @@ bool sl_has_loop (const LADSPA_Handle instance)
         return pLS->headLoopChunk != 0;
 }
 
+void
+sl_set_control_output_mode (LADSPA_Handle instance, int mode)
+{
+	SooperLooperI * pLS = (SooperLooperI *)instance;
+	if (!pLS) return;
+	pLS->iOutputMode = mode;
+}
+
+static inline void
+publishControlOutputs (SooperLooperI * pLS)
+{
+	if (pLS->pfSecsFree) {
+		*pLS->pfSecsFree = pLS->lBufferSize / pLS->fSampleRate;
+	}
+	if (pLS->pfLoopPos) {
+		*pLS->pfLoopPos = (LADSPA_Data) pLS->lOutLoopPos / pLS->fSampleRate;
+	}
+	if (pLS->pfLoopLength) {
+		*pLS->pfLoopLength = (LADSPA_Data) pLS->lOutLoopLength / pLS->fSampleRate;
+	}
+	if (pLS->pfCycleLength) {
+		*pLS->pfCycleLength = (LADSPA_Data) pLS->lOutCycleLength / pLS->fSampleRate;
+	}
+}
+
+void
+sl_publish_control_outputs (LADSPA_Handle instance)
+{
+	SooperLooperI * pLS = (SooperLooperI *)instance;
+	if (!pLS) return;
+	publishControlOutputs (pLS);
+}
+
+void
+sl_get_loop_frames (const LADSPA_Handle instance, unsigned long & pos, unsigned long & length, unsigned long & cycle)
+{
+	const SooperLooperI * pLS = (const SooperLooperI *)instance;
+
+	if (!pLS) {
+		pos = length = cycle = 0;
+		return;
+	}
+	pos = pLS->lOutLoopPos;
+	length = pLS->lOutLoopLength;
+	cycle = pLS->lOutCycleLength;
+}
+
+unsigned long
+sl_get_input_latency_capacity (const LADSPA_Handle instance)
+{
+	const SooperLooperI * pLS = (const SooperLooperI *)instance;
+	if (!pLS) return 0;
+	return pLS->lInputBufSize;
+}
+
+bool
+sl_resize_input_latency_buffer (LADSPA_Handle instance, unsigned long frames)
+{
+	SooperLooperI * pLS = (SooperLooperI *)instance;
+	if (!pLS) return false;
+
+	// must stay a power of two for the mask
+	unsigned long size = INPUT_LATENCY_BUF_MIN;
+	while (size < frames && size < INPUT_LATENCY_BUF_MAX) {
+		size <<= 1;
+	}
+
+	if (size == pLS->lInputBufSize) {
+		return true;
+	}
+
+	LADSPA_Data * buf = (LADSPA_Data *) calloc(size, sizeof(LADSPA_Data));
+	if (!buf) {
+		return false;
+	}
+
+	free (pLS->pInputBuf);
+	pLS->pInputBuf = buf;
+	pLS->lInputBufSize = size;
+	pLS->lInputBufMask = size - 1;
+	pLS->lInputBufWritePos = 0;
+	pLS->lInputBufReadPos = 0;
+
+	return true;
+}
+
+bool
+sl_is_idle (const LADSPA_Handle instance)
+{
+	const SooperLooperI * pLS = (const SooperLooperI *)instance;
+	if (!pLS || !pLS->pfMultiCtrl || !pLS->pfTapCtrl) return false;
+
+	// what a run() in this state could do besides passing the input through
+	// is start on a command or tap, or finish something it was waiting for
+	return (pLS->state == STATE_OFF || pLS->state == STATE_OFF_MUTE)
+		&& !pLS->headLoopChunk
+		&& !pLS->waitingForSync
+		&& !pLS->rounding
+		&& pLS->fNextCurrRate == 0.0f
+		&& (long) (*pLS->pfMultiCtrl) < 0
+		&& *pLS->pfTapCtrl == pLS->fLastTapCtrl;
+}
+
+void
+sl_run_idle (LADSPA_Handle instance, const LADSPA_Data * input, unsigned long SampleCount)
+{
+	SooperLooperI * pLS = (SooperLooperI *)instance;
+	if (!pLS) return;
+
+	if (input) {
+		unsigned long wpos = pLS->lInputBufWritePos;
+		for (unsigned long n=0; n < SampleCount; ++n) {
+			pLS->pInputBuf[wpos] = input[n];
+			wpos = (wpos+1) & pLS->lInputBufMask;
+		}
+	}
+	pLS->lInputBufWritePos = (pLS->lInputBufWritePos + SampleCount) & pLS->lInputBufMask;
+
+	// the bookkeeping run() does at the end of every block
+	pLS->lLastMultiCtrl = (long) (*pLS->pfMultiCtrl);
+	pLS->lScratchSamples += SampleCount;
+	pLS->lTapTrigSamples += SampleCount;
+
+	pLS->fWetCurr = pLS->fWetTarget = LIMIT_BETWEEN_0_AND_1(*pLS->pfWet);
+	pLS->fDryCurr = pLS->fDryTarget = LIMIT_BETWEEN_0_AND_1(*pLS->pfDry);
+	pLS->fFeedbackCurr = pLS->fFeedbackTarget = LIMIT_BETWEEN_0_AND_1(*pLS->pfFeedback);
+	*pLS->pfFeedback = pLS->fFeedbackCurr;
+
+	if (pLS->pfScratchPos) {
+		pLS->fScratchPosCurr = pLS->fScratchPosTarget = LIMIT_BETWEEN_0_AND_1(*pLS->pfScratchPos);
+	}
+}
+
+void
+sl_fill_input_history (LADSPA_Handle instance, const LADSPA_Data * data, unsigned long frames, unsigned long before)
+{
+	SooperLooperI * pLS = (SooperLooperI *)instance;
+	if (!pLS || before >= pLS->lInputBufSize) return;
+
+	// whatever would wrap onto the newer frames is dropped from the front
+	if (before + frames > pLS->lInputBufSize) {
+		unsigned long skip = before + frames - pLS->lInputBufSize;
+		data += skip;
+		frames -= skip;
+	}
+
+	unsigned long wpos = (pLS->lInputBufWritePos - before - frames) & pLS->lInputBufMask;
+	for (unsigned long n=0; n < frames; ++n) {
+		pLS->pInputBuf[wpos] = data[n];
+		wpos = (wpos+1) & pLS->lInputBufMask;
+	}
+}
+
 static bool invalidateTails (SooperLooperI * pLS, unsigned long bufstart, unsigned long buflen, LoopChunk * currloop)
 {
 	LoopChunk * tailLoop = pLS->tailLoopChunk;
@@ -510,8 +1061,10 @@ instantiateSooperLooper(const LADSPA_Descriptor * Descriptor,
    pLS->fTotalSecs = SAMPLE_MEMORY;
    
    // HACK for the moment!
-   sampmem = getenv("SL_SAMPLE_TIME");
-   if (sampmem != NULL) {
+   if (sl_instantiate_secs > 0.0f) {
+	   pLS->fTotalSecs = sl_instantiate_secs;
+   }
+   else if ((sampmem = getenv("SL_SAMPLE_TIME")) != NULL) {
 	   if (sscanf(sampmem, "%f", &pLS->fTotalSecs) != 1) {
 		   pLS->fTotalSecs = SAMPLE_MEMORY;
 	   }
@@ -528,7 +1081,8 @@ instantiateSooperLooper(const LADSPA_Descriptor * Descriptor,
    // not using calloc to force touching all memory ahead of time 
    // this could be bad if you try to allocate too much for your system
    // well, we are using calloc again... so sad
-   pLS->pSampleBuf = (LADSPA_Data *) calloc(pLS->lBufferSize,  sizeof(LADSPA_Data));
+   pLS->iSampleBufMode = sl_loop_memory_mode;
+   pLS->pSampleBuf = alloc_loop_memory (pLS->lBufferSize, pLS->iSampleBufMode, &pLS->iSampleBufBacking, &pLS->lSampleBufBytes);
    if (pLS->pSampleBuf == NULL) {
 	   goto cleanup;
    }
@@ -547,8 +1101,9 @@ instantiateSooperLooper(const LADSPA_Descriptor * Descriptor,
 
    pLS->lastLoopChunk = pLS->pLoopChunks + pLS->lLoopChunkCount - 1;
 
-   // this is the input buffer to handle input latency.  32k max samples of input latency
-   pLS->lInputBufSize = 32768;
+   // this is the input buffer to handle input latency.  it starts small,
+   // the host resizes it once it knows the latency and period size
+   pLS->lInputBufSize = INPUT_LATENCY_BUF_DEFAULT;
    pLS->lInputBufMask = pLS->lInputBufSize - 1;
    pLS->pInputBuf = (LADSPA_Data *) calloc(pLS->lInputBufSize, sizeof(LADSPA_Data));
    pLS->lInputBufWritePos = 0;
@@ -562,6 +1117,10 @@ instantiateSooperLooper(const LADSPA_Descriptor * Descriptor,
    pLS->state = STATE_OFF;
    pLS->wasMuted = false;
    pLS->recSyncEnded = false;
+   pLS->lLoopGeneration = 0;
+   pLS->lUndoCount = 0;
+   pLS->lUndoAllCount = 0;
+   pLS->lRedoCount = 0;
    
    DBG(fprintf(stderr,"%u:%u  instantiated with buffersize: %lu\n", pLS->lLoopIndex, pLS->lChannelIndex, pLS->lBufferSize));
 
@@ -577,7 +1136,7 @@ instantiateSooperLooper(const LADSPA_Descriptor * Descriptor,
 cleanup:
 
    if (pLS->pSampleBuf) {
-	   free (pLS->pSampleBuf);
+	   free_loop_memory (pLS->pSampleBuf, pLS->lSampleBufBytes, pLS->iSampleBufMode, pLS->iSampleBufBacking);
    }
    if (pLS->pLoopChunks) {
 	   free (pLS->pLoopChunks);
@@ -601,7 +1160,11 @@ cleanupSooperLooper(LADSPA_Handle Instance) {
 	}
 	
 	if (pLS->pSampleBuf) {
-		free (pLS->pSampleBuf);
+		free_loop_memory (pLS->pSampleBuf, pLS->lSampleBufBytes, pLS->iSampleBufMode, pLS->iSampleBufBacking);
+	}
+
+	if (pLS->pInputBuf) {
+		free (pLS->pInputBuf);
 	}
 	
 	//cerr << "******* cleanup SL instance" << endl;
@@ -680,7 +1243,12 @@ activateSooperLooper(LADSPA_Handle Instance) {
   memset (pLS->pInputBuf, 0, pLS->lInputBufSize * sizeof(LADSPA_Data));
   
   clearLoopChunks(pLS);
+  // the loop is gone, a reader in the middle of a copy must notice
+  __sync_add_and_fetch (&pLS->lLoopGeneration, 2);
 
+  pLS->lOutLoopPos = 0;
+  pLS->lOutLoopLength = 0;
+  pLS->lOutCycleLength = 0;
 
   if (pLS->pfSecsTotal) {
      *pLS->pfSecsTotal = (LADSPA_Data) pLS->fTotalSecs;
@@ -1814,6 +2382,13 @@ runSooperLooper(LADSPA_Handle Instance,
      pLS->lLastMultiCtrl = lMultiCtrl;
   }
 
+  // readers of the loop memory see an odd generation for as long as this
+  // run may write to it
+  bool memQuiet = loopMemoryQuiet (pLS, lMultiCtrl, useFeedbackPlay && (*pLS->pfFeedback < 1.0f || pLS->fFeedbackCurr < 1.0f));
+  if (!memQuiet) {
+     __sync_add_and_fetch (&pLS->lLoopGeneration, 1);
+  }
+
   // force use delay
   if (lMultiCtrl == MULTI_REDO && *pLS->pfRedoTapMode != 0)
   {
@@ -2845,12 +3420,14 @@ runSooperLooper(LADSPA_Handle Instance,
 							pLS->state = STATE_UNDO;
 							pLS->nextState = STATE_PLAY;
 						}
+						pLS->lUndoCount++;
 					} else {
 							LoopChunk *dead;
    						dead = pLS->headLoopChunk;
 							//only go back into off if this is the only action undone
    						if (dead && (!dead->next)) {
 								pLS->state = STATE_UNDO_ALL;
+								pLS->lUndoCount++;
    						}
 					}
 
@@ -2891,6 +3468,7 @@ runSooperLooper(LADSPA_Handle Instance,
 			
 			if (loop && loop->lLoopLength) {
 				pLS->state = STATE_UNDO_ALL;
+				pLS->lUndoAllCount++;
 				
 				pLS->fLoopFadeDelta = -1.0f / (xfadeSamples);
 				pLS->fPlayFadeDelta = -1.0f / xfadeSamples;// fade out for undo all
@@ -2914,6 +3492,9 @@ runSooperLooper(LADSPA_Handle Instance,
 		if (!loop || (pLS->state == STATE_MUTE)) {
 			lastloop = pLS->headLoopChunk;
 			redoLoop(pLS);
+			if (pLS->headLoopChunk != lastloop) {
+				pLS->lRedoCount++;
+			}
 			 
 			while (pLS->headLoopChunk != lastloop) {
 			lastloop = pLS->headLoopChunk;
@@ -2926,6 +3507,7 @@ runSooperLooper(LADSPA_Handle Instance,
 			if (loop->next) {
 				pLS->state = STATE_REDO_ALL;
 				pLS->nextState = STATE_PLAY;
+				pLS->lRedoCount++;
 			}
 		}
 		
@@ -2970,7 +3552,11 @@ runSooperLooper(LADSPA_Handle Instance,
 			   
 			   if (!loop || pLS->state == STATE_MUTE) {
 				   // we don't need a fadeout
+				   LoopChunk * before = pLS->headLoopChunk;
 				   redoLoop(pLS);
+				   if (pLS->headLoopChunk != before) {
+					   pLS->lRedoCount++;
+				   }
 				   if (!pLS->headLoopChunk) {
                        pLS->state = pLS->wasMuted ? STATE_OFF_MUTE : STATE_OFF;
 				   }
@@ -2980,6 +3566,7 @@ runSooperLooper(LADSPA_Handle Instance,
 					   pLS->state = STATE_REDO;
 					   pLS->nextState = STATE_PLAY;
 					   pLS->fPlayFadeAtten = 0.0f;
+					   pLS->lRedoCount++;
 				   }
 			   }
 			   
@@ -4752,6 +5339,28 @@ runSooperLooper(LADSPA_Handle Instance,
   pLS->fScratchPosCurr = scratchTarget;
   pLS->fScratchPosTarget = scratchTarget;
   
+  pLS->lInputBufWritePos = (pLS->lInputBufWritePos + SampleCount) & pLS->lInputBufMask;
+
+  if (!memQuiet) {
+     // even again, and different from before
+     __sync_add_and_fetch (&pLS->lLoopGeneration, 1);
+  }
+
+  if (loop) {
+     pLS->lOutLoopPos = (unsigned long) loop->dCurrPos;
+     pLS->lOutLoopLength = loop->lLoopLength;
+     pLS->lOutCycleLength = loop->lCycleLength;
+  }
+  else {
+     pLS->lOutLoopPos = 0;
+     pLS->lOutLoopLength = 0;
+     pLS->lOutCycleLength = 0;
+  }
+
+  if (pLS->iOutputMode == OUTPUTS_NONE) {
+     return;
+  }
+  
   // update output ports
   *pLS->pfStateOut = (LADSPA_Data) pLS->state;
 
@@ -4763,46 +5372,15 @@ runSooperLooper(LADSPA_Handle Instance,
 
   *pLS->pfRateOutput = (LADSPA_Data) pLS->fCurrRate *  (*pLS->pfRate);
 
-
-  pLS->lInputBufWritePos = (pLS->lInputBufWritePos + SampleCount) & pLS->lInputBufMask;
-
-  
-  if (pLS->pfSecsFree) {
-	  *pLS->pfSecsFree = pLS->lBufferSize / pLS->fSampleRate;
-//      *pLS->pfSecsFree = (pLS->fTotalSecs) -
-// 	(pLS->headLoopChunk ?
-// 	 ((((unsigned)pLS->headLoopChunk->pLoopStop - (unsigned)pLS->pSampleBuf)
-// 	  / sizeof(LADSPA_Data)) / pLS->fSampleRate)   :
-// 	 0);
-  }
-  
-  if (loop) {
-     if (pLS->pfLoopPos)
-	*pLS->pfLoopPos = (LADSPA_Data) (loop->dCurrPos / pLS->fSampleRate);
-
-     if (pLS->pfLoopLength)
-	*pLS->pfLoopLength = ((LADSPA_Data) loop->lLoopLength) / pLS->fSampleRate;
-
-     if (pLS->pfCycleLength)
-	*pLS->pfCycleLength = ((LADSPA_Data) loop->lCycleLength) / pLS->fSampleRate;
-
-
-     
-  }
-  else {
-     if (pLS->pfLoopPos)
-	*pLS->pfLoopPos = 0.0f;
-     if (pLS->pfLoopLength)
-	*pLS->pfLoopLength = 0.0f;     
-     if (pLS->pfCycleLength)
-	*pLS->pfCycleLength = 0.0f;
-
+  if (!loop) {
      if (pLS->pfStateOut && pLS->state != STATE_OFF_MUTE  && pLS->state != STATE_MUTE && pLS->state != STATE_TRIG_START)
 	*pLS->pfStateOut = (LADSPA_Data) STATE_OFF;
+  }
 
+  // the seconds outputs cost a few divides, a deferring host publishes them itself
+  if (pLS->iOutputMode == OUTPUTS_EVERY_RUN) {
+     publishControlOutputs (pLS);
   }
-  
-  
 }
 
 
@@ -79,6 +79,13 @@ enum AudioPort {
 	PORT_COUNT // must be last
 };
 
+// how runSooperLooper updates the control outputs, see sl_set_control_output_mode
+enum {
+	OUTPUTS_EVERY_RUN = 0,
+	OUTPUTS_DEFERRED,
+	OUTPUTS_NONE
+};
+
 enum {
 	QUANT_OFF=0,
 	QUANT_CYCLE,
@@ -86,6 +93,13 @@ enum {
 	QUANT_LOOP
 };
 
+// how a loop's sample memory is backed, see sl_set_loop_memory_mode
+enum LoopMemoryBacking {
+	LoopMemoryHeap = 0,
+	LoopMemoryTransparentHuge,
+	LoopMemoryHugeTLB
+};
+
 enum LooperState
 {
 	LooperStateUnknown = -1,
@@ -178,6 +192,11 @@ typedef struct {
 	/* the sample memory */
 	//LADSPA_Data * pfSampleBuf;
 	LADSPA_Data * pSampleBuf;
+	// requested mode (the pool key), LoopMemoryBacking actually obtained,
+	// and the mapped size for unmapping
+	int iSampleBufMode;
+	int iSampleBufBacking;
+	unsigned long lSampleBufBytes;
     
 	unsigned int lLoopIndex;
 	unsigned int lChannelIndex;
@@ -385,6 +404,21 @@ typedef struct {
 	LADSPA_Data * pfWaiting;    
 	LADSPA_Data * pfRateOutput;
 	LADSPA_Data * pfNextStateOut;    
+
+	/* loop position and lengths in frames, kept up to date every run.
+	   the seconds outputs above are derived from these */
+	unsigned long lOutLoopPos;
+	unsigned long lOutLoopLength;
+	unsigned long lOutCycleLength;
+	int iOutputMode;
+
+	// odd while a run may be changing the loop memory, moves on after it
+	volatile unsigned long lLoopGeneration;
+
+	// undo, undo all and redo commands that actually moved the loop history
+	unsigned long lUndoCount;
+	unsigned long lUndoAllCount;
+	unsigned long lRedoCount;
 	
 } SooperLooperI;
 
@@ -394,6 +428,15 @@ typedef struct {
 // available returns amount read.  if 0 is returned loop is done.
 extern unsigned long sl_read_current_loop_audio (LADSPA_Handle instance, float * buf, unsigned long frames, unsigned long loop_offset);
 
+// odd while a run() may be changing the loop audio, and different after one that
+// may have.  taken before and after sl_read_current_loop_audio it tells a reader
+// off the rt thread whether what it read is consistent.
+extern unsigned long sl_get_loop_generation (const LADSPA_Handle instance);
+
+// how many undo, undo all and redo commands took effect since instantiation,
+// a command with nothing to undo or redo isn't counted.  rt thread
+extern void sl_get_undo_counts (const LADSPA_Handle instance, unsigned long & undos, unsigned long & undo_alls, unsigned long & redos);
+
 // override current samples since sync
 extern void sl_set_samples_since_sync (LADSPA_Handle instance, unsigned long frames);
 
@@ -403,4 +446,51 @@ extern void sl_set_loop_index (LADSPA_Handle instance, unsigned int index, unsig
 
 extern bool sl_has_loop (const LADSPA_Handle instance);
 
+// OUTPUTS_EVERY_RUN (the default) writes all control outputs at the end of every run.
+// OUTPUTS_DEFERRED only writes state, waiting and rate there, the seconds outputs are
+// written by sl_publish_control_outputs.  OUTPUTS_NONE writes no outputs at all.
+extern void sl_set_control_output_mode (LADSPA_Handle instance, int mode);
+extern void sl_publish_control_outputs (LADSPA_Handle instance);
+
+// current loop position, loop length and cycle length in frames, always up to date
+extern void sl_get_loop_frames (const LADSPA_Handle instance, unsigned long & pos, unsigned long & length, unsigned long & cycle);
+
+// the input latency delay line.  resizing is not rt safe and must not run
+// concurrently with run(), the old contents are discarded.
+extern unsigned long sl_get_input_latency_capacity (const LADSPA_Handle instance);
+extern bool sl_resize_input_latency_buffer (LADSPA_Handle instance, unsigned long frames);
+
+// true while run() would do nothing but pass the input through (no loop, nothing
+// pending).  a host can then call sl_run_idle instead, which only keeps the
+// input delay line and the per block bookkeeping going.  input may be null,
+// the delay line then needs sl_fill_input_history before the next run().
+extern bool sl_is_idle (const LADSPA_Handle instance);
+extern void sl_run_idle (LADSPA_Handle instance, const LADSPA_Data * input, unsigned long frames);
+// rewrites part of the input delay line: data is the audio that ended 'before' frames ago
+extern void sl_fill_input_history (LADSPA_Handle instance, const LADSPA_Data * data, unsigned long frames, unsigned long before);
+
+// loop memory in seconds for the next instantiate from the calling thread only,
+// 0 falls back to SL_SAMPLE_TIME.  lets loops be instantiated from several threads at once.
+extern void sl_set_instantiate_secs (float secs);
+
+// preferred loop memory backing for loops instantiated from now on (process wide).
+// LoopMemoryHugeTLB falls back to LoopMemoryTransparentHuge, which falls back to the heap.
+extern void sl_set_loop_memory_mode (int mode);
+extern int sl_get_loop_memory_mode ();
+
+// the LoopMemoryBacking this instance got
+extern int sl_get_loop_memory_backing (const LADSPA_Handle instance);
+
+// fills bytes[n] with how much of instances[n]'s loop memory really is in huge
+// pages right now.  transparent huge pages are read from /proc/self/smaps in
+// one pass, the kernel may not have given any yet even though we asked.
+// neighbouring loops can share a mapping, their share of it is an estimate.
+extern void sl_get_loop_memory_huge_bytes (const LADSPA_Handle * instances, unsigned long count, unsigned long * bytes);
+
+// keep up to maxbytes of released loop memory mapped (but without pages) for
+// new loops of the same size, instead of unmapping it.  0 (the default) disables.
+// returns the bytes currently pooled.  linux only, elsewhere it is a no-op.
+extern void sl_set_loop_memory_pool (unsigned long maxbytes);
+extern unsigned long sl_get_loop_memory_pool (unsigned long * maxbytes=0);
+
 #endif
@@ -13,6 +13,17 @@
 using namespace std;
 
 
+// each loop gets its own return path here, so these can't be one rule
+// for all loops (/sl/-1/...), but each is still a single message
+static const char * auto_update_controls = "state,next_state,loop_pos,loop_len,cycle_len,free_time,total_time,waiting,"
+	"rate_output,in_peak_meter,out_peak_meter,is_soloed,stretch_ratio,pitch_shift";
+
+static const char * input_controls = "rec_thresh,feedback,use_feedback_play,dry,wet,input_gain,rate,scratch_pos,"
+	"delay_trigger,quantize,fade_samples,round,sync,playback_sync,redo_is_tap,use_rate,use_common_ins,"
+	"use_common_outs,relative_sync,input_latency,output_latency,trigger_latency,autoset_latency,mute_quantized,"
+	"overdub_quantized,replace_quantized,round_integer_tempo,tempo_stretch,pan_1,pan_2,pan_3,pan_4";
+
+
 class RegisterTool
 {
 
@@ -45,28 +56,15 @@ register_global_updates(const string & path="/ctrl", bool unreg=false)
 	}
 
 	// results will come back with instance = -2
-	lo_send(_osc_addr, buf, "sss", "tempo", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "sync_source", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "eighth_per_cycle", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "tap_tempo", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "wet", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "dry", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "input_gain", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "auto_disable_latency", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "output_midi_clock", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "use_midi_stop", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "use_midi_start", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "send_midi_start_on_trigger", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "smart_eighths", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "selected_loop_num", _our_url.c_str(), path.c_str());
+	lo_send(_osc_addr, buf, "sss", "tempo,sync_source,eighth_per_cycle,tap_tempo,wet,dry,input_gain,auto_disable_latency,"
+		"output_midi_clock,use_midi_stop,use_midi_start,send_midi_start_on_trigger,smart_eighths,selected_loop_num",
+		_our_url.c_str(), path.c_str());
 	
 	if (unreg) {
-		lo_send(_osc_addr, "/unregister_auto_update", "siss", "in_peak_meter", 100, _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, "/unregister_auto_update", "siss", "out_peak_meter", 100, _our_url.c_str(), path.c_str());
+		lo_send(_osc_addr, "/unregister_auto_update", "sss", "in_peak_meter,out_peak_meter", _our_url.c_str(), path.c_str());
 	}
 	else {
-		lo_send(_osc_addr, "/register_auto_update", "siss", "in_peak_meter", 100, _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, "/register_auto_update", "siss", "out_peak_meter", 100, _our_url.c_str(), path.c_str());
+		lo_send(_osc_addr, "/register_auto_update", "siss", "in_peak_meter,out_peak_meter", 100, _our_url.c_str(), path.c_str());
 	}
 }
 
@@ -75,45 +73,16 @@ void
 register_auto_updates(int index, const string & path, bool unreg=false)
 {
 	if (!_osc_addr) return;
-	char buf[30];
+	char buf[50];
 
 	if (unreg) {
 		snprintf(buf, sizeof(buf), "/sl/%d/unregister_auto_update", index);
-		lo_send(_osc_addr, buf, "sss", "state", _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "sss", "next_state", _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "sss", "loop_pos", _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "sss", "loop_len", _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "sss", "cycle_len", _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "sss", "free_time", _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "sss", "total_time", _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "sss", "waiting", _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "sss", "rate_output", _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "sss", "in_peak_meter", _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "sss", "out_peak_meter", _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "sss", "is_soloed", _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "sss", "stretch_ratio", _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "sss", "pitch_shift", _our_url.c_str(), path.c_str());
+		lo_send(_osc_addr, buf, "sss", auto_update_controls, _our_url.c_str(), path.c_str());
 	} else {
 		snprintf(buf, sizeof(buf), "/sl/%d/register_auto_update", index);
 		// send request for auto updates
-		lo_send(_osc_addr, buf, "siss", "state",     100, _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "siss", "next_state",     100, _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "siss", "loop_pos",  100, _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "siss", "loop_len",  100, _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "siss", "cycle_len", 100, _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "siss", "free_time", 100, _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "siss", "total_time",100,  _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "siss", "waiting",   100, _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "siss", "rate_output",100, _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "siss", "in_peak_meter", 100, _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "siss", "out_peak_meter", 100, _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "siss",  "is_soloed", 100, _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "siss", "stretch_ratio", 100, _our_url.c_str(), path.c_str());
-		lo_send(_osc_addr, buf, "siss", "pitch_shift", 100, _our_url.c_str(), path.c_str());
+		lo_send(_osc_addr, buf, "siss", auto_update_controls, 100, _our_url.c_str(), path.c_str());
 	}
-
-	
-
 }
 
 void
@@ -130,40 +99,7 @@ register_input_controls(int index, const std::string & path="/ctrl", bool unreg=
 	}
 	
 	// send request for updates
-	lo_send(_osc_addr, buf, "sss", "rec_thresh", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "feedback", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "use_feedback_play", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "dry", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "wet", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "input_gain", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "rate", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "scratch_pos", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "delay_trigger", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "quantize", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "fade_samples", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "round", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "sync", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "playback_sync", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "redo_is_tap", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "use_rate", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "use_common_ins", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "use_common_outs", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "relative_sync", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "input_latency", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "output_latency", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "trigger_latency", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "autoset_latency", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "mute_quantized", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "overdub_quantized", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "replace_quantized", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "round_integer_tempo", _our_url.c_str(), path.c_str());
-	//lo_send(_osc_addr, buf, "sss", "pitch_shift", _our_url.c_str(), path.c_str());
-	//lo_send(_osc_addr, buf, "sss", "stretch_ratio", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "tempo_stretch", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "pan_1", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "pan_2", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "pan_3", _our_url.c_str(), path.c_str());
-	lo_send(_osc_addr, buf, "sss", "pan_4", _our_url.c_str(), path.c_str());
+	lo_send(_osc_addr, buf, "sss", input_controls, _our_url.c_str(), path.c_str());
 }
 
 void
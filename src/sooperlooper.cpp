@@ -35,6 +35,8 @@
 
 #include "midi_bridge.hpp"
 #include "command_map.hpp"
+#include "trace.hpp"
+#include "plugin.hpp"
 #include <midi++/port_request.h>
 
 // #if WITH_ALSA
@@ -62,7 +64,7 @@ Transmitter  error (Transmitter::Error);
 #define DEFAULT_LOOP_TIME 40.0f
 
 
-char *optstring = "c:l:j:p:m:t:U:S:D:L:qVh";
+char *optstring = "c:l:j:p:m:t:U:S:D:L:T:H:P:qVh";
 
 struct option long_options[] = {
 	{ "help", 0, 0, 'h' },
@@ -77,6 +79,9 @@ struct option long_options[] = {
 	{ "jack-server-name", 1, 0, 'S' },
 	{ "load-midi-binding", 1, 0, 'm' },
 	{ "ping-url", 1, 0, 'U' },
+	{ "trace-file", 1, 0, 'T' },
+	{ "huge-pages", 1, 0, 'H' },
+	{ "loop-pool", 1, 0, 'P' },
 	{ "version", 0, 0, 'V' },
 	{ 0, 0, 0, 0 }
 };
@@ -87,7 +92,7 @@ struct OptionInfo
 	OptionInfo() :
 		loop_count(1), channels(2), quiet(false), jack_name(""),
 		oscport(DEFAULT_OSC_PORT), loopsecs(DEFAULT_LOOP_TIME), discrete_io(true),
-		show_usage(0), show_version(0), pingurl() {} 
+		show_usage(0), show_version(0), pingurl(), memory_mode(LoopMemoryHeap), pool_mb(0.0f) {} 
 		
 	int loop_count;
 	int channels;
@@ -103,6 +108,9 @@ struct OptionInfo
 	int show_version;
 	string pingurl;
 	string loadsession;
+	string tracefile;
+	int memory_mode;
+	float pool_mb;
 };
 
 
@@ -123,6 +131,11 @@ static void usage(char *argv0)
 	fprintf(stderr, "  -j <str> , --jack-name=<str> jack client name, default is sooperlooper\n");
 	fprintf(stderr, "  -S <str> , --jack-server-name=<str> specify jack server name\n");
 	fprintf(stderr, "  -m <str> , --load-midi-binding=<str> loads midi binding from file or preset\n");
+#ifdef WITH_TRACE
+	fprintf(stderr, "  -T <pathname> , --trace-file=<pathname> record a timeline trace, written to pathname on exit\n");
+#endif
+	fprintf(stderr, "  -H <off/thp/hugetlb> , --huge-pages=<mode> back loop memory with huge pages, falls back if unavailable (default off)\n");
+	fprintf(stderr, "  -P <MB> , --loop-pool=<MB>   keep up to MB of memory from removed loops for new ones (default 0)\n");
 	fprintf(stderr, "  -q , --quiet                 do not output status to stderr\n");
 	fprintf(stderr, "  -h , --help                  this usage output\n");
 	fprintf(stderr, "  -V , --version               show version only\n");
@@ -183,6 +196,27 @@ static void parse_options (int argc, char **argv, OptionInfo & option_info)
 		case 'L':
 			option_info.loadsession = optarg;
 			break;
+		case 'T':
+			option_info.tracefile = optarg;
+			break;
+		case 'H':
+			if (string("hugetlb") == optarg) {
+				option_info.memory_mode = LoopMemoryHugeTLB;
+			}
+			else if (string("thp") == optarg) {
+				option_info.memory_mode = LoopMemoryTransparentHuge;
+			}
+			else if (string("off") == optarg) {
+				option_info.memory_mode = LoopMemoryHeap;
+			}
+			else {
+				fprintf (stderr, "invalid huge page mode: %s, use off, thp or hugetlb\n", optarg);
+				option_info.show_usage++;
+			}
+			break;
+		case 'P':
+			sscanf(optarg, "%f", &option_info.pool_mb);
+			break;
 		default:
 			fprintf (stderr, "argument error: %d\n", c);
 			option_info.show_usage++;
@@ -311,6 +345,15 @@ int main(int argc, char** argv)
 
 	//sl_init ();
 
+	if (!option_info.tracefile.empty()) {
+#ifdef WITH_TRACE
+		// must happen before any of our threads start
+		Trace::init ();
+#else
+		cerr << "tracing not supported in this build, reconfigure with --enable-trace" << endl;
+#endif
+	}
+
 	// create audio driver
 	// todo: a factory
 	AudioDriver * driver = new JackAudioDriver(option_info.jack_name, option_info.jack_server_name);
@@ -319,7 +362,10 @@ int main(int argc, char** argv)
 	engine = new Engine();
 
 	engine->set_default_loop_secs (option_info.loopsecs);
+	sl_set_loop_memory_mode (option_info.memory_mode);
+	sl_set_loop_memory_pool ((unsigned long) (max (0.0f, option_info.pool_mb) * 1048576.0f));
 	engine->set_default_channels (option_info.channels);
+	engine->set_quiet (option_info.quiet);
 	
 	if (!engine->initialize(driver, 2, option_info.oscport, option_info.pingurl)) {
 		cerr << "cannot initialize sooperlooper\n";
@@ -333,10 +379,7 @@ int main(int argc, char** argv)
 	}
 	
 	if (option_info.loadsession.empty()) {
-		for (int i=0; i < option_info.loop_count; ++i)
-		{
-			engine->add_loop ((unsigned int) option_info.channels, option_info.loopsecs, option_info.discrete_io);
-		}
+		engine->add_loops ((unsigned int) option_info.loop_count, (unsigned int) option_info.channels, option_info.loopsecs, option_info.discrete_io);
 
 		// set default sync source
 		if (option_info.loop_count > 0) {
@@ -393,6 +436,11 @@ int main(int argc, char** argv)
 	delete engine;
 	
 	delete driver;
+
+	if (Trace::enabled()) {
+		Trace::write_json (option_info.tracefile);
+		Trace::cleanup ();
+	}
 	
 	//sl_fini ();
 	
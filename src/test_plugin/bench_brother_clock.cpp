@@ -0,0 +1,226 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+// Runs two BrotherClocks against each other in one process, in real
+// time, over liblo on localhost.  The leader advances its beats the way
+// the engine does and publishes them every period, the follower locks
+// to it and runs its pll.  Halfway through the leader changes tempo.
+// Reported per half: time to lock, and the follower's phase error
+// against the leader's true position once locked.
+//
+// usage: bench_brother_clock [runsecs] [tempo] [newtempo]
+//        (defaults 10 120 97)
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <lo/lo.h>
+
+#include "brother_clock.hpp"
+
+using namespace std;
+using namespace SooperLooper;
+
+#define SRATE     48000
+#define NFRAMES   256
+// a phase error below this, in beats, counts as locked
+#define LOCKED_ERROR  0.002
+
+static double
+now_secs ()
+{
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static int
+register_handler (const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void *data)
+{
+	BrotherClock * leader = (BrotherClock *) data;
+
+	if (strcmp (path, "/brother_register") == 0) {
+		leader->add_follower (&argv[0]->s);
+	}
+	else {
+		leader->remove_follower (&argv[0]->s);
+	}
+	return 0;
+}
+
+static int
+ping_handler (const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void *data)
+{
+	((BrotherClock *) data)->answer_ping (&argv[0]->s, argv[1]->d);
+	return 0;
+}
+
+static int
+pong_handler (const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void *data)
+{
+	((BrotherClock *) data)->receive_pong (argv[0]->d, argv[1]->d);
+	return 0;
+}
+
+static int
+clock_handler (const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void *data)
+{
+	BrotherClock * follower = (BrotherClock *) data;
+	BrotherClock::ClockState state;
+
+	state.hosttime = argv[0]->d;
+	state.beats = argv[1]->d;
+	state.tempo = argv[2]->d;
+
+	follower->receive (state);
+	return 0;
+}
+
+struct Stats
+{
+	Stats() : lock_secs(-1.0), sum(0.0), worst(0.0), count(0) {}
+
+	void print (const char * name, double tempo) {
+		if (lock_secs < 0.0) {
+			printf ("%-8s %6.1f bpm  never locked\n", name, tempo);
+			return;
+		}
+		double msec_per_beat = 60000.0 / tempo;
+		printf ("%-8s %6.1f bpm  locked after %.3f s  phase error mean %.3f ms  max %.3f ms\n",
+			name, tempo, lock_secs, sum / max (count, 1L) * msec_per_beat, worst * msec_per_beat);
+	}
+
+	double lock_secs;
+	double sum;
+	double worst;
+	long   count;
+};
+
+int
+main (int argc, char ** argv)
+{
+	float runsecs = argc > 1 ? atof (argv[1]) : 10.0f;
+	double tempo = argc > 2 ? atof (argv[2]) : 120.0;
+	double newtempo = argc > 3 ? atof (argv[3]) : 97.0;
+
+	lo_server leader_serv = lo_server_new (NULL, NULL);
+	lo_server follower_serv = lo_server_new (NULL, NULL);
+	if (!leader_serv || !follower_serv) {
+		cerr << "cannot create osc servers" << endl;
+		return 1;
+	}
+
+	BrotherClock leader;
+	BrotherClock follower;
+
+	lo_server_add_method (leader_serv, "/brother_register", "s", register_handler, &leader);
+	lo_server_add_method (leader_serv, "/brother_unregister", "s", register_handler, &leader);
+	lo_server_add_method (leader_serv, "/brother_ping", "sd", ping_handler, &leader);
+	lo_server_add_method (follower_serv, "/sl/brother_clock", "ddd", clock_handler, &follower);
+	lo_server_add_method (follower_serv, "/sl/brother_pong", "dd", pong_handler, &follower);
+
+	char * leader_url = lo_server_get_url (leader_serv);
+	char * follower_url = lo_server_get_url (follower_serv);
+	follower.set_leader (leader_url, follower_url);
+
+	printf ("leader %s, follower %s, %d frame periods\n", leader_url, follower_url, NFRAMES);
+
+	float syncbuf[NFRAMES];
+	double period = (double) NFRAMES / SRATE;
+	unsigned long nperiods = (unsigned long) (runsecs / period);
+	double leader_beats = 0.0;
+	double leader_tempo = tempo;
+	double follower_tempo = 0.0;
+	long leader_hits = 0, follower_hits = 0;
+	Stats stats[2];
+
+	double start = now_secs();
+	double deadline = start;
+	double half_start = start;
+
+	for (unsigned long p=0; p < nperiods; ++p) {
+		int half = p >= nperiods / 2 ? 1 : 0;
+
+		if (p == nperiods / 2) {
+			leader_tempo = newtempo;
+			half_start = now_secs();
+		}
+
+		double now = now_secs();
+
+		// leader, as the engine does for internal sync
+		leader.publish (now, leader_beats, leader_tempo);
+		double next = leader_beats + NFRAMES * leader_tempo / (60.0 * SRATE);
+		if (floor (next) != floor (leader_beats)) {
+			++leader_hits;
+		}
+		leader_beats = next;
+
+		// the osc thread and the main loop of both engines
+		while (lo_server_recv_noblock (leader_serv, 0) > 0) {}
+		while (lo_server_recv_noblock (follower_serv, 0) > 0) {}
+		leader.service (now);
+		follower.service (now);
+
+		// follower rt
+		if (follower.run (syncbuf, 0, NFRAMES, now, SRATE, 0.5, follower_tempo) >= 0) {
+			++follower_hits;
+		}
+
+		if (follower.is_locked()) {
+			// where the leader really was at the start of this period
+			double err = fabs (follower.get_period_beats() - (leader_beats - NFRAMES * leader_tempo / (60.0 * SRATE)));
+
+			if (stats[half].lock_secs < 0.0) {
+				if (err < LOCKED_ERROR && follower_tempo == leader_tempo) {
+					stats[half].lock_secs = now - half_start;
+				}
+			}
+			else {
+				stats[half].sum += err;
+				stats[half].worst = max (stats[half].worst, err);
+				++stats[half].count;
+			}
+		}
+
+		deadline += period;
+		double wait = deadline - now_secs();
+		if (wait > 0.0) {
+			usleep ((useconds_t) (wait * 1e6));
+		}
+	}
+
+	stats[0].print ("before", tempo);
+	stats[1].print ("after", newtempo);
+	printf ("beats: leader %ld  follower %ld\n", leader_hits, follower_hits);
+
+	follower.set_leader ("", "");
+	free (leader_url);
+	free (follower_url);
+	lo_server_free (leader_serv);
+	lo_server_free (follower_serv);
+
+	return 0;
+}
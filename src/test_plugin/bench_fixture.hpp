@@ -0,0 +1,99 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+// What the plugin benches share: loops instantiated straight from
+// plugin.cc with their ports in plain arrays, and a wall clock.
+
+#ifndef __sooperlooper_bench_fixture__
+#define __sooperlooper_bench_fixture__
+
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+#include <sys/time.h>
+
+#include "ladspa.h"
+#include "plugin.hpp"
+
+extern const LADSPA_Descriptor* ladspa_descriptor (unsigned long);
+extern void sl_init ();
+
+#define SRATE     48000
+#define NFRAMES   256
+
+struct BenchLoop
+{
+	LADSPA_Handle handle;
+	LADSPA_Data   ports[SooperLooper::LASTPORT];
+};
+
+static inline double
+now_secs ()
+{
+	struct timeval tv;
+	gettimeofday (&tv, 0);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// an activated loop with the controls at unity, on the given NFRAMES buffers.
+// exits if the plugin can't instantiate it
+static inline BenchLoop *
+new_bench_loop (const LADSPA_Descriptor * desc, LADSPA_Data * inbuf, LADSPA_Data * outbuf,
+		LADSPA_Data * syncin, LADSPA_Data * syncout)
+{
+	BenchLoop * loop = new BenchLoop;
+
+	memset (loop->ports, 0, sizeof(loop->ports));
+	loop->ports[SooperLooper::DryLevel] = 1.0f;
+	loop->ports[SooperLooper::WetLevel] = 1.0f;
+	loop->ports[SooperLooper::Feedback] = 1.0f;
+	loop->ports[SooperLooper::Rate] = 1.0f;
+	loop->ports[SooperLooper::Multi] = -1.0f;
+	loop->ports[SooperLooper::FadeSamples] = 64.0f;
+	loop->ports[SooperLooper::UseSafetyFeedback] = 1.0f;
+
+	if ((loop->handle = desc->instantiate (desc, SRATE)) == 0) {
+		std::cerr << "cannot instantiate loop" << std::endl;
+		exit (1);
+	}
+
+	for (unsigned long p = 0; p < SooperLooper::LASTPORT; ++p) {
+		desc->connect_port (loop->handle, p, &loop->ports[p]);
+	}
+	desc->connect_port (loop->handle, SooperLooper::AudioInputPort, inbuf);
+	desc->connect_port (loop->handle, SooperLooper::AudioOutputPort, outbuf);
+	desc->connect_port (loop->handle, SooperLooper::SyncInputPort, syncin);
+	desc->connect_port (loop->handle, SooperLooper::SyncOutputPort, syncout);
+	desc->activate (loop->handle);
+
+	return loop;
+}
+
+static inline void
+delete_bench_loop (const LADSPA_Descriptor * desc, BenchLoop * loop)
+{
+	if (desc->deactivate) {
+		desc->deactivate (loop->handle);
+	}
+	desc->cleanup (loop->handle);
+	delete loop;
+}
+
+#endif
@@ -0,0 +1,146 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+// Soak run of many mostly idle loops through plugin.cc with no jack.  A
+// few loops record and then overdub, the rest stay empty.  The same
+// setup is run with every loop doing a full run() each period, and then
+// the way the engine does it, where loops sl_is_idle() reports on only
+// get sl_run_idle().  That is done once with each loop keeping its own
+// input delay line fed (discrete inputs) and once without (loops only on
+// the common inputs, the engine refills those from its history on wake).
+//
+// usage: bench_idle_loops [loops] [active] [runsecs]
+//        (defaults 1000 8 10)
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <sys/time.h>
+
+#include "ladspa.h"
+#include "plugin.hpp"
+#include "event.hpp"
+#include "bench_fixture.hpp"
+
+using namespace std;
+using namespace SooperLooper;
+
+#define LOOPSECS  4.0f
+
+enum RunMode {
+	RunFull = 0,
+	RunIdleInput,
+	RunIdleCommon
+};
+
+static int
+run_all (const LADSPA_Descriptor * desc, vector<BenchLoop*> & loops, const LADSPA_Data * inbuf, int mode)
+{
+	int idle = 0;
+
+	for (size_t n=0; n < loops.size(); ++n) {
+		if (mode != RunFull && sl_is_idle (loops[n]->handle)) {
+			sl_run_idle (loops[n]->handle, mode == RunIdleInput ? inbuf : 0, NFRAMES);
+			++idle;
+		}
+		else {
+			desc->run (loops[n]->handle, NFRAMES);
+			loops[n]->ports[Multi] = -1.0f;
+		}
+	}
+	return idle;
+}
+
+static void
+bench_mode (int mode, const char * name, int nloops, int nactive, float runsecs)
+{
+	const LADSPA_Descriptor * desc = ladspa_descriptor (0);
+	vector<BenchLoop*> loops;
+	LADSPA_Data inbuf[NFRAMES], outbuf[NFRAMES], syncin[NFRAMES], syncout[NFRAMES];
+
+	for (int i=0; i < NFRAMES; ++i) {
+		inbuf[i] = 0.1f * ((i % 64) - 32) / 32.0f;
+	}
+	memset (syncin, 0, sizeof(syncin));
+
+	// idle loops never record, keep their memory small
+	sl_set_instantiate_secs (LOOPSECS);
+
+	for (int n=0; n < nloops; ++n) {
+		loops.push_back (new_bench_loop (desc, inbuf, outbuf, syncin, syncout));
+	}
+
+	// spread the active loops out, record them for a couple of seconds and overdub
+	int stride = nactive > 0 ? nloops / nactive : nloops;
+	unsigned long recperiods = (unsigned long) (LOOPSECS * 0.5f * SRATE / NFRAMES);
+	unsigned long runperiods = (unsigned long) (runsecs * SRATE / NFRAMES);
+
+	for (int n=0; n < nactive && n * stride < nloops; ++n) {
+		loops[n * stride]->ports[Multi] = (float) Event::RECORD;
+	}
+	for (unsigned long p=0; p < recperiods; ++p) {
+		run_all (desc, loops, inbuf, mode);
+	}
+	for (int n=0; n < nactive && n * stride < nloops; ++n) {
+		loops[n * stride]->ports[Multi] = (float) Event::RECORD;
+	}
+	run_all (desc, loops, inbuf, mode);
+	for (int n=0; n < nactive && n * stride < nloops; ++n) {
+		loops[n * stride]->ports[Multi] = (float) Event::OVERDUB;
+	}
+	run_all (desc, loops, inbuf, mode);
+
+	int idle = 0;
+	double start = now_secs();
+
+	for (unsigned long p=0; p < runperiods; ++p) {
+		idle = run_all (desc, loops, inbuf, mode);
+	}
+
+	double elapsed = now_secs() - start;
+
+	printf ("%-6s  idle loops %4d/%-4d  %7.3f s  %8.2f us/period  (period is %.0f us)\n",
+		name, idle, nloops, elapsed, elapsed * 1e6 / runperiods, NFRAMES * 1e6 / SRATE);
+
+	for (size_t n=0; n < loops.size(); ++n) {
+		delete_bench_loop (desc, loops[n]);
+	}
+}
+
+int
+main (int argc, char ** argv)
+{
+	int nloops = argc > 1 ? atoi (argv[1]) : 1000;
+	int nactive = argc > 2 ? atoi (argv[2]) : 8;
+	float runsecs = argc > 3 ? atof (argv[3]) : 10.0f;
+
+	sl_init ();
+
+	printf ("%d loops, %d of them overdubbing, %g s of audio in %d frame periods\n",
+		nloops, nactive, runsecs, NFRAMES);
+
+	bench_mode (RunFull, "full", nloops, nactive, runsecs);
+	bench_mode (RunIdleInput, "idle", nloops, nactive, runsecs);
+	bench_mode (RunIdleCommon, "common", nloops, nactive, runsecs);
+
+	return 0;
+}
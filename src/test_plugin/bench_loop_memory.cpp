@@ -0,0 +1,171 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+// Runs many loops through plugin.cc with no jack, records each one and
+// then overdubs all of them for a while, once per loop memory backing.
+// Only the overdub phase is measured: wall time and, where the kernel
+// lets us (perf_event_paranoid), dTLB load and store misses.
+//
+// usage: bench_loop_memory [loops] [channels] [loopsecs] [runsecs]
+//        (defaults 64 2 30 20)
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "ladspa.h"
+#include "plugin.hpp"
+#include "event.hpp"
+#include "bench_fixture.hpp"
+
+using namespace std;
+using namespace SooperLooper;
+
+static int
+open_tlb_counter (unsigned long op)
+{
+	struct perf_event_attr attr;
+
+	memset (&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB | (op << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long
+read_counter (int fd)
+{
+	long long val = 0;
+
+	if (fd < 0 || read (fd, &val, sizeof(val)) != sizeof(val)) {
+		return -1;
+	}
+	return val;
+}
+
+static void
+run_all (const LADSPA_Descriptor * desc, vector<BenchLoop*> & loops, float cmd)
+{
+	for (size_t n=0; n < loops.size(); ++n) {
+		loops[n]->ports[Multi] = cmd;
+		desc->run (loops[n]->handle, NFRAMES);
+	}
+}
+
+static void
+bench_mode (int mode, const char * name, int nloops, float loopsecs, float runsecs)
+{
+	const LADSPA_Descriptor * desc = ladspa_descriptor (0);
+	vector<BenchLoop*> loops;
+	LADSPA_Data inbuf[NFRAMES], outbuf[NFRAMES], syncin[NFRAMES], syncout[NFRAMES];
+	int huge = 0;
+
+	for (int i=0; i < NFRAMES; ++i) {
+		inbuf[i] = 0.1f * ((i % 64) - 32) / 32.0f;
+	}
+	memset (syncin, 0, sizeof(syncin));
+
+	sl_set_loop_memory_mode (mode);
+	sl_set_instantiate_secs (loopsecs);
+
+	for (int n=0; n < nloops; ++n) {
+		BenchLoop * loop = new_bench_loop (desc, inbuf, outbuf, syncin, syncout);
+
+		if (sl_get_loop_memory_backing (loop->handle) != LoopMemoryHeap) {
+			++huge;
+		}
+		loops.push_back (loop);
+	}
+
+	// record every loop for loopsecs (minus a little headroom), then overdub
+	unsigned long recperiods = (unsigned long) (loopsecs * 0.9f * SRATE / NFRAMES);
+	unsigned long runperiods = (unsigned long) (runsecs * SRATE / NFRAMES);
+
+	run_all (desc, loops, (float) Event::RECORD);
+	for (unsigned long p=0; p < recperiods; ++p) {
+		run_all (desc, loops, -1.0f);
+	}
+	run_all (desc, loops, (float) Event::RECORD);
+	run_all (desc, loops, -1.0f);
+	run_all (desc, loops, (float) Event::OVERDUB);
+	run_all (desc, loops, -1.0f);
+
+	int loadfd = open_tlb_counter (PERF_COUNT_HW_CACHE_OP_READ);
+	int storefd = open_tlb_counter (PERF_COUNT_HW_CACHE_OP_WRITE);
+
+	if (loadfd >= 0) ioctl (loadfd, PERF_EVENT_IOC_ENABLE, 0);
+	if (storefd >= 0) ioctl (storefd, PERF_EVENT_IOC_ENABLE, 0);
+	double start = now_secs();
+
+	for (unsigned long p=0; p < runperiods; ++p) {
+		run_all (desc, loops, -1.0f);
+	}
+
+	double elapsed = now_secs() - start;
+	if (loadfd >= 0) ioctl (loadfd, PERF_EVENT_IOC_DISABLE, 0);
+	if (storefd >= 0) ioctl (storefd, PERF_EVENT_IOC_DISABLE, 0);
+
+	long long loadmiss = read_counter (loadfd);
+	long long storemiss = read_counter (storefd);
+
+	printf ("%-8s  huge loops %3d/%-3d  %7.3f s  %6.2f us/period  dTLB load miss %12lld  store miss %12lld\n",
+		name, huge, nloops, elapsed, elapsed * 1e6 / runperiods, loadmiss, storemiss);
+
+	if (loadfd >= 0) close (loadfd);
+	if (storefd >= 0) close (storefd);
+
+	for (size_t n=0; n < loops.size(); ++n) {
+		delete_bench_loop (desc, loops[n]);
+	}
+}
+
+int
+main (int argc, char ** argv)
+{
+	int nloops = argc > 1 ? atoi (argv[1]) : 64;
+	int chans = argc > 2 ? atoi (argv[2]) : 2;
+	float loopsecs = argc > 3 ? atof (argv[3]) : 30.0f;
+	float runsecs = argc > 4 ? atof (argv[4]) : 20.0f;
+
+	sl_init ();
+
+	printf ("%d loops x %d channels, %g s loops, overdubbing %g s of audio in %d frame periods\n",
+		nloops, chans, loopsecs, runsecs, NFRAMES);
+
+	bench_mode (LoopMemoryHeap, "heap", nloops * chans, loopsecs, runsecs);
+	bench_mode (LoopMemoryTransparentHuge, "thp", nloops * chans, loopsecs, runsecs);
+	bench_mode (LoopMemoryHugeTLB, "hugetlb", nloops * chans, loopsecs, runsecs);
+
+	printf ("-1 counts mean perf events are unavailable (see /proc/sys/kernel/perf_event_paranoid)\n");
+
+	return 0;
+}
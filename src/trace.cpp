@@ -0,0 +1,225 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**  
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**  
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**  
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**  
+*/
+
+
+#include "trace.hpp"
+
+#include <pthread.h>
+#include <time.h>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+
+using namespace SooperLooper;
+using namespace std;
+
+struct Trace::Buffer
+{
+	Record *          records;
+	volatile uint32_t write_pos;  // total written, wraps the ring
+	pthread_t         thread;
+	char              name[32];
+};
+
+Trace::Buffer *  Trace::_buffers = 0;
+unsigned int     Trace::_max_threads = 0;
+unsigned int     Trace::_records_per_thread = 0;
+volatile int     Trace::_next_buffer = 0;
+volatile unsigned int Trace::_generation = 0;
+
+static __thread Trace::Buffer * _thread_buffer = 0;
+static __thread unsigned int    _thread_generation = 0;
+
+void
+Trace::init (unsigned int max_threads, unsigned int records_per_thread)
+{
+	if (_buffers) return;
+
+	_max_threads = max_threads;
+	_records_per_thread = records_per_thread;
+	_next_buffer = 0;
+	
+	Buffer * bufs = new Buffer[max_threads];
+	for (unsigned int i=0; i < max_threads; ++i) {
+		// touch it all now so the rt thread doesn't fault it in later
+		bufs[i].records = (Record *) calloc (records_per_thread, sizeof(Record));
+		bufs[i].write_pos = 0;
+		bufs[i].thread = 0;
+		bufs[i].name[0] = '\0';
+	}
+
+	_buffers = bufs;
+}
+
+void
+Trace::cleanup ()
+{
+	Buffer * bufs = _buffers;
+	if (!bufs) return;
+	
+	_buffers = 0;
+	// every thread's cached buffer is stale from here on
+	__sync_fetch_and_add (&_generation, 1);
+	for (unsigned int i=0; i < _max_threads; ++i) {
+		free (bufs[i].records);
+	}
+	delete [] bufs;
+}
+
+uint64_t
+Trace::now ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+Trace::Buffer *
+Trace::get_buffer ()
+{
+	if (!_buffers) {
+		return 0;
+	}
+
+	if (_thread_buffer && _thread_generation == _generation) {
+		return _thread_buffer;
+	}
+	_thread_buffer = 0;
+
+	// claim the next free buffer for this thread, lock free
+	int idx = __sync_fetch_and_add (&_next_buffer, 1);
+	if (idx >= (int) _max_threads) {
+		return 0;
+	}
+
+	_thread_buffer = &_buffers[idx];
+	_thread_generation = _generation;
+	_thread_buffer->thread = pthread_self();
+	__sync_synchronize();
+	
+	return _thread_buffer;
+}
+
+void
+Trace::set_thread_name (const char * name)
+{
+	Buffer * buf = get_buffer();
+	if (buf) {
+		strncpy (buf->name, name, sizeof(buf->name) - 1);
+		buf->name[sizeof(buf->name) - 1] = '\0';
+	}
+}
+
+void
+Trace::store (const char * name, uint64_t start, uint64_t dur, int32_t arg, bool instant)
+{
+	Buffer * buf = get_buffer();
+	if (!buf) return;
+
+	uint32_t pos = buf->write_pos;
+	Record & rec = buf->records[pos % _records_per_thread];
+	rec.name = name;
+	rec.start = start;
+	rec.dur = dur;
+	rec.arg = arg;
+	rec.instant = instant;
+
+	// make sure the record is complete before publishing it
+	__sync_synchronize();
+	buf->write_pos = pos + 1;
+}
+
+void
+Trace::record (const char * name, uint64_t start, uint64_t end, int32_t arg)
+{
+	// a span shorter than the clock resolution is still a span
+	store (name, start, end - start, arg, false);
+}
+
+void
+Trace::instant (const char * name, int32_t arg)
+{
+	store (name, now(), 0, arg, true);
+}
+
+bool
+Trace::write_json (const string & filename)
+{
+	Buffer * bufs = _buffers;
+	
+	if (!bufs) {
+		cerr << "tracing is not enabled" << endl;
+		return false;
+	}
+
+	FILE * outf = fopen (filename.c_str(), "w");
+	if (!outf) {
+		cerr << "error opening trace file " << filename << endl;
+		return false;
+	}
+
+	int nbufs = _next_buffer;
+	if (nbufs > (int) _max_threads) {
+		nbufs = _max_threads;
+	}
+	
+	bool first = true;
+	fprintf (outf, "{\"traceEvents\":[\n");
+
+	for (int i=0; i < nbufs; ++i) {
+		Buffer & buf = bufs[i];
+		
+		if (buf.name[0] != '\0') {
+			fprintf (outf, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				 first ? "" : ",\n", i+1, buf.name);
+			first = false;
+		}
+		
+		// the writer may keep going while we read, records that get
+		// overwritten while we are here are just noise in a diagnostic
+		uint32_t end = buf.write_pos;
+		__sync_synchronize();
+		uint32_t start = (end > _records_per_thread) ? end - _records_per_thread : 0;
+
+		for (uint32_t n = start; n < end; ++n) {
+			const Record & rec = buf.records[n % _records_per_thread];
+			if (!rec.name) continue;
+			
+			if (rec.instant) {
+				fprintf (outf, "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%llu",
+					 first ? "" : ",\n", rec.name, i+1, (unsigned long long) rec.start);
+			}
+			else {
+				fprintf (outf, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%llu,\"dur\":%llu",
+					 first ? "" : ",\n", rec.name, i+1, (unsigned long long) rec.start, (unsigned long long) rec.dur);
+			}
+			if (rec.arg >= 0) {
+				fprintf (outf, ",\"args\":{\"n\":%d}", rec.arg);
+			}
+			fprintf (outf, "}");
+			first = false;
+		}
+	}
+
+	fprintf (outf, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	fclose (outf);
+
+	return true;
+}
@@ -0,0 +1,119 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**  
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**  
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**  
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**  
+*/
+
+
+#ifndef __sooperlooper_trace__
+#define __sooperlooper_trace__
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string>
+
+/*
+ * Timeline tracepoints.  These compile to nothing unless configured
+ * with --enable-trace (WITH_TRACE).  Each thread records into its own
+ * fixed size ring of spans, so recording never locks or allocates.
+ * The rings can be written out in the Chrome trace event format,
+ * which chrome://tracing and ui.perfetto.dev can both open.
+ */
+
+namespace SooperLooper {
+
+class Trace
+{
+  public:
+	struct Record {
+		const char * name;
+		uint64_t     start;  // usecs
+		uint64_t     dur;    // usecs
+		int32_t      arg;
+		bool         instant;
+	};
+
+	// allocates the per-thread buffers, call once from main before any threads start
+	static void init (unsigned int max_threads = 32, unsigned int records_per_thread = 32768);
+	// after the threads that record have stopped.  a thread that still
+	// holds a buffer claims a new one if tracing is started again
+	static void cleanup ();
+
+	// names the calling thread in the exported timeline
+	static void set_thread_name (const char * name);
+
+	static void record (const char * name, uint64_t start, uint64_t end, int32_t arg = -1);
+	static void instant (const char * name, int32_t arg = -1);
+
+	// may be called from any non-rt thread
+	static bool write_json (const std::string & filename);
+
+	static uint64_t now ();
+	
+	static bool enabled() { return _buffers != 0; }
+
+	struct Buffer;
+	
+  private:
+	static Buffer * get_buffer ();
+	static void store (const char * name, uint64_t start, uint64_t dur, int32_t arg, bool instant);
+	
+	static Buffer *  _buffers;
+	static volatile unsigned int _generation; // bumped by cleanup()
+	static unsigned int _max_threads;
+	static unsigned int _records_per_thread;
+	static volatile int _next_buffer;
+};
+
+class TraceScope
+{
+  public:
+	TraceScope (const char * name, int32_t arg = -1)
+		: _name (name), _arg (arg), _start (Trace::enabled() ? Trace::now() : 0) {}
+	~TraceScope () {
+		if (_start) {
+			Trace::record (_name, _start, Trace::now(), _arg);
+		}
+	}
+
+  private:
+	const char * _name;
+	int32_t      _arg;
+	uint64_t     _start;
+};
+
+};
+
+#ifdef WITH_TRACE
+#define SL_TRACE_CONCAT2(a,b) a##b
+#define SL_TRACE_CONCAT(a,b) SL_TRACE_CONCAT2(a,b)
+#define SL_TRACE_SCOPE(name) SooperLooper::TraceScope SL_TRACE_CONCAT(_sl_trace_, __LINE__) (name)
+#define SL_TRACE_SCOPE_ARG(name, arg) SooperLooper::TraceScope SL_TRACE_CONCAT(_sl_trace_, __LINE__) (name, arg)
+#define SL_TRACE_INSTANT(name) SooperLooper::Trace::instant (name)
+#define SL_TRACE_INSTANT_ARG(name, arg) SooperLooper::Trace::instant (name, arg)
+#define SL_TRACE_THREAD(name) SooperLooper::Trace::set_thread_name (name)
+#else
+#define SL_TRACE_SCOPE(name)
+#define SL_TRACE_SCOPE_ARG(name, arg)
+#define SL_TRACE_INSTANT(name)
+#define SL_TRACE_INSTANT_ARG(name, arg)
+#define SL_TRACE_THREAD(name)
+#endif
+
+#endif
@@ -29,14 +29,25 @@ using namespace SooperLooper;
 LocaleGuard::LocaleGuard (const char* str)
 {
 	old = strdup (setlocale (LC_NUMERIC, NULL));
-	if (strcmp (old, str)) {
+	changed = false;
+
+	// "C" and "POSIX" are the same locale.  not touching it when
+	// there is nothing to do keeps nested guards safe to use from
+	// several threads while an outer one is held.
+	bool oldc = !strcmp (old, "C") || !strcmp (old, "POSIX");
+	bool newc = !strcmp (str, "C") || !strcmp (str, "POSIX");
+	
+	if (strcmp (old, str) && !(oldc && newc)) {
 		setlocale (LC_NUMERIC, str);
+		changed = true;
 	} 
 }
 
 LocaleGuard::~LocaleGuard ()
 {
-	setlocale (LC_NUMERIC, old);
+	if (changed) {
+		setlocale (LC_NUMERIC, old);
+	}
 	free ((char*)old);
 }
 
@@ -98,6 +98,55 @@ static inline float f_clamp(float x, float a, float b)
 	return x;
 }
 
+/* IEEE 754 half precision conversion, used for compact audio transfer.
+   rounds to nearest, denormal halfs are flushed to zero. */
+
+static inline uint16_t float_to_half(float f)
+{
+	ls_pcast32 v;
+	v.f = f;
+
+	uint16_t sign = (v.i >> 16) & 0x8000;
+	int32_t  expo = ((v.i >> 23) & 0xff) - 127 + 15;
+	uint32_t mant = v.i & 0x007fffff;
+
+	if (expo <= 0) {
+		return sign;
+	}
+	else if (expo >= 31) {
+		// clamp to the max finite half
+		return sign | 0x7bff;
+	}
+
+	mant += 0x00001000; // round
+	if (mant & 0x00800000) {
+		mant = 0;
+		if (++expo >= 31) {
+			return sign | 0x7bff;
+		}
+	}
+	
+	return sign | (expo << 10) | (mant >> 13);
+}
+
+static inline float half_to_float(uint16_t h)
+{
+	ls_pcast32 v;
+	int32_t expo = (h >> 10) & 0x1f;
+
+	if (expo == 0) {
+		v.i = (h & 0x8000) << 16;
+	}
+	else if (expo == 31) {
+		v.i = ((h & 0x8000) << 16) | 0x7f800000 | ((h & 0x03ff) << 13);
+	}
+	else {
+		v.i = ((h & 0x8000) << 16) | ((expo - 15 + 127) << 23) | ((h & 0x03ff) << 13);
+	}
+	
+	return v.f;
+}
+
 };
 
 
@@ -105,6 +154,7 @@ struct LocaleGuard {
 	LocaleGuard (const char*);
 	~LocaleGuard ();
 	const char* old;
+	bool changed;
 };
 
 
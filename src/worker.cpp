@@ -0,0 +1,423 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+#include <iostream>
+#include <algorithm>
+
+#include <sched.h>
+
+#include "worker.hpp"
+#include "trace.hpp"
+
+using namespace SooperLooper;
+using namespace std;
+
+
+bool
+WorkerJob::has_owner (const void * owner) const
+{
+	return find (_owners.begin(), _owners.end(), owner) != _owners.end();
+}
+
+bool
+WorkerJob::shares_owner (const WorkerJob & other) const
+{
+	for (vector<const void*>::const_iterator o = _owners.begin(); o != _owners.end(); ++o) {
+		if (other.has_owner (*o)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+Worker::Worker (int nthreads, size_t max_queued, bool background)
+	: _max_queued(max_queued), _next_id(1), _pushed(0), _rejected(0), _quit(false)
+{
+	pthread_mutex_init (&_lock, NULL);
+	pthread_mutex_init (&_emit_lock, NULL);
+	pthread_cond_init (&_work_cond, NULL);
+	pthread_cond_init (&_idle_cond, NULL);
+
+	pthread_attr_t attr;
+	pthread_attr_t * attrp = NULL;
+
+#ifdef SCHED_IDLE
+	if (background) {
+		struct sched_param param;
+		param.sched_priority = 0;
+
+		pthread_attr_init (&attr);
+		if (pthread_attr_setinheritsched (&attr, PTHREAD_EXPLICIT_SCHED) == 0
+		    && pthread_attr_setschedpolicy (&attr, SCHED_IDLE) == 0
+		    && pthread_attr_setschedparam (&attr, &param) == 0) {
+			attrp = &attr;
+		}
+		else {
+			pthread_attr_destroy (&attr);
+		}
+	}
+#endif
+
+	for (int n=0; n < nthreads; ++n) {
+		pthread_t tid;
+		if (attrp && pthread_create (&tid, attrp, Worker::_thread_entry, this) == 0) {
+			_threads.push_back (tid);
+		}
+		else if (pthread_create (&tid, NULL, Worker::_thread_entry, this) == 0) {
+			// no idle priority here, it runs like the others
+			_threads.push_back (tid);
+		}
+		else {
+			cerr << "sooperlooper: could not start worker thread" << endl;
+		}
+	}
+
+	if (attrp) {
+		pthread_attr_destroy (attrp);
+	}
+}
+
+Worker::~Worker ()
+{
+	stop ();
+	process_completions ();
+
+	pthread_cond_destroy (&_idle_cond);
+	pthread_cond_destroy (&_work_cond);
+	pthread_mutex_destroy (&_emit_lock);
+	pthread_mutex_destroy (&_lock);
+}
+
+void
+Worker::stop ()
+{
+	pthread_mutex_lock (&_lock);
+	_quit = true;
+
+	for (int p=0; p < PriorityCount; ++p) {
+		for (deque<WorkerJob*>::iterator j = _queues[p].begin(); j != _queues[p].end(); ++j) {
+			(*j)->_cancelled = true;
+			_done.push_back (*j);
+		}
+		_queues[p].clear();
+	}
+
+	pthread_cond_broadcast (&_work_cond);
+	pthread_mutex_unlock (&_lock);
+
+	for (size_t n=0; n < _threads.size(); ++n) {
+		pthread_join (_threads[n], NULL);
+	}
+	_threads.clear();
+}
+
+unsigned int
+Worker::push (WorkerJob * job, Priority prio)
+{
+	unsigned int id = 0;
+
+	pthread_mutex_lock (&_lock);
+
+	if (!_quit && !_threads.empty() && _queues[prio].size() < _max_queued) {
+		id = job->_id = _next_id++;
+		if (_next_id == 0) _next_id = 1;
+		job->_order = ++_pushed;
+
+		_queues[prio].push_back (job);
+		pthread_cond_signal (&_work_cond);
+	}
+	else {
+		++_rejected;
+	}
+
+	pthread_mutex_unlock (&_lock);
+
+	if (!id) {
+		delete job;
+	}
+	return id;
+}
+
+bool
+Worker::cancel (unsigned int id)
+{
+	bool found = false;
+
+	pthread_mutex_lock (&_lock);
+
+	for (int p=0; p < PriorityCount && !found; ++p) {
+		for (deque<WorkerJob*>::iterator j = _queues[p].begin(); j != _queues[p].end(); ++j) {
+			if ((*j)->_id == id) {
+				(*j)->_cancelled = true;
+				_done.push_back (*j);
+				_queues[p].erase (j);
+				found = true;
+				// a job behind it may be free to run now
+				pthread_cond_broadcast (&_work_cond);
+				break;
+			}
+		}
+	}
+
+	for (vector<WorkerJob*>::iterator j = _running.begin(); j != _running.end() && !found; ++j) {
+		if ((*j)->_id == id) {
+			(*j)->_cancelled = true;
+			found = true;
+		}
+	}
+
+	pthread_mutex_unlock (&_lock);
+
+	return found;
+}
+
+void
+Worker::cancel_owner (const void * owner, bool wait)
+{
+	pthread_mutex_lock (&_lock);
+
+	for (int p=0; p < PriorityCount; ++p) {
+		deque<WorkerJob*>::iterator j = _queues[p].begin();
+		while (j != _queues[p].end()) {
+			if ((*j)->has_owner (owner)) {
+				(*j)->_cancelled = true;
+				_done.push_back (*j);
+				j = _queues[p].erase (j);
+			}
+			else {
+				++j;
+			}
+		}
+	}
+	pthread_cond_broadcast (&_work_cond);
+
+	while (true) {
+		bool busy = false;
+		for (vector<WorkerJob*>::iterator j = _running.begin(); j != _running.end(); ++j) {
+			if ((*j)->has_owner (owner)) {
+				(*j)->_cancelled = true;
+				busy = true;
+			}
+		}
+
+		if (!busy || !wait) break;
+
+		pthread_cond_wait (&_idle_cond, &_lock);
+	}
+
+	pthread_mutex_unlock (&_lock);
+}
+
+void
+Worker::wait_owner (const void * owner)
+{
+	pthread_mutex_lock (&_lock);
+
+	while (!_threads.empty()) {
+		bool busy = false;
+
+		for (vector<WorkerJob*>::iterator j = _running.begin(); j != _running.end() && !busy; ++j) {
+			busy = (*j)->has_owner (owner);
+		}
+		for (int p=0; p < PriorityCount && !busy; ++p) {
+			for (deque<WorkerJob*>::iterator j = _queues[p].begin(); j != _queues[p].end() && !busy; ++j) {
+				busy = (*j)->has_owner (owner);
+			}
+		}
+
+		if (!busy) break;
+
+		pthread_cond_wait (&_idle_cond, &_lock);
+	}
+
+	pthread_mutex_unlock (&_lock);
+}
+
+void
+Worker::release_owner (const void * owner)
+{
+	pthread_mutex_lock (&_lock);
+
+	for (int p=0; p < PriorityCount; ++p) {
+		deque<WorkerJob*>::iterator j = _queues[p].begin();
+		while (j != _queues[p].end()) {
+			if ((*j)->_owners.size() == 1 && (*j)->has_owner (owner)) {
+				(*j)->_cancelled = true;
+				_done.push_back (*j);
+				j = _queues[p].erase (j);
+			}
+			else {
+				++j;
+			}
+		}
+	}
+	pthread_cond_broadcast (&_work_cond);
+
+	for (vector<WorkerJob*>::iterator j = _running.begin(); j != _running.end(); ++j) {
+		if ((*j)->_owners.size() == 1 && (*j)->has_owner (owner)) {
+			(*j)->_cancelled = true;
+		}
+	}
+
+	pthread_mutex_unlock (&_lock);
+}
+
+bool
+Worker::is_owner_busy (const void * owner)
+{
+	bool busy = false;
+
+	pthread_mutex_lock (&_lock);
+
+	for (vector<WorkerJob*>::iterator j = _running.begin(); j != _running.end() && !busy; ++j) {
+		busy = (*j)->has_owner (owner);
+	}
+	for (int p=0; p < PriorityCount && !busy; ++p) {
+		for (deque<WorkerJob*>::iterator j = _queues[p].begin(); j != _queues[p].end() && !busy; ++j) {
+			busy = (*j)->has_owner (owner);
+		}
+	}
+
+	pthread_mutex_unlock (&_lock);
+
+	return busy;
+}
+
+void
+Worker::process_completions ()
+{
+	vector<WorkerJob*> done;
+
+	pthread_mutex_lock (&_lock);
+	done.swap (_done);
+	pthread_mutex_unlock (&_lock);
+
+	for (vector<WorkerJob*>::iterator j = done.begin(); j != done.end(); ++j) {
+		(*j)->finish ();
+		delete *j;
+	}
+}
+
+size_t
+Worker::get_queued_count ()
+{
+	size_t count;
+
+	pthread_mutex_lock (&_lock);
+	count = _running.size();
+	for (int p=0; p < PriorityCount; ++p) {
+		count += _queues[p].size();
+	}
+	pthread_mutex_unlock (&_lock);
+
+	return count;
+}
+
+bool
+Worker::is_blocked (const WorkerJob * job) const
+{
+	if (job->_owners.empty()) {
+		return false;
+	}
+
+	for (vector<WorkerJob*>::const_iterator j = _running.begin(); j != _running.end(); ++j) {
+		if ((*j)->shares_owner (*job)) {
+			return true;
+		}
+	}
+
+	for (int p=0; p < PriorityCount; ++p) {
+		for (deque<WorkerJob*>::const_iterator j = _queues[p].begin(); j != _queues[p].end(); ++j) {
+			if ((*j)->_order < job->_order && (*j)->shares_owner (*job)) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+WorkerJob *
+Worker::next_job ()
+{
+	// highest priority first, skipping jobs that must wait their turn
+	for (int p=0; p < PriorityCount; ++p) {
+		for (deque<WorkerJob*>::iterator j = _queues[p].begin(); j != _queues[p].end(); ++j) {
+			if (!is_blocked (*j)) {
+				WorkerJob * job = *j;
+				_queues[p].erase (j);
+				return job;
+			}
+		}
+	}
+
+	return 0;
+}
+
+void *
+Worker::_thread_entry (void * arg)
+{
+	Worker * worker = static_cast<Worker*> (arg);
+	worker->thread_run ();
+	return 0;
+}
+
+void
+Worker::thread_run ()
+{
+	SL_TRACE_THREAD("worker");
+
+	pthread_mutex_lock (&_lock);
+
+	while (!_quit)
+	{
+		WorkerJob * job = next_job ();
+
+		if (!job) {
+			pthread_cond_wait (&_work_cond, &_lock);
+			continue;
+		}
+
+		_running.push_back (job);
+		pthread_mutex_unlock (&_lock);
+
+		{
+			SL_TRACE_SCOPE("worker job");
+			job->run ();
+		}
+
+		pthread_mutex_lock (&_lock);
+		_running.erase (find (_running.begin(), _running.end(), job));
+		_done.push_back (job);
+		pthread_cond_broadcast (&_idle_cond);
+		// jobs waiting on this one may be able to go now
+		pthread_cond_broadcast (&_work_cond);
+
+		// not under our lock, the handler may take locks of its own.
+		// the threads still never emit at the same time
+		pthread_mutex_unlock (&_lock);
+		pthread_mutex_lock (&_emit_lock);
+		JobFinished (); // emit
+		pthread_mutex_unlock (&_emit_lock);
+		pthread_mutex_lock (&_lock);
+	}
+
+	pthread_mutex_unlock (&_lock);
+}
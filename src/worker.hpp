@@ -0,0 +1,144 @@
+/*
+** Copyright (C) 2004 Jesse Chappell <jesse@essej.net>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+**
+*/
+
+#ifndef __sooperlooper_worker__
+#define __sooperlooper_worker__
+
+#include <deque>
+#include <vector>
+#include <pthread.h>
+
+#include <sigc++/sigc++.h>
+
+/*
+ * Persistent worker threads for slow non-rt jobs (file io, session
+ * saves) so the engine main loop only does dispatch and completions.
+ * Queues are bounded per priority, a full queue rejects the job.
+ * Jobs can be cancelled by id or by owner, run() should poll
+ * is_cancelled() if it is long.  Jobs sharing an owner run one at a
+ * time in the order they were pushed, whatever their priority, so a
+ * load queued after a save of the same loop can't overtake it.
+ * finish() always happens in the thread calling process_completions(),
+ * which is the engine main loop.
+ */
+
+namespace SooperLooper {
+
+class WorkerJob
+{
+  public:
+	WorkerJob (const void * owner=0) : _id(0), _order(0), _cancelled(false) { if (owner) _owners.push_back (owner); }
+	virtual ~WorkerJob() {}
+
+	// a job touching several objects lists each of them
+	void add_owner (const void * owner) { _owners.push_back (owner); }
+	bool has_owner (const void * owner) const;
+	bool shares_owner (const WorkerJob & other) const;
+
+	// worker thread
+	virtual void run () = 0;
+	// main thread, after run() or after the job was cancelled while queued
+	virtual void finish () {}
+
+	unsigned int get_id() const { return _id; }
+	bool is_cancelled() const { return _cancelled; }
+
+  protected:
+	friend class Worker;
+
+	std::vector<const void*> _owners;
+	unsigned int       _id;
+	unsigned long      _order;    // push order, across the priorities
+	volatile bool      _cancelled;
+};
+
+class Worker
+{
+  public:
+	enum Priority {
+		PriorityHigh = 0, // someone is waiting on it, loop loads
+		PriorityNormal,   // loop saves
+		PriorityLow,      // session saves and housekeeping
+		PriorityCount
+	};
+
+	// background threads run at idle priority where the system has it
+	Worker (int nthreads=2, size_t max_queued=64, bool background=false);
+	~Worker ();
+
+	// takes ownership of the job.  returns its id, or 0 if that queue is full
+	// (the job is deleted then)
+	unsigned int push (WorkerJob * job, Priority prio=PriorityNormal);
+
+	// a queued job is dropped (finish() still runs), a running one is flagged
+	bool cancel (unsigned int id);
+
+	// cancels everything for owner and, if wait, blocks until none of its
+	// jobs is running any more.  call before destroying what the jobs use
+	void cancel_owner (const void * owner, bool wait=true);
+
+	// blocks until every queued or running job for owner has run to the end
+	void wait_owner (const void * owner);
+
+	// cancels the jobs that are only for owner, without waiting.  jobs it
+	// shares with other owners (a session save) go on and may still use it,
+	// until is_owner_busy says they are done
+	void release_owner (const void * owner);
+	bool is_owner_busy (const void * owner);
+
+	// main thread, runs finish() for completed jobs and deletes them
+	void process_completions ();
+
+	// stops the threads, queued jobs are cancelled and running ones completed
+	void stop ();
+
+	size_t get_queued_count ();
+	unsigned long get_rejected_count () const { return _rejected; }
+
+	// emitted from a worker thread when a job is done, not holding the
+	// worker lock, one thread at a time.  handlers must be quick
+	sigc::signal0<void> JobFinished;
+
+  private:
+	static void * _thread_entry (void * arg);
+	void thread_run ();
+	// with the lock held, an earlier job with one of its owners is queued or running
+	bool is_blocked (const WorkerJob * job) const;
+	WorkerJob * next_job ();
+
+	std::deque<WorkerJob*>   _queues[PriorityCount];
+	std::vector<WorkerJob*>  _running;
+	std::vector<WorkerJob*>  _done;
+	std::vector<pthread_t>   _threads;
+
+	pthread_mutex_t  _lock;
+	pthread_mutex_t  _emit_lock;
+	pthread_cond_t   _work_cond;
+	pthread_cond_t   _idle_cond;
+
+	size_t           _max_queued;
+	unsigned int     _next_id;
+	unsigned long    _pushed;
+	unsigned long    _rejected;
+	bool             _quit;
+};
+
+};
+
+#endif